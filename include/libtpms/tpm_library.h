@@ -71,8 +71,42 @@ TPM_RESULT TPMLIB_Process(unsigned char **respbuffer, uint32_t *resp_size,
                           uint32_t *respbufsize,
                           unsigned char *command, uint32_t command_size);
 
+TPM_RESULT TPMLIB_ProcessInto(unsigned char *command, uint32_t command_size,
+                              unsigned char *respbuffer, uint32_t respbufsize,
+                              uint32_t *resp_size);
+
 TPM_RESULT TPMLIB_VolatileAll_Store(unsigned char **buffer, uint32_t *buflen);
 
+/*
+ * Handle-based API for hosting multiple TPM instances in one process.
+ * The 'tpm_number' identifies the instance to the NVRAM callbacks
+ * and must be unique among all active instances.
+ */
+typedef struct TPMLIB_Instance TPMLIB_Instance;
+
+TPM_RESULT TPMLIB_Instance_Create(TPMLIB_Instance **instance,
+                                  uint32_t tpm_number);
+
+void TPMLIB_Instance_Terminate(TPMLIB_Instance *instance);
+
+TPM_RESULT TPMLIB_Instance_Process(TPMLIB_Instance *instance,
+                                   unsigned char **respbuffer,
+                                   uint32_t *resp_size,
+                                   uint32_t *respbufsize,
+                                   unsigned char *command,
+                                   uint32_t command_size);
+
+TPM_RESULT TPMLIB_Instance_ProcessInto(TPMLIB_Instance *instance,
+                                       unsigned char *command,
+                                       uint32_t command_size,
+                                       unsigned char *respbuffer,
+                                       uint32_t respbufsize,
+                                       uint32_t *resp_size);
+
+TPM_RESULT TPMLIB_Instance_VolatileAll_Store(TPMLIB_Instance *instance,
+                                             unsigned char **buffer,
+                                             uint32_t *buflen);
+
 enum TPMLIB_TPMProperty {
     TPMPROP_TPM_RSA_KEY_LENGTH_MAX = 1,
     TPMPROP_TPM_BUFFER_MAX,
@@ -89,9 +123,19 @@ enum TPMLIB_TPMProperty {
     TPMPROP_TPM_MAX_NV_SPACE,
     TPMPROP_TPM_MAX_SAVESTATE_SPACE,
     TPMPROP_TPM_MAX_VOLATILESTATE_SPACE,
+    TPMPROP_TPM_KEY_SWAP,
+    TPMPROP_TPM_KEY_CACHE,
+    TPMPROP_TPM_KEY_POOL,
 };
 
 TPM_RESULT TPMLIB_GetTPMProperty(enum TPMLIB_TPMProperty prop, int *result);
+TPM_RESULT TPMLIB_SetTPMProperty(enum TPMLIB_TPMProperty prop, int value);
+TPM_RESULT TPMLIB_Instance_GetTPMProperty(TPMLIB_Instance *instance,
+                                          enum TPMLIB_TPMProperty prop,
+                                          int *result);
+TPM_RESULT TPMLIB_Instance_SetTPMProperty(TPMLIB_Instance *instance,
+                                          enum TPMLIB_TPMProperty prop,
+                                          int value);
 
 struct libtpms_callbacks {
     int sizeOfStruct;
@@ -112,6 +156,10 @@ struct libtpms_callbacks {
 				     uint32_t tpm_number);
     TPM_RESULT (*tpm_io_getphysicalpresence)(TPM_BOOL *physicalPresence,
 					     uint32_t tpm_number);
+    TPM_RESULT (*tpm_nvram_appenddata)(const unsigned char *data,
+                                       uint32_t length,
+                                       uint32_t tpm_number,
+                                       const char *name);
 };
 
 TPM_RESULT TPMLIB_RegisterCallbacks(struct libtpms_callbacks *);
@@ -128,6 +176,104 @@ enum TPMLIB_BlobType {
 TPM_RESULT TPMLIB_DecodeBlob(const char *data, enum TPMLIB_BlobType type,
                              unsigned char **result, size_t *result_len);
 
+/*
+ * Tracing. A trace message is reported if its level is at most the
+ * level set with TPMLIB_SetTrace() and its category is in the category
+ * mask.
+ */
+#define TPMLIB_TRACE_LEVEL_NONE     0
+#define TPMLIB_TRACE_LEVEL_ERROR    1
+#define TPMLIB_TRACE_LEVEL_INFO     2
+#define TPMLIB_TRACE_LEVEL_DEBUG    3
+
+#define TPMLIB_TRACE_CAT_GENERAL    (1 << 0)
+#define TPMLIB_TRACE_CAT_PROCESS    (1 << 1)
+#define TPMLIB_TRACE_CAT_CRYPTO     (1 << 2)
+#define TPMLIB_TRACE_CAT_KEY        (1 << 3)
+#define TPMLIB_TRACE_CAT_SESSION    (1 << 4)
+#define TPMLIB_TRACE_CAT_NVRAM      (1 << 5)
+#define TPMLIB_TRACE_CAT_ALL        0xffffffff
+
+typedef void (*TPMLIB_TraceFunction)(unsigned int level,
+                                     uint32_t category,
+                                     const char *message);
+
+TPM_RESULT TPMLIB_SetTrace(unsigned int level, uint32_t categories,
+                           TPMLIB_TraceFunction func);
+
+/* a record in the trace buffer, followed by 'length' bytes of message */
+struct tpmlib_trace_record {
+    uint16_t length;
+    uint8_t level;
+    uint8_t reserved;
+    uint32_t category;
+};
+
+TPM_RESULT TPMLIB_SetTraceBuffer(uint32_t size);
+
+TPM_RESULT TPMLIB_GetTraceBuffer(unsigned char *buffer, uint32_t size,
+                                 uint32_t *length);
+
+/*
+ * Statistics. Latencies are in microseconds. Bucket i of the histogram
+ * counts the latencies in the range [2^i, 2^(i+1)), except that bucket 0
+ * also counts latencies below 1 and the last bucket counts all larger
+ * latencies.
+ */
+#define TPMLIB_STATISTICS_BUCKETS   24
+
+struct tpmlib_ordinal_statistics {
+    uint32_t ordinal;
+    uint32_t reserved;
+    uint64_t count;           /* number of times the ordinal was processed */
+    uint64_t errors;          /* number of non-success responses */
+    uint64_t total_usec;
+    uint64_t max_usec;
+    uint64_t histogram[TPMLIB_STATISTICS_BUCKETS];
+};
+
+/*
+ * Object pools. While it processes commands, a TPM allocates keys and
+ * other fixed size structures from per-type pools. The counts of the
+ * pools are collected whether statistics are enabled or not.
+ */
+#define TPMLIB_POOL_KEY             0
+#define TPMLIB_POOL_STORE_ASYMKEY   1
+#define TPMLIB_POOL_PCR_INFO        2
+#define TPMLIB_POOL_PCR_INFO_LONG   3
+#define TPMLIB_POOL_PCR_INFO_SHORT  4
+#define TPMLIB_POOL_SYMMETRIC_KEY   5
+#define TPMLIB_POOL_RSA_KEY_PARMS   6
+#define TPMLIB_POOLS                7
+
+struct tpmlib_pool_statistics {
+    uint32_t object_size;     /* bytes per object, 0 until first used */
+    uint32_t slabs;           /* number of allocated slabs */
+    uint32_t in_use;          /* objects allocated from the pool */
+    uint32_t available;       /* free objects in the slabs */
+    uint64_t allocs;          /* number of allocations from the pool */
+    uint64_t frees;           /* number of objects returned to the pool */
+};
+
+struct tpmlib_statistics {
+    uint64_t nvstore_count;   /* writes of the permanent state */
+    uint64_t nvstore_usec;
+    uint64_t rsa_count;       /* RSA private key operations and key generations */
+    uint64_t rsa_usec;
+    uint32_t num_ordinals;    /* number of entries in 'ordinals' */
+    struct tpmlib_ordinal_statistics *ordinals;
+    struct tpmlib_pool_statistics pools[TPMLIB_POOLS];
+};
+
+TPM_RESULT TPMLIB_SetStatistics(TPM_BOOL enable);
+
+TPM_RESULT TPMLIB_GetStatistics(struct tpmlib_statistics **stats,
+                                TPM_BOOL reset);
+
+TPM_RESULT TPMLIB_Instance_GetStatistics(TPMLIB_Instance *instance,
+                                         struct tpmlib_statistics **stats,
+                                         TPM_BOOL reset);
+
 #ifdef __cplusplus
 }
 #endif
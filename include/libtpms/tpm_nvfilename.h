@@ -52,5 +52,7 @@
 
 #define TPM_VOLATILESTATE_NAME      "volatilestate"
 
+#define TPM_NV_LOG_NAME		"nvlog"
+
 
 #endif
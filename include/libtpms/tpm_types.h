@@ -137,6 +137,7 @@ typedef uint32_t  TPM_FAMILY_OPERATION;	/* What operation is happening  */
 typedef uint16_t  TPM_TAG;		/* The command and response tags */
 
 typedef unsigned char *	TPM_SYMMETRIC_KEY_TOKEN;	/* abstract symmetric key token */
+typedef unsigned char *	TPM_RSA_KEY_TOKEN;		/* abstract RSA private key token */
 typedef unsigned char *	TPM_BIGNUM;			/* abstract bignum */
 
 #ifdef __cplusplus
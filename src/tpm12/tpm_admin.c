@@ -63,6 +63,7 @@
        on failure, sets tpm_state->testState to failure for the virtual TPM
 
    TPM_SelfTestFullCmd(tpm_state) calls
+       TPM_CryptoTestKeyGen(void)
        TPM_LimitedSelfTestTPM()
        TPM_ContinueSelfTestCmd(tpm_state)
        on failure, sets tpm_state->testState to failure for the virtual TPM
@@ -255,6 +256,14 @@ TPM_RESULT TPM_SelfTestFullCmd(tpm_state_t *tpm_state)
     TPM_RESULT	rc = 0;
 
     printf(" TPM_SelfTestFullCmd\n");
+    /* RSA key generation is too slow for the startup self test, run it here */
+    if (rc == 0) {
+	rc = TPM_CryptoTestKeyGen();
+	if (rc != 0) {
+	    printf("  TPM_SelfTestFullCmd: Set testState to %u \n", TPM_TEST_STATE_FAILURE);
+	    tpm_state->testState = TPM_TEST_STATE_FAILURE;
+	}
+    }
     if (rc == 0) {
 	rc = TPM_LimitedSelfTestTPM(tpm_state);
     }
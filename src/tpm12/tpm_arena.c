@@ -0,0 +1,258 @@
+/********************************************************************************/
+/*										*/
+/*				Per Command Arena				*/
+/*		       IBM Thomas J. Watson Research Center			*/
+/*										*/
+/* (c) Copyright IBM Corporation 2015.						*/
+/*										*/
+/* All rights reserved.								*/
+/* 										*/
+/* Redistribution and use in source and binary forms, with or without		*/
+/* modification, are permitted provided that the following conditions are	*/
+/* met:										*/
+/* 										*/
+/* Redistributions of source code must retain the above copyright notice,	*/
+/* this list of conditions and the following disclaimer.			*/
+/* 										*/
+/* Redistributions in binary form must reproduce the above copyright		*/
+/* notice, this list of conditions and the following disclaimer in the		*/
+/* documentation and/or other materials provided with the distribution.		*/
+/* 										*/
+/* Neither the names of the IBM Corporation nor the names of its		*/
+/* contributors may be used to endorse or promote products derived from		*/
+/* this software without specific prior written permission.			*/
+/* 										*/
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS		*/
+/* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT		*/
+/* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR	*/
+/* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT		*/
+/* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,	*/
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT		*/
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,	*/
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY	*/
+/* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT		*/
+/* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE	*/
+/* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
+/********************************************************************************/
+
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_PROCESS
+#include "tpm_constants.h"
+#include "tpm_debug.h"
+#include "tpm_error.h"
+#include "tpm_memory.h"
+
+#include "tpm_arena.h"
+
+/* Buffers that do not outlive a command, such as parsed input parameters and intermediate crypto
+   results, are allocated from the arena of the TPM instance processing the command rather than
+   from the heap.
+
+   The arena is a single buffer per instance.  Allocations are carved sequentially from it and
+   released all at once by TPM_Arena_End() when the command completes.  Since these buffers can
+   hold secrets, the used part of the arena is zeroized at that point.
+
+   While a command is processed, the instance's arena is the thread specific 'current' arena, so
+   that code deep in the call tree can allocate from it without access to the TPM instance.  Without
+   a current arena, or when it is full, TPM_Arena_Malloc() falls back to TPM_Malloc().  Therefore,
+   an arena buffer must always be released with TPM_Arena_Free(), never with free().
+
+   Each allocation is preceded by a header holding its size, so that TPM_Arena_Realloc() can move
+   it to the heap and TPM_Arena_Free() can release the most recent allocation immediately.
+*/
+
+#define TPM_ARENA_ALIGN		16			/* alignment of each allocation */
+#define TPM_ARENA_HEADER	TPM_ARENA_ALIGN		/* size header before each allocation */
+
+static pthread_key_t	tpm_arena_current;
+static pthread_once_t	tpm_arena_once = PTHREAD_ONCE_INIT;
+
+static void TPM_Arena_KeyCreate(void)
+{
+    pthread_key_create(&tpm_arena_current, NULL);
+    return;
+}
+
+/* TPM_Arena_Current() returns the arena of the command being processed by this thread, or NULL */
+
+static TPM_ARENA *TPM_Arena_Current(void)
+{
+    pthread_once(&tpm_arena_once, TPM_Arena_KeyCreate);
+    return pthread_getspecific(tpm_arena_current);
+}
+
+/* TPM_Arena_BlockSize() returns the arena bytes used by an allocation of 'size' bytes */
+
+static uint32_t TPM_Arena_BlockSize(uint32_t size)
+{
+    return TPM_ARENA_HEADER + ((size + TPM_ARENA_ALIGN - 1) & ~(TPM_ARENA_ALIGN - 1));
+}
+
+/* TPM_Arena_Init() sets members to default values.  The arena buffer is allocated on first use. */
+
+void TPM_Arena_Init(TPM_ARENA *tpm_arena)
+{
+    tpm_arena->buffer = NULL;
+    tpm_arena->size = 0;
+    tpm_arena->used = 0;
+    return;
+}
+
+/* TPM_Arena_Delete() zeroizes and frees the arena buffer */
+
+void TPM_Arena_Delete(TPM_ARENA *tpm_arena)
+{
+    if (tpm_arena != NULL) {
+	if (tpm_arena->buffer != NULL) {
+	    memset(tpm_arena->buffer, 0, tpm_arena->size);
+	}
+	free(tpm_arena->buffer);
+	TPM_Arena_Init(tpm_arena);
+    }
+    return;
+}
+
+/* TPM_Arena_Begin() makes 'tpm_arena' the current arena for a command processed by this thread.
+
+   The arena is best effort, an allocation failure must not fail the command.
+*/
+
+void TPM_Arena_Begin(TPM_ARENA *tpm_arena)
+{
+    TPM_RESULT	rc = 0;
+
+    if (tpm_arena->buffer == NULL) {
+	rc = TPM_Malloc(&(tpm_arena->buffer), TPM_ARENA_SIZE);
+	if (rc == 0) {
+	    tpm_arena->size = TPM_ARENA_SIZE;
+	    tpm_arena->used = 0;
+	}
+    }
+    if (rc == 0) {
+	pthread_once(&tpm_arena_once, TPM_Arena_KeyCreate);
+	pthread_setspecific(tpm_arena_current, tpm_arena);
+    }
+    return;
+}
+
+/* TPM_Arena_End() releases all allocations of the command and zeroizes them.
+
+   Must be called once the command no longer uses any arena buffer.
+*/
+
+void TPM_Arena_End(TPM_ARENA *tpm_arena)
+{
+    if (tpm_arena->buffer != NULL) {
+	TPM_TRACE_DEBUG(" TPM_Arena_End: Releasing %u of %u bytes\n",
+			tpm_arena->used, tpm_arena->size);
+	memset(tpm_arena->buffer, 0, tpm_arena->used);
+	tpm_arena->used = 0;
+    }
+    /* also if TPM_Init deleted the arena during the command */
+    pthread_setspecific(tpm_arena_current, NULL);
+    return;
+}
+
+/* TPM_Arena_Malloc() is an alternative to TPM_Malloc() for a buffer that does not outlive the
+   command being processed.
+
+   The buffer is allocated from the current arena if there is one and it has space, otherwise from
+   the heap.  Either way, it must be released with TPM_Arena_Free().
+*/
+
+TPM_RESULT TPM_Arena_Malloc(unsigned char **buffer, uint32_t size)
+{
+    TPM_RESULT		rc = 0;
+    TPM_ARENA		*tpm_arena;
+    uint32_t		blockSize;
+    TPM_BOOL		done = FALSE;
+
+    tpm_arena = TPM_Arena_Current();
+    /* parameter errors are left to TPM_Malloc() */
+    if ((tpm_arena != NULL) && (*buffer == NULL) && (size > 0) && (size <= TPM_ALLOC_MAX)) {
+	blockSize = TPM_Arena_BlockSize(size);
+	if (blockSize <= (tpm_arena->size - tpm_arena->used)) {
+	    memcpy(tpm_arena->buffer + tpm_arena->used, &size, sizeof(uint32_t));
+	    *buffer = tpm_arena->buffer + tpm_arena->used + TPM_ARENA_HEADER;
+	    tpm_arena->used += blockSize;
+	    done = TRUE;
+	}
+    }
+    if (!done) {
+	rc = TPM_Malloc(buffer, size);
+    }
+    return rc;
+}
+
+/* TPM_Arena_Contains() returns TRUE if 'buffer' was allocated from the current arena */
+
+TPM_BOOL TPM_Arena_Contains(const unsigned char *buffer)
+{
+    TPM_ARENA		*tpm_arena;
+
+    if (buffer == NULL) {
+	return FALSE;
+    }
+    tpm_arena = TPM_Arena_Current();
+    return ((tpm_arena != NULL) &&
+	    (buffer >= tpm_arena->buffer) &&
+	    (buffer < (tpm_arena->buffer + tpm_arena->used)));
+}
+
+/* TPM_Arena_Realloc() is called by TPM_Realloc() for a buffer allocated from the current arena.
+
+   Since arena allocations cannot grow in place, the buffer is moved to the heap.  It is then no
+   longer transient, but must still be released with TPM_Arena_Free().
+*/
+
+TPM_RESULT TPM_Arena_Realloc(unsigned char **buffer, uint32_t size)
+{
+    TPM_RESULT		rc = 0;
+    unsigned char	*tmpptr = NULL;
+    uint32_t		oldSize;
+
+    if (rc == 0) {
+	rc = TPM_Malloc(&tmpptr, size);
+    }
+    if (rc == 0) {
+	memcpy(&oldSize, *buffer - TPM_ARENA_HEADER, sizeof(uint32_t));
+	memcpy(tmpptr, *buffer, (oldSize < size) ? oldSize : size);
+	TPM_Arena_Free(*buffer);
+	*buffer = tmpptr;
+    }
+    return rc;
+}
+
+/* TPM_Arena_Free() is the companion to TPM_Arena_Malloc().
+
+   A heap buffer is freed.  An arena buffer is released when the command completes, except that
+   the most recent allocation is released immediately, so that nested allocate and free pairs reuse
+   the arena.
+*/
+
+void TPM_Arena_Free(unsigned char *buffer)
+{
+    TPM_ARENA		*tpm_arena;
+    uint32_t		size;
+    uint32_t		blockSize;
+
+    if (!TPM_Arena_Contains(buffer)) {
+	free(buffer);
+    }
+    else {
+	tpm_arena = TPM_Arena_Current();
+	memcpy(&size, buffer - TPM_ARENA_HEADER, sizeof(uint32_t));
+	blockSize = TPM_Arena_BlockSize(size);
+	if ((buffer - TPM_ARENA_HEADER + blockSize) == (tpm_arena->buffer + tpm_arena->used)) {
+	    memset(buffer - TPM_ARENA_HEADER, 0, blockSize);
+	    tpm_arena->used -= blockSize;
+	}
+    }
+    return;
+}
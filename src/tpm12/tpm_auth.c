@@ -41,8 +41,10 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "tpm_arena.h"
 #include "tpm_crypto.h"
 #include "tpm_cryptoh.h"
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_SESSION
 #include "tpm_debug.h"
 #include "tpm_digest.h"
 #include "tpm_error.h"
@@ -53,6 +55,7 @@
 #include "tpm_permanent.h"
 #include "tpm_process.h"
 #include "tpm_secret.h"
+#include "tpm_slab.h"
 #include "tpm_storage.h"
 #include "tpm_time.h"
 #include "tpm_transport.h"
@@ -213,10 +216,13 @@ TPM_RESULT TPM_AuthParams_Set(TPM_STORE_BUFFER *response,
     if (rc == 0) {
 	rc = TPM_Sbuffer_Append(response, &continueAuthSession, sizeof(TPM_BOOL));
     }
-    /* Calculate resAuth using the hmac key */
+    /* Calculate resAuth using the hmac key.  A session terminated by the command does not cache
+       the pad states. */
     if (rc == 0) {
 	rc = TPM_Authdata_Generate(resAuth,			/* result */
 				   hmacKey,			/* HMAC key */
+				   auth_session_data->valid ?
+				   &(auth_session_data->hmacState) : NULL,
 				   outParamDigest,		/* params */
 				   auth_session_data->nonceEven,
 				   nonceOdd,
@@ -231,6 +237,7 @@ TPM_RESULT TPM_AuthParams_Set(TPM_STORE_BUFFER *response,
 
 TPM_RESULT TPM_Authdata_Generate(TPM_AUTHDATA resAuth,		/* result */
 				 TPM_SECRET usageAuth,		/* HMAC key */
+				 TPM_HMAC_STATE *hmacState,	/* cached pad states, or NULL */
 				 TPM_DIGEST outParamDigest, /* digest of outputs above double
 							       line */
 				 TPM_NONCE nonceEven,
@@ -246,13 +253,14 @@ TPM_RESULT TPM_Authdata_Generate(TPM_AUTHDATA resAuth,		/* result */
 	TPM_PrintFour("  TPM_Authdata_Generate: nonceEven", nonceEven);
 	TPM_PrintFour("  TPM_Authdata_Generate: nonceOdd", nonceOdd);
 	printf       ("  TPM_Authdata_Generate: continueSession %02x\n", continueSession);
-	rc = TPM_HMAC_Generate(resAuth,
-			       usageAuth,				/* key */
-			       TPM_DIGEST_SIZE, outParamDigest,		/* response digest */
-			       TPM_NONCE_SIZE, nonceEven,		/* 2H */
-			       TPM_NONCE_SIZE, nonceOdd,		/* 3H */
-			       sizeof(TPM_BOOL), &continueSession,	/* 4H */
-			       0, NULL);
+	rc = TPM_HMAC_GenerateState(resAuth,
+				    usageAuth,				/* key */
+				    hmacState,
+				    TPM_DIGEST_SIZE, outParamDigest,	/* response digest */
+				    TPM_NONCE_SIZE, nonceEven,		/* 2H */
+				    TPM_NONCE_SIZE, nonceOdd,		/* 3H */
+				    sizeof(TPM_BOOL), &continueSession,	/* 4H */
+				    0, NULL);
 	TPM_PrintFour("  TPM_Authdata_Generate: resAuth", resAuth);
     }
     return rc;
@@ -286,14 +294,15 @@ TPM_RESULT TPM_Authdata_Check(tpm_state_t	*tpm_state,
 	printf       ("  TPM_Authdata_Check: continueSession %02x\n", continueSession);
 	/* HMAC the inParamDigest, authLastNonceEven, nonceOdd, continue */
 	/* authLastNonceEven is retrieved from internal authorization session storage */
-	rc = TPM_HMAC_Check(&valid,
-			    usageAuth,					/* expected, from command */
-			    hmacKey,					/* key */
-			    sizeof(TPM_DIGEST), inParamDigest,		/* command digest */
-			    sizeof(TPM_NONCE), tpm_auth_session_data->nonceEven,	/* 2H */
-			    sizeof(TPM_NONCE), nonceOdd,				/* 3H */
-			    sizeof(TPM_BOOL), &continueSession,				/* 4H */
-			    0, NULL);
+	rc = TPM_HMAC_CheckState(&valid,
+				 usageAuth,				/* expected, from command */
+				 hmacKey,				/* key */
+				 &(tpm_auth_session_data->hmacState),
+				 sizeof(TPM_DIGEST), inParamDigest,	/* command digest */
+				 sizeof(TPM_NONCE), tpm_auth_session_data->nonceEven,	/* 2H */
+				 sizeof(TPM_NONCE), nonceOdd,				/* 3H */
+				 sizeof(TPM_BOOL), &continueSession,			/* 4H */
+				 0, NULL);
     }
     if (rc == 0) {
 	if (!valid) {
@@ -1231,7 +1240,7 @@ TPM_RESULT TPM_Process_ChangeAuth(tpm_state_t *tpm_state,
     */
     TPM_SizedBuffer_Delete(&encData);		/* @1 */
     TPM_SizedBuffer_Delete(&outData);		/* @2 */
-    free(b1DecryptData);			/* @3 */
+    TPM_Arena_Free(b1DecryptData);			/* @3 */
     TPM_StoreAsymkey_Delete(&keyEntity);	/* @4 */
     TPM_SealedData_Delete(&sealEntity);		/* @5 */
     return rcf;
@@ -1711,7 +1720,7 @@ TPM_RESULT TPM_Process_ChangeAuthAsymStart(tpm_state_t *tpm_state,
     /* Allocate space for k1.  The key cannot be a local variable, since it persists in key storage
        after the command completes. */
     if (returnCode == TPM_SUCCESS) {
-	returnCode = TPM_Malloc((unsigned char **)&tempKey, sizeof(TPM_KEY));
+	returnCode = TPM_Slab_Malloc((unsigned char **)&tempKey, TPM_SLAB_KEY, sizeof(TPM_KEY));
     }
     /* 
        Field Descriptions for certifyInfo parameter
@@ -1750,7 +1759,7 @@ TPM_RESULT TPM_Process_ChangeAuthAsymStart(tpm_state_t *tpm_state,
     if (returnCode == TPM_SUCCESS) {
 	ephHandle = 0;	/* no preferred value */
 	returnCode = TPM_KeyHandleEntries_AddKeyEntry(&ephHandle,			/* output */
-						      tpm_state->tpm_key_handle_entries, /* input */
+						      &(tpm_state->tpm_key_handle_entries), /* input */
 						      tempKey,				/* input */
 						      0,	/* parentPCRStatus not used */
 						      0);	/* keyControl not used */
@@ -1866,11 +1875,11 @@ TPM_RESULT TPM_Process_ChangeAuthAsymStart(tpm_state_t *tpm_state,
     if ((rcf != 0) ||
 	(returnCode != TPM_SUCCESS)) {
 	TPM_Key_Delete(tempKey);		/* @4 */
-	free(tempKey);				/* @4 */
+	TPM_Slab_Free(tempKey);			/* @4 */
 	if (key_added) {
 	    /* if there was a failure and tempKey was stored in the handle list, free the handle.
 	       Ignore errors, since only one error code can be returned. */
-	    TPM_KeyHandleEntries_DeleteHandle(tpm_state->tpm_key_handle_entries, ephHandle);
+	    TPM_KeyHandleEntries_DeleteHandle(&(tpm_state->tpm_key_handle_entries), ephHandle);
 	}	
     }
     return rcf;
@@ -2213,9 +2222,9 @@ TPM_RESULT TPM_Process_ChangeAuthAsymFinish(tpm_state_t *tpm_state,
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_ChangeAuthAsymFinish: Deleting ephemeral key\n");
 	TPM_Key_Delete(ephKey);		/* free the key resources */
-	free(ephKey);			/* free the key itself */
+	TPM_Slab_Free(ephKey);		/* free the key itself */
 	/* remove entry from the key handle entries list */
-	returnCode = TPM_KeyHandleEntries_DeleteHandle(tpm_state->tpm_key_handle_entries,
+	returnCode = TPM_KeyHandleEntries_DeleteHandle(&(tpm_state->tpm_key_handle_entries),
 						       ephHandle);
     }
     /*
@@ -2290,8 +2299,8 @@ TPM_RESULT TPM_Process_ChangeAuthAsymFinish(tpm_state_t *tpm_state,
     TPM_SizedBuffer_Delete(&encData);			/* @2 */
     TPM_SizedBuffer_Delete(&outData);			/* @3 */
     TPM_StoreAsymkey_Delete(&keyEntity);		/* @4 */
-    free(e1DecryptData);				/* @5 */
-    free(a1Auth);					/* @6 */
+    TPM_Arena_Free(e1DecryptData);				/* @5 */
+    TPM_Arena_Free(a1Auth);					/* @6 */
     TPM_ChangeauthValidate_Delete(&changeauthValidate); /* @7 */
     return rcf;
 }
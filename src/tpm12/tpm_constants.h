@@ -155,6 +155,22 @@
 
 #define TPM_STORE_BUFFER_INCREMENT (TPM_ALLOC_MAX / 64)
 
+/* This is the size of the per command arena of a TPM instance, see TPM_Arena_Malloc().
+   Allocations that do not fit fall back to the heap, so it need only hold the transient buffers of
+   common commands. */
+
+#ifndef TPM_ARENA_SIZE
+#define TPM_ARENA_SIZE (TPM_ALLOC_MAX / 4)	/* 16k bytes */
+#endif
+
+/* This is the number of objects that a slab of a TPM instance's object pool holds, see
+   TPM_Slab_Malloc().  A pool grows by one slab whenever all of its objects of a type are in
+   use. */
+
+#ifndef TPM_SLAB_OBJECTS
+#define TPM_SLAB_OBJECTS 16
+#endif
+
 /* This is the maximum value of the TPM input and output packet buffer.  It should be large enough
    to accommodate the largest TPM command or response, currently about 1200 bytes.  It should be
    small enough to accommodate whatever software is driving the TPM.
@@ -288,6 +304,10 @@
 
 #define TPM_TAG_NVSTATE_V1		0x0001		/* svn revision 4078 */
 
+/* Each record of the NV index data log that follows the V1 state starts with this tag */
+
+#define TPM_TAG_NVLOG_V1		0x0002
+
 /* These tags describe the TPM_PERMANENT_DATA format */
 
 /* For the first release, use the standard TPM_TAG_PERMANENT_DATA tag.  Since this tag is never
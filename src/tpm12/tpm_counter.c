@@ -103,6 +103,13 @@ TPM_RESULT TPM_Counters_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_Counters_SizeOf() returns the number of bytes TPM_Counters_Store() serializes */
+
+uint32_t TPM_Counters_SizeOf(void)
+{
+    return TPM_MIN_COUNTERS * TPM_CounterValue_SizeOf();
+}
+
 /* TPM_Counters_StoreHandles() stores a count of the created counters and a list of created counter
    handles.
 */
@@ -393,6 +400,17 @@ TPM_RESULT TPM_CounterValue_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_CounterValue_SizeOf() returns the number of bytes TPM_CounterValue_Store() serializes */
+
+uint32_t TPM_CounterValue_SizeOf(void)
+{
+    return sizeof(uint16_t) +			/* tag */
+	TPM_COUNTER_LABEL_SIZE +
+	sizeof(TPM_ACTUAL_COUNT) +
+	TPM_SECRET_SIZE +
+	sizeof(TPM_BOOL);
+}
+
 /* TPM_CounterValue_StorePublic()
    
    serialize the structure to a stream contained in 'sbuffer'
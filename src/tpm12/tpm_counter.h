@@ -54,6 +54,7 @@ TPM_RESULT TPM_Counters_Load(TPM_COUNTER_VALUE *monotonicCountersa,
                              uint32_t *stream_size);
 TPM_RESULT TPM_Counters_Store(TPM_STORE_BUFFER *sbuffer,
                               TPM_COUNTER_VALUE *monotonicCounters);
+uint32_t   TPM_Counters_SizeOf(void);
 
 TPM_RESULT TPM_Counters_StoreHandles(TPM_STORE_BUFFER *sbuffer,
                                      TPM_COUNTER_VALUE *monotonicCounters);
@@ -84,6 +85,7 @@ TPM_RESULT TPM_CounterValue_Load(TPM_COUNTER_VALUE *tpm_counter_value,
                                  uint32_t *stream_size);
 TPM_RESULT TPM_CounterValue_Store(TPM_STORE_BUFFER *sbuffer,
                                   const TPM_COUNTER_VALUE *tpm_counter_value);
+uint32_t   TPM_CounterValue_SizeOf(void);
 
 TPM_RESULT TPM_CounterValue_StorePublic(TPM_STORE_BUFFER *sbuffer,
                                         const TPM_COUNTER_VALUE *tpm_counter_value);
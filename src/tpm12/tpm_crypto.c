@@ -49,7 +49,12 @@
 #include <openssl/sha.h>
 #include <openssl/engine.h>
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#include <pthread.h>
+#endif
+
 #include "tpm_cryptoh.h"
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_CRYPTO
 #include "tpm_debug.h"
 #include "tpm_error.h"
 #include "tpm_key.h"
@@ -57,6 +62,7 @@
 #include "tpm_load.h"
 #include "tpm_memory.h"
 #include "tpm_process.h"
+#include "tpm_slab.h"
 #include "tpm_types.h"
 
 #include "tpm_crypto.h"
@@ -69,6 +75,9 @@ static const unsigned char tpm_oaep_pad_str[] = { 'T', 'C', 'P', 'A' };
 /* local prototypes */
 
 static void       TPM_OpenSSL_PrintError(void);
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+static TPM_RESULT TPM_OpenSSL_InitLocking(void);
+#endif
 
 static TPM_RESULT TPM_RSAGeneratePublicToken(RSA **rsa_pub_key,
 					     unsigned char *narr,
@@ -81,7 +90,17 @@ static TPM_RESULT TPM_RSAGeneratePrivateToken(RSA **rsa_pri_key,
 					      unsigned char *earr,
 					      uint32_t ebytes,
 					      unsigned char *darr,
-					      uint32_t dbytes);
+					      uint32_t dbytes,
+					      unsigned char *parr,
+					      uint32_t pbytes,
+					      unsigned char *qarr,
+					      uint32_t qbytes,
+					      unsigned char *dparr,
+					      uint32_t dpbytes,
+					      unsigned char *dqarr,
+					      uint32_t dqbytes,
+					      unsigned char *qinvarr,
+					      uint32_t qinvbytes);
 static TPM_RESULT TPM_RSASignSHA1(unsigned char *signature,
                                   unsigned int *signature_length,
                                   const unsigned char *message,
@@ -182,6 +201,12 @@ TPM_RESULT TPM_Crypto_Init()
     TPM_RESULT rc = 0;
 
     printf("TPM_Crypto_Init: OpenSSL library %08lx\n", (unsigned long)OPENSSL_VERSION_NUMBER);
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    /* TPM instances may process commands concurrently */
+    if (rc == 0) {
+	rc = TPM_OpenSSL_InitLocking();
+    }
+#endif
     OpenSSL_add_all_algorithms();
     /* sanity check that the SHA1 context handling remains portable */
     if (rc == 0) {
@@ -195,6 +220,59 @@ TPM_RESULT TPM_Crypto_Init()
     return rc;
 }
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+
+/* OpenSSL before 1.1.0 is only thread safe if the application provides locking callbacks.  If the
+   application using libtpms has not installed them, install a set based on POSIX mutexes.
+
+   The mutexes are never freed since OpenSSL may use them until the process exits.
+*/
+
+static pthread_mutex_t *tpm_openssl_locks = NULL;
+
+static void TPM_OpenSSL_LockingCallback(int mode, int n, const char *file, int line)
+{
+    file = file;	/* not used */
+    line = line;	/* not used */
+    if (mode & CRYPTO_LOCK) {
+	pthread_mutex_lock(&(tpm_openssl_locks[n]));
+    }
+    else {
+	pthread_mutex_unlock(&(tpm_openssl_locks[n]));
+    }
+    return;
+}
+
+static unsigned long TPM_OpenSSL_ThreadId(void)
+{
+    return (unsigned long)pthread_self();
+}
+
+static TPM_RESULT TPM_OpenSSL_InitLocking(void)
+{
+    TPM_RESULT	rc = 0;
+    int		i;
+
+    /* nothing to do if the application or a previous call installed the callbacks */
+    if ((tpm_openssl_locks == NULL) && (CRYPTO_get_locking_callback() == NULL)) {
+	printf(" TPM_OpenSSL_InitLocking: Installing %d locks\n", CRYPTO_num_locks());
+	if (rc == 0) {
+	    rc = TPM_Malloc((unsigned char **)&tpm_openssl_locks,
+			    CRYPTO_num_locks() * sizeof(pthread_mutex_t));
+	}
+	if (rc == 0) {
+	    for (i = 0 ; i < CRYPTO_num_locks() ; i++) {
+		pthread_mutex_init(&(tpm_openssl_locks[i]), NULL);
+	    }
+	    CRYPTO_set_id_callback(TPM_OpenSSL_ThreadId);
+	    CRYPTO_set_locking_callback(TPM_OpenSSL_LockingCallback);
+	}
+    }
+    return rc;
+}
+
+#endif	/* OPENSSL_VERSION_NUMBER < 0x10100000L */
+
 /* TPM_Crypto_TestSpecific() performs any library specific tests
 
    For OpenSSL
@@ -446,7 +524,11 @@ static TPM_RESULT TPM_RSAGeneratePublicToken(RSA **rsa_pub_key,		/* freed by cal
 }
 
 /* TPM_RSAGeneratePrivateToken() generates an RSA key token from n,e,d
- */
+
+   If the prime factors p,q and the CRT parameters dP,dQ,qInv are all supplied, they are added to
+   the token so that the private key operations use the Chinese Remainder Theorem.  Otherwise they
+   may be NULL and the private key operations use d directly.
+*/
 
 static TPM_RESULT TPM_RSAGeneratePrivateToken(RSA **rsa_pri_key,	/* freed by caller */
 					      unsigned char *narr,      /* public modulus */
@@ -454,12 +536,28 @@ static TPM_RESULT TPM_RSAGeneratePrivateToken(RSA **rsa_pri_key,	/* freed by cal
 					      unsigned char *earr,      /* public exponent */
 					      uint32_t ebytes,
 					      unsigned char *darr,	/* private exponent */
-					      uint32_t dbytes)
+					      uint32_t dbytes,
+					      unsigned char *parr,	/* prime factor */
+					      uint32_t pbytes,
+					      unsigned char *qarr,	/* prime factor */
+					      uint32_t qbytes,
+					      unsigned char *dparr,	/* d mod (p-1) */
+					      uint32_t dpbytes,
+					      unsigned char *dqarr,	/* d mod (q-1) */
+					      uint32_t dqbytes,
+					      unsigned char *qinvarr,	/* q^-1 mod p */
+					      uint32_t qinvbytes)
 {
     TPM_RESULT  rc = 0;
     BIGNUM *    n = NULL;
     BIGNUM *    e = NULL;
     BIGNUM *    d = NULL;
+    BIGNUM *    p = NULL;
+    BIGNUM *    q = NULL;
+    BIGNUM *    dmp1 = NULL;
+    BIGNUM *    dmq1 = NULL;
+    BIGNUM *    iqmp = NULL;
+    TPM_BOOL	crt;
 
     /* sanity check for the free */
     if (rc == 0) {
@@ -491,14 +589,116 @@ static TPM_RESULT TPM_RSAGeneratePrivateToken(RSA **rsa_pri_key,	/* freed by cal
     }
     if (rc == 0) {
         (*rsa_pri_key)->d = d;
+	crt = (parr != NULL) && (qarr != NULL) &&
+	      (dparr != NULL) && (dqarr != NULL) && (qinvarr != NULL);
+    }
+    /* add the CRT parameters */
+    if ((rc == 0) && crt) {
+        rc = TPM_bin2bn((TPM_BIGNUM *)&p, parr, pbytes);	/* freed by caller */
+	if (rc == 0) {
+	    (*rsa_pri_key)->p = p;
+	    rc = TPM_bin2bn((TPM_BIGNUM *)&q, qarr, qbytes);	/* freed by caller */
+	}
+	if (rc == 0) {
+	    (*rsa_pri_key)->q = q;
+	    rc = TPM_bin2bn((TPM_BIGNUM *)&dmp1, dparr, dpbytes);	/* freed by caller */
+	}
+	if (rc == 0) {
+	    (*rsa_pri_key)->dmp1 = dmp1;
+	    rc = TPM_bin2bn((TPM_BIGNUM *)&dmq1, dqarr, dqbytes);	/* freed by caller */
+	}
+	if (rc == 0) {
+	    (*rsa_pri_key)->dmq1 = dmq1;
+	    rc = TPM_bin2bn((TPM_BIGNUM *)&iqmp, qinvarr, qinvbytes);	/* freed by caller */
+	}
+	if (rc == 0) {
+	    (*rsa_pri_key)->iqmp = iqmp;
+	}
+    }
+    return rc;
+}
+
+/* TPM_RSAKeyToken_New() allocates and constructs an OpenSSL RSA private key token from n, e, d and
+   optionally the CRT parameters p, q, dP, dQ, qInv.
+
+   The token can be used for any number of private key operations.  OpenSSL caches the Montgomery
+   contexts in the token, so the caller should keep it as long as the key is in use.
+
+   The token must be freed by the caller using TPM_RSAKeyToken_Free().
+*/
+
+TPM_RESULT TPM_RSAKeyToken_New(TPM_RSA_KEY_TOKEN *rsa_key_token,	/* freed by caller */
+			       unsigned char *narr,	/* public modulus */
+			       uint32_t nbytes,
+			       unsigned char *earr,	/* public exponent */
+			       uint32_t ebytes,
+			       unsigned char *darr,	/* private exponent */
+			       uint32_t dbytes,
+			       unsigned char *parr,	/* prime factor, may be NULL */
+			       uint32_t pbytes,
+			       unsigned char *qarr,	/* prime factor, may be NULL */
+			       uint32_t qbytes,
+			       unsigned char *dparr,	/* d mod (p-1), may be NULL */
+			       uint32_t dpbytes,
+			       unsigned char *dqarr,	/* d mod (q-1), may be NULL */
+			       uint32_t dqbytes,
+			       unsigned char *qinvarr,	/* q^-1 mod p, may be NULL */
+			       uint32_t qinvbytes)
+{
+    TPM_RESULT  rc = 0;
+    RSA *       rsa_pri_key = NULL;
+
+    printf(" TPM_RSAKeyToken_New:\n");
+    if (rc == 0) {
+	rc = TPM_RSAGeneratePrivateToken(&rsa_pri_key,
+					 narr,      	/* public modulus */
+					 nbytes,
+					 earr,      	/* public exponent */
+					 ebytes,
+					 darr,		/* private exponent */
+					 dbytes,
+					 parr,		/* CRT parameters */
+					 pbytes,
+					 qarr,
+					 qbytes,
+					 dparr,
+					 dpbytes,
+					 dqarr,
+					 dqbytes,
+					 qinvarr,
+					 qinvbytes);
+    }
+    if (rc == 0) {
+	*rsa_key_token = (TPM_RSA_KEY_TOKEN)rsa_pri_key;
+    }
+    else {
+	if (rsa_pri_key != NULL) {
+	    RSA_free(rsa_pri_key);
+	}
+	*rsa_key_token = NULL;
     }
     return rc;
 }
 
+/* TPM_RSAKeyToken_Free() frees the RSA private key token and sets it to NULL.
+ */
+
+void TPM_RSAKeyToken_Free(TPM_RSA_KEY_TOKEN *rsa_key_token)
+{
+    if (*rsa_key_token != NULL) {
+	RSA_free((RSA *)*rsa_key_token);
+	*rsa_key_token = NULL;
+    }
+    return;
+}
+
 /* TPM_RSAPrivateDecrypt() decrypts 'encrypt_data' using the private key 'n, e, d'.  The OAEP
    padding is removed and 'decrypt_data_length' bytes are moved to 'decrypt_data'.
 
    'decrypt_data_length' is at most 'decrypt_data_size'.
+
+   If the CRT parameters 'p, q, dP, dQ, qInv' are supplied, the decryption uses the Chinese
+   Remainder Theorem.
 */
 
 TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted data */
@@ -513,26 +713,71 @@ TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted dat
                                  unsigned char *earr,           /* public exponent */
                                  uint32_t ebytes,
                                  unsigned char *darr,           /* private exponent */
-                                 uint32_t dbytes)
+                                 uint32_t dbytes,
+                                 unsigned char *parr,           /* prime factor, may be NULL */
+                                 uint32_t pbytes,
+                                 unsigned char *qarr,           /* prime factor, may be NULL */
+                                 uint32_t qbytes,
+                                 unsigned char *dparr,          /* d mod (p-1), may be NULL */
+                                 uint32_t dpbytes,
+                                 unsigned char *dqarr,          /* d mod (q-1), may be NULL */
+                                 uint32_t dqbytes,
+                                 unsigned char *qinvarr,        /* q^-1 mod p, may be NULL */
+                                 uint32_t qinvbytes)
+{
+    TPM_RESULT  	rc = 0;
+    TPM_RSA_KEY_TOKEN	rsa_key_token = NULL;	/* freed @1 */
+
+    printf(" TPM_RSAPrivateDecrypt:\n");
+    /* construct the OpenSSL private key object */
+    if (rc == 0) {
+	rc = TPM_RSAKeyToken_New(&rsa_key_token,	/* freed @1 */
+				 narr, nbytes,
+				 earr, ebytes,
+				 darr, dbytes,
+				 parr, pbytes,
+				 qarr, qbytes,
+				 dparr, dpbytes,
+				 dqarr, dqbytes,
+				 qinvarr, qinvbytes);
+    }
+    if (rc == 0) {
+	rc = TPM_RSAPrivateDecryptToken(decrypt_data,
+					decrypt_data_length,
+					decrypt_data_size,
+					encScheme,
+					encrypt_data,
+					encrypt_data_size,
+					rsa_key_token);
+    }
+    TPM_RSAKeyToken_Free(&rsa_key_token);	/* @1 */
+    return rc;
+}
+
+/* TPM_RSAPrivateDecryptToken() decrypts 'encrypt_data' using the private key token
+   'rsa_key_token'.  The OAEP padding is removed and 'decrypt_data_length' bytes are moved to
+   'decrypt_data'.
+
+   'decrypt_data_length' is at most 'decrypt_data_size'.
+*/
+
+TPM_RESULT TPM_RSAPrivateDecryptToken(unsigned char *decrypt_data,	/* decrypted data */
+				      uint32_t *decrypt_data_length,	/* length of data put into
+									   decrypt_data */
+				      size_t decrypt_data_size,	/* size of decrypt_data buffer */
+				      TPM_ENC_SCHEME encScheme,	/* encryption scheme */
+				      unsigned char *encrypt_data,	/* encrypted data */
+				      uint32_t encrypt_data_size,
+				      TPM_RSA_KEY_TOKEN rsa_key_token)	/* private key token */
 {
     TPM_RESULT  rc = 0;
     int         irc;
-    RSA *       rsa_pri_key = NULL;	/* freed @1 */
+    RSA *       rsa_pri_key = (RSA *)rsa_key_token;
 
-    unsigned char       *padded_data = NULL;
+    unsigned char       *padded_data = NULL;	/* freed @1 */
     int                 padded_data_size = 0;
     
-    printf(" TPM_RSAPrivateDecrypt:\n");
-    /* construct the OpenSSL private key object */
-    if (rc == 0) {
-	rc = TPM_RSAGeneratePrivateToken(&rsa_pri_key,	/* freed @1 */
-					 narr,      	/* public modulus */
-					 nbytes,
-					 earr,      	/* public exponent */
-					 ebytes,
-					 darr,		/* private exponent */
-					 dbytes);
-    }
+    printf(" TPM_RSAPrivateDecryptToken:\n");
     /* intermediate buffer for the decrypted but still padded data */
     if (rc == 0) {
         /* the size of the decrypted data is guaranteed to be less than this */
@@ -549,14 +794,14 @@ TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted dat
                                       rsa_pri_key,              /* key */
                                       RSA_NO_PADDING);          /* padding */
             if (irc < 0) {
-                printf("TPM_RSAPrivateDecrypt: Error in RSA_private_decrypt()\n");
+                printf("TPM_RSAPrivateDecryptToken: Error in RSA_private_decrypt()\n");
                 rc = TPM_DECRYPT_ERROR;
             }
     }
     if (rc == 0) {
-        printf("  TPM_RSAPrivateDecrypt: RSA_private_decrypt() success\n");
-        printf("  TPM_RSAPrivateDecrypt: Padded data size %u\n", padded_data_size);
-        TPM_PrintFour("  TPM_RSAPrivateDecrypt: Decrypt padded data", padded_data);
+        printf("  TPM_RSAPrivateDecryptToken: RSA_private_decrypt() success\n");
+        printf("  TPM_RSAPrivateDecryptToken: Padded data size %u\n", padded_data_size);
+        TPM_PrintFour("  TPM_RSAPrivateDecryptToken: Decrypt padded data", padded_data);
         if (encScheme == TPM_ES_RSAESOAEP_SHA1_MGF1) {
             /* openSSL expects the padded data to skip the first 0x00 byte, since it expects the
                padded data to come from a bignum via bn2bin. */
@@ -570,7 +815,7 @@ TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted dat
                                                                            */
                                                );
             if (irc < 0) {
-                printf("TPM_RSAPrivateDecrypt: Error in RSA_padding_check_PKCS1_OAEP()\n");
+                printf("TPM_RSAPrivateDecryptToken: Error in RSA_padding_check_PKCS1_OAEP()\n");
                 rc = TPM_DECRYPT_ERROR;
             }
         }
@@ -582,24 +827,21 @@ TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted dat
                                                  encrypt_data_size      /* rsa_len */
                                                  );
             if (irc < 0) {
-                printf("TPM_RSAPrivateDecrypt: Error in RSA_padding_check_PKCS1_type_2()\n");
+                printf("TPM_RSAPrivateDecryptToken: Error in RSA_padding_check_PKCS1_type_2()\n");
                 rc = TPM_DECRYPT_ERROR;
             }
         }
         else {
-            printf("TPM_RSAPrivateDecrypt: Error, unknown encryption scheme %04x\n", encScheme);
+            printf("TPM_RSAPrivateDecryptToken: Error, unknown encryption scheme %04x\n", encScheme);
             rc = TPM_INAPPROPRIATE_ENC;
         }
     }
     if (rc == 0) {
         *decrypt_data_length = irc;
-        printf("  TPM_RSAPrivateDecrypt: RSA_padding_check_PKCS1_OAEP() recovered %d bytes\n", irc);
-        TPM_PrintFour("  TPM_RSAPrivateDecrypt: Decrypt data", decrypt_data);
-    }
-    if (rsa_pri_key != NULL) {
-        RSA_free(rsa_pri_key);          /* @1 */
+        printf("  TPM_RSAPrivateDecryptToken: RSA_padding_check_PKCS1_OAEP() recovered %d bytes\n", irc);
+        TPM_PrintFour("  TPM_RSAPrivateDecryptToken: Decrypt data", decrypt_data);
     }
-    free(padded_data);                  /* @2 */
+    free(padded_data);                  /* @1 */
     return rc;
 }
 
@@ -772,6 +1014,9 @@ TPM_RESULT TPM_RSAPublicEncryptRaw(unsigned char *encrypt_data,	/* output */
 
    'signature_length' bytes are moved to 'signature'.  'signature_length' is at most
    'signature_size'.  signature must point to RSA_size(rsa) bytes of memory.
+
+   If the CRT parameters 'p, q, dP, dQ, qInv' are supplied, the signature uses the Chinese Remainder
+   Theorem.
 */
 
 TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
@@ -785,29 +1030,73 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
                        unsigned char *earr,             /* public exponent */
                        uint32_t ebytes,
                        unsigned char *darr,             /* private exponent */
-                       uint32_t dbytes)
+                       uint32_t dbytes,
+                       unsigned char *parr,           /* prime factor, may be NULL */
+                       uint32_t pbytes,
+                       unsigned char *qarr,           /* prime factor, may be NULL */
+                       uint32_t qbytes,
+                       unsigned char *dparr,          /* d mod (p-1), may be NULL */
+                       uint32_t dpbytes,
+                       unsigned char *dqarr,          /* d mod (q-1), may be NULL */
+                       uint32_t dqbytes,
+                       unsigned char *qinvarr,        /* q^-1 mod p, may be NULL */
+                       uint32_t qinvbytes)
 {
     TPM_RESULT          rc = 0;
-    RSA *               rsa_pri_key = NULL;	/* freed @1 */
-    unsigned int        key_size;
+    TPM_RSA_KEY_TOKEN	rsa_key_token = NULL;	/* freed @1 */
 
     printf(" TPM_RSASign:\n");
     /* construct the OpenSSL private key object */
     if (rc == 0) {
-	rc = TPM_RSAGeneratePrivateToken(&rsa_pri_key,	/* freed @1 */
-					 narr,      	/* public modulus */
-					 nbytes,
-					 earr,      	/* public exponent */
-					 ebytes,
-					 darr,		/* private exponent */
-					 dbytes);
-    }
+	rc = TPM_RSAKeyToken_New(&rsa_key_token,	/* freed @1 */
+				 narr, nbytes,
+				 earr, ebytes,
+				 darr, dbytes,
+				 parr, pbytes,
+				 qarr, qbytes,
+				 dparr, dpbytes,
+				 dqarr, dqbytes,
+				 qinvarr, qinvbytes);
+    }
+    if (rc == 0) {
+	rc = TPM_RSASignToken(signature,
+			      signature_length,
+			      signature_size,
+			      sigScheme,
+			      message,
+			      message_size,
+			      rsa_key_token);
+    }
+    TPM_RSAKeyToken_Free(&rsa_key_token);	/* @1 */
+    return rc;
+}
+
+/* TPM_RSASignToken() signs 'message' of size 'message_size' using the private key token
+   'rsa_key_token' and the signature scheme 'sigScheme' as specified in PKCS #1 v2.0.
+
+   'signature_length' bytes are moved to 'signature'.  'signature_length' is at most
+   'signature_size'.  signature must point to RSA_size(rsa) bytes of memory.
+*/
+
+TPM_RESULT TPM_RSASignToken(unsigned char *signature,        /* output */
+			    unsigned int *signature_length,  /* output, size of signature */
+			    unsigned int signature_size,     /* input, size of signature buffer */
+			    TPM_SIG_SCHEME sigScheme,        /* input, type of signature */
+			    const unsigned char *message,    /* input */
+			    size_t message_size,             /* input */
+			    TPM_RSA_KEY_TOKEN rsa_key_token) /* private key token */
+{
+    TPM_RESULT          rc = 0;
+    RSA *               rsa_pri_key = (RSA *)rsa_key_token;
+    unsigned int        key_size;
+
+    printf(" TPM_RSASignToken:\n");
     /* check the size of the output signature buffer */
     if (rc == 0) {
         key_size = (unsigned int)RSA_size(rsa_pri_key); /* openSSL returns an int, but never
                                                            negative */
         if (signature_size < key_size) {
-            printf("TPM_RSASign: Error (fatal), buffer %u too small for signature %u\n",
+            printf("TPM_RSASignToken: Error (fatal), buffer %u too small for signature %u\n",
                    signature_size, key_size);
             rc = TPM_FAIL;      /* internal error, should never occur */
         }
@@ -816,7 +1105,7 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
     if (rc == 0) {
         switch(sigScheme) {
           case TPM_SS_NONE:
-            printf("TPM_RSASign: Error, sigScheme TPM_SS_NONE\n");
+            printf("TPM_RSASignToken: Error, sigScheme TPM_SS_NONE\n");
             rc = TPM_INVALID_KEYUSAGE;
             break;
           case TPM_SS_RSASSAPKCS1v15_SHA1:
@@ -835,14 +1124,11 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
                                 rsa_pri_key);
             break;
           default:
-            printf("TPM_RSASign: Error, sigScheme %04hx unknown\n", sigScheme);
+            printf("TPM_RSASignToken: Error, sigScheme %04hx unknown\n", sigScheme);
             rc = TPM_INVALID_KEYUSAGE;
             break;
         }
     }
-    if (rsa_pri_key != NULL) {
-        RSA_free(rsa_pri_key);          /* @1 */
-    }
     return rc;
 }
 
@@ -1171,6 +1457,150 @@ TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
     return rc;
 }
 
+/* TPM_RSAGetCRTParameters() calculates the Chinese Remainder Theorem parameters dP = d mod (p-1),
+   dQ = d mod (q-1), and qInv = q^-1 mod p from the prime factors p, q and the private exponent d.
+
+   The results are padded to the size of p.
+
+   'dparr', 'dqarr', 'qinvarr' must be freed by the caller.
+*/
+
+TPM_RESULT TPM_RSAGetCRTParameters(uint32_t *dpbytes, unsigned char **dparr,
+				   uint32_t *dqbytes, unsigned char **dqarr,
+				   uint32_t *qinvbytes, unsigned char **qinvarr,
+				   uint32_t pbytes, unsigned char *parr,
+				   uint32_t qbytes, unsigned char *qarr,
+				   uint32_t dbytes, unsigned char *darr)
+{
+    TPM_RESULT          rc = 0;         /* TPM return code */
+    int                 irc;            /* openSSL return code */
+    BIGNUM              *brc;           /* BIGNUM return code */
+
+    BIGNUM *p = NULL;           	/* secret prime factor */
+    BIGNUM *q = NULL;           	/* secret prime factor */
+    BIGNUM *d = NULL;           	/* private exponent */
+    BIGNUM *dp = NULL;			/* d mod (p-1) */
+    BIGNUM *dq = NULL;			/* d mod (q-1) */
+    BIGNUM *qinv = NULL;		/* q^-1 mod p */
+    /* temporary variables */
+    BN_CTX *ctx = NULL;			/* freed @7, @8 */
+    BIGNUM *r0 = NULL;
+
+    /* set to NULL so caller can free after failure */
+    printf(" TPM_RSAGetCRTParameters:\n");
+    *dparr = NULL;
+    *dqarr = NULL;
+    *qinvarr = NULL;
+    /* check input parameters */
+    if (rc == 0) {
+        if ((parr == NULL) || (pbytes == 0) ||
+	    (qarr == NULL) || (qbytes == 0) ||
+	    (darr == NULL) || (dbytes == 0)) {
+            printf("TPM_RSAGetCRTParameters: Error, missing p, q, or d\n");
+            rc = TPM_BAD_PARAMETER;
+        }
+    }
+    /* get a temporary BIGNUM for use in the calculations */
+    if (rc == 0) {
+        rc = TPM_BN_CTX_new(&ctx);
+    }
+    if (rc == 0) {
+        BN_CTX_start(ctx);      /* no return code */
+        r0 = BN_CTX_get(ctx);
+        if (r0 == 0) {
+            printf("TPM_RSAGetCRTParameters: Error in BN_CTX_get()\n");
+            TPM_OpenSSL_PrintError();
+            rc = TPM_SIZE;
+        }
+    }
+    /* allocate BIGNUM's for dP, dQ, qInv */
+    if (rc == 0) {
+        rc = TPM_BN_new((TPM_BIGNUM *)&dp);			/* freed @4 */
+    }
+    if (rc == 0) {
+        rc = TPM_BN_new((TPM_BIGNUM *)&dq);			/* freed @5 */
+    }
+    if (rc == 0) {
+        rc = TPM_BN_new((TPM_BIGNUM *)&qinv);			/* freed @6 */
+    }
+    /* convert p, q, d to BIGNUM's */
+    if (rc == 0) {
+        rc = TPM_bin2bn((TPM_BIGNUM *)&p, parr, pbytes);	/* freed @1 */
+    }
+    if (rc == 0) {
+        rc = TPM_bin2bn((TPM_BIGNUM *)&q, qarr, qbytes);	/* freed @2 */
+    }
+    if (rc == 0) {
+        rc = TPM_bin2bn((TPM_BIGNUM *)&d, darr, dbytes);	/* freed @3 */
+    }
+    /* calculate dP = d mod (p-1) */
+    if (rc == 0) {
+        irc = BN_sub(r0, p, BN_value_one());
+	if (irc == 1) {		/* 1 is success */
+	    irc = BN_mod(dp, d, r0, ctx);
+	}
+        if (irc != 1) {
+            printf("TPM_RSAGetCRTParameters: Error calculating dP\n");
+            TPM_OpenSSL_PrintError();
+            rc = TPM_BAD_PARAMETER;
+        }
+    }
+    /* calculate dQ = d mod (q-1) */
+    if (rc == 0) {
+        irc = BN_sub(r0, q, BN_value_one());
+	if (irc == 1) {		/* 1 is success */
+	    irc = BN_mod(dq, d, r0, ctx);
+	}
+        if (irc != 1) {
+            printf("TPM_RSAGetCRTParameters: Error calculating dQ\n");
+            TPM_OpenSSL_PrintError();
+            rc = TPM_BAD_PARAMETER;
+        }
+    }
+    /* calculate qInv = multiplicative inverse q mod p */
+    if (rc == 0) {
+        brc = BN_mod_inverse(qinv, q, p, ctx);
+        if (brc == NULL) {
+            printf("TPM_RSAGetCRTParameters: Error in BN_mod_inverse()\n");
+            TPM_OpenSSL_PrintError();
+            rc = TPM_BAD_PARAMETER;
+        }
+    }
+    /* get dP, dQ, qInv as arrays */
+    if (rc == 0) {
+        rc = TPM_bn2binMalloc(dparr, dpbytes, (TPM_BIGNUM)dp, pbytes);	/* freed by caller */
+    }
+    if (rc == 0) {
+        rc = TPM_bn2binMalloc(dqarr, dqbytes, (TPM_BIGNUM)dq, pbytes);	/* freed by caller */
+    }
+    if (rc == 0) {
+        rc = TPM_bn2binMalloc(qinvarr, qinvbytes, (TPM_BIGNUM)qinv, pbytes); /* freed by caller */
+    }
+    if (rc == 0) {
+        printf("  TPM_RSAGetCRTParameters: length of dP,dQ,qInv = %u / %u / %u\n",
+               *dpbytes, *dqbytes, *qinvbytes);
+    }
+    if (rc != 0) {
+        free(*dparr);
+        free(*dqarr);
+        free(*qinvarr);
+        *dparr = NULL;
+        *dqarr = NULL;
+        *qinvarr = NULL;
+    }
+    BN_free(p);         /* @1 */
+    BN_free(q);         /* @2 */
+    BN_clear_free(d);   /* @3 */
+    BN_clear_free(dp);  /* @4 */
+    BN_clear_free(dq);  /* @5 */
+    BN_clear_free(qinv); /* @6 */
+    if (ctx != NULL) {
+	BN_CTX_end(ctx);    /* @7 */
+	BN_CTX_free(ctx);   /* @8 */
+    }
+    return rc;
+}
+
 /*
   openSSL wrappers do error logging and transformation of openSSL errors to TPM type errors
 */
@@ -1890,6 +2320,22 @@ TPM_RESULT TPM_Sha1Context_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_Sha1Context_SizeOf() returns the number of bytes TPM_Sha1Context_Store() serializes */
+
+uint32_t TPM_Sha1Context_SizeOf(void *context)
+{
+    uint32_t 	size;
+
+    size = sizeof(TPM_BOOL);			/* contextPresent */
+    if (context != NULL) {
+	size += sizeof(uint16_t) +		/* tag */
+		(7 * sizeof(uint32_t)) +	/* h0-h4, Nl, Nh */
+		(SHA_LBLOCK * sizeof(uint32_t)) +
+		sizeof(uint32_t);		/* num */
+    }
+    return size;
+}
+
 /*
   TPM_SYMMETRIC_KEY_DATA
 */
@@ -1903,7 +2349,8 @@ TPM_RESULT TPM_SymmetricKeyData_New(TPM_SYMMETRIC_KEY_TOKEN *tpm_symmetric_key_d
 
     printf(" TPM_SymmetricKeyData_New:\n");
     if (rc == 0) {
-	rc = TPM_Malloc(tpm_symmetric_key_data, sizeof(TPM_SYMMETRIC_KEY_DATA));
+	rc = TPM_Slab_Malloc(tpm_symmetric_key_data, TPM_SLAB_SYMMETRIC_KEY,
+			     sizeof(TPM_SYMMETRIC_KEY_DATA));
     }
     if (rc == 0) {
 	TPM_SymmetricKeyData_Init(*tpm_symmetric_key_data);
@@ -1920,7 +2367,7 @@ void TPM_SymmetricKeyData_Free(TPM_SYMMETRIC_KEY_TOKEN *tpm_symmetric_key_data)
     printf(" TPM_SymmetricKeyData_Free:\n");
     if (*tpm_symmetric_key_data != NULL) {
         TPM_SymmetricKeyData_Init(*tpm_symmetric_key_data);
-	free(*tpm_symmetric_key_data);
+	TPM_Slab_Free(*tpm_symmetric_key_data);
 	*tpm_symmetric_key_data = NULL;
     }
     return;
@@ -2039,6 +2486,17 @@ TPM_RESULT TPM_SymmetricKeyData_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_SymmetricKeyData_SizeOf() returns the number of bytes TPM_SymmetricKeyData_Store()
+   serializes */
+
+uint32_t TPM_SymmetricKeyData_SizeOf(const TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token)
+{
+    tpm_symmetric_key_token = tpm_symmetric_key_token;	/* to quiet the compiler */
+    return sizeof(uint16_t) +			/* tag */
+	(2 * sizeof(TPM_BOOL)) +		/* valid, fill */
+	(3 * sizeof(DES_cblock));
+}
+
 /* TPM_SymmetricKeyData_GenerateKey() is DES non-portable code to generate a symmetric key
 
    vsymmetric_key must be freed by the caller
@@ -2375,6 +2833,19 @@ TPM_RESULT TPM_SymmetricKeyData_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_SymmetricKeyData_SizeOf() returns the number of bytes TPM_SymmetricKeyData_Store()
+   serializes */
+
+uint32_t TPM_SymmetricKeyData_SizeOf(const TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token)
+{
+    TPM_SYMMETRIC_KEY_DATA *tpm_symmetric_key_data =
+	(TPM_SYMMETRIC_KEY_DATA *)tpm_symmetric_key_token;
+
+    return sizeof(uint16_t) +			/* tag */
+	(2 * sizeof(TPM_BOOL)) +		/* valid, fill */
+	sizeof(tpm_symmetric_key_data->userKey);
+}
+
 /* TPM_SymmetricKeyData_GenerateKey() is AES non-portable code to generate a random symmetric key
 
    tpm_symmetric_key_data should be initialized before and after use
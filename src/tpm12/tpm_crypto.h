@@ -107,6 +107,25 @@ TPM_RESULT TPM_RSAGenerateKeyPair(unsigned char **n,
                                   const unsigned char *earr,
                                   uint32_t e_size);
 
+TPM_RESULT TPM_RSAKeyToken_New(TPM_RSA_KEY_TOKEN *rsa_key_token,
+                               unsigned char *n,
+                               uint32_t nbytes,
+                               unsigned char *e,
+                               uint32_t ebytes,
+                               unsigned char *d,
+                               uint32_t dbytes,
+                               unsigned char *p,
+                               uint32_t pbytes,
+                               unsigned char *q,
+                               uint32_t qbytes,
+                               unsigned char *dp,
+                               uint32_t dpbytes,
+                               unsigned char *dq,
+                               uint32_t dqbytes,
+                               unsigned char *qinv,
+                               uint32_t qinvbytes);
+void       TPM_RSAKeyToken_Free(TPM_RSA_KEY_TOKEN *rsa_key_token);
+
 TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,
                                  uint32_t *decrypt_data_length,
                                  size_t decrypt_data_size,
@@ -118,7 +137,24 @@ TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,
                                  unsigned char *e,
                                  uint32_t ebytes,
                                  unsigned char *d,
-                                 uint32_t dbytes);
+                                 uint32_t dbytes,
+                                 unsigned char *p,
+                                 uint32_t pbytes,
+                                 unsigned char *q,
+                                 uint32_t qbytes,
+                                 unsigned char *dp,
+                                 uint32_t dpbytes,
+                                 unsigned char *dq,
+                                 uint32_t dqbytes,
+                                 unsigned char *qinv,
+                                 uint32_t qinvbytes);
+TPM_RESULT TPM_RSAPrivateDecryptToken(unsigned char *decrypt_data,
+                                      uint32_t *decrypt_data_length,
+                                      size_t decrypt_data_size,
+                                      TPM_ENC_SCHEME encScheme,
+                                      unsigned char* encrypt_data,
+                                      uint32_t encrypt_data_size,
+                                      TPM_RSA_KEY_TOKEN rsa_key_token);
 
 TPM_RESULT TPM_RSAPublicEncrypt(unsigned char* encrypt_data,
                                 size_t encrypt_data_size,
@@ -143,6 +179,12 @@ TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
                                 uint32_t nbytes, unsigned char *narr,
                                 uint32_t ebytes, unsigned char *earr,
                                 uint32_t pbytes, unsigned char *parr);
+TPM_RESULT TPM_RSAGetCRTParameters(uint32_t *dpbytes, unsigned char **dparr,
+                                   uint32_t *dqbytes, unsigned char **dqarr,
+                                   uint32_t *qinvbytes, unsigned char **qinvarr,
+                                   uint32_t pbytes, unsigned char *parr,
+                                   uint32_t qbytes, unsigned char *qarr,
+                                   uint32_t dbytes, unsigned char *darr);
 TPM_RESULT TPM_RSASign(unsigned char *signature,
                        unsigned int *signature_length,
                        unsigned int signature_size,
@@ -154,7 +196,24 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,
                        unsigned char *earr,
                        uint32_t ebytes,
                        unsigned char *darr,
-                       uint32_t dbytes);
+                       uint32_t dbytes,
+                       unsigned char *parr,
+                       uint32_t pbytes,
+                       unsigned char *qarr,
+                       uint32_t qbytes,
+                       unsigned char *dparr,
+                       uint32_t dpbytes,
+                       unsigned char *dqarr,
+                       uint32_t dqbytes,
+                       unsigned char *qinvarr,
+                       uint32_t qinvbytes);
+TPM_RESULT TPM_RSASignToken(unsigned char *signature,
+                            unsigned int *signature_length,
+                            unsigned int signature_size,
+                            TPM_SIG_SCHEME sigScheme,
+                            const unsigned char *message,
+                            size_t message_size,
+                            TPM_RSA_KEY_TOKEN rsa_key_token);
 TPM_RESULT TPM_RSAVerifySHA1(unsigned char *signature,
 			     unsigned int signature_size,
 			     const unsigned char *message,
@@ -178,6 +237,7 @@ TPM_RESULT TPM_Sha1Context_Load(void **context,
 				uint32_t *stream_size);
 TPM_RESULT TPM_Sha1Context_Store(TPM_STORE_BUFFER *sbuffer,
 				 void *context);
+uint32_t   TPM_Sha1Context_SizeOf(void *context);
 
 /*
   TPM_SYMMETRIC_KEY_DATA
@@ -191,6 +251,7 @@ TPM_RESULT TPM_SymmetricKeyData_Load(TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_t
                                      uint32_t *stream_size);
 TPM_RESULT TPM_SymmetricKeyData_Store(TPM_STORE_BUFFER *sbuffer,
                                       const TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token);
+uint32_t   TPM_SymmetricKeyData_SizeOf(const TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token);
 TPM_RESULT TPM_SymmetricKeyData_GenerateKey(TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token);
 TPM_RESULT TPM_SymmetricKeyData_Encrypt(unsigned char **encrypt_data,
                                         uint32_t *encrypt_length,
@@ -53,6 +53,7 @@
 #include <gmp.h>
 
 #include "tpm_cryptoh.h"
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_CRYPTO
 #include "tpm_debug.h"
 #include "tpm_error.h"
 #include "tpm_key.h"
@@ -60,6 +61,7 @@
 #include "tpm_load.h"
 #include "tpm_memory.h"
 #include "tpm_process.h"
+#include "tpm_slab.h"
 #include "tpm_types.h"
 
 #include "tpm_crypto.h"
@@ -94,7 +96,17 @@ static TPM_RESULT TPM_RSAGeneratePrivateToken(RSAPrivateKey *rsa_pri_key,
 					      unsigned char *earr,
 					      uint32_t ebytes,
 					      unsigned char *darr,
-					      uint32_t dbytes);
+					      uint32_t dbytes,
+					      unsigned char *parr,
+					      uint32_t pbytes,
+					      unsigned char *qarr,
+					      uint32_t qbytes,
+					      unsigned char *dparr,
+					      uint32_t dpbytes,
+					      unsigned char *dqarr,
+					      uint32_t dqbytes,
+					      unsigned char *qinvarr,
+					      uint32_t qinvbytes);
 static TPM_RESULT TPM_RSASignSHA1(unsigned char *signature,
                                   unsigned int *signature_length,
                                   const unsigned char *message,
@@ -517,7 +529,11 @@ static TPM_RESULT TPM_RSAGeneratePublicToken(RSAPublicKey *rsaPublicKey,
 }
 
 /* TPM_RSAGeneratePrivateToken() generates an RSA key token from n, e, d
- */
+
+   If the prime factors p,q and the CRT parameters dP,dQ,qInv are all supplied, they are assigned
+   to the key token directly.  Otherwise they may be NULL and RSA_PopulatePrivateKey() must
+   recover them from n, e, d, which requires factoring n.
+*/
 
 static TPM_RESULT TPM_RSAGeneratePrivateToken(RSAPrivateKey *rsa_pri_key, /* freed by caller */
 					      unsigned char *narr,      /* public modulus */
@@ -525,7 +541,17 @@ static TPM_RESULT TPM_RSAGeneratePrivateToken(RSAPrivateKey *rsa_pri_key, /* fre
 					      unsigned char *earr,      /* public exponent */
 					      uint32_t ebytes,
 					      unsigned char *darr,	/* private exponent */
-					      uint32_t dbytes)
+					      uint32_t dbytes,
+					      unsigned char *parr,	/* prime factor */
+					      uint32_t pbytes,
+					      unsigned char *qarr,	/* prime factor */
+					      uint32_t qbytes,
+					      unsigned char *dparr,	/* d mod (p-1) */
+					      uint32_t dpbytes,
+					      unsigned char *dqarr,	/* d mod (q-1) */
+					      uint32_t dqbytes,
+					      unsigned char *qinvarr,	/* q^-1 mod p */
+					      uint32_t qinvbytes)
 {
     TPM_RESULT  rc = 0;
     SECStatus rv = SECSuccess;
@@ -545,20 +571,122 @@ static TPM_RESULT TPM_RSAGeneratePrivateToken(RSAPrivateKey *rsa_pri_key, /* fre
 	rsa_pri_key->privateExponent.type = siBuffer;
 	rsa_pri_key->privateExponent.data = darr;
 	rsa_pri_key->privateExponent.len = dbytes;
-	/* given these key parameters (n,e,d), fill in the rest of the parameters */
-	rv = RSA_PopulatePrivateKey(rsa_pri_key); 	/* freed by caller */
-	if (rv != SECSuccess) {
-	    printf("TPM_RSAGeneratePrivateToken: Error, RSA_PopulatePrivateKey rv %d\n", rv);
-	    rc = TPM_BAD_PARAMETER;
+    }
+    if (rc == 0) {
+	if ((parr != NULL) && (qarr != NULL) &&
+	    (dparr != NULL) && (dqarr != NULL) && (qinvarr != NULL)) {
+	    /* simply assign the CRT parameters to the key token */
+	    rsa_pri_key->prime1.type = siBuffer;
+	    rsa_pri_key->prime1.data = parr;
+	    rsa_pri_key->prime1.len = pbytes;
+	    rsa_pri_key->prime2.type = siBuffer;
+	    rsa_pri_key->prime2.data = qarr;
+	    rsa_pri_key->prime2.len = qbytes;
+	    rsa_pri_key->exponent1.type = siBuffer;
+	    rsa_pri_key->exponent1.data = dparr;
+	    rsa_pri_key->exponent1.len = dpbytes;
+	    rsa_pri_key->exponent2.type = siBuffer;
+	    rsa_pri_key->exponent2.data = dqarr;
+	    rsa_pri_key->exponent2.len = dqbytes;
+	    rsa_pri_key->coefficient.type = siBuffer;
+	    rsa_pri_key->coefficient.data = qinvarr;
+	    rsa_pri_key->coefficient.len = qinvbytes;
+	}
+	else {
+	    /* given these key parameters (n,e,d), fill in the rest of the parameters */
+	    rv = RSA_PopulatePrivateKey(rsa_pri_key); 	/* freed by caller */
+	    if (rv != SECSuccess) {
+		printf("TPM_RSAGeneratePrivateToken: Error, RSA_PopulatePrivateKey rv %d\n", rv);
+		rc = TPM_BAD_PARAMETER;
+	    }
 	}
     }
     return rc;
 }
 
+/* TPM_RSAKeyToken_New() allocates and constructs a freebl RSA private key token from n, e, d and
+   optionally the CRT parameters p, q, dP, dQ, qInv.
+
+   The token points into the caller's arrays, which must remain valid until the token is freed.
+   The token can be used for any number of private key operations.
+
+   The token must be freed by the caller using TPM_RSAKeyToken_Free().
+*/
+
+TPM_RESULT TPM_RSAKeyToken_New(TPM_RSA_KEY_TOKEN *rsa_key_token,	/* freed by caller */
+			       unsigned char *narr,	/* public modulus */
+			       uint32_t nbytes,
+			       unsigned char *earr,	/* public exponent */
+			       uint32_t ebytes,
+			       unsigned char *darr,	/* private exponent */
+			       uint32_t dbytes,
+			       unsigned char *parr,	/* prime factor, may be NULL */
+			       uint32_t pbytes,
+			       unsigned char *qarr,	/* prime factor, may be NULL */
+			       uint32_t qbytes,
+			       unsigned char *dparr,	/* d mod (p-1), may be NULL */
+			       uint32_t dpbytes,
+			       unsigned char *dqarr,	/* d mod (q-1), may be NULL */
+			       uint32_t dqbytes,
+			       unsigned char *qinvarr,	/* q^-1 mod p, may be NULL */
+			       uint32_t qinvbytes)
+{
+    TPM_RESULT  	rc = 0;
+    RSAPrivateKey	*rsa_pri_key = NULL;
+
+    printf(" TPM_RSAKeyToken_New:\n");
+    if (rc == 0) {
+	rc = TPM_Malloc((unsigned char **)&rsa_pri_key, sizeof(RSAPrivateKey));
+    }
+    if (rc == 0) {
+	TPM_RSAPrivateKeyInit(rsa_pri_key);
+	rc = TPM_RSAGeneratePrivateToken(rsa_pri_key,
+					 narr,      	/* public modulus */
+					 nbytes,
+					 earr,      	/* public exponent */
+					 ebytes,
+					 darr,		/* private exponent */
+					 dbytes,
+					 parr,		/* CRT parameters */
+					 pbytes,
+					 qarr,
+					 qbytes,
+					 dparr,
+					 dpbytes,
+					 dqarr,
+					 dqbytes,
+					 qinvarr,
+					 qinvbytes);
+    }
+    *rsa_key_token = (TPM_RSA_KEY_TOKEN)rsa_pri_key;
+    if (rc != 0) {
+	TPM_RSAKeyToken_Free(rsa_key_token);
+    }
+    return rc;
+}
+
+/* TPM_RSAKeyToken_Free() frees the RSA private key token and sets it to NULL.
+ */
+
+void TPM_RSAKeyToken_Free(TPM_RSA_KEY_TOKEN *rsa_key_token)
+{
+    RSAPrivateKey	*rsa_pri_key = (RSAPrivateKey *)*rsa_key_token;
+
+    if (rsa_pri_key != NULL) {
+	PORT_FreeArena(rsa_pri_key->arena, PR_TRUE);
+	free(rsa_pri_key);
+	*rsa_key_token = NULL;
+    }
+    return;
+}
+
 /* TPM_RSAPrivateDecrypt() decrypts 'encrypt_data' using the private key 'n, e, d'.  The OAEP
    padding is removed and 'decrypt_data_length' bytes are moved to 'decrypt_data'.
 
    'decrypt_data_length' is at most 'decrypt_data_size'.
+
+   If the CRT parameters 'p, q, dP, dQ, qInv' are supplied, the key token is built without
+   factoring n.
 */
 
 TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted data */
@@ -573,16 +701,22 @@ TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted dat
                                  unsigned char *earr,           /* public exponent */
                                  uint32_t ebytes,
                                  unsigned char *darr,           /* private exponent */
-                                 uint32_t dbytes)
+                                 uint32_t dbytes,
+                                 unsigned char *parr,           /* prime factor, may be NULL */
+                                 uint32_t pbytes,
+                                 unsigned char *qarr,           /* prime factor, may be NULL */
+                                 uint32_t qbytes,
+                                 unsigned char *dparr,          /* d mod (p-1), may be NULL */
+                                 uint32_t dpbytes,
+                                 unsigned char *dqarr,          /* d mod (q-1), may be NULL */
+                                 uint32_t dqbytes,
+                                 unsigned char *qinvarr,        /* q^-1 mod p, may be NULL */
+                                 uint32_t qinvbytes)
 {
     TPM_RESULT  	rc = 0;
-    SECStatus 		rv = SECSuccess;
-    RSAPrivateKey	rsa_pri_key;
-    unsigned char       *padded_data = NULL;	/* freed @2 */
-    int                 padded_data_size = 0;
+    TPM_RSA_KEY_TOKEN	rsa_key_token = NULL;	/* freed @1 */
 
     printf(" TPM_RSAPrivateDecrypt: Input data size %u\n", encrypt_data_size);
-    TPM_RSAPrivateKeyInit(&rsa_pri_key);			/* freed @1 */
     /* the encrypted data size must equal the public key size */
     if (rc == 0) {
 	if (encrypt_data_size != nbytes) {
@@ -591,37 +725,83 @@ TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted dat
 	    rc = TPM_DECRYPT_ERROR;
 	}
     }
-    /* construct the freebl private key object from n,e,d */
+    /* construct the freebl private key object from n,e,d and the CRT parameters */
     if (rc == 0) {
-	rc = TPM_RSAGeneratePrivateToken(&rsa_pri_key,	/* freed @1 */
-					 narr,      	/* public modulus */
-					 nbytes,
-					 earr,      	/* public exponent */
-					 ebytes,
-					 darr,		/* private exponent */
-					 dbytes);
+	rc = TPM_RSAKeyToken_New(&rsa_key_token,	/* freed @1 */
+				 narr, nbytes,
+				 earr, ebytes,
+				 darr, dbytes,
+				 parr, pbytes,
+				 qarr, qbytes,
+				 dparr, dpbytes,
+				 dqarr, dqbytes,
+				 qinvarr, qinvbytes);
+    }
+    if (rc == 0) {
+	rc = TPM_RSAPrivateDecryptToken(decrypt_data,
+					decrypt_data_length,
+					decrypt_data_size,
+					encScheme,
+					encrypt_data,
+					encrypt_data_size,
+					rsa_key_token);
+    }
+    TPM_RSAKeyToken_Free(&rsa_key_token);	/* @1 */
+    return rc;
+}
+
+/* TPM_RSAPrivateDecryptToken() decrypts 'encrypt_data' using the private key token
+   'rsa_key_token'.  The OAEP padding is removed and 'decrypt_data_length' bytes are moved to
+   'decrypt_data'.
+
+   'decrypt_data_length' is at most 'decrypt_data_size'.
+*/
+
+TPM_RESULT TPM_RSAPrivateDecryptToken(unsigned char *decrypt_data,	/* decrypted data */
+				      uint32_t *decrypt_data_length,	/* length of data put into
+									   decrypt_data */
+				      size_t decrypt_data_size,	/* size of decrypt_data buffer */
+				      TPM_ENC_SCHEME encScheme,	/* encryption scheme */
+				      unsigned char *encrypt_data,	/* encrypted data */
+				      uint32_t encrypt_data_size,
+				      TPM_RSA_KEY_TOKEN rsa_key_token)	/* private key token */
+{
+    TPM_RESULT  	rc = 0;
+    SECStatus 		rv = SECSuccess;
+    RSAPrivateKey	*rsa_pri_key = (RSAPrivateKey *)rsa_key_token;
+    unsigned char       *padded_data = NULL;	/* freed @1 */
+    int                 padded_data_size = 0;
+
+    printf(" TPM_RSAPrivateDecryptToken: Input data size %u\n", encrypt_data_size);
+    /* the encrypted data size must equal the public key size */
+    if (rc == 0) {
+	if (encrypt_data_size != rsa_pri_key->modulus.len) {
+	    printf("TPM_RSAPrivateDecryptToken: Error, Encrypted data size is %u not %u\n",
+		   encrypt_data_size, rsa_pri_key->modulus.len);
+	    rc = TPM_DECRYPT_ERROR;
+	}
     }
     /* allocate intermediate buffer for the decrypted but still padded data */
     if (rc == 0) {
         /* the size of the decrypted data is guaranteed to be less than this */
-        padded_data_size = rsa_pri_key.modulus.len;
-        rc = TPM_Malloc(&padded_data, padded_data_size);	/* freed @2 */
+        padded_data_size = rsa_pri_key->modulus.len;
+        rc = TPM_Malloc(&padded_data, padded_data_size);	/* freed @1 */
     }
     if (rc == 0) {
         /* decrypt with private key.  Must decrypt first and then remove padding because the decrypt
            call cannot specify an encoding parameter */
-	rv = RSA_PrivateKeyOp(&rsa_pri_key,		/* private key token */
+	rv = RSA_PrivateKeyOp(rsa_pri_key,		/* private key token */
 			      padded_data,		/* to - the decrypted but padded data */
 			      encrypt_data);		/* from - the encrypted data */
 	if (rv != SECSuccess) {
-	    printf("TPM_RSAPrivateDecrypt: Error in RSA_PrivateKeyOp(), rv %d\n", rv);
+	    printf("TPM_RSAPrivateDecryptToken: Error in RSA_PrivateKeyOp(), rv %d\n", rv);
 	    rc = TPM_DECRYPT_ERROR;
 	}
    }
     if (rc == 0) {
-        printf("  TPM_RSAPrivateDecrypt: RSA_PrivateKeyOp() success\n");
-        printf("  TPM_RSAPrivateDecrypt: Padded data size %u\n", padded_data_size);
-        TPM_PrintFour("  TPM_RSAPrivateDecrypt: Decrypt padded data", padded_data);
+        printf("  TPM_RSAPrivateDecryptToken: RSA_PrivateKeyOp() success\n");
+        printf("  TPM_RSAPrivateDecryptToken: Padded data size %u\n", padded_data_size);
+        TPM_PrintFour("  TPM_RSAPrivateDecryptToken: Decrypt padded data", padded_data);
 	/* check and remove the padding based on the TPM encryption scheme */
         if (encScheme == TPM_ES_RSAESOAEP_SHA1_MGF1) {
 	    /* recovered seed and pHash are not returned */
@@ -647,17 +827,16 @@ TPM_RESULT TPM_RSAPrivateDecrypt(unsigned char *decrypt_data,   /* decrypted dat
 					     padded_data_size);  	/* from length */
         }
         else {
-            printf("TPM_RSAPrivateDecrypt: Error, unknown encryption scheme %04x\n", encScheme);
+            printf("TPM_RSAPrivateDecryptToken: Error, unknown encryption scheme %04x\n", encScheme);
             rc = TPM_INAPPROPRIATE_ENC;
         }
     }
     if (rc == 0) {
-        printf("  TPM_RSAPrivateDecrypt: RSA_padding_check_PKCS1 recovered %d bytes\n",
+        printf("  TPM_RSAPrivateDecryptToken: RSA_padding_check_PKCS1 recovered %d bytes\n",
 	       *decrypt_data_length);
-        TPM_PrintFour("  TPM_RSAPrivateDecrypt: Decrypt data", decrypt_data);
+        TPM_PrintFour("  TPM_RSAPrivateDecryptToken: Decrypt data", decrypt_data);
     }
-    PORT_FreeArena(rsa_pri_key.arena, PR_TRUE);	/* @1 */
-    free(padded_data);                  	/* @2 */
+    free(padded_data);                  	/* @1 */
     return rc;
 }
 
@@ -797,6 +976,9 @@ TPM_RESULT TPM_RSAPublicEncryptRaw(unsigned char *encrypt_data,	/* output */
 
    'signature_length' bytes are moved to 'signature'.  'signature_length' is at most
    'signature_size'.  signature must point to bytes of memory equal to the public modulus size.
+
+   If the CRT parameters 'p, q, dP, dQ, qInv' are supplied, the key token is built without
+   factoring n.
 */
 
 TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
@@ -810,28 +992,71 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
                        unsigned char *earr,             /* public exponent */
                        uint32_t ebytes,
                        unsigned char *darr,             /* private exponent */
-                       uint32_t dbytes)
+                       uint32_t dbytes,
+                       unsigned char *parr,           /* prime factor, may be NULL */
+                       uint32_t pbytes,
+                       unsigned char *qarr,           /* prime factor, may be NULL */
+                       uint32_t qbytes,
+                       unsigned char *dparr,          /* d mod (p-1), may be NULL */
+                       uint32_t dpbytes,
+                       unsigned char *dqarr,          /* d mod (q-1), may be NULL */
+                       uint32_t dqbytes,
+                       unsigned char *qinvarr,        /* q^-1 mod p, may be NULL */
+                       uint32_t qinvbytes)
 {
     TPM_RESULT          rc = 0;
-    RSAPrivateKey 	rsa_pri_key;
+    TPM_RSA_KEY_TOKEN	rsa_key_token = NULL;	/* freed @1 */
 
     printf(" TPM_RSASign:\n");
-    TPM_RSAPrivateKeyInit(&rsa_pri_key);			/* freed @1 */
-    /* construct the free private key object from n,e,d */
-    if (rc == 0) {
-	rc = TPM_RSAGeneratePrivateToken(&rsa_pri_key,	/* freed @1 */
-					 narr,      	/* public modulus */
-					 nbytes,
-					 earr,      	/* public exponent */
-					 ebytes,
-					 darr,		/* private exponent */
-					 dbytes);
-    }
+    /* construct the freebl private key object from n,e,d and the CRT parameters */
+    if (rc == 0) {
+	rc = TPM_RSAKeyToken_New(&rsa_key_token,	/* freed @1 */
+				 narr, nbytes,
+				 earr, ebytes,
+				 darr, dbytes,
+				 parr, pbytes,
+				 qarr, qbytes,
+				 dparr, dpbytes,
+				 dqarr, dqbytes,
+				 qinvarr, qinvbytes);
+    }
+    if (rc == 0) {
+	rc = TPM_RSASignToken(signature,
+			      signature_length,
+			      signature_size,
+			      sigScheme,
+			      message,
+			      message_size,
+			      rsa_key_token);
+    }
+    TPM_RSAKeyToken_Free(&rsa_key_token);	/* @1 */
+    return rc;
+}
+
+/* TPM_RSASignToken() signs 'message' of size 'message_size' using the private key token
+   'rsa_key_token' and the signature scheme 'sigScheme' as specified in PKCS #1 v2.0.
+
+   'signature_length' bytes are moved to 'signature'.  'signature_length' is at most
+   'signature_size'.  signature must point to bytes of memory equal to the public modulus size.
+*/
+
+TPM_RESULT TPM_RSASignToken(unsigned char *signature,        /* output */
+			    unsigned int *signature_length,  /* output, size of signature */
+			    unsigned int signature_size,     /* input, size of signature buffer */
+			    TPM_SIG_SCHEME sigScheme,        /* input, type of signature */
+			    const unsigned char *message,    /* input */
+			    size_t message_size,             /* input */
+			    TPM_RSA_KEY_TOKEN rsa_key_token) /* private key token */
+{
+    TPM_RESULT          rc = 0;
+    RSAPrivateKey 	*rsa_pri_key = (RSAPrivateKey *)rsa_key_token;
+
+    printf(" TPM_RSASignToken:\n");
     /* sanity check the size of the output signature buffer */
     if (rc == 0) {
-        if (signature_size < nbytes) {
-            printf("TPM_RSASign: Error (fatal), buffer %u too small for signature %u\n",
-                   signature_size, nbytes);
+        if (signature_size < rsa_pri_key->modulus.len) {
+            printf("TPM_RSASignToken: Error (fatal), buffer %u too small for signature %u\n",
+                   signature_size, rsa_pri_key->modulus.len);
             rc = TPM_FAIL;      /* internal error, should never occur */
         }
     }
@@ -839,7 +1064,7 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
     if (rc == 0) {
         switch(sigScheme) {
           case TPM_SS_NONE:
-            printf("TPM_RSASign: Error, sigScheme TPM_SS_NONE\n");
+            printf("TPM_RSASignToken: Error, sigScheme TPM_SS_NONE\n");
             rc = TPM_INVALID_KEYUSAGE;
             break;
           case TPM_SS_RSASSAPKCS1v15_SHA1:
@@ -848,22 +1073,21 @@ TPM_RESULT TPM_RSASign(unsigned char *signature,        /* output */
                                  signature_length,
                                  message,
                                  message_size,
-                                 &rsa_pri_key);
+                                 rsa_pri_key);
             break;
           case TPM_SS_RSASSAPKCS1v15_DER:
             rc = TPM_RSASignDER(signature,
                                 signature_length,
                                 message,
                                 message_size,
-                                &rsa_pri_key);
+                                rsa_pri_key);
             break;
           default:
-            printf("TPM_RSASign: Error, sigScheme %04hx unknown\n", sigScheme);
+            printf("TPM_RSASignToken: Error, sigScheme %04hx unknown\n", sigScheme);
             rc = TPM_INVALID_KEYUSAGE;
             break;
         }
     }
-    PORT_FreeArena(rsa_pri_key.arena, PR_TRUE);		/* @1 */
     return rc;
 }
 
@@ -1125,6 +1349,113 @@ TPM_RESULT TPM_RSAGetPrivateKey(uint32_t *qbytes, unsigned char **qarr,
     return rc;
 }
 
+/* TPM_RSAGetCRTParameters() calculates the Chinese Remainder Theorem parameters dP = d mod (p-1),
+   dQ = d mod (q-1), and qInv = q^-1 mod p from the prime factors p, q and the private exponent d.
+
+   The results are padded to the size of p.
+
+   'dparr', 'dqarr', 'qinvarr' must be freed by the caller.
+*/
+
+TPM_RESULT TPM_RSAGetCRTParameters(uint32_t *dpbytes, unsigned char **dparr,
+				   uint32_t *dqbytes, unsigned char **dqarr,
+				   uint32_t *qinvbytes, unsigned char **qinvarr,
+				   uint32_t pbytes, unsigned char *parr,
+				   uint32_t qbytes, unsigned char *qarr,
+				   uint32_t dbytes, unsigned char *darr)
+{
+    TPM_RESULT          rc = 0;
+    int			irc;
+    TPM_BIGNUM		p = NULL;	/* freed @1 */
+    TPM_BIGNUM		q = NULL;	/* freed @2 */
+    TPM_BIGNUM		d = NULL;	/* freed @3 */
+    TPM_BIGNUM		dp = NULL;	/* freed @4 */
+    TPM_BIGNUM		dq = NULL;	/* freed @5 */
+    TPM_BIGNUM		qinv = NULL;	/* freed @6 */
+    TPM_BIGNUM		r0 = NULL;	/* freed @7 */
+
+    /* set to NULL so caller can free after failure */
+    printf(" TPM_RSAGetCRTParameters:\n");
+    *dparr = NULL;
+    *dqarr = NULL;
+    *qinvarr = NULL;
+    /* check input parameters */
+    if (rc == 0) {
+        if ((parr == NULL) || (pbytes == 0) ||
+	    (qarr == NULL) || (qbytes == 0) ||
+	    (darr == NULL) || (dbytes == 0)) {
+            printf("TPM_RSAGetCRTParameters: Error, missing p, q, or d\n");
+            rc = TPM_BAD_PARAMETER;
+        }
+    }
+    /* convert p, q, d to bignums */
+    if (rc == 0) {
+        rc = TPM_bin2bn(&p, parr, pbytes);	/* freed @1 */
+    }
+    if (rc == 0) {
+        rc = TPM_bin2bn(&q, qarr, qbytes);	/* freed @2 */
+    }
+    if (rc == 0) {
+        rc = TPM_bin2bn(&d, darr, dbytes);	/* freed @3 */
+    }
+    if (rc == 0) {
+        rc = TPM_BN_new(&dp);			/* freed @4 */
+    }
+    if (rc == 0) {
+        rc = TPM_BN_new(&dq);			/* freed @5 */
+    }
+    if (rc == 0) {
+        rc = TPM_BN_new(&qinv);			/* freed @6 */
+    }
+    if (rc == 0) {
+        rc = TPM_BN_new(&r0);			/* freed @7 */
+    }
+    if (rc == 0) {
+	/* dP = d mod (p-1) */
+	mpz_sub_ui(*(mpz_t *)r0, *(mpz_t *)p, 1);
+	mpz_mod(*(mpz_t *)dp, *(mpz_t *)d, *(mpz_t *)r0);
+	/* dQ = d mod (q-1) */
+	mpz_sub_ui(*(mpz_t *)r0, *(mpz_t *)q, 1);
+	mpz_mod(*(mpz_t *)dq, *(mpz_t *)d, *(mpz_t *)r0);
+	/* qInv = multiplicative inverse q mod p */
+	irc = mpz_invert(*(mpz_t *)qinv, *(mpz_t *)q, *(mpz_t *)p);
+	if (irc == 0) {
+            printf("TPM_RSAGetCRTParameters: Error in mpz_invert()\n");
+            rc = TPM_BAD_PARAMETER;
+	}
+    }
+    /* get dP, dQ, qInv as arrays */
+    if (rc == 0) {
+        rc = TPM_bn2binMalloc(dparr, dpbytes, dp, pbytes);	/* freed by caller */
+    }
+    if (rc == 0) {
+        rc = TPM_bn2binMalloc(dqarr, dqbytes, dq, pbytes);	/* freed by caller */
+    }
+    if (rc == 0) {
+        rc = TPM_bn2binMalloc(qinvarr, qinvbytes, qinv, pbytes);	/* freed by caller */
+    }
+    if (rc == 0) {
+        printf("  TPM_RSAGetCRTParameters: length of dP,dQ,qInv = %u / %u / %u\n",
+               *dpbytes, *dqbytes, *qinvbytes);
+    }
+    if (rc != 0) {
+        free(*dparr);
+        free(*dqarr);
+        free(*qinvarr);
+        *dparr = NULL;
+        *dqarr = NULL;
+        *qinvarr = NULL;
+    }
+    TPM_BN_free(p);	/* @1 */
+    TPM_BN_free(q);	/* @2 */
+    TPM_BN_free(d);	/* @3 */
+    TPM_BN_free(dp);	/* @4 */
+    TPM_BN_free(dq);	/* @5 */
+    TPM_BN_free(qinv);	/* @6 */
+    TPM_BN_free(r0);	/* @7 */
+    return rc;
+}
+
 /*
   PKCS1 Padding Functions
 */
@@ -2043,6 +2374,22 @@ TPM_RESULT TPM_Sha1Context_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_Sha1Context_SizeOf() returns the number of bytes TPM_Sha1Context_Store() serializes */
+
+uint32_t TPM_Sha1Context_SizeOf(void *context)
+{
+    uint32_t 	size;
+
+    size = sizeof(TPM_BOOL);			/* contextPresent */
+    if (context != NULL) {
+	size += sizeof(uint16_t) +		/* tag */
+		64 +				/* u.b */
+		(2 * sizeof(uint32_t)) +	/* size */
+		(5 * sizeof(uint32_t));		/* H */
+    }
+    return size;
+}
+
 /*
   TPM_SYMMETRIC_KEY_DATA
 */
@@ -2058,7 +2405,8 @@ TPM_RESULT TPM_SymmetricKeyData_New(TPM_SYMMETRIC_KEY_TOKEN *tpm_symmetric_key_d
 
     printf(" TPM_SymmetricKeyData_New:\n");
     if (rc == 0) {
-	rc = TPM_Malloc(tpm_symmetric_key_data, sizeof(TPM_SYMMETRIC_KEY_DATA));
+	rc = TPM_Slab_Malloc(tpm_symmetric_key_data, TPM_SLAB_SYMMETRIC_KEY,
+			     sizeof(TPM_SYMMETRIC_KEY_DATA));
     }
     if (rc == 0) {
 	TPM_SymmetricKeyData_Init(*tpm_symmetric_key_data);
@@ -2075,7 +2423,7 @@ void TPM_SymmetricKeyData_Free(TPM_SYMMETRIC_KEY_TOKEN *tpm_symmetric_key_data)
     printf(" TPM_SymmetricKeyData_Free:\n");
     if (*tpm_symmetric_key_data != NULL) {
         TPM_SymmetricKeyData_Init(*tpm_symmetric_key_data);
-	free(*tpm_symmetric_key_data);
+	TPM_Slab_Free(*tpm_symmetric_key_data);
 	*tpm_symmetric_key_data = NULL;
     }
     return;
@@ -2168,6 +2516,19 @@ TPM_RESULT TPM_SymmetricKeyData_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_SymmetricKeyData_SizeOf() returns the number of bytes TPM_SymmetricKeyData_Store()
+   serializes */
+
+uint32_t TPM_SymmetricKeyData_SizeOf(const TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_token)
+{
+    TPM_SYMMETRIC_KEY_DATA *tpm_symmetric_key_data =
+	(TPM_SYMMETRIC_KEY_DATA *)tpm_symmetric_key_token;
+
+    return sizeof(uint16_t) +			/* tag */
+	(2 * sizeof(TPM_BOOL)) +		/* valid, fill */
+	sizeof(tpm_symmetric_key_data->userKey);
+}
+
 /* TPM_SymmetricKeyData_GenerateKey() is AES non-portable code to generate a random symmetric key
 
    tpm_symmetric_key_data should be initialized before and after use
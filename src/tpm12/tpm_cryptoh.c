@@ -43,8 +43,10 @@
 #include <stdarg.h>
 
 #include "tpm_admin.h"
+#include "tpm_arena.h"
 #include "tpm_auth.h"
 #include "tpm_crypto.h"
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_CRYPTO
 #include "tpm_debug.h"
 #include "tpm_digest.h"
 #include "tpm_error.h"
@@ -55,19 +57,37 @@
 #include "tpm_key.h"
 #include "tpm_pcr.h"
 #include "tpm_process.h"
+#include "tpm_sha1.h"
+#include "tpm_slab.h"
+#include "tpm_statistics.h"
 #include "tpm_store.h"
 #include "tpm_ver.h"
 
 #include "tpm_cryptoh.h"
 
+#define TPM_HMAC_BLOCK_SIZE 64
+
 /* local prototypes */
 
 static TPM_RESULT TPM_SHA1_valist(TPM_DIGEST md, 
-				  uint32_t length0, unsigned char *buffer0,
+				  const uint32_t *blockState,
 				  va_list ap);
+static TPM_RESULT TPM_SHA1_Continue(TPM_DIGEST md,
+				    const uint32_t *blockState,
+				    ...);
+static TPM_RESULT TPM_HmacState_Set(TPM_HMAC_STATE *tpm_hmac_state,
+				    const TPM_SECRET key);
+static TPM_RESULT TPM_HmacState_Pad(uint32_t *state,
+				    const unsigned char *pad);
 static TPM_RESULT TPM_HMAC_Generatevalist(TPM_HMAC hmac,
 					  const TPM_SECRET key,
+					  TPM_HMAC_STATE *tpm_hmac_state,
 					  va_list ap);
+static TPM_RESULT TPM_HMAC_Checkvalist(TPM_BOOL *valid,
+				       TPM_HMAC expect,
+				       const TPM_SECRET key,
+				       TPM_HMAC_STATE *tpm_hmac_state,
+				       va_list ap);
 
 static TPM_RESULT TPM_SHA1CompleteCommon(TPM_DIGEST hashValue,
 					 void **sha1_context,
@@ -320,7 +340,7 @@ void TPM_CertifyInfo_Delete(TPM_CERTIFY_INFO *tpm_certify_info)
 	TPM_SizedBuffer_Delete(&(tpm_certify_info->pcrInfo));
 	/* pcr cache */
 	TPM_PCRInfo_Delete(tpm_certify_info->tpm_pcr_info);
-	free(tpm_certify_info->tpm_pcr_info);
+	TPM_Slab_Free(tpm_certify_info->tpm_pcr_info);
 	TPM_CertifyInfo_Init(tpm_certify_info);
     }
     return;
@@ -562,7 +582,7 @@ void TPM_CertifyInfo2_Delete(TPM_CERTIFY_INFO2 *tpm_certify_info2)
 	TPM_SizedBuffer_Delete(&(tpm_certify_info2->pcrInfo));
 	/* pcr cache */
 	TPM_PCRInfoShort_Delete(tpm_certify_info2->tpm_pcr_info_short);
-	free(tpm_certify_info2->tpm_pcr_info_short);
+	TPM_Slab_Free(tpm_certify_info2->tpm_pcr_info_short);
 	TPM_SizedBuffer_Delete(&(tpm_certify_info2->migrationAuthority));
 	TPM_CertifyInfo2_Init(tpm_certify_info2);
     }
@@ -914,7 +934,7 @@ TPM_RESULT TPM_SHA1(TPM_DIGEST md, ...)
 
     printf(" TPM_SHA1:\n");
     va_start(ap, md);
-    rc = TPM_SHA1_valist(md, 0, NULL, ap);
+    rc = TPM_SHA1_valist(md, NULL, ap);
     va_end(ap);
     return rc;
 }
@@ -931,7 +951,7 @@ TPM_RESULT TPM_SHA1_Check(TPM_DIGEST digest_expect, ...)
     printf(" TPM_SHA1_Check:\n");
     if (rc == 0) {
 	va_start(ap, digest_expect);
-	rc = TPM_SHA1_valist(digest_actual, 0, NULL, ap);
+	rc = TPM_SHA1_valist(digest_actual, NULL, ap);
 	va_end(ap);
     }
     if (rc == 0) {
@@ -942,52 +962,61 @@ TPM_RESULT TPM_SHA1_Check(TPM_DIGEST digest_expect, ...)
 
 /* TPM_SHA1_valist() is the internal function, called with the va_list already created.
 
-   It is called from TPM_SHA1() to do a simple hash.  Typically length0==0 and buffer0==NULL.
+   It is called from TPM_SHA1() to do a simple hash.  Typically blockState is NULL.
 
    It can also be called from the HMAC function to hash the variable number of input parameters.  In
-   that case, the va_list for the text is already formed.  length0 and buffer0 are used to input the
-   padded key.
+   that case, the va_list for the text is already formed.  blockState is the SHA-1 chaining value
+   after the padded key block, from which the hash continues.
 */
 
 static TPM_RESULT TPM_SHA1_valist(TPM_DIGEST md,
-				  uint32_t length0, unsigned char *buffer0,
+				  const uint32_t *blockState,
 				  va_list ap)
 {
     TPM_RESULT		rc = 0;
     uint32_t		length;
     unsigned char	*buffer;
-    void		*context = NULL;	/* platform dependent context */
+    TPM_SHA1_CTX	context;		/* built-in engine, no allocation */
     TPM_BOOL		done = FALSE;
     
     printf(" TPM_SHA1_valist:\n");
-    if (rc == 0) {
-	rc = TPM_SHA1InitCmd(&context);
+    if (blockState == NULL) {
+	TPM_SHA1Ctx_Init(&context);
     }
-    if (rc == 0) {	
-	if (length0 !=0) {		/* optional first text block */
-	    printf("  TPM_SHA1_valist: Digesting %u bytes\n", length0);
-	    rc = TPM_SHA1UpdateCmd(context, buffer0, length0);	/* hash the buffer */
-	}
+    else {
+	TPM_SHA1Ctx_SetState(&context, blockState, TPM_HMAC_BLOCK_SIZE);
     }
-    while ((rc == 0) && !done) {
+    while (!done) {
 	length = va_arg(ap, uint32_t);		/* first vararg is the length */
 	if (length != 0) {			/* loop until a zero length argument terminates */
 	    buffer = va_arg(ap, unsigned char *);	/* second vararg is the array */
 	    printf("  TPM_SHA1_valist: Digesting %u bytes\n", length);
-	    rc = TPM_SHA1UpdateCmd(context, buffer, length);	/* hash the buffer */
+	    TPM_SHA1Ctx_Update(&context, buffer, length);	/* hash the buffer */
 	}
 	else {
 	    done = TRUE;
 	}
     }
-    if (rc == 0) {
-	rc = TPM_SHA1FinalCmd(md, context);
-    }
-    if (rc == 0) {
-	TPM_PrintFour("  TPM_SHA1_valist: Digest", md);
-    }	 
-    /* call TPM_SHA1Delete even if there was an error */
-    TPM_SHA1Delete(&context);
+    /* TPM_SHA1Ctx_Final() also clears the context */
+    TPM_SHA1Ctx_Final(md, &context);
+    TPM_PrintFour("  TPM_SHA1_valist: Digest", md);
+    return rc;
+}
+
+/* TPM_SHA1_Continue() hashes a list of streams, continuing from the chaining value 'blockState'
+   after one block.  The list is as for TPM_SHA1().
+*/
+
+static TPM_RESULT TPM_SHA1_Continue(TPM_DIGEST md,
+				    const uint32_t *blockState,
+				    ...)
+{
+    TPM_RESULT	rc = 0;
+    va_list	ap;
+
+    va_start(ap, blockState);
+    rc = TPM_SHA1_valist(md, blockState, ap);
+    va_end(ap);
     return rc;
 }
 
@@ -1066,7 +1095,28 @@ TPM_RESULT TPM_HMAC_Generate(TPM_HMAC tpm_hmac,
     
     printf(" TPM_HMAC_Generate:\n");
     va_start(ap, hmac_key);
-    rc = TPM_HMAC_Generatevalist(tpm_hmac, hmac_key, ap);
+    rc = TPM_HMAC_Generatevalist(tpm_hmac, hmac_key, NULL, ap);
+    va_end(ap);
+    return rc;
+}
+
+/* TPM_HMAC_GenerateState() is TPM_HMAC_Generate() with pad states cached in 'tpm_hmac_state'.
+
+   The cached states are used if they were computed for 'hmac_key'.  Otherwise they are computed
+   and replace the cached states.
+*/
+
+TPM_RESULT TPM_HMAC_GenerateState(TPM_HMAC tpm_hmac,
+				  const TPM_SECRET hmac_key,
+				  TPM_HMAC_STATE *tpm_hmac_state,
+				  ...)
+{
+    TPM_RESULT		rc = 0;
+    va_list		ap;
+    
+    printf(" TPM_HMAC_GenerateState:\n");
+    va_start(ap, tpm_hmac_state);
+    rc = TPM_HMAC_Generatevalist(tpm_hmac, hmac_key, tpm_hmac_state, ap);
     va_end(ap);
     return rc;
 }
@@ -1074,46 +1124,43 @@ TPM_RESULT TPM_HMAC_Generate(TPM_HMAC tpm_hmac,
 /* TPM_HMAC_Generatevalist() is the internal function, called with the va_list already created.
 
    It is called from TPM_HMAC_Generate() and TPM_HMAC_Check() with the va_list for the text already
-   formed.
+   formed.  If 'tpm_hmac_state' is NULL, the pad states are computed for this HMAC only.
 */
 
-#define TPM_HMAC_BLOCK_SIZE 64
-
 static TPM_RESULT TPM_HMAC_Generatevalist(TPM_HMAC tpm_hmac,
 					  const TPM_SECRET key,
+					  TPM_HMAC_STATE *tpm_hmac_state,
 					  va_list ap)
 {
     TPM_RESULT		rc = 0;
-    unsigned char	ipad[TPM_HMAC_BLOCK_SIZE];
-    unsigned char	opad[TPM_HMAC_BLOCK_SIZE];
-    size_t		i;
+    TPM_HMAC_STATE	localState;	/* if the caller does not cache the states */
     TPM_DIGEST		inner_hash;
 
     printf(" TPM_HMAC_Generatevalist:\n");
-    /* calculate key XOR ipad and key XOR opad */
+    TPM_HmacState_Init(&localState);
+    if (tpm_hmac_state == NULL) {
+	tpm_hmac_state = &localState;
+    }
+    /* get the states after key XOR ipad and key XOR opad */
+    if (rc == 0) {
+	rc = TPM_HmacState_Set(tpm_hmac_state, key);
+    }
+    /* calculate the inner hash, hash the key XOR ipad and the text */
     if (rc == 0) {
-	/* first part, key XOR pad */
-	for (i = 0 ; i < TPM_AUTHDATA_SIZE ; i++) {
-	    ipad[i] = key[i] ^ 0x36;	/* magic numbers from RFC 2104 */
-	    opad[i] = key[i] ^ 0x5c;
-	}
-	/* second part, 0x00 XOR pad */
-	memset(ipad + TPM_AUTHDATA_SIZE, 0x36, TPM_HMAC_BLOCK_SIZE - TPM_AUTHDATA_SIZE);
-	memset(opad + TPM_AUTHDATA_SIZE, 0x5c, TPM_HMAC_BLOCK_SIZE - TPM_AUTHDATA_SIZE);
-	/* calculate the inner hash, hash the key XOR ipad and the text */
 	rc = TPM_SHA1_valist(inner_hash,
-			     TPM_HMAC_BLOCK_SIZE, ipad, ap);
+			     tpm_hmac_state->innerState, ap);
     }
     /* hash the key XOR opad and the previous hash */
     if (rc == 0) {
-	rc = TPM_SHA1(tpm_hmac,
-		      TPM_HMAC_BLOCK_SIZE, opad,
-		      TPM_DIGEST_SIZE, inner_hash,
-		      0, NULL);
+	rc = TPM_SHA1_Continue(tpm_hmac,
+			       tpm_hmac_state->outerState,
+			       TPM_DIGEST_SIZE, inner_hash,
+			       0, NULL);
     }
     if (rc == 0) {
 	TPM_PrintFour(" TPM_HMAC_Generatevalist: HMAC", tpm_hmac);
     }	 
+    TPM_HmacState_Delete(&localState);
     return rc;
 }
 
@@ -1163,13 +1210,48 @@ TPM_RESULT TPM_HMAC_Check(TPM_BOOL *valid,
 {
     TPM_RESULT		rc = 0;
     va_list		ap;
-    TPM_HMAC		actual;
-    int			result;
 
     printf(" TPM_HMAC_Check:\n");
     va_start(ap, key);
+    rc = TPM_HMAC_Checkvalist(valid, expect, key, NULL, ap);
+    va_end(ap);
+    return rc;
+}
+
+/* TPM_HMAC_CheckState() is TPM_HMAC_Check() with pad states cached in 'tpm_hmac_state', see
+   TPM_HMAC_GenerateState().
+*/
+
+TPM_RESULT TPM_HMAC_CheckState(TPM_BOOL *valid,
+			       TPM_HMAC expect,
+			       const TPM_SECRET key,
+			       TPM_HMAC_STATE *tpm_hmac_state,
+			       ...)
+{
+    TPM_RESULT		rc = 0;
+    va_list		ap;
+
+    printf(" TPM_HMAC_CheckState:\n");
+    va_start(ap, tpm_hmac_state);
+    rc = TPM_HMAC_Checkvalist(valid, expect, key, tpm_hmac_state, ap);
+    va_end(ap);
+    return rc;
+}
+
+/* TPM_HMAC_Checkvalist() is the internal function, called with the va_list already created */
+
+static TPM_RESULT TPM_HMAC_Checkvalist(TPM_BOOL *valid,
+				       TPM_HMAC expect,
+				       const TPM_SECRET key,
+				       TPM_HMAC_STATE *tpm_hmac_state,
+				       va_list ap)
+{
+    TPM_RESULT		rc = 0;
+    TPM_HMAC		actual;
+    int			result;
+
     if (rc == 0) {
-	rc = TPM_HMAC_Generatevalist(actual, key, ap);
+	rc = TPM_HMAC_Generatevalist(actual, key, tpm_hmac_state, ap);
     }
     if (rc == 0) {
 	TPM_PrintFour("  TPM_HMAC_Check: Calculated", actual);
@@ -1182,7 +1264,6 @@ TPM_RESULT TPM_HMAC_Check(TPM_BOOL *valid,
 	    *valid = FALSE;
 	}
     }
-    va_end(ap);
     return rc;
 }
 
@@ -1236,6 +1317,92 @@ TPM_RESULT TPM_HMAC_CheckStructure(const TPM_SECRET hmac_key,
     return rc;
 }
 
+/*
+  TPM_HMAC_STATE
+*/
+
+/* TPM_HmacState_Init() initializes the structure without cached pad states */
+
+void TPM_HmacState_Init(TPM_HMAC_STATE *tpm_hmac_state)
+{
+    memset(tpm_hmac_state, 0, sizeof(TPM_HMAC_STATE));
+    tpm_hmac_state->valid = FALSE;
+    return;
+}
+
+/* TPM_HmacState_Delete() zeroes the cached key and pad states */
+
+void TPM_HmacState_Delete(TPM_HMAC_STATE *tpm_hmac_state)
+{
+    if (tpm_hmac_state != NULL) {
+	TPM_HmacState_Init(tpm_hmac_state);
+    }
+    return;
+}
+
+/* TPM_HmacState_Set() computes the states after the key XOR ipad and key XOR opad blocks, unless
+   they were already computed for 'key'.
+*/
+
+static TPM_RESULT TPM_HmacState_Set(TPM_HMAC_STATE *tpm_hmac_state,
+				    const TPM_SECRET key)
+{
+    TPM_RESULT		rc = 0;
+    TPM_BOOL		cached;
+    unsigned char	ipad[TPM_HMAC_BLOCK_SIZE];
+    unsigned char	opad[TPM_HMAC_BLOCK_SIZE];
+    size_t		i;
+
+    cached = tpm_hmac_state->valid &&
+	     (memcmp(tpm_hmac_state->key, key, TPM_SECRET_SIZE) == 0);
+    if (cached) {
+	printf("  TPM_HmacState_Set: Using cached pad states\n");
+    }
+    else {
+	TPM_HmacState_Delete(tpm_hmac_state);
+    }
+    /* calculate key XOR ipad and key XOR opad */
+    if ((rc == 0) && !cached) {
+	/* first part, key XOR pad */
+	for (i = 0 ; i < TPM_AUTHDATA_SIZE ; i++) {
+	    ipad[i] = key[i] ^ 0x36;	/* magic numbers from RFC 2104 */
+	    opad[i] = key[i] ^ 0x5c;
+	}
+	/* second part, 0x00 XOR pad */
+	memset(ipad + TPM_AUTHDATA_SIZE, 0x36, TPM_HMAC_BLOCK_SIZE - TPM_AUTHDATA_SIZE);
+	memset(opad + TPM_AUTHDATA_SIZE, 0x5c, TPM_HMAC_BLOCK_SIZE - TPM_AUTHDATA_SIZE);
+	rc = TPM_HmacState_Pad(tpm_hmac_state->innerState, ipad);
+    }
+    if ((rc == 0) && !cached) {
+	rc = TPM_HmacState_Pad(tpm_hmac_state->outerState, opad);
+    }
+    if ((rc == 0) && !cached) {
+	memcpy(tpm_hmac_state->key, key, TPM_SECRET_SIZE);
+	tpm_hmac_state->valid = TRUE;
+    }
+    if (rc != 0) {
+	TPM_HmacState_Delete(tpm_hmac_state);
+    }
+    memset(ipad, 0, TPM_HMAC_BLOCK_SIZE);
+    memset(opad, 0, TPM_HMAC_BLOCK_SIZE);
+    return rc;
+}
+
+/* TPM_HmacState_Pad() gets the SHA-1 chaining value 'state' after hashing the 'pad' block */
+
+static TPM_RESULT TPM_HmacState_Pad(uint32_t *state,
+				    const unsigned char *pad)
+{
+    TPM_RESULT		rc = 0;
+    TPM_SHA1_CTX	context;
+
+    TPM_SHA1Ctx_Init(&context);
+    TPM_SHA1Ctx_Update(&context, pad, TPM_HMAC_BLOCK_SIZE);
+    rc = TPM_SHA1Ctx_GetState(state, &context);
+    TPM_SHA1Ctx_Delete(&context);
+    return rc;
+}
+
 /* TPM_XOR XOR's 'in1' and 'in2' of 'length', putting the result in 'out'
 
 */
@@ -1294,8 +1461,12 @@ TPM_RESULT TPM_MGF1(unsigned char       *mask,
     uint32_t	        count;          /* counter as an integral type */
     uint32_t		outLen;
     TPM_DIGEST          lastDigest;     
+    TPM_SHA1_CTX	seedContext;	/* the hash of the seed, continued for each counter */
+    TPM_SHA1_CTX	context;
     
     printf(" TPM_MGF1: Output length %u\n", maskLen);
+    TPM_SHA1Ctx_Init(&seedContext);
+    TPM_SHA1Ctx_Update(&seedContext, mgfSeed, mgfSeedlen);
     if (rc == 0) {
         /* this is possible with arrayLen on a 64 bit architecture, comment to quiet beam */
         if ((maskLen / TPM_DIGEST_SIZE) > 0xffffffff) {        /*constant condition*/
@@ -1314,27 +1485,25 @@ TPM_RESULT TPM_MGF1(unsigned char       *mask,
 	memcpy(counter, &count_n, 4);
 	/* b.Concatenate the hash of the seed mgfSeed and C to the octet string T: */
 	/* T = T || Hash (mgfSeed || C) */
+	/* the seed is hashed once, each counter continues from there */
+	context = seedContext;
+	TPM_SHA1Ctx_Update(&context, counter, 4);
 	/* If the entire digest is needed for the mask */
 	if ((outLen + TPM_DIGEST_SIZE) < maskLen) {
-	    rc = TPM_SHA1(mask + outLen,
-			  mgfSeedlen, mgfSeed,
-			  4, counter,
-			  0, NULL);
+	    TPM_SHA1Ctx_Final(mask + outLen, &context);
 	    outLen += TPM_DIGEST_SIZE;
 	}
 	/* if the mask is not modulo TPM_DIGEST_SIZE, only part of the final digest is needed */
 	else {
 	    /* hash to a temporary digest variable */
-	    rc = TPM_SHA1(lastDigest,
-			  mgfSeedlen, mgfSeed,
-			  4, counter,
-			  0, NULL);
+	    TPM_SHA1Ctx_Final(lastDigest, &context);
 	    /* copy what's needed */
 	    memcpy(mask + outLen, lastDigest, maskLen - outLen);
 	    outLen = maskLen;           /* outLen = outLen + maskLen - outLen */
 	}
     }
     /* 4.Output the leading l octets of T as the octet string mask. */
+    TPM_SHA1Ctx_Delete(&seedContext);
     return rc;
 }
 
@@ -1343,7 +1512,8 @@ TPM_RESULT TPM_MGF1(unsigned char       *mask,
    Since the seed is a known length, it is passed in rather that extracted from the varargs.  If the
    seed length turns out to be wrong once the varargs are parsed, TPM_FAIL is returned.
 
-   'array' must be freed by the caller.
+   'array' is allocated from the per command arena and must be freed by the caller with
+   TPM_Arena_Free().
 */
 
 TPM_RESULT TPM_MGF1_GenerateArray(unsigned char **array,
@@ -1366,7 +1536,7 @@ TPM_RESULT TPM_MGF1_GenerateArray(unsigned char **array,
     va_start(ap, seedLen);
     /* allocate temporary memory for the seed */
     if (rc == 0) {
-	rc = TPM_Malloc(&seed, seedLen);
+	rc = TPM_Arena_Malloc(&seed, seedLen);
 	seedBuffer = seed;
 	seedLeft = seedLen;
     }
@@ -1399,7 +1569,7 @@ TPM_RESULT TPM_MGF1_GenerateArray(unsigned char **array,
     }
     /* allocate memory for the array */
     if (rc == 0) {
-	rc = TPM_Malloc(array, arrayLen);
+	rc = TPM_Arena_Malloc(array, arrayLen);
     }
     /* generate the MGF1 array */
     if (rc == 0) {
@@ -1410,7 +1580,7 @@ TPM_RESULT TPM_MGF1_GenerateArray(unsigned char **array,
 	TPM_PrintFour("  TPM_MGF1_GenerateArray: MGF1", *array);
     }
     va_end(ap);
-    free(seed);		/* @1 */
+    TPM_Arena_Free(seed);	/* @1 */
     return rc;
 }
 
@@ -1542,6 +1712,9 @@ TPM_RESULT TPM_2bin2bn(TPM_BIGNUM *bignum_in,         /* freed by caller */
 
 /* TPM_RSAPrivateDecryptMalloc() allocates a buffer 'decrypt_data' of size 'decrypt_data_size'
    and then calls TPM_RSAPrivateDecryptH().
+
+   The buffer is allocated from the per command arena and must be freed by the caller with
+   TPM_Arena_Free().
 */
 
 TPM_RESULT TPM_RSAPrivateDecryptMalloc(unsigned char **decrypt_data,	/* decrypted data */
@@ -1557,7 +1730,7 @@ TPM_RESULT TPM_RSAPrivateDecryptMalloc(unsigned char **decrypt_data,	/* decrypte
     printf(" TPM_RSAPrivateDecryptMalloc: Return max data size %u bytes\n",
 	   tpm_key->pubKey.size);
     if (rc == 0) {
-	rc = TPM_Malloc(decrypt_data, tpm_key->pubKey.size);
+	rc = TPM_Arena_Malloc(decrypt_data, tpm_key->pubKey.size);
     }
     if (rc == 0) {
 	rc = TPM_RSAPrivateDecryptH(*decrypt_data,
@@ -1587,10 +1760,8 @@ TPM_RESULT TPM_RSAPrivateDecryptH(unsigned char *decrypt_data,	/* decrypted data
     TPM_RESULT		rc = 0;
     unsigned char	*narr;		/* public modulus */
     uint32_t		nbytes;
-    unsigned char	*earr;		/* public exponent */
-    uint32_t		ebytes;
-    unsigned char	*darr;		/* private exponent */
-    uint32_t		dbytes;
+    TPM_RSA_KEY_TOKEN	rsa_key_token;	/* cached in the TPM_KEY */
+    uint64_t		startTime;
 
     printf(" TPM_RSAPrivateDecryptH: Data size %u bytes\n", encrypt_data_size);
     TPM_PrintFour("  TPM_RSAPrivateDecryptH: Encrypt data", encrypt_data);
@@ -1604,14 +1775,6 @@ TPM_RESULT TPM_RSAPrivateDecryptH(unsigned char *decrypt_data,	/* decrypted data
     if (rc == 0) {
 	rc = TPM_Key_GetPublicKey(&nbytes, &narr, tpm_key);
     }	
-    /* extract the private key from TPM_KEY */
-    if (rc == 0) {
-	rc = TPM_Key_GetPrivateKey(&dbytes, &darr, tpm_key);
-    }
-    /* extract the exponent from TPM_KEY */
-    if (rc == 0) {
-	rc = TPM_Key_GetExponent(&ebytes, &earr, tpm_key);
-    }
     /* check the key size vs the data size */
     if (rc == 0) {
 	if (encrypt_data_size > nbytes) {
@@ -1620,26 +1783,25 @@ TPM_RESULT TPM_RSAPrivateDecryptH(unsigned char *decrypt_data,	/* decrypted data
 	    rc = TPM_BAD_DATASIZE;
 	}
     }
+    /* get the private key token, constructing it on first use */
+    if (rc == 0) {
+	rc = TPM_Key_GetRSAKeyToken(&rsa_key_token, tpm_key);
+    }
     if (rc == 0) {
 	/* debug printing */
 	printf("  TPM_RSAPrivateDecryptH: Public key length %u\n", nbytes);
-	printf("  TPM_RSAPrivateDecryptH: Private key length %u\n", dbytes);
 	TPM_PrintFour("  TPM_RSAPrivateDecryptH: Public key", narr);
-	printf("  TPM_RSAPrivateDecryptH: Exponent %02x %02x %02x\n", earr[0], earr[1], earr[2]);
-	TPM_PrintFour("  TPM_RSAPrivateDecryptH: Private key", darr);
 	/* decrypt with private key */
-	rc = TPM_RSAPrivateDecrypt(decrypt_data,	/* decrypted data */
-				   decrypt_data_length, /* length of data put into decrypt_data */
-				   decrypt_data_size,	/* size of decrypt_data buffer */
-				   tpm_key->algorithmParms.encScheme,	/* encryption scheme */
-				   encrypt_data,	/* encrypted data */
-				   encrypt_data_size,
-				   narr,		/* public modulus */
-				   nbytes,
-				   earr,		/* public exponent */
-				   ebytes,
-				   darr,		/* private exponent */
-				   dbytes);
+	TPM_Statistics_StartTimer(&startTime);
+	rc = TPM_RSAPrivateDecryptToken(decrypt_data,	/* decrypted data */
+					decrypt_data_length, /* length of data put into
+								decrypt_data */
+					decrypt_data_size,	/* size of decrypt_data buffer */
+					tpm_key->algorithmParms.encScheme,	/* encryption scheme */
+					encrypt_data,	/* encrypted data */
+					encrypt_data_size,
+					rsa_key_token);	/* private key token */
+	TPM_Statistics_StopTimer(startTime, TPM_STATISTICS_RSA);
     }
     if (rc == 0) {
 	TPM_PrintFour(" TPM_RSAPrivateDecryptH: Decrypt data", decrypt_data);
@@ -1889,45 +2051,26 @@ TPM_RESULT TPM_RSASignH(unsigned char *signature,		/* output */
 			TPM_KEY *tpm_key)		/* input, signing key */
 {
     TPM_RESULT		rc = 0;
-    unsigned char	*narr;		 /* public modulus */
-    uint32_t		nbytes;
-    unsigned char	*earr;		 /* public exponent */
-    uint32_t		ebytes;
-    unsigned char	*darr;		/* private exponent */
-    uint32_t		dbytes;
+    TPM_RSA_KEY_TOKEN	rsa_key_token;	/* cached in the TPM_KEY */
+    uint64_t		startTime;
     
     printf(" TPM_RSASignH: Message size %lu bytes\n", (unsigned long)message_size);
     TPM_PrintFour("  TPM_RSASignH: Message", message);
-    /* extract the public key from TPM_KEY */
-    if (rc == 0) {
-	rc = TPM_Key_GetPublicKey(&nbytes, &narr, tpm_key);
-    }	
-    /* extract the private key from TPM_KEY */
-    if (rc == 0) {
-	rc = TPM_Key_GetPrivateKey(&dbytes, &darr, tpm_key);
-    }
-    /* extract the exponent from TPM_KEY */
+    /* get the private key token, constructing it on first use */
     if (rc == 0) {
-	rc = TPM_Key_GetExponent(&ebytes, &earr, tpm_key);
+	rc = TPM_Key_GetRSAKeyToken(&rsa_key_token, tpm_key);
     }
     if (rc == 0) {
-	/* debug printing */
-	TPM_PrintFour("  TPM_RSASignH: Public key", narr);
-	printf("  TPM_RSASignH: Exponent %02x %02x %02x\n", earr[0], earr[1], earr[2]);
-	TPM_PrintFour("  TPM_RSASignH: Private key", darr);
 	/* sign with private key */
-	rc = TPM_RSASign(signature,		/* output */
-			 signature_length,	/* output, size of signature */
-			 signature_size,	/* input, size of signature buffer */
-			 tpm_key->algorithmParms.sigScheme,	/* input, type of signature */
-			 message,	/* input */
-			 message_size,	/* input */
-			 narr,		/* public modulus */
-			 nbytes,
-			 earr,		/* public exponent */
-			 ebytes,
-			 darr,		/* private exponent */
-			 dbytes);
+	TPM_Statistics_StartTimer(&startTime);
+	rc = TPM_RSASignToken(signature,		/* output */
+			      signature_length,	/* output, size of signature */
+			      signature_size,	/* input, size of signature buffer */
+			      tpm_key->algorithmParms.sigScheme,	/* input, type of signature */
+			      message,	/* input */
+			      message_size,	/* input */
+			      rsa_key_token);	/* private key token */
+	TPM_Statistics_StopTimer(startTime, TPM_STATISTICS_RSA);
     }
     if (rc == 0) {
 	TPM_PrintFour("  TPM_RSASignH: Signature", signature);
@@ -2295,7 +2438,161 @@ TPM_RESULT TPM_RSA_exponent_verify(unsigned long exponent)
     return rc;
 }
 
-/* SHA1 and HMAC test driver
+/* RSA known answer test key, 2048 bits, public exponent 65537.  The key was generated for this
+   self test only and protects nothing.
+
+   tpm_rsa_test_sig is the PKCS #1 v1.5 SHA-1 signature of the TPM_CryptoTest() expect1 digest.
+*/
+
+static unsigned char tpm_rsa_test_n[] = {
+    0xba,0x54,0xb9,0x2c,0x27,0x24,0x0d,0x95,0xa5,0x84,0x63,0x4a,
+    0x9b,0xbe,0x5c,0xd3,0x96,0xc4,0xad,0x7a,0xec,0xf3,0xb7,0x8b,
+    0xb9,0x49,0x91,0x95,0x31,0xda,0xa3,0x80,0xa9,0xee,0x1f,0xdb,
+    0x63,0x2f,0x01,0xd5,0x9f,0x57,0x2d,0x7e,0x36,0x2e,0xf7,0x4f,
+    0x06,0x99,0x4f,0xbe,0xf2,0x3f,0xf0,0xe8,0x96,0x4d,0xd9,0xbd,
+    0x63,0xc8,0x2d,0x01,0xa6,0xbf,0x66,0x04,0x05,0xb8,0x61,0xb7,
+    0x1c,0x1e,0x63,0x11,0x6f,0x5d,0xa8,0x82,0x80,0xab,0x47,0xbd,
+    0xcb,0xcd,0xfe,0x78,0x6c,0x46,0x4d,0x2e,0x96,0x9a,0xb9,0x80,
+    0xf4,0x7e,0x0c,0xb3,0x89,0x67,0x65,0xc7,0xdf,0xe1,0x47,0x4e,
+    0x1b,0xae,0x3a,0xa9,0xa6,0xa1,0x43,0x80,0x93,0xaa,0xba,0x67,
+    0x9c,0xff,0xf8,0x5a,0x61,0x60,0xe3,0xfb,0xbd,0x85,0xcc,0xc8,
+    0xc6,0xf2,0x83,0xc7,0xa5,0xeb,0x8e,0xba,0xc3,0x96,0xbd,0xef,
+    0x46,0xaa,0x0b,0xe7,0x2e,0xf7,0xe1,0x2a,0x94,0x19,0xd0,0x8a,
+    0x25,0x88,0xe3,0x4b,0x68,0x8a,0x4e,0x80,0x4c,0x69,0x8e,0xab,
+    0xaf,0x09,0xcb,0x1d,0xae,0xd6,0x85,0x5e,0x37,0xab,0x6c,0xcb,
+    0x85,0x3d,0xa2,0x65,0xb0,0x5b,0xe5,0xe8,0xd4,0xb5,0x0c,0x2e,
+    0xad,0x13,0x60,0x82,0x16,0xdb,0x04,0xad,0x87,0x60,0xb8,0x3b,
+    0x78,0x37,0xc1,0xa8,0xf0,0x00,0xaf,0x43,0xab,0x91,0x11,0xf9,
+    0xa3,0xa3,0x3e,0x17,0x22,0x69,0xaa,0x8e,0x80,0x74,0x7f,0x48,
+    0x50,0x6f,0x95,0xd8,0xe2,0x81,0x79,0xe1,0x6d,0x9c,0xa7,0x01,
+    0xfc,0x2d,0xe2,0xd1,0x20,0x44,0x42,0xe7,0x11,0x85,0x85,0xee,
+    0x9a,0xb9,0x07,0xf3
+};
+
+static unsigned char tpm_rsa_test_d[] = {
+    0x25,0x6d,0x57,0x34,0x93,0x38,0x1e,0xb2,0x6c,0x68,0xc7,0x38,
+    0xf9,0x47,0xa7,0x85,0xa8,0xc7,0x20,0xc1,0x8c,0x4e,0xf8,0x13,
+    0x4c,0xc8,0x86,0x41,0x9d,0x9d,0xf9,0x31,0xa2,0xf0,0x7d,0xdd,
+    0xa7,0x72,0x8d,0xbf,0xc7,0x1d,0xcf,0xb9,0x86,0x50,0xb0,0xc4,
+    0x62,0xe2,0xf0,0xad,0xbe,0x23,0x31,0xd4,0xc6,0x3c,0x24,0xfc,
+    0x71,0xca,0x87,0x9f,0xc9,0x4a,0xb0,0xc7,0x26,0x0e,0xff,0x31,
+    0xb4,0xa8,0x35,0xe6,0x0e,0xa4,0x95,0x70,0x81,0x3f,0xe6,0x4d,
+    0x2d,0x5e,0xd7,0x3a,0x81,0x25,0x2d,0xe3,0xa9,0xc4,0xb2,0x76,
+    0x40,0xa6,0x01,0x0f,0x1f,0x0e,0x71,0xd7,0x50,0x15,0x04,0x29,
+    0xa0,0x4d,0xc2,0xe2,0xc8,0xe1,0xa3,0x99,0x74,0x0f,0xdb,0x19,
+    0x6c,0xe3,0xcd,0x92,0xf9,0xf4,0x68,0x56,0x94,0xda,0x16,0xcd,
+    0x6d,0xa6,0x52,0x94,0xe9,0x2f,0xe4,0x02,0xec,0xe0,0xc4,0x47,
+    0x27,0x50,0x65,0x78,0xe8,0x72,0xb5,0xef,0xf5,0x0d,0xe1,0xcd,
+    0xfa,0xc4,0x12,0x8d,0x47,0x4e,0x76,0xa8,0xa6,0x5d,0x6b,0x4f,
+    0x57,0x13,0x20,0x10,0xf5,0x37,0x7d,0xb1,0xec,0xd5,0x9f,0x18,
+    0xcf,0x34,0xc6,0xab,0xa6,0x7d,0x6d,0xce,0x91,0x75,0x04,0x83,
+    0xf6,0x6d,0xef,0x6d,0x7d,0x6a,0x76,0x1e,0x57,0x9f,0xb2,0x4e,
+    0x24,0xc0,0x86,0x63,0x73,0xaa,0xef,0x08,0xe3,0xe4,0x9d,0x95,
+    0xdc,0xda,0x3b,0x89,0x4d,0xf1,0x13,0x39,0xfb,0xa9,0xb3,0xf5,
+    0x32,0x46,0x05,0xc4,0xdc,0x11,0xbe,0xce,0x43,0x4a,0x3b,0x35,
+    0x4d,0x63,0x2d,0x70,0x0b,0xf6,0x07,0x8b,0x9a,0x29,0xd8,0xb4,
+    0x8b,0x2a,0x7e,0xe1
+};
+
+static unsigned char tpm_rsa_test_p[] = {
+    0xe0,0x10,0xf8,0x70,0xf2,0xcf,0x73,0xeb,0x8e,0x75,0x60,0x1e,
+    0x00,0x07,0xa7,0x84,0xe2,0x4f,0xe9,0xf2,0xf9,0x96,0x12,0xe3,
+    0x6e,0x7b,0x42,0x95,0x6e,0xce,0x69,0x98,0x8b,0xd0,0x91,0x4b,
+    0x16,0xbd,0xed,0x42,0xe2,0xe6,0x9f,0x27,0xba,0x2f,0xf8,0x16,
+    0xb3,0x0d,0x30,0x01,0xd3,0x85,0x6d,0x0e,0xb9,0xd2,0x92,0x23,
+    0xc8,0x88,0x31,0x26,0x4a,0x15,0x10,0x36,0x0b,0xee,0x2a,0xdd,
+    0xdd,0xb8,0x67,0x47,0xd9,0x15,0x66,0x4d,0x8c,0xe1,0x00,0xf9,
+    0x2e,0x2d,0x15,0xfa,0xcf,0x6c,0x9f,0x66,0x57,0x7d,0xc3,0x9d,
+    0x6b,0x80,0xea,0xe0,0xd7,0x44,0xff,0xb8,0x02,0x36,0x42,0xcd,
+    0x74,0xf2,0xb0,0x92,0xe7,0x5f,0xf7,0x12,0x6d,0x5f,0xf0,0xde,
+    0x74,0xe7,0xc3,0x64,0xb3,0x00,0xd5,0x5f
+};
+
+static unsigned char tpm_rsa_test_q[] = {
+    0xd4,0xe2,0xfb,0xde,0x64,0x98,0x0c,0xeb,0x2f,0xdf,0x18,0x3b,
+    0x83,0x00,0x3f,0x19,0xa7,0xf5,0x61,0xca,0xdd,0xa5,0x0b,0xc1,
+    0x9a,0xcf,0x59,0x87,0x90,0xf6,0x1c,0xf3,0x00,0x47,0x96,0x05,
+    0x1d,0xe7,0xa6,0x73,0x68,0x71,0x71,0x6c,0x7a,0xbf,0x8a,0xfe,
+    0xf8,0x73,0xff,0xfc,0xfd,0x4c,0x6f,0x84,0x4a,0x72,0xd7,0x3b,
+    0x38,0xc1,0x78,0x4d,0x04,0x22,0x0f,0x5a,0xf6,0x28,0x22,0x5f,
+    0x25,0xc4,0x70,0x1b,0xdb,0x36,0x5d,0x75,0x2c,0x3c,0xa4,0xa6,
+    0x11,0x28,0x86,0x90,0xb6,0x2f,0x74,0xb1,0xb2,0x87,0x10,0xf7,
+    0x2b,0xbf,0xdb,0xad,0xe7,0xdf,0xad,0x05,0x11,0xf3,0x1a,0x73,
+    0xb0,0x00,0x1a,0x61,0x88,0xda,0xc7,0x5a,0xf2,0x8f,0x4e,0xd0,
+    0x06,0xd8,0xaa,0xd8,0x3d,0x75,0xe1,0xed
+};
+
+static unsigned char tpm_rsa_test_dp[] = {
+    0x22,0x64,0xf8,0x7d,0xfe,0x07,0xb2,0x37,0x9a,0x6a,0x92,0x12,
+    0x88,0xd6,0xa3,0xf4,0x55,0xf9,0x06,0x64,0x71,0xc3,0x83,0xaa,
+    0xbd,0xae,0xd6,0x0d,0xb2,0x30,0xa5,0x2c,0xf1,0x69,0x56,0xa4,
+    0x3c,0x1d,0x73,0x6a,0x2d,0x02,0x51,0xb3,0xfb,0x74,0x99,0x94,
+    0x82,0x6f,0xa7,0xca,0xdf,0xf9,0x3f,0x40,0x5f,0x6d,0xdf,0x58,
+    0xf6,0xd3,0x51,0x18,0x1b,0x8f,0x18,0x29,0xf3,0xb2,0xdf,0x89,
+    0xa7,0x1b,0x43,0x5f,0x58,0x07,0x5c,0xe8,0xd2,0x93,0x47,0x5e,
+    0xf8,0xa3,0x9b,0x18,0x20,0xf6,0xff,0x90,0xea,0x25,0x37,0xfd,
+    0xd6,0x1e,0xb7,0xef,0x43,0x9c,0x27,0xd4,0xcb,0x22,0x21,0x27,
+    0x00,0xa8,0xb0,0x4a,0x1c,0x92,0x32,0x8e,0xf5,0x93,0x20,0x9a,
+    0x45,0x3f,0xbe,0x52,0x9a,0xd7,0xa9,0xe9
+};
+
+static unsigned char tpm_rsa_test_dq[] = {
+    0x24,0xa5,0xd6,0x9a,0x18,0x53,0x1c,0x96,0x38,0x2d,0x7d,0xac,
+    0x71,0x06,0xcf,0xd6,0x08,0xd5,0xf3,0x39,0xcb,0x22,0x28,0x7d,
+    0xf1,0xba,0x94,0x3d,0x04,0x35,0x7a,0x12,0x53,0x0f,0xff,0xc1,
+    0x6d,0xbe,0x7d,0x27,0x0c,0xe9,0xca,0x8e,0xd4,0x2a,0xb9,0x30,
+    0xdf,0x70,0x88,0xb6,0xf2,0x9b,0xff,0xee,0x94,0x2a,0x64,0xe6,
+    0xeb,0x04,0x53,0x43,0x5e,0xdc,0xc6,0x2b,0xf0,0x88,0x44,0x32,
+    0x80,0xfb,0xea,0x18,0xc1,0x8a,0x00,0x58,0xb5,0x7e,0xd3,0x11,
+    0x4b,0x8e,0xe0,0x6b,0x75,0x11,0x82,0x53,0x3c,0xda,0x87,0x8f,
+    0x25,0x56,0xe7,0xe8,0x6e,0x2c,0x51,0x4a,0xb8,0x26,0x53,0x7d,
+    0x6a,0xe4,0xf9,0xa5,0xa4,0xbb,0x94,0xea,0x11,0x2b,0x9e,0x73,
+    0xad,0x5a,0x0b,0x3f,0x22,0x85,0x72,0x99
+};
+
+static unsigned char tpm_rsa_test_qinv[] = {
+    0x82,0x32,0xf5,0x73,0xbf,0x35,0x24,0x8a,0xca,0xa1,0xe5,0xa3,
+    0x80,0x65,0xe5,0x82,0x36,0x29,0x8d,0xb6,0xb7,0x60,0x93,0xb5,
+    0x2e,0x24,0x85,0x8a,0xd1,0x87,0xf7,0xd2,0xb6,0xdf,0xf1,0x3f,
+    0x17,0x5c,0xcb,0x05,0x53,0xd5,0x18,0x39,0xa7,0xa1,0x7d,0x34,
+    0xc4,0x3e,0x86,0x2d,0x61,0x88,0xe3,0x7b,0x56,0x55,0x8f,0x30,
+    0x98,0xd3,0x89,0x9c,0x1b,0x63,0xc3,0xb0,0x93,0x01,0x73,0x1d,
+    0x81,0xa1,0x6d,0x97,0x3b,0xe9,0x1c,0xc5,0xc9,0xd1,0x18,0x27,
+    0x04,0xf6,0x9e,0x76,0x50,0x41,0x12,0x7c,0x4f,0x6d,0xd8,0xfb,
+    0xab,0x6a,0xf1,0x72,0x87,0x94,0xa7,0xc2,0xb6,0xed,0x89,0x8f,
+    0xb4,0x73,0x23,0x4d,0x13,0xb4,0xfb,0x7d,0xef,0x14,0x88,0xf9,
+    0xea,0xe6,0xad,0x80,0x16,0x9a,0x4e,0x1b
+};
+
+static unsigned char tpm_rsa_test_sig[] = {
+    0x3d,0xc5,0x85,0x4a,0x96,0x97,0xa7,0xa0,0x0d,0xbb,0xc8,0x86,
+    0x19,0x5c,0xe5,0xe4,0x3e,0x37,0x44,0xc6,0x34,0x04,0x59,0x12,
+    0x02,0x21,0xf0,0x23,0x9d,0xf3,0xa0,0x49,0xdb,0x5a,0xe8,0x8a,
+    0xee,0x32,0x3c,0x69,0x96,0x6b,0x6c,0xcb,0x45,0x1b,0xf0,0x24,
+    0xc3,0x3f,0xe9,0xb7,0xc3,0x69,0x8a,0xd4,0xba,0xc2,0x1b,0x5f,
+    0xe2,0x1d,0xc3,0xda,0x89,0xcc,0x11,0x9c,0xfa,0x0a,0x3e,0x8b,
+    0x94,0x2f,0x58,0x9b,0x8f,0xb2,0x8c,0x77,0xb3,0x7b,0xa3,0x9b,
+    0xf2,0x14,0x1c,0xaa,0x40,0x5e,0x09,0xcb,0x8f,0x68,0x78,0xd3,
+    0x35,0xc4,0x75,0xda,0x73,0x5e,0xd9,0x41,0xbb,0xe8,0x8c,0x06,
+    0xc3,0x59,0xab,0x20,0xe9,0xf2,0x53,0x31,0x87,0x39,0x1b,0xa1,
+    0x8d,0x5d,0x01,0x34,0xd1,0x4d,0x76,0x9f,0x91,0xcf,0x99,0xab,
+    0x59,0x5f,0x93,0x2d,0x96,0xd9,0x02,0x41,0x59,0x53,0x0c,0xee,
+    0x95,0x6e,0xfc,0xb9,0x93,0x96,0xd2,0x2f,0xe9,0x85,0xe9,0x42,
+    0x8c,0xe3,0x84,0x67,0x99,0x49,0x53,0x7c,0x68,0xab,0xbd,0x5a,
+    0x40,0xfc,0x2d,0xa3,0xb9,0x6f,0x93,0xfd,0x1a,0xbf,0x6f,0x5e,
+    0x88,0xd4,0x18,0x69,0x46,0x90,0x85,0xc5,0x8c,0x61,0x53,0xa9,
+    0x09,0xc4,0xfe,0x2f,0x71,0x92,0x16,0x7b,0xd8,0xbc,0x9b,0xc9,
+    0x3f,0xa4,0xa9,0x7a,0x50,0xca,0x3b,0x70,0x1a,0xb8,0x6f,0x23,
+    0xe5,0x8d,0x18,0x37,0xf6,0x4f,0x79,0x09,0x15,0x07,0xb9,0x30,
+    0xa4,0x7d,0x07,0x9e,0x79,0x29,0x86,0x91,0xbc,0xc7,0xdd,0x98,
+    0xc9,0xd4,0x95,0x3f,0xb8,0x5c,0xb1,0x58,0x8b,0x3d,0x52,0x19,
+    0x37,0x03,0xda,0x44
+};
+
+/* SHA1, HMAC, symmetric and RSA test driver
+
+   The RSA tests use the fixed tpm_rsa_test key so that startup does not pay for a key generation.
+   See TPM_CryptoTestKeyGen().
 
    Returns TPM_FAILEDSELFTEST on error
 */
@@ -2337,7 +2634,7 @@ TPM_RESULT TPM_CryptoTest(void)
     uint32_t	  oeap_length;
 
     /* symmetric key with pad */
-    TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_data = NULL;	/* opaque structure, freed @7 */
+    TPM_SYMMETRIC_KEY_TOKEN tpm_symmetric_key_data = NULL;	/* opaque structure, freed @3 */
     unsigned char	clrStream[64];	/* expected */
     unsigned char	*encStream;	/* encrypted */
     uint32_t		encSize;
@@ -2352,20 +2649,18 @@ TPM_RESULT TPM_CryptoTest(void)
     TPM_ENCAUTH		symDec;
     
     /* RSA encrypt and decrypt, sign and verify */
-    unsigned char *n;		/* public key - modulus */
-    unsigned char *p;		/* private key prime */
-    unsigned char *q;		/* private key prime */
-    unsigned char *d;		/* private key (private exponent) */
     unsigned char encrypt_data[2048/8];		/* encrypted data */
+    unsigned char signature[2048/8];		/* signature */
+    unsigned int  signature_length;
     
     printf(" TPM_CryptoTest:\n");
     encStream = NULL;		/* freed @1 */
     decStream = NULL;		/* freed @2 */
-    n = NULL;			/* freed @3 */
-    p = NULL;			/* freed @4 */
-    q = NULL;			/* freed @5 */
-    d = NULL;			/* freed @6 */
     
+    if (rc == 0) {
+	printf(" TPM_CryptoTest: Test 0 - SHA1 engine\n");
+	rc = TPM_SHA1Ctx_Test();
+    }
     if (rc == 0) {
 	printf(" TPM_CryptoTest: Test 1 - SHA1 one part\n");
 	rc = TPM_SHA1(actual,
@@ -2504,7 +2799,7 @@ TPM_RESULT TPM_CryptoTest(void)
     if (rc == 0) {
 	printf(" TPM_CryptoTest: Test 6 - Symmetric key with PKCS pad test\n");
 	/* allocate memory for the key token */
-	rc = TPM_SymmetricKeyData_New(&tpm_symmetric_key_data);	/* freed @7 */
+	rc = TPM_SymmetricKeyData_New(&tpm_symmetric_key_data);	/* freed @3 */
     }
     /* generate a key */
     if (rc == 0) {
@@ -2627,27 +2922,69 @@ TPM_RESULT TPM_CryptoTest(void)
 	    TPM_PrintFour("\tdecrypted stream", symDec);
 	}
     }
-    /* RSA OAEP encrypt and decrypt */
+    /* RSA known answer signature */
+    if (rc == 0) {
+	printf(" TPM_CryptoTest: Test 9 - RSA known answer signature, CRT sign\n");
+	rc = TPM_RSASign(signature,			/* output */
+			 &signature_length,		/* output, size of signature */
+			 sizeof(signature),		/* input, size of signature buffer */
+			 TPM_SS_RSASSAPKCS1v15_SHA1,	/* input, type of signature */
+			 expect1,			/* input */
+			 sizeof(expect1),		/* input */
+			 tpm_rsa_test_n,		/* public modulus */
+			 sizeof(tpm_rsa_test_n),
+			 tpm_default_rsa_exponent,	/* public exponent */
+			 3,
+			 tpm_rsa_test_d,		/* private exponent */
+			 sizeof(tpm_rsa_test_d),
+			 tpm_rsa_test_p,		/* CRT parameters */
+			 sizeof(tpm_rsa_test_p),
+			 tpm_rsa_test_q,
+			 sizeof(tpm_rsa_test_q),
+			 tpm_rsa_test_dp,
+			 sizeof(tpm_rsa_test_dp),
+			 tpm_rsa_test_dq,
+			 sizeof(tpm_rsa_test_dq),
+			 tpm_rsa_test_qinv,
+			 sizeof(tpm_rsa_test_qinv));
+    }
+    if (rc == 0) {
+	if (signature_length != sizeof(tpm_rsa_test_sig)) {
+	    printf("TPM_CryptoTest: Error in test 9, expect length %lu, actual length %u\n",
+		   (unsigned long)sizeof(tpm_rsa_test_sig), signature_length);
+	    rc = TPM_FAILEDSELFTEST;
+	}
+    }
     if (rc == 0) {
-	printf(" TPM_CryptoTest: Test 9 - RSA encrypt with OAEP padding\n");
-	/* generate a key */
-	rc = TPM_RSAGenerateKeyPair(&n,				/* public key - modulus */
-				    &p,				/* private key prime */
-				    &q,				/* private key prime */
-				    &d,				/* private key (private exponent) */
-				    2048,			/* key size in bits */
-				    tpm_default_rsa_exponent,	/* public exponent as an array */
-				    3);
+	not_equal = memcmp(tpm_rsa_test_sig, signature, sizeof(tpm_rsa_test_sig));
+	if (not_equal) {
+	    printf("TPM_CryptoTest: Error in test 9\n");
+	    TPM_PrintFour("\texpect", tpm_rsa_test_sig);
+	    TPM_PrintFour("\tactual", signature);
+	    rc = TPM_FAILEDSELFTEST;
+	}
     }
-    /* encrypt */
+    /* verify */
+    if (rc == 0) {
+	rc = TPM_RSAVerifySHA1(signature,		/* input */
+			       signature_length,	/* input, size of signature buffer */
+			       expect1,			/* input */
+			       sizeof(expect1),		/* input */
+			       tpm_rsa_test_n,		/* public modulus */
+			       sizeof(tpm_rsa_test_n),
+			       tpm_default_rsa_exponent,	/* public exponent */
+			       3);
+    }
+    /* RSA OAEP encrypt and decrypt */
     if (rc == 0) {
+	printf(" TPM_CryptoTest: Test 10 - RSA encrypt with OAEP padding, CRT decrypt\n");
 	rc = TPM_RSAPublicEncrypt(encrypt_data,			/* encrypted data */
 				  sizeof(encrypt_data),		/* size of encrypted data buffer */
 				  TPM_ES_RSAESOAEP_SHA1_MGF1,	/* TPM_ENC_SCHEME */
 				  expect1,			/* decrypted data */
 				  sizeof(expect1),
-				  n,				/* public modulus */
-				  2048/8,
+				  tpm_rsa_test_n,		/* public modulus */
+				  sizeof(tpm_rsa_test_n),
 				  tpm_default_rsa_exponent,	/* public exponent */
 				  3);
     }
@@ -2659,16 +2996,26 @@ TPM_RESULT TPM_CryptoTest(void)
 				   TPM_ES_RSAESOAEP_SHA1_MGF1,	/* TPM_ENC_SCHEME */
 				   encrypt_data,		/* encrypted data */
 				   sizeof(encrypt_data),
-				   n,				/* public modulus */
-				   2048/8,
+				   tpm_rsa_test_n,		/* public modulus */
+				   sizeof(tpm_rsa_test_n),
 				   tpm_default_rsa_exponent,	/* public exponent */
 				   3,
-				   d,				/* private exponent */
-				   2048/8);
+				   tpm_rsa_test_d,		/* private exponent */
+				   sizeof(tpm_rsa_test_d),
+				   tpm_rsa_test_p,		/* CRT parameters */
+				   sizeof(tpm_rsa_test_p),
+				   tpm_rsa_test_q,
+				   sizeof(tpm_rsa_test_q),
+				   tpm_rsa_test_dp,
+				   sizeof(tpm_rsa_test_dp),
+				   tpm_rsa_test_dq,
+				   sizeof(tpm_rsa_test_dq),
+				   tpm_rsa_test_qinv,
+				   sizeof(tpm_rsa_test_qinv));
     }
     if (rc == 0) {
 	if (actual_size != TPM_DIGEST_SIZE) {
-	    printf("TPM_CryptoTest: Error in test 9, expect length %u, actual length %u\n",
+	    printf("TPM_CryptoTest: Error in test 10, expect length %u, actual length %u\n",
 		   TPM_DIGEST_SIZE, actual_size);
 	    rc = TPM_FAILEDSELFTEST;
 	}
@@ -2676,7 +3023,7 @@ TPM_RESULT TPM_CryptoTest(void)
     if (rc == 0) {
 	not_equal = memcmp(expect1, actual, TPM_DIGEST_SIZE);
 	if (not_equal) {
-	    printf("TPM_CryptoTest: Error in test 9\n");
+	    printf("TPM_CryptoTest: Error in test 10\n");
 	    TPM_PrintFour("\tin ", expect1);
 	    TPM_PrintFour("\tout", actual);
 	    rc = TPM_FAILEDSELFTEST;
@@ -2684,15 +3031,15 @@ TPM_RESULT TPM_CryptoTest(void)
     }
     /* RSA PKCS1 pad, encrypt and decrypt */
     if (rc == 0) {
-	printf(" TPM_CryptoTest: Test 10 - RSA encrypt with PKCS padding\n");
+	printf(" TPM_CryptoTest: Test 11 - RSA encrypt with PKCS padding\n");
 	/* encrypt */
 	rc = TPM_RSAPublicEncrypt(encrypt_data,			/* encrypted data */
 				  sizeof(encrypt_data),		/* size of encrypted data buffer */
 				  TPM_ES_RSAESPKCSv15,		/* TPM_ENC_SCHEME */
 				  expect1,			/* decrypted data */
 				  sizeof(expect1),
-				  n,				/* public modulus */
-				  2048/8,
+				  tpm_rsa_test_n,		/* public modulus */
+				  sizeof(tpm_rsa_test_n),
 				  tpm_default_rsa_exponent,	/* public exponent */
 				  3);
     }
@@ -2705,17 +3052,22 @@ TPM_RESULT TPM_CryptoTest(void)
 				   TPM_ES_RSAESPKCSv15,		/* TPM_ENC_SCHEME */
 				   encrypt_data,		/* encrypted data */
 				   sizeof(encrypt_data),
-				   n,				/* public modulus */
-				   2048/8,
+				   tpm_rsa_test_n,		/* public modulus */
+				   sizeof(tpm_rsa_test_n),
 				   tpm_default_rsa_exponent,	/* public exponent */
 				   3,
-				   d,				/* private exponent */
-				   2048/8);
+				   tpm_rsa_test_d,		/* private exponent */
+				   sizeof(tpm_rsa_test_d),
+				   NULL, 0,			/* no CRT, test the private exponent */
+				   NULL, 0,
+				   NULL, 0,
+				   NULL, 0,
+				   NULL, 0);
     }
     /* check length after padding removed */
     if (rc == 0) {
 	if (actual_size != TPM_DIGEST_SIZE) {
-	    printf("TPM_CryptoTest: Error in test 10, expect length %u, actual length %u\n",
+	    printf("TPM_CryptoTest: Error in test 11, expect length %u, actual length %u\n",
 		   TPM_DIGEST_SIZE, actual_size);
 	    rc = TPM_FAILEDSELFTEST;
 	}
@@ -2724,7 +3076,7 @@ TPM_RESULT TPM_CryptoTest(void)
     if (rc == 0) {
 	not_equal = memcmp(expect1, actual, TPM_DIGEST_SIZE);
 	if (not_equal) {
-	    printf("TPM_CryptoTest: Error in test 10\n");
+	    printf("TPM_CryptoTest: Error in test 11\n");
 	    TPM_PrintFour("\tin ", expect1);
 	    TPM_PrintFour("\tout", actual);
 	    rc = TPM_FAILEDSELFTEST;
@@ -2739,11 +3091,132 @@ TPM_RESULT TPM_CryptoTest(void)
     }
     free(encStream);					/* @1 */
     free(decStream);					/* @2 */
-    free(n);						/* @3 */
-    free(p);						/* @4 */
-    free(q);						/* @5 */
-    free(d);						/* @6 */
-    TPM_SymmetricKeyData_Free(&tpm_symmetric_key_data);	/* @7 */
+    TPM_SymmetricKeyData_Free(&tpm_symmetric_key_data);	/* @3 */
+    return rc;
+}
+
+/* TPM_CryptoTestKeyGen() generates an RSA key pair and checks it with an OAEP encrypt and CRT
+   decrypt.
+
+   Key generation is slow and has a high variance, so it is not part of TPM_CryptoTest(), which
+   runs at every startup.  It is run for TPM_SelfTestFull.
+
+   Returns TPM_FAILEDSELFTEST on error
+*/
+
+TPM_RESULT TPM_CryptoTestKeyGen(void)
+{
+    TPM_RESULT	rc = 0;
+    int		not_equal;
+    unsigned char clrData[TPM_DIGEST_SIZE];		/* clear text */
+    unsigned char decData[TPM_DIGEST_SIZE];		/* decrypted data */
+    uint32_t	  decLength;
+    unsigned char encrypt_data[2048/8];		/* encrypted data */
+    unsigned char *n;		/* public key - modulus */
+    unsigned char *p;		/* private key prime */
+    unsigned char *q;		/* private key prime */
+    unsigned char *d;		/* private key (private exponent) */
+    unsigned char *dp;		/* CRT exponent d mod (p-1) */
+    unsigned char *dq;		/* CRT exponent d mod (q-1) */
+    unsigned char *qinv;	/* CRT coefficient q^-1 mod p */
+    uint32_t	  dpbytes;
+    uint32_t	  dqbytes;
+    uint32_t	  qinvbytes;
+
+    printf(" TPM_CryptoTestKeyGen:\n");
+    n = NULL;			/* freed @1 */
+    p = NULL;			/* freed @2 */
+    q = NULL;			/* freed @3 */
+    d = NULL;			/* freed @4 */
+    dp = NULL;			/* freed @5 */
+    dq = NULL;			/* freed @6 */
+    qinv = NULL;		/* freed @7 */
+    /* generate a key */
+    if (rc == 0) {
+	rc = TPM_RSAGenerateKeyPair(&n,				/* public key - modulus */
+				    &p,				/* private key prime */
+				    &q,				/* private key prime */
+				    &d,				/* private key (private exponent) */
+				    2048,			/* key size in bits */
+				    tpm_default_rsa_exponent,	/* public exponent as an array */
+				    3);
+    }
+    if (rc == 0) {
+	rc = TPM_RSAGetCRTParameters(&dpbytes, &dp,		/* freed @5 */
+				     &dqbytes, &dq,		/* freed @6 */
+				     &qinvbytes, &qinv,		/* freed @7 */
+				     2048/16, p,
+				     2048/16, q,
+				     2048/8, d);
+    }
+    /* generate clear text */
+    if (rc == 0) {
+	rc = TPM_Random(clrData, sizeof(clrData));
+    }
+    /* encrypt */
+    if (rc == 0) {
+	rc = TPM_RSAPublicEncrypt(encrypt_data,			/* encrypted data */
+				  sizeof(encrypt_data),		/* size of encrypted data buffer */
+				  TPM_ES_RSAESOAEP_SHA1_MGF1,	/* TPM_ENC_SCHEME */
+				  clrData,			/* decrypted data */
+				  sizeof(clrData),
+				  n,				/* public modulus */
+				  2048/8,
+				  tpm_default_rsa_exponent,	/* public exponent */
+				  3);
+    }
+    /* decrypt */
+    if (rc == 0) {
+	rc = TPM_RSAPrivateDecrypt(decData,			/* decrypted data */
+				   &decLength,			/* length of data put into
+								   decrypt_data */
+				   sizeof(decData),		/* size of decrypt_data buffer */
+				   TPM_ES_RSAESOAEP_SHA1_MGF1,	/* TPM_ENC_SCHEME */
+				   encrypt_data,		/* encrypted data */
+				   sizeof(encrypt_data),
+				   n,				/* public modulus */
+				   2048/8,
+				   tpm_default_rsa_exponent,	/* public exponent */
+				   3,
+				   d,				/* private exponent */
+				   2048/8,
+				   p,				/* CRT parameters */
+				   2048/16,
+				   q,
+				   2048/16,
+				   dp,
+				   dpbytes,
+				   dq,
+				   dqbytes,
+				   qinv,
+				   qinvbytes);
+    }
+    if (rc == 0) {
+	if (decLength != sizeof(clrData)) {
+	    printf("TPM_CryptoTestKeyGen: Error, expect length %lu, actual length %u\n",
+		   (unsigned long)sizeof(clrData), decLength);
+	    rc = TPM_FAILEDSELFTEST;
+	}
+    }
+    if (rc == 0) {
+	not_equal = memcmp(clrData, decData, sizeof(clrData));
+	if (not_equal) {
+	    printf("TPM_CryptoTestKeyGen: Error, decrypted data does not match\n");
+	    TPM_PrintFour("\tin ", clrData);
+	    TPM_PrintFour("\tout", decData);
+	    rc = TPM_FAILEDSELFTEST;
+	}
+    }
+    if (rc != 0) {
+	rc = TPM_FAILEDSELFTEST;
+    }
+    free(n);						/* @1 */
+    free(p);						/* @2 */
+    free(q);						/* @3 */
+    free(d);						/* @4 */
+    free(dp);						/* @5 */
+    free(dq);						/* @6 */
+    free(qinv);						/* @7 */
     return rc;
 }
 
@@ -2780,7 +3253,7 @@ TPM_RESULT TPM_Process_Sign(tpm_state_t *tpm_state,
     /* input parameters */
     TPM_KEY_HANDLE	keyHandle;	/* The keyHandle identifier of a loaded key that can perform
 					   digital signatures. */
-    TPM_SIZED_BUFFER	areaToSign;	/* The value to sign */
+    TPM_SIZED_BUFFER_VIEW areaToSign;	/* The value to sign */
     TPM_AUTHHANDLE	authHandle;	/* The authorization handle used for keyHandle authorization
 					 */
     TPM_NONCE		nonceOdd;	/* Nonce generated by system associated with authHandle */
@@ -2813,7 +3286,7 @@ TPM_RESULT TPM_Process_Sign(tpm_state_t *tpm_state,
     TPM_SIZED_BUFFER	sig;		/* The resulting digital signature. */
 
     printf("TPM_Process_Sign: Ordinal Entry\n");
-    TPM_SizedBuffer_Init(&areaToSign);	/* freed @1 */
+    TPM_SizedBufferView_Init(&areaToSign);	/* borrowed from the command */
     TPM_SignInfo_Init(&tpm_sign_info);	/* freed @2 */
     TPM_Sbuffer_Init(&sbuffer);		/* freed @3 */
     TPM_SizedBuffer_Init(&sig);		/* freed @4 */
@@ -2829,7 +3302,7 @@ TPM_RESULT TPM_Process_Sign(tpm_state_t *tpm_state,
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_Sign: keyHandle %08x\n", keyHandle);
 	/* get areaToSignSize and areaToSign parameters */
-	returnCode = TPM_SizedBuffer_Load(&areaToSign, &command, &paramSize);	/* freed @1 */
+	returnCode = TPM_SizedBufferView_Load(&areaToSign, &command, &paramSize);
     }
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_Sign: Signing %u bytes\n", areaToSign.size);
@@ -2998,7 +3471,8 @@ TPM_RESULT TPM_Process_Sign(tpm_state_t *tpm_state,
 		TPM_Nonce_Copy(tpm_sign_info.replay, nonceOdd);
 		/* d. Set S2 -> dataLen to areaToSignSize */
 		/* e. Set S2 -> data to areaToSign */
-		returnCode = TPM_SizedBuffer_Copy(&(tpm_sign_info.data), &areaToSign);
+		returnCode = TPM_SizedBuffer_Set(&(tpm_sign_info.data),
+						 areaToSign.size, areaToSign.buffer);
 	    }
 	    /* f. Set S1 to the SHA-1(S2) */
 	    if (returnCode == TPM_SUCCESS) {
@@ -3084,7 +3558,6 @@ TPM_RESULT TPM_Process_Sign(tpm_state_t *tpm_state,
     /*
       cleanup
     */
-    TPM_SizedBuffer_Delete(&areaToSign);	/* @1 */
     TPM_SignInfo_Delete(&tpm_sign_info);	/* @2 */
     TPM_Sbuffer_Delete(&sbuffer);		/* @3 */
     TPM_SizedBuffer_Delete(&sig);		/* @4 */
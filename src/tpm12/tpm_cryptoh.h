@@ -216,6 +216,10 @@ TPM_RESULT TPM_HMAC_GenerateStructure(TPM_HMAC tpm_hmac,
 TPM_RESULT TPM_HMAC_Generate(TPM_HMAC tpm_hmac,
                              const TPM_SECRET hmac_key,
                              ...);
+TPM_RESULT TPM_HMAC_GenerateState(TPM_HMAC tpm_hmac,
+                                  const TPM_SECRET hmac_key,
+                                  TPM_HMAC_STATE *tpm_hmac_state,
+                                  ...);
 
 TPM_RESULT TPM_HMAC_CheckSbuffer(TPM_BOOL *valid,
                                  TPM_HMAC expect,
@@ -225,12 +229,20 @@ TPM_RESULT TPM_HMAC_Check(TPM_BOOL *valid,
                           TPM_HMAC expect,
                           const TPM_SECRET key,
                           ...);
+TPM_RESULT TPM_HMAC_CheckState(TPM_BOOL *valid,
+                               TPM_HMAC expect,
+                               const TPM_SECRET key,
+                               TPM_HMAC_STATE *tpm_hmac_state,
+                               ...);
 TPM_RESULT TPM_HMAC_CheckStructure(const TPM_SECRET hmac_key,
                                    void *structure,
                                    TPM_HMAC expect,
                                    TPM_STORE_FUNCTION_T storeFunction,
                                    TPM_RESULT error);
 
+void       TPM_HmacState_Init(TPM_HMAC_STATE *tpm_hmac_state);
+void       TPM_HmacState_Delete(TPM_HMAC_STATE *tpm_hmac_state);
+
 /*
   XOR
 */
@@ -270,6 +282,7 @@ TPM_RESULT TPM_2bin2bn(TPM_BIGNUM *bignum_in,
 */
 
 TPM_RESULT TPM_CryptoTest(void);
+TPM_RESULT TPM_CryptoTestKeyGen(void);
 
 
 /*
@@ -41,6 +41,7 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "tpm_arena.h"
 #include "tpm_auth.h"
 #include "tpm_crypto.h"
 #include "tpm_cryptoh.h"
@@ -140,6 +141,31 @@ TPM_RESULT TPM_DaaSessions_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_DaaSessions_SizeOf() returns the number of bytes TPM_DaaSessions_Store() serializes */
+
+uint32_t TPM_DaaSessions_SizeOf(TPM_DAA_SESSION_DATA *daaSessions)
+{
+    uint32_t	size;
+    uint32_t	space;
+
+    TPM_DaaSessions_GetSpace(&space, daaSessions);
+    size = sizeof(uint32_t) +			/* activeCount */
+	   ((TPM_MIN_DAA_SESSIONS - space) *
+	    (sizeof(uint16_t) + (6 * TPM_DIGEST_SIZE) +	/* TPM_DAA_ISSUER */
+	     sizeof(daaSessions->DAA_issuerSettings.DAA_generic_q) +
+	     sizeof(uint16_t) + (4 * TPM_DIGEST_SIZE) +	/* TPM_DAA_TPM */
+	     sizeof(uint32_t) +
+	     sizeof(uint16_t) + (2 * TPM_DIGEST_SIZE) +	/* TPM_DAA_CONTEXT */
+	     TPM_NONCE_SIZE +
+	     sizeof(daaSessions->DAA_session.DAA_scratch) +
+	     sizeof(BYTE) + sizeof(TPM_BOOL) +
+	     sizeof(daaSessions->DAA_joinSession.DAA_join_u0) +	/* TPM_DAA_JOINDATA */
+	     sizeof(daaSessions->DAA_joinSession.DAA_join_u1) +
+	     TPM_DIGEST_SIZE +
+	     sizeof(TPM_HANDLE)));			/* daaHandle */
+    return size;
+}
+
 /* TPM_DaaSessions_Delete() terminates all loaded DAA sessions
 
 */
@@ -2138,7 +2164,7 @@ TPM_RESULT TPM_DAAJoin_Stage08(tpm_state_t *tpm_state,
     /* h. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* i. return TPM_SUCCESS */
-    free(NE);			/* @1 */
+    TPM_Arena_Free(NE);			/* @1 */
     return rc;
 }
 
@@ -2237,7 +2263,7 @@ TPM_RESULT TPM_DAAJoin_Stage09_Sign_Stage2(tpm_state_t *tpm_state,
     /* n. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* o. return TPM_SUCCESS */
-    free(Y);			/* @1 */
+    TPM_Arena_Free(Y);			/* @1 */
     TPM_BN_free(yBignum);	/* @2 */
     TPM_BN_free(xBignum);	/* @3 */
     TPM_BN_free(nBignum);	/* @4 */
@@ -2342,7 +2368,7 @@ TPM_RESULT TPM_DAAJoin_Stage10_Sign_Stage3(tpm_state_t *tpm_state,
     /* n. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* o. return TPM_SUCCESS */
-    free(Y);			/* @1 */
+    TPM_Arena_Free(Y);			/* @1 */
     TPM_BN_free(xBignum);	/* @2 */
     TPM_BN_free(nBignum);	/* @3 */
     TPM_BN_free(zBignum);	/* @4 */
@@ -2447,7 +2473,7 @@ TPM_RESULT TPM_DAAJoin_Stage11_Sign_Stage4(tpm_state_t *tpm_state,
     /* n. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* o. return TPM_SUCCESS */
-    free(Y);			/* @1 */
+    TPM_Arena_Free(Y);			/* @1 */
     TPM_BN_free(yBignum);	/* @2 */
     TPM_BN_free(xBignum);	/* @3 */
     TPM_BN_free(nBignum);	/* @4 */
@@ -2559,7 +2585,7 @@ TPM_RESULT TPM_DAAJoin_Stage12(tpm_state_t *tpm_state,
     /* o. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* p. return TPM_SUCCESS */
-    free(Y);			/* @1 */
+    TPM_Arena_Free(Y);			/* @1 */
     TPM_BN_free(yBignum);	/* @2 */
     TPM_BN_free(xBignum);	/* @3 */
     TPM_BN_free(nBignum);	/* @4 */
@@ -2886,8 +2912,8 @@ TPM_RESULT TPM_DAAJoin_Stage15_Sign_Stage8(tpm_state_t *tpm_state,
     /* l. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* m. return TPM_SUCCESS. */
-    free(r0);			/* @1 */
-    free(r1);			/* @2 */
+    TPM_Arena_Free(r0);			/* @1 */
+    TPM_Arena_Free(r1);			/* @2 */
     TPM_BN_free(r0Bignum);	/* @3 */
     TPM_BN_free(r1Bignum);	/* @4 */
     TPM_BN_free(r1sBignum);	/* @5 */
@@ -3027,7 +3053,7 @@ TPM_RESULT TPM_DAAJoin_Stage17_Sign_Stage11(tpm_state_t *tpm_state,
     /* i. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* j. return TPM_SUCCESS */
-    free(r0);			/* @1 */
+    TPM_Arena_Free(r0);			/* @1 */
     TPM_BN_free(r0Bignum);	/* @2 */
     TPM_BN_free(fBignum);	/* @3 */
     TPM_BN_free(s0Bignum);	/* @4 */
@@ -3109,7 +3135,7 @@ TPM_RESULT TPM_DAAJoin_Stage18_Sign_Stage12(tpm_state_t *tpm_state,
     /* i. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* j. return TPM_SUCCESS */
-    free(r1);			/* @1 */
+    TPM_Arena_Free(r1);			/* @1 */
     TPM_BN_free(r1Bignum);	/* @2 */
     TPM_BN_free(fBignum);	/* @3 */
     TPM_BN_free(f1Bignum);	/* @4 */
@@ -3194,7 +3220,7 @@ TPM_RESULT TPM_DAAJoin_Stage19(tpm_state_t *tpm_state,
     /* g. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* h. return TPM_SUCCESS */
-    free(r2);			/* @1 */
+    TPM_Arena_Free(r2);			/* @1 */
     TPM_BN_free(r2Bignum);	/* @2 */
     TPM_BN_free(s2Bignum);	/* @3 */
     TPM_BN_free(cBignum);	/* @4 */
@@ -3291,7 +3317,7 @@ TPM_RESULT TPM_DAAJoin_Stage20(tpm_state_t *tpm_state,
     /* i. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* j. return TPM_SUCCESS */
-    free(r2);			/* @1 */
+    TPM_Arena_Free(r2);			/* @1 */
     TPM_BN_free(r2Bignum);	/* @2 */
     TPM_BN_free(s12Bignum);	/* @3 */
     TPM_BN_free(s12sBignum);	/* @4 */
@@ -3407,7 +3433,7 @@ TPM_RESULT TPM_DAAJoin_Stage21(tpm_state_t *tpm_state,
     /* h. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* i. return TPM_SUCCESS */
-    free(r3);			/* @1 */
+    TPM_Arena_Free(r3);			/* @1 */
     TPM_BN_free(r3Bignum);	/* @2 */
     TPM_BN_free(s3Bignum);	/* @3 */
     TPM_BN_free(cBignum);	/* @4 */
@@ -3911,7 +3937,7 @@ TPM_RESULT TPM_DAASign_Stage05(tpm_state_t *tpm_state,
     /* o. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* p. return TPM_SUCCESS */
-    free(Y);			/* @1 */
+    TPM_Arena_Free(Y);			/* @1 */
     TPM_BN_free(yBignum);	/* @2 */
     TPM_BN_free(xBignum);	/* @3 */
     TPM_BN_free(nBignum);	/* @4 */
@@ -4145,7 +4171,7 @@ TPM_RESULT TPM_DAASign_Stage13(tpm_state_t *tpm_state,
     /* i. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* j. return TPM_SUCCESS */
-    free(r2);						/* @1 */
+    TPM_Arena_Free(r2);						/* @1 */
     TPM_BN_free(r2Bignum);				/* @2 */
     TPM_BN_free(s2Bignum);				/* @3 */
     TPM_BN_free(cBignum);				/* @4 */
@@ -4252,7 +4278,7 @@ TPM_RESULT TPM_DAASign_Stage14(tpm_state_t *tpm_state,
     /* k. increment DAA_session -> DAA_stage by 1 */
     /* NOTE Done by common code */
     /* l. return TPM_SUCCESS */
-    free(r2);						/* @1 */
+    TPM_Arena_Free(r2);						/* @1 */
     TPM_BN_free(r2Bignum);				/* @2 */
     TPM_BN_free(s12Bignum);				/* @3 */
     TPM_BN_free(s12sBignum);				/* @4 */
@@ -4367,7 +4393,7 @@ TPM_RESULT TPM_DAASign_Stage15(tpm_state_t *tpm_state,
        handle. */
     /* NOTE Done by caller */
     /* k. return TPM_SUCCESS */
-    free(r4);						/* @1 */
+    TPM_Arena_Free(r4);						/* @1 */
     TPM_BN_free(r4Bignum);				/* @2 */
     TPM_BN_free(s3Bignum);				/* @3 */
     TPM_BN_free(cBignum);				/* @4 */
@@ -54,6 +54,7 @@ TPM_RESULT TPM_DaaSessions_Load(TPM_DAA_SESSION_DATA *daaSessions,
                                 uint32_t *stream_size);
 TPM_RESULT TPM_DaaSessions_Store(TPM_STORE_BUFFER *sbuffer,
                                  TPM_DAA_SESSION_DATA *daaSessions);
+uint32_t   TPM_DaaSessions_SizeOf(TPM_DAA_SESSION_DATA *daaSessions);
 void       TPM_DaaSessions_Delete(TPM_DAA_SESSION_DATA *daaSessions);
 
 void       TPM_DaaSessions_IsSpace(TPM_BOOL *isSpace,
@@ -37,64 +37,280 @@
 /* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
 /********************************************************************************/
 
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "tpm_commands.h"
+#include "tpm_error.h"
 #include "tpm_load.h"
+#include "tpm_memory.h"
 
 #include "tpm_debug.h"
 
+/* maximum length of one formatted trace message, including the terminating nul */
+#define TPM_TRACE_MESSAGE_MAX	256
 
-#ifndef TPM_DEBUG
+/* runtime trace settings */
 
-int swallow_rc = 0;
+#ifdef TPM_DEBUG
+unsigned int	tpm_trace_level = TPMLIB_TRACE_LEVEL_DEBUG;
+#else
+unsigned int	tpm_trace_level = TPMLIB_TRACE_LEVEL_NONE;
+#endif
+uint32_t	tpm_trace_categories = TPMLIB_TRACE_CAT_ALL;
+
+static TPMLIB_TraceFunction tpm_trace_function = NULL;
+
+/* The trace ring buffer holds a sequence of struct tpmlib_trace_record, each followed by its
+   message.  Records wrap around the end of the buffer.  When the buffer is full, the oldest
+   records are discarded.
+
+   The ring buffer is shared by all TPM instances and is protected by tpm_trace_lock.
+*/
 
-int tpm_swallow_printf_args(const char *format, ...)
+static pthread_mutex_t	tpm_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned char	*tpm_trace_buffer = NULL;	/* freed @1 */
+static uint32_t		tpm_trace_buffer_size = 0;
+static uint32_t		tpm_trace_buffer_head = 0;	/* offset of the oldest record */
+static uint32_t		tpm_trace_buffer_used = 0;	/* bytes in use */
+
+/* TPM_TraceBuffer_Copy() copies 'length' bytes out of the ring buffer, starting at 'offset' */
+
+static void TPM_TraceBuffer_Copy(unsigned char *dest, uint32_t offset, uint32_t length)
 {
-    format = format;	/* to silence compiler */
-    return 0;
+    uint32_t first = tpm_trace_buffer_size - offset;
+
+    if (length <= first) {
+        memcpy(dest, tpm_trace_buffer + offset, length);
+    }
+    else {
+        memcpy(dest, tpm_trace_buffer + offset, first);
+        memcpy(dest + first, tpm_trace_buffer, length - first);
+    }
+    return;
 }
 
-#else
+/* TPM_TraceBuffer_Write() copies 'length' bytes into the ring buffer, starting at 'offset' */
+
+static void TPM_TraceBuffer_Write(uint32_t offset, const unsigned char *src, uint32_t length)
+{
+    uint32_t first = tpm_trace_buffer_size - offset;
+
+    if (length <= first) {
+        memcpy(tpm_trace_buffer + offset, src, length);
+    }
+    else {
+        memcpy(tpm_trace_buffer + offset, src, first);
+        memcpy(tpm_trace_buffer, src + first, length - first);
+    }
+    return;
+}
+
+/* TPM_TraceBuffer_Discard() removes the oldest record from the ring buffer */
+
+static void TPM_TraceBuffer_Discard(void)
+{
+    struct tpmlib_trace_record record;
+    uint32_t recordSize;
+
+    TPM_TraceBuffer_Copy((unsigned char *)&record, tpm_trace_buffer_head, sizeof(record));
+    recordSize = sizeof(record) + record.length;
+    tpm_trace_buffer_head = (tpm_trace_buffer_head + recordSize) % tpm_trace_buffer_size;
+    tpm_trace_buffer_used -= recordSize;
+    return;
+}
+
+/* TPM_TraceBuffer_Append() adds a record to the ring buffer, discarding the oldest records as
+   required.
+
+   The caller must hold tpm_trace_lock.
+*/
+
+static void TPM_TraceBuffer_Append(unsigned int level, uint32_t category,
+                                   const char *message, uint32_t length)
+{
+    struct tpmlib_trace_record record;
+    uint32_t recordSize;
+    uint32_t tail;
+
+    recordSize = sizeof(record) + length;
+    if (recordSize > tpm_trace_buffer_size) {
+        return;
+    }
+    while ((tpm_trace_buffer_size - tpm_trace_buffer_used) < recordSize) {
+        TPM_TraceBuffer_Discard();
+    }
+    record.length = length;
+    record.level = level;
+    record.reserved = 0;
+    record.category = category;
+    tail = (tpm_trace_buffer_head + tpm_trace_buffer_used) % tpm_trace_buffer_size;
+    TPM_TraceBuffer_Write(tail, (const unsigned char *)&record, sizeof(record));
+    tail = (tail + sizeof(record)) % tpm_trace_buffer_size;
+    TPM_TraceBuffer_Write(tail, (const unsigned char *)message, length);
+    tpm_trace_buffer_used += recordSize;
+    return;
+}
+
+/* TPM_Trace_Set() sets the runtime trace level, category mask, and optional callback.
 
-/* TPM_PrintFour() prints a prefix plus 4 bytes of a buffer */
+   It must not be called while commands are being processed.
+*/
 
-void TPM_PrintFour(const char *string, const unsigned char* buff)
+void TPM_Trace_Set(unsigned int level, uint32_t categories, TPMLIB_TraceFunction function)
+{
+    tpm_trace_level = level;
+    tpm_trace_categories = categories;
+    tpm_trace_function = function;
+    return;
+}
+
+/* TPM_TraceBuffer_Set() allocates a trace ring buffer of 'size' bytes, discarding any previous
+   buffer and its contents.  A 'size' of 0 frees the buffer.
+*/
+
+TPM_RESULT TPM_TraceBuffer_Set(uint32_t size)
+{
+    TPM_RESULT		rc = 0;
+    unsigned char	*buffer = NULL;
+
+    if (size != 0) {
+        /* must hold at least one record header and some text */
+        if (size < (sizeof(struct tpmlib_trace_record) * 2)) {
+            rc = TPM_BAD_PARAMETER;
+        }
+        if (rc == 0) {
+            rc = TPM_Malloc(&buffer, size);
+        }
+    }
+    if (rc == 0) {
+        pthread_mutex_lock(&tpm_trace_lock);
+        free(tpm_trace_buffer);		/* @1 */
+        tpm_trace_buffer = buffer;
+        tpm_trace_buffer_size = size;
+        tpm_trace_buffer_head = 0;
+        tpm_trace_buffer_used = 0;
+        pthread_mutex_unlock(&tpm_trace_lock);
+    }
+    return rc;
+}
+
+/* TPM_TraceBuffer_Get() removes the oldest records from the ring buffer and copies them to
+   'buffer'.  Only whole records are copied.  'length' is the number of bytes copied.
+*/
+
+void TPM_TraceBuffer_Get(unsigned char *buffer, uint32_t size, uint32_t *length)
+{
+    struct tpmlib_trace_record record;
+    uint32_t recordSize;
+
+    *length = 0;
+    pthread_mutex_lock(&tpm_trace_lock);
+    while (tpm_trace_buffer_used > 0) {
+        TPM_TraceBuffer_Copy((unsigned char *)&record, tpm_trace_buffer_head, sizeof(record));
+        recordSize = sizeof(record) + record.length;
+        if (recordSize > (size - *length)) {
+            break;
+        }
+        TPM_TraceBuffer_Copy(buffer + *length, tpm_trace_buffer_head, recordSize);
+        *length += recordSize;
+        TPM_TraceBuffer_Discard();
+    }
+    pthread_mutex_unlock(&tpm_trace_lock);
+    return;
+}
+
+/* TPM_Trace() formats a trace message and sends it to the trace callback, the trace ring buffer,
+   or, if neither is set, stdout.
+
+   Callers should use the TPM_TRACE macros, which check the trace level and category first.
+*/
+
+void TPM_Trace(unsigned int level, uint32_t category, const char *format, ...)
+{
+    char	message[TPM_TRACE_MESSAGE_MAX];
+    int		length;
+    TPM_BOOL	buffered;
+    va_list	ap;
+
+    va_start(ap, format);
+    length = vsnprintf(message, sizeof(message), format, ap);
+    va_end(ap);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length >= sizeof(message)) {
+        length = sizeof(message) - 1;
+    }
+    if (tpm_trace_function != NULL) {
+        tpm_trace_function(level, category, message);
+    }
+    pthread_mutex_lock(&tpm_trace_lock);
+    buffered = (tpm_trace_buffer != NULL);
+    if (buffered) {
+        TPM_TraceBuffer_Append(level, category, message, length);
+    }
+    pthread_mutex_unlock(&tpm_trace_lock);
+    if ((tpm_trace_function == NULL) && !buffered) {
+        fputs(message, stdout);
+    }
+    return;
+}
+
+/* TPM_Trace_PrintFour() prints a prefix plus 4 bytes of a buffer
+
+   Callers should use the TPM_PrintFour() macro, which checks the trace level and category first.
+*/
+
+void TPM_Trace_PrintFour(uint32_t category,
+                         const char *string, const unsigned char* buff)
 {
     if (buff != NULL) {
-        printf("%s %02x %02x %02x %02x\n",
-               string,
-               buff[0],
-               buff[1],
-               buff[2],
-               buff[3]);
+        TPM_Trace(TPMLIB_TRACE_LEVEL_DEBUG, category, "%s %02x %02x %02x %02x\n",
+                  string,
+                  buff[0],
+                  buff[1],
+                  buff[2],
+                  buff[3]);
     }
     else {
-        printf("%s null\n", string);
+        TPM_Trace(TPMLIB_TRACE_LEVEL_DEBUG, category, "%s null\n", string);
     }
     return;
 }
 
-#endif
+/* TPM_Trace_PrintAll() prints 'string', the length, and then the entire byte array
 
-/* TPM_PrintAll() prints 'string', the length, and then the entire byte array
- */
+   Each line of 16 bytes is one trace message.  Callers should use the TPM_PrintAll() macro, which
+   checks the trace level and category first.
+*/
 
-void TPM_PrintAll(const char *string, const unsigned char* buff, uint32_t length)
+void TPM_Trace_PrintAll(uint32_t category,
+                        const char *string, const unsigned char* buff, uint32_t length)
 {
     uint32_t i;
+    uint32_t j;
+    char line[1 + (16 * 3) + 2];	/* leading space, 16 bytes, newline, nul */
+    size_t offset;
+
     if (buff != NULL) {
-        printf("%s length %u\n ", string, length);
-        for (i = 0 ; i < length ; i++) {
-            if (i && !( i % 16 )) {
-                printf("\n ");
+        TPM_Trace(TPMLIB_TRACE_LEVEL_DEBUG, category, "%s length %u\n", string, length);
+        for (i = 0 ; i < length ; i += 16) {
+            offset = 0;
+            line[offset++] = ' ';
+            for (j = i ; (j < (i + 16)) && (j < length) ; j++) {
+                offset += sprintf(line + offset, "%.2X ", buff[j]);
             }
-            printf("%.2X ",buff[i]);
+            line[offset++] = '\n';
+            line[offset] = '\0';
+            TPM_Trace(TPMLIB_TRACE_LEVEL_DEBUG, category, "%s", line);
         }
-        printf("\n");
     }
     else {
-        printf("%s null\n", string);
+        TPM_Trace(TPMLIB_TRACE_LEVEL_DEBUG, category, "%s null\n", string);
     }
     return;
 }
@@ -41,25 +41,73 @@
 #define TPM_DEBUG_H
 
 #include "tpm_types.h"
+#include "tpm_library.h"
 
-/* prototypes */
+/* Tracing
+
+   Each trace point has a level and a category.  A trace point is reported if its level is at most
+   the runtime level set by TPMLIB_SetTrace() and its category is in the runtime category mask.
 
-void TPM_PrintFour(const char *string, const unsigned char* buff);
-void TPM_PrintAll(const char *string, const unsigned char* buff, uint32_t length);
+   Trace points above TPM_TRACE_MAX_LEVEL are not compiled in.  Their arguments are still type
+   checked but never evaluated.  By default only error and info trace points are compiled in,
+   unless TPM_DEBUG is defined.
 
+   A source file sets its category by defining TPM_TRACE_CATEGORY before including this file.
 
-#ifndef TPM_DEBUG       /* if debug is turned off */
+   The existing printf() calls are debug level trace points.
+*/
+
+#ifndef TPM_TRACE_MAX_LEVEL
+#ifdef TPM_DEBUG
+#define TPM_TRACE_MAX_LEVEL	TPMLIB_TRACE_LEVEL_DEBUG
+#else
+#define TPM_TRACE_MAX_LEVEL	TPMLIB_TRACE_LEVEL_INFO
+#endif
+#endif
+
+#ifndef TPM_TRACE_CATEGORY
+#define TPM_TRACE_CATEGORY	TPMLIB_TRACE_CAT_GENERAL
+#endif
+
+/* runtime trace settings, only changed by TPMLIB_SetTrace() */
+extern unsigned int	tpm_trace_level;
+extern uint32_t		tpm_trace_categories;
+
+#define TPM_TRACE_ENABLED(level, category)			\
+    (((level) <= TPM_TRACE_MAX_LEVEL) &&			\
+     ((level) <= tpm_trace_level) &&				\
+     (((category) & tpm_trace_categories) != 0))
+
+#define TPM_TRACE(level, ...)						\
+    (TPM_TRACE_ENABLED(level, TPM_TRACE_CATEGORY) ?			\
+     TPM_Trace(level, TPM_TRACE_CATEGORY, __VA_ARGS__) : (void)0)
+
+#define TPM_TRACE_ERROR(...)	TPM_TRACE(TPMLIB_TRACE_LEVEL_ERROR, __VA_ARGS__)
+#define TPM_TRACE_INFO(...)	TPM_TRACE(TPMLIB_TRACE_LEVEL_INFO, __VA_ARGS__)
+#define TPM_TRACE_DEBUG(...)	TPM_TRACE(TPMLIB_TRACE_LEVEL_DEBUG, __VA_ARGS__)
+
+/* prototypes */
 
-/* dummy function to match the printf prototype */
-int tpm_swallow_printf_args(const char *format, ...);
+void TPM_Trace(unsigned int level, uint32_t category, const char *format, ...)
+    __attribute__ ((format (printf, 3, 4)));
+void TPM_Trace_Set(unsigned int level, uint32_t categories, TPMLIB_TraceFunction function);
+TPM_RESULT TPM_TraceBuffer_Set(uint32_t size);
+void TPM_TraceBuffer_Get(unsigned char *buffer, uint32_t size, uint32_t *length);
 
-/* assign to this dummy value to eliminate "statement has no effect" warnings */
-extern int swallow_rc;
+void TPM_Trace_PrintFour(uint32_t category,
+                         const char *string, const unsigned char* buff);
+void TPM_Trace_PrintAll(uint32_t category,
+                        const char *string, const unsigned char* buff, uint32_t length);
 
-/* redefine printf to null */
-#define printf swallow_rc = swallow_rc && tpm_swallow_printf_args
-#define TPM_PrintFour(arg1, arg2)
+/* redirect printf to debug level trace points.  This must not write to a global variable, since
+   TPM instances may process commands concurrently. */
+#define printf(...)	TPM_TRACE_DEBUG(__VA_ARGS__)
 
-#endif  /* TPM_DEBUG */
+#define TPM_PrintFour(string, buff)					\
+    (TPM_TRACE_ENABLED(TPMLIB_TRACE_LEVEL_DEBUG, TPM_TRACE_CATEGORY) ?	\
+     TPM_Trace_PrintFour(TPM_TRACE_CATEGORY, string, buff) : (void)0)
+#define TPM_PrintAll(string, buff, length)				\
+    (TPM_TRACE_ENABLED(TPMLIB_TRACE_LEVEL_DEBUG, TPM_TRACE_CATEGORY) ?	\
+     TPM_Trace_PrintAll(TPM_TRACE_CATEGORY, string, buff, length) : (void)0)
 
 #endif
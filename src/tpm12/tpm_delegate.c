@@ -159,6 +159,18 @@ TPM_RESULT TPM_DelegatePublic_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_DelegatePublic_SizeOf() returns the number of bytes TPM_DelegatePublic_Store() serializes */
+
+uint32_t TPM_DelegatePublic_SizeOf(const TPM_DELEGATE_PUBLIC *tpm_delegate_public)
+{
+    return sizeof(uint16_t) +			/* tag */
+	sizeof(TPM_DELEGATE_LABEL) +
+	TPM_PCRInfoShort_SizeOf(&(tpm_delegate_public->pcrInfo), FALSE) +
+	sizeof(uint16_t) + (3 * sizeof(uint32_t)) +	/* TPM_DELEGATIONS */
+	sizeof(TPM_FAMILY_ID) +
+	sizeof(TPM_FAMILY_VERIFICATION);
+}
+
 /* TPM_DelegatePublic_Delete()
 
    No-OP if the parameter is NULL, else:
@@ -981,6 +993,24 @@ TPM_RESULT TPM_FamilyTable_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_FamilyTable_SizeOf() returns the number of bytes TPM_FamilyTable_Store() serializes with
+   the same 'store_tag' setting */
+
+uint32_t TPM_FamilyTable_SizeOf(TPM_BOOL store_tag)
+{
+    uint32_t	size;
+
+    size = sizeof(TPM_FAMILY_LABEL) +
+	   sizeof(TPM_FAMILY_ID) +
+	   sizeof(TPM_FAMILY_VERIFICATION) +
+	   sizeof(TPM_FAMILY_FLAGS) +
+	   sizeof(TPM_BOOL);			/* valid */
+    if (store_tag) {
+	size += sizeof(uint16_t);
+    }
+    return TPM_NUM_FAMILY_TABLE_ENTRY_MIN * size;
+}
+
 /* TPM_FamilyTable_Delete()
 
    No-OP if the parameter is NULL, else:
@@ -1347,6 +1377,22 @@ TPM_RESULT TPM_DelegateTable_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_DelegateTable_SizeOf() returns the number of bytes TPM_DelegateTable_Store() serializes */
+
+uint32_t TPM_DelegateTable_SizeOf(const TPM_DELEGATE_TABLE *tpm_delegate_table)
+{
+    uint32_t	size = 0;
+    size_t	i;
+
+    for (i = 0 ; i < TPM_NUM_DELEGATE_TABLE_ENTRY_MIN ; i++) {
+	size += sizeof(uint16_t) +		/* tag */
+		TPM_DelegatePublic_SizeOf(&(tpm_delegate_table->delRow[i].pub)) +
+		TPM_SECRET_SIZE +
+		sizeof(TPM_BOOL);		/* valid */
+    }
+    return size;
+}
+
 /* TPM_DelegateTable_Delete()
 
    No-OP if the parameter is NULL, else:
@@ -52,6 +52,7 @@ TPM_RESULT TPM_DelegatePublic_Load(TPM_DELEGATE_PUBLIC *tpm_delegate_public,
                                    uint32_t *stream_size);
 TPM_RESULT TPM_DelegatePublic_Store(TPM_STORE_BUFFER *sbuffer,
                                     const TPM_DELEGATE_PUBLIC *tpm_delegate_public);
+uint32_t   TPM_DelegatePublic_SizeOf(const TPM_DELEGATE_PUBLIC *tpm_delegate_public);
 void       TPM_DelegatePublic_Delete(TPM_DELEGATE_PUBLIC *tpm_delegate_public);
 
 TPM_RESULT TPM_DelegatePublic_Copy(TPM_DELEGATE_PUBLIC *dest,
@@ -133,6 +134,7 @@ TPM_RESULT TPM_FamilyTable_Load(TPM_FAMILY_TABLE *tpm_family_table,
 TPM_RESULT TPM_FamilyTable_Store(TPM_STORE_BUFFER *sbuffer,
                                  const TPM_FAMILY_TABLE *tpm_family_table,
 				 TPM_BOOL store_tag);
+uint32_t   TPM_FamilyTable_SizeOf(TPM_BOOL store_tag);
 void       TPM_FamilyTable_Delete(TPM_FAMILY_TABLE *tpm_family_table);
 
 TPM_RESULT TPM_FamilyTable_StoreValid(TPM_STORE_BUFFER *sbuffer,
@@ -173,6 +175,7 @@ TPM_RESULT TPM_DelegateTable_Load(TPM_DELEGATE_TABLE *tpm_delegate_table,
                                   uint32_t *stream_size);
 TPM_RESULT TPM_DelegateTable_Store(TPM_STORE_BUFFER *sbuffer,
                                    const TPM_DELEGATE_TABLE *tpm_delegate_table);
+uint32_t   TPM_DelegateTable_SizeOf(const TPM_DELEGATE_TABLE *tpm_delegate_table);
 void       TPM_DelegateTable_Delete(TPM_DELEGATE_TABLE *tpm_delegate_table);
 
 TPM_RESULT TPM_DelegateTable_StoreValid(TPM_STORE_BUFFER *sbuffer,
@@ -40,6 +40,7 @@
 #include <string.h>
 #include <stdio.h>
 
+#include "tpm_arena.h"
 #include "tpm_crypto.h"
 #include "tpm_debug.h"
 #include "tpm_digest.h"
@@ -51,7 +52,10 @@
 #include "tpm_nvram.h"
 #include "tpm_permanent.h"
 #include "tpm_platform.h"
+#include "tpm_slab.h"
 #include "tpm_startup.h"
+#include "tpm_statistics.h"
+#include "tpm_store.h"
 #include "tpm_structures.h"
 
 
@@ -60,12 +64,17 @@
 /* state for the TPM's */
 tpm_state_t *tpm_instances[TPMS_MAX];
 
-/* TPM_Global_Init initializes the tpm_state to default values.
+/* TPM_Global_Init initializes the tpm_state to default values, with 'keyHandles' key slots.  If
+   'keySwap' is TRUE, keys are swapped out when the slots are full.  The decrypted key blob cache
+   has 'keyCacheEntries' entries.
 
    It does not load any data from or store data to NVRAM
 */
 
-TPM_RESULT TPM_Global_Init(tpm_state_t *tpm_state)
+TPM_RESULT TPM_Global_Init(tpm_state_t *tpm_state,
+                           uint32_t keyHandles,
+                           TPM_BOOL keySwap,
+                           uint32_t keyCacheEntries)
 {
     TPM_RESULT rc = 0;
     
@@ -104,7 +113,16 @@ TPM_RESULT TPM_Global_Init(tpm_state_t *tpm_state)
     /* initialize the TPM_KEY_HANDLE_LIST structure */
     if (rc == 0) {
         printf("TPM_Global_Init: Initializing TPM_KEY_HANDLE_LIST\n");
-        TPM_KeyHandleEntries_Init(tpm_state->tpm_key_handle_entries);
+        TPM_KeyHandleEntries_Init(&(tpm_state->tpm_key_handle_entries));
+        rc = TPM_KeyHandleEntries_Alloc(&(tpm_state->tpm_key_handle_entries),
+                                        keyHandles, keySwap);
+    }
+    if (rc == 0) {
+        printf("TPM_Global_Init: Initializing TPM_KEY_CACHE\n");
+        TPM_KeyCache_Init(&(tpm_state->tpm_key_cache));
+        rc = TPM_KeyCache_Alloc(&(tpm_state->tpm_key_cache), keyCacheEntries);
+    }
+    if (rc == 0) {
 	/* initialize the SHA1 thread context */
 	tpm_state->sha1_context = NULL;
 	/* initialize the TIS SHA1 thread context */
@@ -112,6 +130,16 @@ TPM_RESULT TPM_Global_Init(tpm_state_t *tpm_state)
 	tpm_state->transportHandle = 0;
         printf("TPM_Global_Init: Initializing TPM_NV_INDEX_ENTRIES\n");
 	TPM_NVIndexEntries_Init(&(tpm_state->tpm_nv_index_entries));
+	tpm_state->tpm_nv_coalesce = FALSE;
+	tpm_state->tpm_nv_dirty = FALSE;
+	TPM_Digest_Init(tpm_state->tpm_nv_log_digest);
+	tpm_state->tpm_nv_log_size = 0;
+	TPM_Sbuffer_Init(&(tpm_state->tpm_permanent_shadow));
+	TPM_Sbuffer_Init(&(tpm_state->tpm_nv_log_shadow));
+	/* statistics are allocated on first use */
+	tpm_state->tpm_statistics = NULL;
+	TPM_Arena_Init(&(tpm_state->tpm_arena));
+	TPM_SlabPool_Init(&(tpm_state->tpm_slab_pool));
     }
     /* comes up in limited operation mode */
     /* shutdown is set on a self test failure, before calling TPM_Global_Init() */
@@ -195,11 +223,20 @@ void TPM_Global_Delete(tpm_state_t *tpm_state)
 	printf("  TPM_Global_Delete: Deleting TPM_STANY_DATA\n");
 	TPM_StanyData_Delete(&(tpm_state->tpm_stany_data));
 	printf("  TPM_Global_Delete: Deleting key handle entries\n");
-	TPM_KeyHandleEntries_Delete(tpm_state->tpm_key_handle_entries);
+	TPM_KeyHandleEntries_Delete(&(tpm_state->tpm_key_handle_entries));
+	TPM_KeyCache_Delete(&(tpm_state->tpm_key_cache));
 	printf("  TPM_Global_Delete: Deleting SHA1 contexts\n");
 	TPM_SHA1Delete(&(tpm_state->sha1_context));
 	TPM_SHA1Delete(&(tpm_state->sha1_context_tis));
 	TPM_NVIndexEntries_Delete(&(tpm_state->tpm_nv_index_entries));
+	TPM_Sbuffer_Zero(&(tpm_state->tpm_permanent_shadow));
+	TPM_Sbuffer_Delete(&(tpm_state->tpm_permanent_shadow));
+	TPM_Sbuffer_Zero(&(tpm_state->tpm_nv_log_shadow));
+	TPM_Sbuffer_Delete(&(tpm_state->tpm_nv_log_shadow));
+	TPM_Statistics_Delete(&(tpm_state->tpm_statistics));
+	TPM_Arena_Delete(&(tpm_state->tpm_arena));
+	/* last, after all pool objects were freed */
+	TPM_SlabPool_Delete(&(tpm_state->tpm_slab_pool));
     }
     return;
 }
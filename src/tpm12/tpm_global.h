@@ -65,7 +65,9 @@ typedef struct tdTPM_STATE
     /* 7.6 TPM_STANY_DATA  */
     TPM_STANY_DATA tpm_stany_data;
     /* 5.6 TPM_KEY_HANDLE_ENTRY */
-    TPM_KEY_HANDLE_ENTRY tpm_key_handle_entries[TPM_KEY_HANDLES];
+    TPM_KEY_HANDLE_ENTRIES tpm_key_handle_entries;
+    /* decrypted key blobs, see TPM_Key_DecryptEncData() */
+    TPM_KEY_CACHE tpm_key_cache;
     /* Context for SHA1 functions */
     void *sha1_context;
     void *sha1_context_tis;
@@ -77,11 +79,32 @@ typedef struct tdTPM_STATE
        have been read.  The index not being present indicates that some volatile fields should be
        cleared at first read. */
     TPM_NV_INDEX_ENTRIES tpm_nv_index_entries;
+    /* While tpm_nv_coalesce is TRUE, TPM_PermanentAll_NVStore() only sets tpm_nv_dirty and
+       TPM_PermanentAll_NVFlush() writes the permanent state once */
+    TPM_BOOL tpm_nv_coalesce;
+    TPM_BOOL tpm_nv_dirty;
+    /* NV index data log, see TPM_PermanentAll_NVStoreData().  The digest of the last record, or of
+       the non-volatile state if the log is empty, and the size of the log */
+    TPM_DIGEST tpm_nv_log_digest;
+    uint32_t tpm_nv_log_size;
+    /* The serialized non-volatile state last written to or read from NVRAM and the NV index data
+       log records appended since then.  TPM_PermanentAll_NVStore() rolls back from these copies
+       rather than reading NVRAM. */
+    TPM_STORE_BUFFER tpm_permanent_shadow;
+    TPM_STORE_BUFFER tpm_nv_log_shadow;
+    /* statistics, NULL unless enabled by TPMLIB_SetStatistics() */
+    struct tdTPM_STATISTICS *tpm_statistics;
+    /* per command arena for buffers that do not outlive the command, see TPM_Arena_Malloc() */
+    TPM_ARENA tpm_arena;
+    /* pools of keys and other fixed size structures, see TPM_Slab_Malloc() */
+    TPM_SLAB_POOL tpm_slab_pool;
     /* NOTE: members added here should be initialized by TPM_Global_Init() and possibly added to
        TPM_SaveState_Load() and TPM_SaveState_Store() */
 } tpm_state_t;
 
-/* state for the TPM */
+/* state for the TPM's created by TPM_MainInit().  Instances created through the handle-based
+   library API are not in this array.  Command processing must not access it, since each command
+   is processed on behalf of the instance passed to TPM_Process(). */
 extern tpm_state_t *tpm_instances[];
 
 
@@ -89,7 +112,10 @@ extern tpm_state_t *tpm_instances[];
   tpm_state_t
 */
 
-TPM_RESULT TPM_Global_Init(tpm_state_t *tpm_state);
+TPM_RESULT TPM_Global_Init(tpm_state_t *tpm_state,
+                           uint32_t keyHandles,
+                           TPM_BOOL keySwap,
+                           uint32_t keyCacheEntries);
 TPM_RESULT TPM_Global_Load(tpm_state_t *tpm_state);
 TPM_RESULT TPM_Global_Store(tpm_state_t *tpm_state);
 void       TPM_Global_Delete(tpm_state_t *tpm_state);
@@ -40,6 +40,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "tpm_arena.h"
 #include "tpm_auth.h"
 #include "tpm_crypto.h"
 #include "tpm_cryptoh.h"
@@ -1431,7 +1432,7 @@ TPM_RESULT TPM_Process_ActivateIdentity(tpm_state_t *tpm_state,
     */
     TPM_SizedBuffer_Delete(&blob);			/* @1 */
     TPM_SymmetricKey_Delete(&symmetricKey);		/* @2 */
-    free(b1Blob);					/* @3 */
+    TPM_Arena_Free(b1Blob);					/* @3 */
     TPM_AsymCaContents_Delete(&b1AsymCaContents);	/* @4 */
     TPM_EKBlob_Delete(&b1EkBlob);			/* @5 */
     TPM_EKBlobActivate_Delete(&a1);			/* @6 */
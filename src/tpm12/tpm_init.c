@@ -50,6 +50,8 @@
 #include "tpm_digest.h"
 #include "tpm_error.h"
 #include "tpm_io.h"
+#include "tpm_key.h"
+#include "tpm_keypool.h"
 #include "tpm_memory.h"
 #include "tpm_nonce.h"
 #include "tpm_nvfile.h"
@@ -70,6 +72,24 @@
 
 static TPM_RESULT TPM_CheckTypes(void);
 
+/* state shared by all TPM instances, set by TPM_MainInitCommon() */
+
+static TPM_BOOL   tpm_common_initialized = FALSE;   /* TRUE after TPM_MainInitCommon() */
+static TPM_RESULT tpm_common_test_rc = 0;           /* common self test result */
+
+/* key slots of the TPM instances created by TPM_MainInit(), see TPM_MainInit_SetKeyHandles() */
+
+static uint32_t   tpm_key_handles = TPM_KEY_HANDLES;
+
+/* key swapping of the TPM instances created by TPM_MainInitTPM(), see TPM_MainInit_SetKeySwap() */
+
+static TPM_BOOL   tpm_key_swap = FALSE;
+
+/* decrypted key blob cache entries of the TPM instances created by TPM_MainInitTPM(), see
+   TPM_MainInit_SetKeyCache() */
+
+static uint32_t   tpm_key_cache_entries = 0;
+
 
 /* TPM_Init transitions the TPM from a power-off state to one where the TPM begins an initialization
    process.  TPM_Init could be the result of power being applied to the platform or a hard reset.
@@ -83,11 +103,16 @@ static TPM_RESULT TPM_CheckTypes(void);
 
    main()
         TPM_MainInit()
-                TPM_IO_Init() - initializes the TPM I/O interface
-                TPM_Crypto_Init() - initializes cryptographic libraries
-                TPM_NVRAM_Init() - get NVRAM path once
-                TPM_LimitedSelfTest() - as per the specification
-                TPM_Global_Init() - initializes the TPM state
+                TPM_MainInitCommon()
+                        TPM_OrdinalTable_Init() - builds the ordinal dispatch index
+                        TPM_IO_Init() - initializes the TPM I/O interface
+                        TPM_Crypto_Init() - initializes cryptographic libraries
+                        TPM_NVRAM_Init() - get NVRAM path once
+                        TPM_LimitedSelfTestCommon() - as per the specification
+                TPM_MainInitTPM() - for each TPM instance
+                        TPM_Global_Init() - initializes the TPM state
+                        TPM_LimitedSelfTestTPM() - as per the specification
+                        TPM_KeyPool_Start() - starts the key pair pool worker
 
    Returns: 0 on success
 
@@ -101,120 +126,282 @@ TPM_RESULT TPM_MainInit(void)
 {
     TPM_RESULT  rc = 0;         /* results for common code, fatal errors */
     uint32_t    i;
-    TPM_RESULT  testRc = 0;     /* temporary place to hold common self tests failure before the tpm
-                                   state is created */
-    tpm_state_t *tpm_state;     /* TPM instance state */
 
-    tpm_state = NULL;           /* freed @1 */
+    /* initialization common to all TPM instances */
+    if (rc == 0) {
+        rc = TPM_MainInitCommon();
+    }
+    /* initialize the global structure for the TPM */
+    for (i = 0 ; (rc == 0) && (i < TPMS_MAX) ; i++) {
+        printf("TPM_MainInit: Initializing global TPM %lu\n", (unsigned long)i);
+        /* If there was no state for TPM 0 (instance 0 does not exist), initialize state for the
+           first time.  Instances > 0 are only loaded if they exist in NVRAM. */
+        rc = TPM_MainInitTPM(&(tpm_instances[i]), i,
+                             (i == 0),          /* create TPM 0 if it does not exist */
+                             tpm_key_handles);
+        /* If there was the non-fatal error TPM_RETRY, the instance does not exist.  If instance > 0
+           does not exist, the array entry is set to NULL.  Continue */
+        if (rc == TPM_RETRY) {
+            printf("TPM_MainInit: Not Creating global TPM %lu\n", (unsigned long)i);
+            tpm_instances[i] = NULL;    /* flag that the instance does not exist */
+            rc = 0;                     /* Instance does not exist, not fatal error */
+        }
+    }
+    return rc;
+}
+
+/* TPM_MainInitCommon() runs the part of the initialization that is shared by all TPM instances: the
+   host interface, the crypto library, the NVRAM static variables and the common limited self test.
+
+   It must be called once before the first TPM instance is created by TPM_MainInitTPM().
+
+   The result of the common self test is saved and applied to each TPM instance subsequently
+   created.
+
+   Returns: 0 on success
+
+            non-zero on a fatal error
+*/
+
+TPM_RESULT TPM_MainInitCommon(void)
+{
+    TPM_RESULT  rc = 0;         /* results for common code, fatal errors */
+
+    tpm_common_initialized = FALSE;
     /* preliminary check that platform specific sizes are correct */
     if (rc == 0) {
         rc = TPM_CheckTypes();
     }
+    /* build the ordinal dispatch index */
+    if (rc == 0) {
+        rc = TPM_OrdinalTable_Init();
+    }
     /* initialize the TPM to host interface */
     if (rc == 0) {
-        printf("TPM_MainInit: Initialize the TPM to host interface\n");
+        printf("TPM_MainInitCommon: Initialize the TPM to host interface\n");
         rc = TPM_IO_Init();
     }
     /* initialize cryptographic functions */
     if (rc == 0) {
-        printf("TPM_MainInit: Initialize the TPM crypto support\n");
+        printf("TPM_MainInitCommon: Initialize the TPM crypto support\n");
         rc = TPM_Crypto_Init();
     }
     /* initialize NVRAM static variables.  This must be called before the global TPM state is
        loaded */
     if (rc == 0) {
-        printf("TPM_MainInit: Initialize the TPM NVRAM\n");
+        printf("TPM_MainInitCommon: Initialize the TPM NVRAM\n");
         rc = TPM_NVRAM_Init();
     }
     /* run the initial subset of self tests once */
     if (rc == 0) {
-        printf("TPM_MainInit: Run common limited self tests\n");
+        printf("TPM_MainInitCommon: Run common limited self tests\n");
         /* an error is a fatal error, causes a shutdown of the TPM */
-        testRc = TPM_LimitedSelfTestCommon();
-    }   
-    /* initialize the global structure for the TPM */
-    for (i = 0 ; (rc == 0) && (i < TPMS_MAX) ; i++) {
-        printf("TPM_MainInit: Initializing global TPM %lu\n", (unsigned long)i);
-        /* Need to malloc and init a TPM state if this is the first time through or if the
-           state was saved in the array.  Otherwise, the malloc'ed structure from the previous
-           time through the loop can be reused. */
-        if ((rc == 0) && (tpm_state == NULL)) {
-            if (rc == 0) {
-                rc = TPM_Malloc((unsigned char **)&tpm_state, sizeof(tpm_state_t));
-            }
-            /* initialize the global instance state */
-            if (rc == 0) {
-                rc = TPM_Global_Init(tpm_state);                /* freed @2 */
-            }
+        tpm_common_test_rc = TPM_LimitedSelfTestCommon();
+        tpm_common_initialized = TRUE;
+    }
+    return rc;
+}
+
+/* TPM_MainInitCommon_IsDone() returns TRUE if TPM_MainInitCommon() completed successfully.
+*/
+
+TPM_BOOL TPM_MainInitCommon_IsDone(void)
+{
+    return tpm_common_initialized;
+}
+
+/* TPM_MainInit_SetKeyHandles() sets the number of key slots of the TPM instances created by
+   TPM_MainInit().  The key slots of those instances that already exist are resized.  Instances
+   created otherwise are not affected.
+
+   Returns TPM_BAD_PARAMETER if 'keyHandles' does not leave 2 slots besides the owner evict keys or
+   does not fit the uint16_t of the standard getcap, TPM_NOSPACE if the loaded keys of an existing
+   instance do not fit.
+*/
+
+TPM_RESULT TPM_MainInit_SetKeyHandles(uint32_t keyHandles)
+{
+    TPM_RESULT  rc = 0;
+    uint32_t    i;
+
+    printf("TPM_MainInit_SetKeyHandles: %u\n", keyHandles);
+    if (rc == 0) {
+        if ((keyHandles < (TPM_OWNER_EVICT_KEY_HANDLES + 2)) || (keyHandles > 0xffff)) {
+            printf("TPM_MainInit_SetKeyHandles: Error, %u not in range %u to %u\n",
+                   keyHandles, TPM_OWNER_EVICT_KEY_HANDLES + 2, 0xffff);
+            rc = TPM_BAD_PARAMETER;
         }
-        if (rc == 0) {
-            /* record the TPM number in the state */
-            tpm_state->tpm_number = i;
-            /* If the instance exists in NVRAM, it it initialized and saved in the tpm_instances[]
-               array. Restores TPM_PERMANENT_FLAGS and TPM_PERMANENT_DATA to in-memory
-               structures. */
-            /* Returns TPM_RETRY on non-existent file */
-            rc = TPM_PermanentAll_NVLoad(tpm_state);
+    }
+    for (i = 0 ; (rc == 0) && (i < TPMS_MAX) ; i++) {
+        if (tpm_instances[i] != NULL) {
+            rc = TPM_KeyHandleEntries_Resize(&(tpm_instances[i]->tpm_key_handle_entries),
+                                             keyHandles);
         }
-        /* If there was no state for TPM 0 (instance 0 does not exist), initialize state for the
-           first time using TPM_Global_Init() above.  It is created and set to default values.  */
-        if ((rc == TPM_RETRY) && (i == 0)) {
-            /* save the state for TPM 0 (first time through) */
-            rc = TPM_PermanentAll_NVStore(tpm_state,
-					  TRUE,		/* write NV */
-					  0);		/* no roll back */
+    }
+    if (rc == 0) {
+        tpm_key_handles = keyHandles;
+    }
+    return rc;
+}
+
+/* TPM_MainInit_GetKeyHandles() returns the number of key slots of the TPM instances created by
+   TPM_MainInit().
+*/
+
+uint32_t TPM_MainInit_GetKeyHandles(void)
+{
+    return tpm_key_handles;
+}
+
+/* TPM_MainInit_SetKeySwap() sets whether the TPM instances subsequently created by
+   TPM_MainInitTPM() swap out the least recently used key when the key slots are full, rather than
+   failing to load a key.  Instances that already exist keep their setting.
+*/
+
+void TPM_MainInit_SetKeySwap(TPM_BOOL keySwap)
+{
+    printf("TPM_MainInit_SetKeySwap: %u\n", keySwap);
+    tpm_key_swap = keySwap;
+    return;
+}
+
+/* TPM_MainInit_GetKeySwap() returns whether the TPM instances subsequently created by
+   TPM_MainInitTPM() swap out keys.
+*/
+
+TPM_BOOL TPM_MainInit_GetKeySwap(void)
+{
+    return tpm_key_swap;
+}
+
+/* TPM_MainInit_SetKeyCache() sets the number of decrypted key blob cache entries of the TPM
+   instances subsequently created by TPM_MainInitTPM().  0 disables the cache.  Instances that
+   already exist keep their cache.
+
+   Returns TPM_BAD_PARAMETER if 'keyCacheEntries' is greater than TPM_KEY_CACHE_ENTRIES_MAX.
+*/
+
+TPM_RESULT TPM_MainInit_SetKeyCache(uint32_t keyCacheEntries)
+{
+    TPM_RESULT  rc = 0;
+
+    printf("TPM_MainInit_SetKeyCache: %u\n", keyCacheEntries);
+    if (keyCacheEntries > TPM_KEY_CACHE_ENTRIES_MAX) {
+        printf("TPM_MainInit_SetKeyCache: Error, %u greater than %u\n",
+               keyCacheEntries, TPM_KEY_CACHE_ENTRIES_MAX);
+        rc = TPM_BAD_PARAMETER;
+    }
+    else {
+        tpm_key_cache_entries = keyCacheEntries;
+    }
+    return rc;
+}
+
+/* TPM_MainInit_GetKeyCache() returns the number of decrypted key blob cache entries of the TPM
+   instances subsequently created by TPM_MainInitTPM().
+*/
+
+uint32_t TPM_MainInit_GetKeyCache(void)
+{
+    return tpm_key_cache_entries;
+}
+
+/* TPM_MainInitTPM() allocates, initializes and loads the TPM instance 'tpm_number' with
+   'keyHandles' key slots.
+
+   If the instance does not exist in NVRAM and 'create' is TRUE, the instance is created with
+   default values and its permanent state is stored.  If 'create' is FALSE, TPM_RETRY is returned
+   and no instance is allocated.
+
+   On success, '*tpm_state' must be freed by the caller with TPM_Global_Delete() and free().
+
+   TPM_MainInitCommon() must have been called before.
+
+   Returns: 0 on success
+
+            TPM_RETRY if the instance does not exist and 'create' is FALSE
+
+            other non-zero values on a fatal error
+*/
+
+TPM_RESULT TPM_MainInitTPM(tpm_state_t **tpm_state,
+                           uint32_t tpm_number,
+                           TPM_BOOL create,
+                           uint32_t keyHandles)
+{
+    TPM_RESULT  rc = 0;
+    TPM_RESULT  testRc = 0;
+    tpm_state_t *new_state = NULL;      /* freed @1 on error */
+
+    printf("TPM_MainInitTPM: Initializing TPM %lu\n", (unsigned long)tpm_number);
+    *tpm_state = NULL;
+    if (rc == 0) {
+        if (!tpm_common_initialized) {
+            printf("TPM_MainInitTPM: Error (fatal), common initialization not done\n");
+            rc = TPM_FAIL;
         }
+    }
+    if (rc == 0) {
+        rc = TPM_Malloc((unsigned char **)&new_state, sizeof(tpm_state_t));
+    }
+    /* initialize the global instance state */
+    if (rc == 0) {
+        rc = TPM_Global_Init(new_state, keyHandles, tpm_key_swap,
+                             tpm_key_cache_entries);                    /* freed @2 */
+    }
+    if (rc == 0) {
+        /* record the TPM number in the state */
+        new_state->tpm_number = tpm_number;
+        /* Restores TPM_PERMANENT_FLAGS and TPM_PERMANENT_DATA to in-memory structures. */
+        /* Returns TPM_RETRY on non-existent file */
+        rc = TPM_PermanentAll_NVLoad(new_state);
+    }
+    /* If there was no state for the TPM, initialize state for the first time using
+       TPM_Global_Init() above.  It is created and set to default values.  */
+    if ((rc == TPM_RETRY) && create) {
+        rc = TPM_PermanentAll_NVStore(new_state,
+                                      TRUE,		/* write NV */
+                                      0);		/* no roll back */
+    }
 #ifdef TPM_VOLATILE_LOAD
-	/* if volatile state exists at startup, load it.  This is used for fail-over restart. */
-	if (rc == 0) {
-	    rc = TPM_VolatileAll_NVLoad(tpm_state);
-	}
+    /* if volatile state exists at startup, load it.  This is used for fail-over restart. */
+    if (rc == 0) {
+        rc = TPM_VolatileAll_NVLoad(new_state);
+    }
 #endif	/* TPM_VOLATILE_LOAD */
-        /* if permanent state was loaded successfully (or stored successfully for TPM 0 the first
-           time) */
-        if (rc == 0) {
-            printf("TPM_MainInit: Creating global TPM instance %lu\n", (unsigned long)i);
-            /* set the testState for the TPM based on the common selftest result */
+    /* if permanent state was loaded successfully (or stored successfully the first time) */
+    if (rc == 0) {
+        printf("TPM_MainInitTPM: Creating global TPM instance %lu\n", (unsigned long)tpm_number);
+        /* set the testState for the TPM based on the common selftest result */
+        if (tpm_common_test_rc != 0) {
+            /* a. When the TPM detects a failure during any self-test, it SHOULD delete values
+               preserved by TPM_SaveState. */
+            TPM_SaveState_NVDelete(new_state,
+                                   FALSE);        /* ignore error if the state does not exist */
+            printf("  TPM_MainInitTPM: Set testState to %u \n", TPM_TEST_STATE_FAILURE);
+            new_state->testState = TPM_TEST_STATE_FAILURE;
+        }
+        /* run individual self test on the TPM, don't continue if already error */
+        else {
+            printf("TPM_MainInitTPM: Run limited self tests on TPM %lu\n",
+                   (unsigned long)tpm_number);
+            testRc = TPM_LimitedSelfTestTPM(new_state);
             if (testRc != 0) {
                 /* a. When the TPM detects a failure during any self-test, it SHOULD delete values
                    preserved by TPM_SaveState. */
-                TPM_SaveState_NVDelete(tpm_state,
-                                       FALSE);        /* ignore error if the state does not exist */
-		printf("  TPM_MainInit: Set testState to %u \n", TPM_TEST_STATE_FAILURE);
-                tpm_state->testState = TPM_TEST_STATE_FAILURE;
+                TPM_SaveState_NVDelete(new_state,
+                                       FALSE);    /* ignore error if the state does not exist */
             }
-            /* save state in array */
-            tpm_instances[i] = tpm_state;
-            tpm_state = NULL;   /* flag that the malloc'ed structure was used.  It should not be
-                                   freed, and a new instance is needed the next time through the
-                                   loop */
-        }
-        /* If there was the non-fatal error TPM_RETRY, the instance does not exist.  If instance > 0
-           does not exist, the array entry is set to NULL.  Continue */
-        else if (rc == TPM_RETRY) {
-            printf("TPM_MainInit: Not Creating global TPM %lu\n", (unsigned long)i);
-            tpm_instances[i] = NULL;    /* flag that the instance does not exist */
-            rc = 0;                     /* Instance does not exist, not fatal error */
         }
-    }
-   /* run individual self test on a TPM */
-    for (i = 0 ;
-         (rc == 0) && (i < TPMS_MAX) && (tpm_instances[i] != NULL) &&
-             (tpm_instances[i]->testState != TPM_TEST_STATE_FAILURE) ;  /* don't continue if already
-                                                                           error */
-         i++) {
-        printf("TPM_MainInit: Run limited self tests on TPM %lu\n", (unsigned long)i);
-        testRc = TPM_LimitedSelfTestTPM(tpm_instances[i]);
-        if (testRc != 0) {
-            /* a. When the TPM detects a failure during any self-test, it SHOULD delete values
-               preserved by TPM_SaveState. */
-            TPM_SaveState_NVDelete(tpm_state,
-                                   FALSE);        /* ignore error if the state does not exist */
-        }
-    }
-    /* the _Delete(), free() clean up if the last created instance was not required */
-    TPM_Global_Delete(tpm_state); 	/* @2 */
-    free(tpm_state);                    /* @1 */
+        /* pre-generate key pairs if enabled, stopped by TPM_KeyPool_Stop() when the instance is
+           terminated */
+        TPM_KeyPool_Start();
+        *tpm_state = new_state;
+        new_state = NULL;       /* flag that the malloc'ed structure was used */
+    }
+    /* the _Delete(), free() clean up if the created instance was not required */
+    TPM_Global_Delete(new_state); 	/* @2 */
+    free(new_state);                    /* @1 */
     return rc;
 }
 
@@ -356,6 +543,17 @@ TPM_RESULT TPM_StanyFlags_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_StanyFlags_SizeOf() returns the number of bytes TPM_StanyFlags_Store() serializes */
+
+uint32_t TPM_StanyFlags_SizeOf(void)
+{
+    return sizeof(uint16_t) +			/* tag */
+	sizeof(TPM_BOOL) +			/* postInitialise */
+	sizeof(uint32_t) +			/* localityModifier */
+	sizeof(uint32_t) +			/* transportExclusive */
+	(2 * sizeof(TPM_BOOL));			/* TOSPresent, stateSaved */
+}
+
 /*
   TPM_STCLEAR_FLAGS
 */
@@ -465,6 +663,13 @@ TPM_RESULT TPM_StclearFlags_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_StclearFlags_SizeOf() returns the number of bytes TPM_StclearFlags_Store() serializes */
+
+uint32_t TPM_StclearFlags_SizeOf(void)
+{
+    return sizeof(uint16_t) + (5 * sizeof(TPM_BOOL));
+}
+
 /* TPM_StclearFlags_StoreBitmap() serializes TPM_STCLEAR_FLAGS structure into a bit map
 
  */
@@ -577,6 +782,13 @@ TPM_RESULT TPM_StanyData_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_StanyData_SizeOf() returns the number of bytes TPM_StanyData_Store() serializes */
+
+uint32_t TPM_StanyData_SizeOf(void)
+{
+    return sizeof(uint16_t) + TPM_CurrentTicks_SizeOfAll();
+}
+
 /* TPM_StanyData_Delete()
 
    No-OP if the parameter is NULL, else:
@@ -834,6 +1046,35 @@ TPM_RESULT TPM_StclearData_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_StclearData_SizeOf() returns the number of bytes TPM_StclearData_Store() serializes for the
+   same 'pcrAttrib' */
+
+uint32_t TPM_StclearData_SizeOf(TPM_STCLEAR_DATA *tpm_stclear_data,
+				TPM_PCR_ATTRIBUTES *pcrAttrib)
+{
+    uint32_t		size;
+
+    size = sizeof(uint16_t) +			/* tag */
+	   TPM_NONCE_SIZE +			/* contextNonceKey */
+	   sizeof(TPM_COUNT_ID) +		/* countID */
+	   sizeof(uint32_t) +			/* ownerReference */
+	   sizeof(TPM_BOOL) +			/* disableResetLock */
+	   TPM_PCRs_SizeOf(pcrAttrib) +
+#if  (TPM_REVISION >= 103)
+	   sizeof(uint32_t) +			/* deferredPhysicalPresence */
+#endif
+	   sizeof(uint32_t) +			/* authFailCount */
+	   sizeof(uint32_t) +			/* authFailTime */
+	   TPM_AuthSessions_SizeOf(tpm_stclear_data->authSessions) +
+	   TPM_TransportSessions_SizeOf(tpm_stclear_data->transSessions) +
+	   TPM_DaaSessions_SizeOf(tpm_stclear_data->daaSessions) +
+	   TPM_NONCE_SIZE +			/* contextNonceSession */
+	   sizeof(uint32_t) +			/* contextCount */
+	   TPM_ContextList_SizeOf() +
+	   TPM_DIGEST_SIZE;			/* auditDigest */
+    return size;
+}
+
 /* TPM_StclearData_Delete()
 
    No-OP if the parameter is NULL, else:
@@ -928,13 +1169,25 @@ TPM_RESULT TPM_InitCmd(tpm_state_t *tpm_state)
 {
     TPM_RESULT  rc = 0;
     uint32_t	tpm_number;
+    uint32_t	keyHandles;
+    TPM_BOOL	keySwap;
+    uint32_t	keyCacheEntries;
+    struct tdTPM_STATISTICS *tpm_statistics;
     
     printf(" TPM_Init:\n");
     /* Release all resources for the TPM and reinitialize */
     if (rc == TPM_SUCCESS) {
         tpm_number = tpm_state->tpm_number;     /* save the TPM value */
+        keyHandles = tpm_state->tpm_key_handle_entries.keyHandleCount;
+        keySwap = tpm_state->tpm_key_handle_entries.keySwap;
+        keyCacheEntries = tpm_state->tpm_key_cache.keyCacheCount;
+        /* the statistics describe the instance, not its state, keep them */
+        tpm_statistics = tpm_state->tpm_statistics;
+        tpm_state->tpm_statistics = NULL;
         TPM_Global_Delete(tpm_state);		/* delete all the state */
-	rc = TPM_Global_Init(tpm_state);	/* re-allocate the state */
+	rc = TPM_Global_Init(tpm_state, keyHandles, keySwap,	/* re-allocate the state */
+			     keyCacheEntries);
+        tpm_state->tpm_statistics = tpm_statistics;
     }
     /* Reload non-volatile memory */
     if (rc == TPM_SUCCESS) {
@@ -46,6 +46,18 @@
 
 /* Power up initialization */
 TPM_RESULT TPM_MainInit(void);
+TPM_RESULT TPM_MainInitCommon(void);
+TPM_BOOL   TPM_MainInitCommon_IsDone(void);
+TPM_RESULT TPM_MainInit_SetKeyHandles(uint32_t keyHandles);
+uint32_t   TPM_MainInit_GetKeyHandles(void);
+void       TPM_MainInit_SetKeySwap(TPM_BOOL keySwap);
+TPM_BOOL   TPM_MainInit_GetKeySwap(void);
+TPM_RESULT TPM_MainInit_SetKeyCache(uint32_t keyCacheEntries);
+uint32_t   TPM_MainInit_GetKeyCache(void);
+TPM_RESULT TPM_MainInitTPM(tpm_state_t **tpm_state,
+                           uint32_t tpm_number,
+                           TPM_BOOL create,
+                           uint32_t keyHandles);
 
 /*
   TPM_STANY_FLAGS
@@ -58,6 +70,7 @@ TPM_RESULT TPM_StanyFlags_Load(TPM_STANY_FLAGS *tpm_stany_flags,
 			       uint32_t *stream_size);
 TPM_RESULT TPM_StanyFlags_Store(TPM_STORE_BUFFER *sbuffer,
 				TPM_STANY_FLAGS *tpm_stany_flags);
+uint32_t   TPM_StanyFlags_SizeOf(void);
 
 /*
   TPM_STCLEAR_FLAGS
@@ -69,6 +82,7 @@ TPM_RESULT TPM_StclearFlags_Load(TPM_STCLEAR_FLAGS *tpm_stclear_flags,
                                  uint32_t *stream_size);
 TPM_RESULT TPM_StclearFlags_Store(TPM_STORE_BUFFER *sbuffer,
                                   const TPM_STCLEAR_FLAGS *tpm_stclear_flags);
+uint32_t   TPM_StclearFlags_SizeOf(void);
 TPM_RESULT TPM_StclearFlags_StoreBitmap(uint32_t *tpm_bitmap,
                                         const TPM_STCLEAR_FLAGS *tpm_stclear_flags);
 /*
@@ -81,6 +95,7 @@ TPM_RESULT TPM_StanyData_Load(TPM_STANY_DATA *tpm_stany_data,
 			      uint32_t *stream_size);
 TPM_RESULT TPM_StanyData_Store(TPM_STORE_BUFFER *sbuffer,
 			       TPM_STANY_DATA *tpm_stany_data);
+uint32_t   TPM_StanyData_SizeOf(void);
 void       TPM_StanyData_Delete(TPM_STANY_DATA *tpm_stany_data);
 
 /*
@@ -97,6 +112,8 @@ TPM_RESULT TPM_StclearData_Load(TPM_STCLEAR_DATA *tpm_stclear_data,
 TPM_RESULT TPM_StclearData_Store(TPM_STORE_BUFFER *sbuffer,
                                  TPM_STCLEAR_DATA *tpm_stclear_data,
                                  TPM_PCR_ATTRIBUTES *pcrAttrib);
+uint32_t   TPM_StclearData_SizeOf(TPM_STCLEAR_DATA *tpm_stclear_data,
+				  TPM_PCR_ATTRIBUTES *pcrAttrib);
 void       TPM_StclearData_Delete(TPM_STCLEAR_DATA *tpm_stclear_data,
                                   TPM_PCR_ATTRIBUTES *pcrAttrib,
                                   TPM_BOOL pcrInit);
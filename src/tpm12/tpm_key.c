@@ -41,15 +41,18 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "tpm_arena.h"
 #include "tpm_auth.h"
 #include "tpm_commands.h"
 #include "tpm_crypto.h"
 #include "tpm_cryptoh.h"
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_KEY
 #include "tpm_debug.h"
 #include "tpm_digest.h"
 #include "tpm_error.h"
 #include "tpm_init.h"
 #include "tpm_io.h"
+#include "tpm_keypool.h"
 #include "tpm_load.h"
 #include "tpm_memory.h"
 #include "tpm_nonce.h"
@@ -58,9 +61,11 @@
 #include "tpm_owner.h"
 #include "tpm_pcr.h"
 #include "tpm_sizedbuffer.h"
+#include "tpm_slab.h"
 #include "tpm_store.h"
 #include "tpm_structures.h"
 #include "tpm_startup.h"
+#include "tpm_statistics.h"
 #include "tpm_permanent.h"
 #include "tpm_process.h"
 #include "tpm_ver.h"
@@ -70,9 +75,37 @@
 /* The default RSA exponent */
 unsigned char tpm_default_rsa_exponent[] = {0x01, 0x00, 0x01};
 
+/* The swap entries and the key handle hash table, at least 4 buckets per slot or swap entry, are
+   each allocated as one buffer of at most TPM_ALLOC_MAX bytes */
+#define TPM_KEY_SWAP_ENTRIES_MAX	(TPM_ALLOC_MAX / sizeof(TPM_KEY_HANDLE_ENTRY))
+#define TPM_KEY_LOCATIONS_MAX		(TPM_ALLOC_MAX / (4 * sizeof(uint32_t)))
+
 /* local prototypes */
 
 static TPM_RESULT TPM_Key_CheckTag(TPM_KEY12 *tpm_key12);
+static TPM_KEY_HANDLE_ENTRY *
+TPM_KeyHandleEntries_GetLocation(const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
+				 uint32_t location);
+static void TPM_KeyHandleEntries_GetFree(TPM_BOOL *isFree,
+					 uint32_t *index,
+					 const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries);
+static void TPM_KeyHandleEntries_GetVictim(TPM_BOOL *isVictim,
+					   uint32_t *index,
+					   const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries);
+static TPM_RESULT TPM_KeyHandleEntries_SwapOut(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
+					       uint32_t index);
+static TPM_RESULT TPM_KeyHandleEntries_SwapGrow(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries);
+static uint32_t TPM_KeyHandleEntries_GetSwapMax(uint32_t keyHandleCount);
+static void TPM_KeyHandleEntries_SwapIn(uint32_t *index,
+					TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
+					uint32_t location);
+static void TPM_KeyHandleEntries_HashAdd(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
+					 uint32_t location);
+static void TPM_KeyHandleEntries_HashBuild(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries);
+static uint32_t TPM_KeyHandleEntries_Hash(TPM_KEY_HANDLE tpm_key_handle,
+					  uint32_t hashMask);
+static void TPM_KeyCacheEntry_Init(TPM_KEY_CACHE_ENTRY *tpm_key_cache_entry);
+static void TPM_KeyCacheEntry_Delete(TPM_KEY_CACHE_ENTRY *tpm_key_cache_entry);
 
 /*
   TPM_KEY, TPM_KEY12
@@ -101,6 +134,7 @@ void TPM_Key_Init(TPM_KEY *tpm_key)
     tpm_key->tpm_pcr_info_long = NULL;
     tpm_key->tpm_store_asymkey = NULL;
     tpm_key->tpm_migrate_asymkey = NULL;
+    tpm_key->rsa_key_token = NULL;
     return;
 }
 
@@ -563,12 +597,12 @@ TPM_RESULT TPM_Key_StoreClear(TPM_STORE_BUFFER *sbuffer,
 			      TPM_KEY *tpm_key)
 {
     TPM_RESULT		rc = 0;
-    TPM_STORE_BUFFER	asymSbuffer;
-    const unsigned char *asymBuffer;
+    const unsigned char *buffer;		/* elements of sbuffer */
+    uint32_t		asymStart;		/* sbuffer length before TPM_STORE_ASYMKEY */
+    uint32_t		asymEnd;		/* sbuffer length after TPM_STORE_ASYMKEY */
     uint32_t		asymLength;
     
     printf(" TPM_Key_StoreClear:\n");
-    TPM_Sbuffer_Init(&asymSbuffer);			/* freed @1 */
     /* store the pubData */
     if (rc == 0) {
 	rc = TPM_Key_StorePubData(sbuffer, isEK, tpm_key); 
@@ -577,18 +611,23 @@ TPM_RESULT TPM_Key_StoreClear(TPM_STORE_BUFFER *sbuffer,
     if (rc == 0) {
 	/* if the TPM_STORE_ASYMKEY cache exists */
 	if (tpm_key->tpm_store_asymkey != NULL) {
-	    /* , serialize it */
+	    /* the size is known up front, so serialize it directly as a sized buffer */
+	    asymLength = TPM_StoreAsymkey_SizeOf(isEK, tpm_key->tpm_store_asymkey);
 	    if (rc == 0) {
-		rc = TPM_StoreAsymkey_Store(&asymSbuffer, isEK, tpm_key->tpm_store_asymkey);
+		rc = TPM_Sbuffer_Append32(sbuffer, asymLength);
 	    }
-	    /* get the result */
-	    TPM_Sbuffer_Get(&asymSbuffer, &asymBuffer, &asymLength);
-	    /* store the result as a sized buffer */
 	    if (rc == 0) {
-		rc = TPM_Sbuffer_Append32(sbuffer, asymLength);
+		TPM_Sbuffer_Get(sbuffer, &buffer, &asymStart);
+		rc = TPM_StoreAsymkey_Store(sbuffer, isEK, tpm_key->tpm_store_asymkey);
 	    }
+	    /* sanity check that the size prefix matches what was serialized */
 	    if (rc == 0) {
-		rc = TPM_Sbuffer_Append(sbuffer, asymBuffer, asymLength);
+		TPM_Sbuffer_Get(sbuffer, &buffer, &asymEnd);
+		if ((asymEnd - asymStart) != asymLength) {
+		    printf("TPM_Key_StoreClear: Error (fatal), stored %u bytes, expected %u\n",
+			   asymEnd - asymStart, asymLength);
+		    rc = TPM_FAIL;
+		}
 	    }
 	}
 	/* If there is no TPM_STORE_ASYMKEY cache, mark it empty.  This can occur for an internal
@@ -597,10 +636,64 @@ TPM_RESULT TPM_Key_StoreClear(TPM_STORE_BUFFER *sbuffer,
 	    rc = TPM_Sbuffer_Append32(sbuffer, 0);
 	}
     }
-    TPM_Sbuffer_Delete(&asymSbuffer);			/* @1 */
     return rc;
 }
 
+/* TPM_Key_SizeOfPubData() returns the number of bytes TPM_Key_StorePubData() serializes.
+
+   Like the store, it uses the PCR and algorithm parameter caches rather than the serialized sized
+   buffers.
+*/
+
+uint32_t TPM_Key_SizeOfPubData(TPM_BOOL isEK,
+			       const TPM_KEY *tpm_key)
+{
+    uint32_t	size;
+
+    size = sizeof(uint32_t) +			/* ver, or tag and fill */
+	   sizeof(TPM_KEY_USAGE) +
+	   sizeof(TPM_KEY_FLAGS) +
+	   sizeof(TPM_AUTH_DATA_USAGE) +
+	   TPM_KeyParms_SizeOf(&(tpm_key->algorithmParms));
+    if (!isEK) {
+	size += sizeof(uint32_t);
+	if (((TPM_KEY12 *)tpm_key)->tag != TPM_TAG_KEY12) {	/* TPM_KEY */
+	    if (tpm_key->tpm_pcr_info != NULL) {
+		size += TPM_PCRInfo_SizeOf(tpm_key->tpm_pcr_info);
+	    }
+	}
+	else {							/* TPM_KEY12 */
+	    if (tpm_key->tpm_pcr_info_long != NULL) {
+		size += TPM_PCRInfoLong_SizeOf(tpm_key->tpm_pcr_info_long);
+	    }
+	}
+    }
+    size += sizeof(uint32_t) + tpm_key->pubKey.size;
+    return size;
+}
+
+/* TPM_Key_SizeOf() returns the number of bytes TPM_Key_Store() serializes */
+
+uint32_t TPM_Key_SizeOf(const TPM_KEY *tpm_key)
+{
+    return TPM_Key_SizeOfPubData(FALSE, tpm_key) +
+	sizeof(uint32_t) + tpm_key->encData.size;
+}
+
+/* TPM_Key_SizeOfClear() returns the number of bytes TPM_Key_StoreClear() serializes */
+
+uint32_t TPM_Key_SizeOfClear(TPM_BOOL isEK,
+			     const TPM_KEY *tpm_key)
+{
+    uint32_t	size;
+
+    size = TPM_Key_SizeOfPubData(isEK, tpm_key) + sizeof(uint32_t);
+    if (tpm_key->tpm_store_asymkey != NULL) {
+	size += TPM_StoreAsymkey_SizeOf(isEK, tpm_key->tpm_store_asymkey);
+    }
+    return size;
+}
+
 /* TPM_KEY_StorePubkey() gets (as a stream) the TPM_PUBKEY derived from a TPM_KEY
 
    There is no need to actually assemble the structure, since only the serialization of its two
@@ -655,16 +748,17 @@ void TPM_Key_Delete(TPM_KEY *tpm_key)
 	TPM_SizedBuffer_Delete(&(tpm_key->pcrInfo));
 	/* pcr caches */
 	TPM_PCRInfo_Delete(tpm_key->tpm_pcr_info);
-	free(tpm_key->tpm_pcr_info);
+	TPM_Slab_Free(tpm_key->tpm_pcr_info);
 	TPM_PCRInfoLong_Delete(tpm_key->tpm_pcr_info_long);
-	free(tpm_key->tpm_pcr_info_long);
+	TPM_Slab_Free(tpm_key->tpm_pcr_info_long);
 
 	TPM_SizedBuffer_Delete(&(tpm_key->pubKey));
 	TPM_SizedBuffer_Delete(&(tpm_key->encData));
 	TPM_StoreAsymkey_Delete(tpm_key->tpm_store_asymkey);
-	free(tpm_key->tpm_store_asymkey);
+	TPM_Slab_Free(tpm_key->tpm_store_asymkey);
 	TPM_MigrateAsymkey_Delete(tpm_key->tpm_migrate_asymkey);
 	free(tpm_key->tpm_migrate_asymkey);
+	TPM_RSAKeyToken_Free(&(tpm_key->rsa_key_token));
 	TPM_Key_Init(tpm_key);
     }
     return;
@@ -799,8 +893,8 @@ TPM_RESULT TPM_Key_LoadStoreAsymKey(TPM_KEY *tpm_key,
     }
     /* allocate memory for the structure */
     if (rc == 0) {
-	rc = TPM_Malloc((unsigned char **)&(tpm_key->tpm_store_asymkey),
-			sizeof(TPM_STORE_ASYMKEY));
+	rc = TPM_Slab_Malloc((unsigned char **)&(tpm_key->tpm_store_asymkey),
+			     TPM_SLAB_STORE_ASYMKEY, sizeof(TPM_STORE_ASYMKEY));
     }
     if (rc == 0) {
 	TPM_StoreAsymkey_Init(tpm_key->tpm_store_asymkey);
@@ -962,6 +1056,109 @@ TPM_RESULT TPM_Key_GetPrivateKey(uint32_t	*dbytes,
     return rc;
 }
 
+/* TPM_Key_GetCRTParameters() gets the prime factors and the Chinese Remainder Theorem parameters
+   from the TPM_STORE_ASYMKEY contained in a TPM_KEY
+*/
+
+TPM_RESULT TPM_Key_GetCRTParameters(uint32_t		*pbytes,
+				    unsigned char	**parr,
+				    uint32_t		*qbytes,
+				    unsigned char	**qarr,
+				    uint32_t		*dpbytes,
+				    unsigned char	**dparr,
+				    uint32_t		*dqbytes,
+				    unsigned char	**dqarr,
+				    uint32_t		*qinvbytes,
+				    unsigned char	**qinvarr,
+				    TPM_KEY		*tpm_key)
+{
+    TPM_RESULT	rc = 0;
+    TPM_STORE_ASYMKEY	*tpm_store_asymkey;
+    
+    printf(" TPM_Key_GetCRTParameters:\n");
+    if (rc == 0) {
+	rc = TPM_Key_GetStoreAsymkey(&tpm_store_asymkey, tpm_key);
+    }
+    if (rc == 0) {
+	*pbytes = tpm_store_asymkey->privKey.p_key.size;
+	*parr = tpm_store_asymkey->privKey.p_key.buffer;
+	*qbytes = tpm_store_asymkey->privKey.q_key.size;
+	*qarr = tpm_store_asymkey->privKey.q_key.buffer;
+	*dpbytes = tpm_store_asymkey->privKey.dp_key.size;
+	*dparr = tpm_store_asymkey->privKey.dp_key.buffer;
+	*dqbytes = tpm_store_asymkey->privKey.dq_key.size;
+	*dqarr = tpm_store_asymkey->privKey.dq_key.buffer;
+	*qinvbytes = tpm_store_asymkey->privKey.qinv_key.size;
+	*qinvarr = tpm_store_asymkey->privKey.qinv_key.buffer;
+    }
+    return rc;
+}
+
+/* TPM_Key_GetRSAKeyToken() gets the crypto library private key token for the TPM_KEY.
+
+   The token is built from the public and private key parts on first use and cached in the TPM_KEY
+   until TPM_Key_Delete(), so that repeated operations with a loaded key skip the key setup.  The
+   caller must not free the token.
+*/
+
+TPM_RESULT TPM_Key_GetRSAKeyToken(TPM_RSA_KEY_TOKEN	*rsa_key_token,
+				  TPM_KEY		*tpm_key)
+{
+    TPM_RESULT		rc = 0;
+    uint32_t		nbytes;
+    unsigned char	*narr;
+    uint32_t		ebytes;
+    unsigned char	*earr;
+    uint32_t		dbytes;
+    unsigned char	*darr;
+    uint32_t		pbytes;
+    unsigned char	*parr;
+    uint32_t		qbytes;
+    unsigned char	*qarr;
+    uint32_t		dpbytes;
+    unsigned char	*dparr;
+    uint32_t		dqbytes;
+    unsigned char	*dqarr;
+    uint32_t		qinvbytes;
+    unsigned char	*qinvarr;
+
+    printf(" TPM_Key_GetRSAKeyToken:\n");
+    if ((rc == 0) && (tpm_key->rsa_key_token == NULL)) {
+	if (rc == 0) {
+	    rc = TPM_Key_GetPublicKey(&nbytes, &narr, tpm_key);
+	}
+	if (rc == 0) {
+	    rc = TPM_Key_GetExponent(&ebytes, &earr, tpm_key);
+	}
+	if (rc == 0) {
+	    rc = TPM_Key_GetPrivateKey(&dbytes, &darr, tpm_key);
+	}
+	if (rc == 0) {
+	    rc = TPM_Key_GetCRTParameters(&pbytes, &parr,
+					  &qbytes, &qarr,
+					  &dpbytes, &dparr,
+					  &dqbytes, &dqarr,
+					  &qinvbytes, &qinvarr,
+					  tpm_key);
+	}
+	if (rc == 0) {
+	    rc = TPM_RSAKeyToken_New(&(tpm_key->rsa_key_token),	/* freed by TPM_Key_Delete() */
+				     narr, nbytes,
+				     earr, ebytes,
+				     darr, dbytes,
+				     parr, pbytes,
+				     qarr, qbytes,
+				     dparr, dpbytes,
+				     dqarr, dqbytes,
+				     qinvarr, qinvbytes);
+	}
+    }
+    if (rc == 0) {
+	*rsa_key_token = tpm_key->rsa_key_token;
+    }
+    return rc;
+}
+
 /* TPM_Key_GetExponent() gets the exponent key from the TPM_RSA_KEY_PARMS contained in a TPM_KEY
  */
 
@@ -1066,6 +1263,7 @@ TPM_RESULT TPM_Key_GenerateRSA(TPM_KEY *tpm_key,		/* output created key */
     unsigned char	*p = NULL;	/* prime factor */
     unsigned char	*q = NULL;	/* prime factor */
     unsigned char	*d = NULL;	/* private key */
+    uint64_t		startTime;
     
     printf(" TPM_Key_GenerateRSA:\n");
     /* extract the TPM_RSA_KEY_PARMS from TPM_KEY_PARMS */
@@ -1079,21 +1277,23 @@ TPM_RESULT TPM_Key_GenerateRSA(TPM_KEY *tpm_key,		/* output created key */
     /* allocate storage for TPM_STORE_ASYMKEY.	The structure is not freed.  It is cached in the
        TPM_KEY->TPM_STORE_ASYMKEY member and freed when they are deleted. */
     if (rc == 0) {
-	rc = TPM_Malloc((unsigned char **)&(tpm_key->tpm_store_asymkey),
-			sizeof(TPM_STORE_ASYMKEY));
+	rc = TPM_Slab_Malloc((unsigned char **)&(tpm_key->tpm_store_asymkey),
+			     TPM_SLAB_STORE_ASYMKEY, sizeof(TPM_STORE_ASYMKEY));
     }
     if (rc == 0) {
 	TPM_StoreAsymkey_Init(tpm_key->tpm_store_asymkey);
     }
     /* generate the key pair */
     if (rc == 0) {
-	rc = TPM_RSAGenerateKeyPair(&n,		/* public key (modulus) freed @3 */
-				    &p,		/* private prime factor freed @4 */
-				    &q,		/* private prime factor freed @5 */
-				    &d,		/* private key (private exponent) freed @6 */
-				    tpm_rsa_key_parms->keyLength,	/* key size in bits */
-				    earr,	/* public exponent */
-				    ebytes);
+	TPM_Statistics_StartTimer(&startTime);
+	rc = TPM_KeyPool_GenerateKeyPair(&n,	/* public key (modulus) freed @3 */
+					 &p,	/* private prime factor freed @4 */
+					 &q,	/* private prime factor freed @5 */
+					 &d,	/* private key (private exponent) freed @6 */
+					 tpm_rsa_key_parms->keyLength,	/* key size in bits */
+					 earr,	/* public exponent */
+					 ebytes);
+	TPM_Statistics_StopTimer(startTime, TPM_STATISTICS_RSA);
     }
     /* construct the TPM_STORE_ASYMKEY member */
     if (rc == 0) {
@@ -1117,6 +1317,9 @@ TPM_RESULT TPM_Key_GenerateRSA(TPM_KEY *tpm_key,		/* output created key */
 				 tpm_rsa_key_parms->keyLength/(CHAR_BIT * 2),
 				 q);
     }
+    if (rc == 0) {
+	rc = TPM_StorePrivkey_SetCRT(&(tpm_key->tpm_store_asymkey->privKey));
+    }
     if (rc == 0) {
 	rc = TPM_Key_Set(tpm_key,
 			 tpm_state,
@@ -1287,20 +1490,39 @@ TPM_RESULT TPM_Key_GenerateEncData(TPM_KEY *tpm_key,
 /* TPM_Key_DecryptEncData() decrypts the TPM_KEY -> encData using the parent private key.  The
    result is deserialized and stored in the TPM_KEY -> TPM_STORE_ASYMKEY cache.
 
+   If 'tpm_key_cache' has entries, the decrypted encData is looked up there first, and added after
+   a private key operation.  The parent is identified by its pubDataDigest, so that the entry does
+   not match any other parent key.
 */
 
-TPM_RESULT TPM_Key_DecryptEncData(TPM_KEY *tpm_key,	/* result */
-				  TPM_KEY *parent_key)	/* parent for decrypting encData */
+TPM_RESULT TPM_Key_DecryptEncData(TPM_KEY *tpm_key,		/* result */
+				  TPM_KEY *parent_key,		/* parent for decrypting encData */
+				  TPM_KEY_CACHE *tpm_key_cache)
 {
     TPM_RESULT		rc = 0;
+    TPM_RESULT		irc;
     unsigned char	*decryptData = NULL;	/* freed @1 */
     uint32_t		decryptDataLength = 0;	/* actual valid data */
+    const unsigned char	*cacheData = NULL;	/* belongs to the cache */
+    TPM_DIGEST		encDataDigest;
     unsigned char	*stream;
     uint32_t		stream_size;
 
     printf(" TPM_Key_DecryptEncData\n");
+    /* look for the decrypted data in the cache */
+    if ((rc == 0) && (tpm_key_cache->keyCacheCount > 0)) {
+	rc = TPM_SHA1(encDataDigest,
+		      tpm_key->encData.size, tpm_key->encData.buffer,
+		      0, NULL);
+	if (rc == 0) {
+	    TPM_KeyCache_GetEntry(&cacheData, &decryptDataLength,
+				  tpm_key_cache,
+				  parent_key->tpm_store_asymkey->pubDataDigest,
+				  encDataDigest);
+	}
+    }
     /* allocate space for the decrypted data */
-    if (rc == 0) {
+    if ((rc == 0) && (cacheData == NULL)) {
 	rc = TPM_RSAPrivateDecryptMalloc(&decryptData,			/* decrypted data */
 					 &decryptDataLength,		/* actual size of decrypted
 									   data */
@@ -1310,11 +1532,24 @@ TPM_RESULT TPM_Key_DecryptEncData(TPM_KEY *tpm_key,	/* result */
     }
     /* load the TPM_STORE_ASYMKEY cache from the 'encData' member stream */
     if (rc == 0) {
-	stream = decryptData;
+	stream = (cacheData != NULL) ? (unsigned char *)cacheData : decryptData;
 	stream_size = decryptDataLength;
 	rc = TPM_Key_LoadStoreAsymKey(tpm_key, FALSE, &stream, &stream_size);
     }
-    free(decryptData);		/* @1 */
+    /* cache data that deserialized, a failure only loses the cache entry */
+    if ((rc == 0) && (cacheData == NULL) && (tpm_key_cache->keyCacheCount > 0)) {
+	irc = TPM_KeyCache_AddEntry(tpm_key_cache,
+				    parent_key->tpm_store_asymkey->pubDataDigest,
+				    encDataDigest,
+				    decryptData, decryptDataLength);
+	if (irc != 0) {
+	    printf("TPM_Key_DecryptEncData: Error %08x caching the decrypted data\n", irc);
+	}
+    }
+    if (decryptData != NULL) {
+	memset(decryptData, 0, decryptDataLength);
+    }
+    TPM_Arena_Free(decryptData);		/* @1 */
     return rc;
 }
 
@@ -1668,6 +1903,28 @@ TPM_RESULT TPM_KeyParms_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_KeyParms_SizeOf() returns the number of bytes TPM_KeyParms_Store() serializes */
+
+uint32_t TPM_KeyParms_SizeOf(const TPM_KEY_PARMS *tpm_key_parms)
+{
+    uint32_t	size;
+
+    size = sizeof(TPM_ALGORITHM_ID) +
+	   sizeof(TPM_ENC_SCHEME) +
+	   sizeof(TPM_SIG_SCHEME) +
+	   sizeof(uint32_t);
+    if (tpm_key_parms->algorithmID == TPM_ALG_RSA) {
+	/* the store serializes the parms from the cache */
+	if (tpm_key_parms->tpm_rsa_key_parms != NULL) {
+	    size += TPM_RSAKeyParms_SizeOf(tpm_key_parms->tpm_rsa_key_parms);
+	}
+    }
+    else {
+	size += tpm_key_parms->parms.size;
+    }
+    return size;
+}
+
 /* TPM_KeyParms_Delete frees any member allocated memory */
     
 void TPM_KeyParms_Delete(TPM_KEY_PARMS *tpm_key_parms)
@@ -1676,7 +1933,7 @@ void TPM_KeyParms_Delete(TPM_KEY_PARMS *tpm_key_parms)
     if (tpm_key_parms != NULL) {
 	TPM_SizedBuffer_Delete(&(tpm_key_parms->parms));
 	TPM_RSAKeyParms_Delete(tpm_key_parms->tpm_rsa_key_parms);
-	free(tpm_key_parms->tpm_rsa_key_parms);
+	TPM_Slab_Free(tpm_key_parms->tpm_rsa_key_parms);
 	TPM_KeyParms_Init(tpm_key_parms);
     }
     return;
@@ -2203,6 +2460,21 @@ TPM_RESULT TPM_StoreAsymkey_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_StoreAsymkey_SizeOf() returns the number of bytes TPM_StoreAsymkey_Store() serializes */
+
+uint32_t TPM_StoreAsymkey_SizeOf(TPM_BOOL isEK,
+				 const TPM_STORE_ASYMKEY *tpm_store_asymkey)
+{
+    uint32_t	size = 0;
+
+    if (!isEK) {
+	size += sizeof(TPM_PAYLOAD_TYPE) + (2 * TPM_SECRET_SIZE);
+    }
+    size += TPM_DIGEST_SIZE +
+	    sizeof(uint32_t) + tpm_store_asymkey->privKey.p_key.size;
+    return size;
+}
+
 void TPM_StoreAsymkey_Delete(TPM_STORE_ASYMKEY *tpm_store_asymkey)
 {
     printf(" TPM_StoreAsymkey_Delete:\n");
@@ -2613,11 +2885,14 @@ void TPM_StorePrivkey_Init(TPM_STORE_PRIVKEY *tpm_store_privkey)
     TPM_SizedBuffer_Init(&(tpm_store_privkey->d_key));
     TPM_SizedBuffer_Init(&(tpm_store_privkey->p_key));
     TPM_SizedBuffer_Init(&(tpm_store_privkey->q_key));
+    TPM_SizedBuffer_Init(&(tpm_store_privkey->dp_key));
+    TPM_SizedBuffer_Init(&(tpm_store_privkey->dq_key));
+    TPM_SizedBuffer_Init(&(tpm_store_privkey->qinv_key));
     return;
 }
 
 /* TPM_StorePrivkey_Convert() sets the prime factor q and private key d based on the prime factor p
-   and the public key and exponent.
+   and the public key and exponent.  It then sets the CRT parameters.
 */
 
 TPM_RESULT TPM_StorePrivkey_Convert(TPM_STORE_ASYMKEY *tpm_store_asymkey,	/* I/O result */
@@ -2663,11 +2938,58 @@ TPM_RESULT TPM_StorePrivkey_Convert(TPM_STORE_ASYMKEY *tpm_store_asymkey,	/* I/O
     if (rc == 0) {
 	rc = TPM_SizedBuffer_Set((&(tpm_store_asymkey->privKey.d_key)), dbytes, darr);
     }
+    if (rc == 0) {
+	rc = TPM_StorePrivkey_SetCRT(&(tpm_store_asymkey->privKey));
+    }
     free(qarr); /* @1 */
     free(darr); /* @2 */
     return rc;
 }
 
+/* TPM_StorePrivkey_SetCRT() sets the Chinese Remainder Theorem parameters dP, dQ, qInv based on
+   the prime factors p, q and the private key d.
+
+   The parameters are not serialized.  Calculating them once here saves the calculation on each
+   private key operation.
+*/
+
+TPM_RESULT TPM_StorePrivkey_SetCRT(TPM_STORE_PRIVKEY *tpm_store_privkey)	/* I/O result */
+{
+    TPM_RESULT		rc = 0;
+    unsigned char	*dparr = NULL;
+    unsigned char	*dqarr = NULL;
+    unsigned char	*qinvarr = NULL;
+    uint32_t		dpbytes;
+    uint32_t		dqbytes;
+    uint32_t		qinvbytes;
+
+    printf(" TPM_StorePrivkey_SetCRT:\n");
+    if (rc == 0) {
+	rc = TPM_RSAGetCRTParameters(&dpbytes, &dparr,		/* freed @1 */
+				     &dqbytes, &dqarr,		/* freed @2 */
+				     &qinvbytes, &qinvarr,	/* freed @3 */
+				     tpm_store_privkey->p_key.size,
+				     tpm_store_privkey->p_key.buffer,
+				     tpm_store_privkey->q_key.size,
+				     tpm_store_privkey->q_key.buffer,
+				     tpm_store_privkey->d_key.size,
+				     tpm_store_privkey->d_key.buffer);
+    }
+    if (rc == 0) {
+	rc = TPM_SizedBuffer_Set(&(tpm_store_privkey->dp_key), dpbytes, dparr);
+    }
+    if (rc == 0) {
+	rc = TPM_SizedBuffer_Set(&(tpm_store_privkey->dq_key), dqbytes, dqarr);
+    }
+    if (rc == 0) {
+	rc = TPM_SizedBuffer_Set(&(tpm_store_privkey->qinv_key), qinvbytes, qinvarr);
+    }
+    free(dparr);	/* @1 */
+    free(dqarr);	/* @2 */
+    free(qinvarr);	/* @3 */
+    return rc;
+}
+
 /* TPM_StorePrivkey_Store serializes a TPM_STORE_PRIVKEY structure, appending results to 'sbuffer'
 
    Only the prime factor p is stored.  The other prime factor q and the private key d are
@@ -2694,10 +3016,16 @@ void TPM_StorePrivkey_Delete(TPM_STORE_PRIVKEY *tpm_store_privkey)
 	TPM_SizedBuffer_Zero(&(tpm_store_privkey->d_key));
 	TPM_SizedBuffer_Zero(&(tpm_store_privkey->p_key));
 	TPM_SizedBuffer_Zero(&(tpm_store_privkey->q_key));
+	TPM_SizedBuffer_Zero(&(tpm_store_privkey->dp_key));
+	TPM_SizedBuffer_Zero(&(tpm_store_privkey->dq_key));
+	TPM_SizedBuffer_Zero(&(tpm_store_privkey->qinv_key));
 	
 	TPM_SizedBuffer_Delete(&(tpm_store_privkey->d_key));
 	TPM_SizedBuffer_Delete(&(tpm_store_privkey->p_key));
 	TPM_SizedBuffer_Delete(&(tpm_store_privkey->q_key));
+	TPM_SizedBuffer_Delete(&(tpm_store_privkey->dp_key));
+	TPM_SizedBuffer_Delete(&(tpm_store_privkey->dq_key));
+	TPM_SizedBuffer_Delete(&(tpm_store_privkey->qinv_key));
 	TPM_StorePrivkey_Init(tpm_store_privkey);
     }
     return;
@@ -2751,6 +3079,14 @@ TPM_RESULT TPM_Pubkey_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_Pubkey_SizeOf() returns the number of bytes TPM_Pubkey_Store() serializes */
+
+uint32_t TPM_Pubkey_SizeOf(const TPM_PUBKEY *tpm_pubkey)
+{
+    return TPM_KeyParms_SizeOf(&(tpm_pubkey->algorithmParms)) +
+	sizeof(uint32_t) + tpm_pubkey->pubKey.size;
+}
+
 void TPM_Pubkey_Delete(TPM_PUBKEY *tpm_pubkey)
 {
     printf(" TPM_Pubkey_Delete:\n");
@@ -2905,6 +3241,14 @@ TPM_RESULT TPM_RSAKeyParms_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_RSAKeyParms_SizeOf() returns the number of bytes TPM_RSAKeyParms_Store() serializes */
+
+uint32_t TPM_RSAKeyParms_SizeOf(const TPM_RSA_KEY_PARMS *tpm_rsa_key_parms)
+{
+    return (2 * sizeof(uint32_t)) +
+	sizeof(uint32_t) + tpm_rsa_key_parms->exponent.size;
+}
+
 /* TPM_RSAKeyParms_Delete frees any member allocated memory
 
    If 'tpm_rsa_key_parms' is NULL, this is a no-op.
@@ -2948,7 +3292,8 @@ TPM_RESULT TPM_RSAKeyParms_New(TPM_RSA_KEY_PARMS **tpm_rsa_key_parms)
 
     printf(" TPM_RSAKeyParms_New:\n");
     if (rc == 0) {
-	rc = TPM_Malloc((unsigned char **)tpm_rsa_key_parms, sizeof(TPM_RSA_KEY_PARMS));
+	rc = TPM_Slab_Malloc((unsigned char **)tpm_rsa_key_parms, TPM_SLAB_RSA_KEY_PARMS,
+			     sizeof(TPM_RSA_KEY_PARMS));
     }	 
     if (rc == 0) {
 	TPM_RSAKeyParms_Init(*tpm_rsa_key_parms);
@@ -2992,6 +3337,7 @@ void TPM_KeyHandleEntry_Init(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry)
     tpm_key_handle_entry->key = NULL;
     tpm_key_handle_entry->parentPCRStatus = TRUE;
     tpm_key_handle_entry->keyControl = 0;
+    tpm_key_handle_entry->lastUse = 0;
     return;
 }
 
@@ -3018,7 +3364,8 @@ TPM_RESULT TPM_KeyHandleEntry_Load(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry,
     }
     /* malloc space for the key member */
     if (rc == 0) {
-	rc = TPM_Malloc((unsigned char **)&(tpm_key_handle_entry->key), sizeof(TPM_KEY));
+	rc = TPM_Slab_Malloc((unsigned char **)&(tpm_key_handle_entry->key), TPM_SLAB_KEY,
+			     sizeof(TPM_KEY));
     }
     /* load key */
     if (rc == 0) {
@@ -3072,6 +3419,16 @@ TPM_RESULT TPM_KeyHandleEntry_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_KeyHandleEntry_SizeOf() returns the number of bytes TPM_KeyHandleEntry_Store() serializes */
+
+uint32_t TPM_KeyHandleEntry_SizeOf(const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry)
+{
+    return sizeof(TPM_KEY_HANDLE) +
+	TPM_Key_SizeOfClear(FALSE, tpm_key_handle_entry->key) +
+	sizeof(TPM_BOOL) +
+	sizeof(TPM_KEY_CONTROL);
+}
+
 /* TPM_KeyHandleEntry_Delete() deletes an entry from the list, deletes the TPM_KEY object, and
    free's the TPM_KEY.
 */
@@ -3082,7 +3439,7 @@ void TPM_KeyHandleEntry_Delete(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry)
 	if (tpm_key_handle_entry->handle != 0) {
 	    printf(" TPM_KeyHandleEntry_Delete: Deleting %08x\n", tpm_key_handle_entry->handle);
 	    TPM_Key_Delete(tpm_key_handle_entry->key);
-	    free(tpm_key_handle_entry->key);
+	    TPM_Slab_Free(tpm_key_handle_entry->key);
 	}
 	TPM_KeyHandleEntry_Init(tpm_key_handle_entry);
     }
@@ -3131,33 +3488,165 @@ TPM_RESULT TPM_KeyHandleEntry_FlushSpecific(tpm_state_t *tpm_state,
   Key Handle Entries
 */
 
-/* TPM_KeyHandleEntries_Init() initializes the fixed TPM_KEY_HANDLE_ENTRY array.  All entries are
-   emptied.  The keys are not deleted.
+/* TPM_KeyHandleEntries_Init() initializes the TPM_KEY_HANDLE_ENTRIES structure without key slots.
+   TPM_KeyHandleEntries_Alloc() allocates them.
 */
 
-void TPM_KeyHandleEntries_Init(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries)
+void TPM_KeyHandleEntries_Init(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
 {
-    size_t i;
-    
     printf(" TPM_KeyHandleEntries_Init:\n");
-    for (i = 0 ; i < TPM_KEY_HANDLES ; i++) {
-	TPM_KeyHandleEntry_Init(&(tpm_key_handle_entries[i]));
-    }
+    tpm_key_handle_entries->keyHandleCount = 0;
+    tpm_key_handle_entries->tpm_key_handle_entry = NULL;
+    tpm_key_handle_entries->keyHandleNext = 0;
+    tpm_key_handle_entries->keyHandleHashSize = 0;
+    tpm_key_handle_entries->keyHandleHashUsed = 0;
+    tpm_key_handle_entries->keyHandleHash = NULL;
+    tpm_key_handle_entries->keyHandleTick = 0;
+    tpm_key_handle_entries->keySwap = FALSE;
+    tpm_key_handle_entries->keySwapCount = 0;
+    tpm_key_handle_entries->keySwapAlloc = 0;
+    tpm_key_handle_entries->tpm_key_swap_entry = NULL;
     return;
 }
 
-/* TPM_KeyHandleEntries_Delete() deletes and freed all TPM_KEY's stored in entries, and the entry
+/* TPM_KeyHandleEntries_Alloc() allocates 'keyHandleCount' empty key slots and a hash table that is
+   at most a quarter full when all slots are used.
 
+   If 'keySwap' is TRUE, keys are evicted to swap entries when the slots are full.  The swap entries
+   are allocated when needed.
+
+   The structure must be initialized and have no key slots.
 */
 
-void TPM_KeyHandleEntries_Delete(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries)
+TPM_RESULT TPM_KeyHandleEntries_Alloc(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
+				      uint32_t keyHandleCount,
+				      TPM_BOOL keySwap)
+{
+    TPM_RESULT	rc = 0;
+    uint32_t	hashSize;
+    size_t	i;
+
+    printf(" TPM_KeyHandleEntries_Alloc: %u entries, keySwap %u\n", keyHandleCount, keySwap);
+    /* the uint16_t corresponds to the standard getcap */
+    if (rc == 0) {
+	if ((keyHandleCount < (TPM_OWNER_EVICT_KEY_HANDLES + 2)) || (keyHandleCount > 0xffff)) {
+	    printf("TPM_KeyHandleEntries_Alloc: Error, %u entries not in range %u to %u\n",
+		   keyHandleCount, TPM_OWNER_EVICT_KEY_HANDLES + 2, 0xffff);
+	    rc = TPM_BAD_PARAMETER;
+	}
+    }
+    if (rc == 0) {
+	rc = TPM_Malloc((unsigned char **)&(tpm_key_handle_entries->tpm_key_handle_entry),
+			keyHandleCount * sizeof(TPM_KEY_HANDLE_ENTRY));
+    }
+    if (rc == 0) {
+	for (hashSize = 1 ; hashSize < keyHandleCount * 4 ; hashSize *= 2);
+	rc = TPM_Malloc((unsigned char **)&(tpm_key_handle_entries->keyHandleHash),
+			hashSize * sizeof(uint32_t));
+    }
+    if (rc == 0) {
+	tpm_key_handle_entries->keyHandleCount = keyHandleCount;
+	for (i = 0 ; i < keyHandleCount ; i++) {
+	    TPM_KeyHandleEntry_Init(&(tpm_key_handle_entries->tpm_key_handle_entry[i]));
+	}
+	tpm_key_handle_entries->keyHandleHashSize = hashSize;
+	memset(tpm_key_handle_entries->keyHandleHash, 0, hashSize * sizeof(uint32_t));
+	tpm_key_handle_entries->keySwap = keySwap;
+    }
+    return rc;
+}
+
+/* TPM_KeyHandleEntries_Resize() changes the number of key slots to 'keyHandleCount'.  The loaded
+   keys keep their handles.  If keys are swapped, the keys that do not fit in the slots are moved to
+   the swap entries, the keys that were already swapped first.
+
+   Returns TPM_NOSPACE if the loaded keys do not fit.  On error, the entries are not changed.
+*/
+
+TPM_RESULT TPM_KeyHandleEntries_Resize(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
+				       uint32_t keyHandleCount)
+{
+    TPM_RESULT			rc = 0;
+    TPM_KEY_HANDLE_ENTRIES	tpm_key_handle_entries_new;	/* freed @1 */
+    TPM_KEY_HANDLE_ENTRY	*tpm_key_handle_entry;
+    TPM_KEY_HANDLE		tpm_key_handle;
+    uint32_t			keyCount;
+    uint32_t			keyMax;
+    uint32_t			locations;
+    uint32_t			location;
+    uint32_t			i;
+
+    printf(" TPM_KeyHandleEntries_Resize: %u to %u entries\n",
+	   tpm_key_handle_entries->keyHandleCount, keyHandleCount);
+    TPM_KeyHandleEntries_Init(&tpm_key_handle_entries_new);	/* freed @1 */
+    locations = tpm_key_handle_entries->keyHandleCount + tpm_key_handle_entries->keySwapCount;
+    /* allocating checks the range of 'keyHandleCount' */
+    if (rc == 0) {
+	rc = TPM_KeyHandleEntries_Alloc(&tpm_key_handle_entries_new,
+					keyHandleCount, tpm_key_handle_entries->keySwap);
+    }
+    /* check that the loaded keys fit */
+    if (rc == 0) {
+	for (location = 0, keyCount = 0 ; location < locations ; location++) {
+	    if (TPM_KeyHandleEntries_GetLocation(tpm_key_handle_entries, location)->key != NULL) {
+		keyCount++;
+	    }
+	}
+	keyMax = TPM_KeyHandleEntries_GetMaxKeys(keyHandleCount, tpm_key_handle_entries->keySwap);
+	if (keyCount > keyMax) {
+	    printf("TPM_KeyHandleEntries_Resize: Error, %u keys loaded, room for %u\n",
+		   keyCount, keyMax);
+	    rc = TPM_NOSPACE;
+	}
+    }
+    /* copy the entries, the swapped ones first, since they were used less recently than the
+       slots */
+    for (i = 0 ; (rc == 0) && (i < locations) ; i++) {
+	location = (i + tpm_key_handle_entries->keyHandleCount) % locations;
+	tpm_key_handle_entry = TPM_KeyHandleEntries_GetLocation(tpm_key_handle_entries, location);
+	if (tpm_key_handle_entry->key != NULL) {
+	    tpm_key_handle = tpm_key_handle_entry->handle;
+	    rc = TPM_KeyHandleEntries_AddEntry(&tpm_key_handle,
+					       TRUE,			/* keep handle */
+					       &tpm_key_handle_entries_new,
+					       tpm_key_handle_entry);
+	}
+    }
+    /* the TPM_KEY's are now owned by the new entries if all were copied, else still by the old
+       ones, so only the arrays are freed */
+    if (rc == 0) {
+	free(tpm_key_handle_entries->tpm_key_handle_entry);
+	free(tpm_key_handle_entries->tpm_key_swap_entry);
+	free(tpm_key_handle_entries->keyHandleHash);
+	*tpm_key_handle_entries = tpm_key_handle_entries_new;
+    }
+    else {
+	free(tpm_key_handle_entries_new.tpm_key_handle_entry);		/* @1 */
+	free(tpm_key_handle_entries_new.tpm_key_swap_entry);		/* @1 */
+	free(tpm_key_handle_entries_new.keyHandleHash);			/* @1 */
+    }
+    return rc;
+}
+
+/* TPM_KeyHandleEntries_Delete() deletes and freed all TPM_KEY's stored in entries, and the entries
+
+*/
+
+void TPM_KeyHandleEntries_Delete(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
 {
     size_t i;
     
     printf(" TPM_KeyHandleEntries_Delete:\n");
-    for (i = 0 ; i < TPM_KEY_HANDLES ; i++) {
-	TPM_KeyHandleEntry_Delete(&(tpm_key_handle_entries[i]));
+    for (i = 0 ; i < tpm_key_handle_entries->keyHandleCount ; i++) {
+	TPM_KeyHandleEntry_Delete(&(tpm_key_handle_entries->tpm_key_handle_entry[i]));
     }
+    for (i = 0 ; i < tpm_key_handle_entries->keySwapCount ; i++) {
+	TPM_KeyHandleEntry_Delete(&(tpm_key_handle_entries->tpm_key_swap_entry[i]));
+    }
+    free(tpm_key_handle_entries->tpm_key_handle_entry);
+    free(tpm_key_handle_entries->tpm_key_swap_entry);
+    free(tpm_key_handle_entries->keyHandleHash);
+    TPM_KeyHandleEntries_Init(tpm_key_handle_entries);
     return;
 }
 
@@ -3173,6 +3662,7 @@ TPM_RESULT TPM_KeyHandleEntries_Load(tpm_state_t *tpm_state,
 {
     TPM_RESULT			rc = 0;
     uint32_t			keyCount = 0;			/* keys to be saved */
+    uint32_t			keyMax;
     size_t			i;
     TPM_KEY_HANDLE_ENTRY	tpm_key_handle_entry;
 
@@ -3187,12 +3677,15 @@ TPM_RESULT TPM_KeyHandleEntries_Load(tpm_state_t *tpm_state,
 	rc = TPM_Load32(&keyCount, stream, stream_size);
 	printf("  TPM_KeyHandleEntries_Load: %u keys to be loaded\n", keyCount);
     }
-    /* sanity check that keyCount not greater than key slots */
+    /* sanity check that keyCount not greater than key slots, plus swap entries if keys are
+       swapped */
     if (rc == 0) {
-	if (keyCount > TPM_KEY_HANDLES) {
+	keyMax = TPM_KeyHandleEntries_GetMaxKeys(tpm_state->tpm_key_handle_entries.keyHandleCount,
+						 tpm_state->tpm_key_handle_entries.keySwap);
+	if (keyCount > keyMax) {
 	    printf("TPM_KeyHandleEntries_Load: Error (fatal)"
-		   " key handles in stream %u greater than %d\n",
-		   keyCount, TPM_KEY_HANDLES);
+		   " key handles in stream %u greater than %u\n",
+		   keyCount, keyMax);
 	    rc = TPM_FAIL;
 	}
     }    
@@ -3211,7 +3704,7 @@ TPM_RESULT TPM_KeyHandleEntries_Load(tpm_state_t *tpm_state,
 	       handle was saved twice.	*/
 	    rc = TPM_KeyHandleEntries_AddEntry(&(tpm_key_handle_entry.handle), 	/* suggested */
 					       TRUE,				/* keep handle */
-					       tpm_state->tpm_key_handle_entries,
+					       &(tpm_state->tpm_key_handle_entries),
 					       &tpm_key_handle_entry);
 	}
 	/* if there was an error copying the entry to the array, the entry must be delete'd to
@@ -3252,7 +3745,7 @@ TPM_RESULT TPM_KeyHandleEntries_Store(TPM_STORE_BUFFER *sbuffer,
 	   /* returns TPM_RETRY when at the end of the table, terminates loop */
 	   (TPM_KeyHandleEntries_GetNextEntry(&tpm_key_handle_entry,
 					      &current,
-					      tpm_state->tpm_key_handle_entries,
+					      &(tpm_state->tpm_key_handle_entries),
 					      start)) == 0) {
 	TPM_SaveState_IsSaveKey(&save, tpm_key_handle_entry);
 	if (save) {
@@ -3274,7 +3767,7 @@ TPM_RESULT TPM_KeyHandleEntries_Store(TPM_STORE_BUFFER *sbuffer,
 	   /* returns TPM_RETRY when at the end of the table, terminates loop */
 	   (TPM_KeyHandleEntries_GetNextEntry(&tpm_key_handle_entry,
 					      &current,
-					      tpm_state->tpm_key_handle_entries,
+					      &(tpm_state->tpm_key_handle_entries),
 					      start)) == 0) {
 	TPM_SaveState_IsSaveKey(&save, tpm_key_handle_entry);
 	if (save) {
@@ -3286,6 +3779,32 @@ TPM_RESULT TPM_KeyHandleEntries_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_KeyHandleEntries_SizeOf() returns the number of bytes TPM_KeyHandleEntries_Store()
+   serializes */
+
+uint32_t TPM_KeyHandleEntries_SizeOf(tpm_state_t *tpm_state)
+{
+    uint32_t			size;
+    size_t			start;		/* iterator though key handle entries */
+    size_t			current;	/* iterator though key handle entries */
+    TPM_BOOL 			save;		/* should key be saved */
+    TPM_KEY_HANDLE_ENTRY	*tpm_key_handle_entry;
+
+    size = sizeof(uint16_t) + sizeof(uint32_t);		/* tag, keyCount */
+    start = 0;
+    while (TPM_KeyHandleEntries_GetNextEntry(&tpm_key_handle_entry,
+					     &current,
+					     &(tpm_state->tpm_key_handle_entries),
+					     start) == 0) {
+	TPM_SaveState_IsSaveKey(&save, tpm_key_handle_entry);
+	if (save) {
+	    size += TPM_KeyHandleEntry_SizeOf(tpm_key_handle_entry);
+	}
+	start = current + 1;
+    }
+    return size;
+}
+
 
 
 /* TPM_KeyHandleEntries_StoreHandles() stores only the two members which are part of the
@@ -3301,26 +3820,34 @@ TPM_RESULT TPM_KeyHandleEntries_Store(TPM_STORE_BUFFER *sbuffer,
 */
 
 TPM_RESULT TPM_KeyHandleEntries_StoreHandles(TPM_STORE_BUFFER *sbuffer,
-					     const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries)
+					     const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
 {
     TPM_RESULT	rc = 0;
-    uint16_t	i, loadedCount;
+    uint32_t	locations;
+    uint32_t	i;
+    uint16_t	loadedCount;	/* swapped keys are included, see TPM_KEY_LOCATIONS_MAX */
+    TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry;
     
     printf(" TPM_KeyHandleEntries_StoreHandles:\n");
+    locations = tpm_key_handle_entries->keyHandleCount + tpm_key_handle_entries->keySwapCount;
     if (rc == 0) {
 	loadedCount = 0;
 	/* count the number of loaded handles */
-	for (i = 0 ; i < TPM_KEY_HANDLES ; i++) {
-	    if (tpm_key_handle_entries[i].key != NULL) {
+	for (i = 0 ; i < locations ; i++) {
+	    tpm_key_handle_entry = TPM_KeyHandleEntries_GetLocation(tpm_key_handle_entries, i);
+	    if (tpm_key_handle_entry->key != NULL) {
 		loadedCount++;
 	    }
 	}
 	/* store 'loaded' handle count */
 	rc = TPM_Sbuffer_Append16(sbuffer, loadedCount); 
     }
-    for (i = 0 ; (rc == 0) && (i < TPM_KEY_HANDLES) ; i++) {
-	if (tpm_key_handle_entries[i].key != NULL) {	/* if the index is loaded */
-	    rc = TPM_Sbuffer_Append32(sbuffer, tpm_key_handle_entries[i].handle); /* store it */
+    for (i = 0 ; (rc == 0) && (i < locations) ; i++) {
+	tpm_key_handle_entry = TPM_KeyHandleEntries_GetLocation(tpm_key_handle_entries, i);
+	/* if the index is loaded */
+	if (tpm_key_handle_entry->key != NULL) {
+	    /* store it */
+	    rc = TPM_Sbuffer_Append32(sbuffer, tpm_key_handle_entry->handle);
 	}
     }
     return rc;
@@ -3332,7 +3859,7 @@ TPM_RESULT TPM_KeyHandleEntries_StoreHandles(TPM_STORE_BUFFER *sbuffer,
    the table.
 */
 
-TPM_RESULT TPM_KeyHandleEntries_DeleteHandle(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+TPM_RESULT TPM_KeyHandleEntries_DeleteHandle(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
 					     TPM_KEY_HANDLE tpm_key_handle)
 {
     TPM_RESULT	rc = 0;
@@ -3358,59 +3885,129 @@ TPM_RESULT TPM_KeyHandleEntries_DeleteHandle(TPM_KEY_HANDLE_ENTRY *tpm_key_handl
 
 /* TPM_KeyHandleEntries_IsSpace() returns 'isSpace' TRUE if an entry is available, FALSE if not.
 
-   If TRUE, 'index' holds the first free position.
+   If TRUE, 'index' holds a free position.  The search starts after the entry last added, so that
+   it does not pass all loaded keys each time.
+
+   If the slots are full and keys are swapped, 'index' holds the slot to be swapped out by
+   TPM_KeyHandleEntries_AddEntry().
 */
 
 void TPM_KeyHandleEntries_IsSpace(TPM_BOOL *isSpace,
 				  uint32_t *index,
-				  const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries)
+				  const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
 {
+    uint32_t i;
+
     printf(" TPM_KeyHandleEntries_IsSpace:\n");
-    for (*index = 0, *isSpace = FALSE ; *index < TPM_KEY_HANDLES ; (*index)++) {
-	if (tpm_key_handle_entries[*index].key == NULL) {	/* if the index is empty */
-	    printf("  TPM_KeyHandleEntries_IsSpace: Found space at %u\n", *index);
+    TPM_KeyHandleEntries_GetFree(isSpace, index, tpm_key_handle_entries);
+    if (!(*isSpace) && tpm_key_handle_entries->keySwap) {
+	/* deleted swap entries are reused, else the swap entries are grown */
+	if ((tpm_key_handle_entries->keySwapCount < tpm_key_handle_entries->keySwapAlloc) ||
+	    (tpm_key_handle_entries->keySwapAlloc <
+	     TPM_KeyHandleEntries_GetSwapMax(tpm_key_handle_entries->keyHandleCount))) {
 	    *isSpace = TRUE;
+	}
+	for (i = 0 ; !(*isSpace) && (i < tpm_key_handle_entries->keySwapCount) ; i++) {
+	    if (tpm_key_handle_entries->tpm_key_swap_entry[i].key == NULL) {
+		*isSpace = TRUE;
+	    }
+	}
+	if (*isSpace) {
+	    TPM_KeyHandleEntries_GetVictim(isSpace, index, tpm_key_handle_entries);
+	}
+    }
+    return;
+}
+
+/* TPM_KeyHandleEntries_GetFree() returns 'isFree' TRUE and the position in 'index' if a slot is
+   empty, FALSE if not.
+*/
+
+static void TPM_KeyHandleEntries_GetFree(TPM_BOOL *isFree,
+					 uint32_t *index,
+					 const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
+{
+    uint32_t i;
+
+    *index = tpm_key_handle_entries->keyHandleNext;
+    for (i = 0, *isFree = FALSE ; i < tpm_key_handle_entries->keyHandleCount ; i++) {
+	if (*index >= tpm_key_handle_entries->keyHandleCount) {
+	    *index = 0;
+	}
+	/* if the index is empty */
+	if (tpm_key_handle_entries->tpm_key_handle_entry[*index].key == NULL) {
+	    printf("  TPM_KeyHandleEntries_GetFree: Found space at %u\n", *index);
+	    *isFree = TRUE;
 	    break;
 	}
+	(*index)++;
     }
     return;
 }
 
 /* TPM_KeyHandleEntries_GetSpace() returns the number of unused key handle entries.
 
+   If keys are swapped, it returns the number of keys that can still be loaded into the slots and
+   swap entries.
 */
 
 void TPM_KeyHandleEntries_GetSpace(uint32_t *space,
-				   const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries)
+				   const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
 {
     uint32_t i;
 
     printf(" TPM_KeyHandleEntries_GetSpace:\n");
-    for (*space = 0 , i = 0 ; i < TPM_KEY_HANDLES ; i++) {
-	if (tpm_key_handle_entries[i].key == NULL) {	/* if the index is empty */
+    for (*space = 0 , i = 0 ; i < tpm_key_handle_entries->keyHandleCount ; i++) {
+	/* if the index is empty */
+	if (tpm_key_handle_entries->tpm_key_handle_entry[i].key == NULL) {
 	    (*space)++;
 	}	    
     }
+    if (tpm_key_handle_entries->keySwap) {
+	*space += TPM_KeyHandleEntries_GetSwapMax(tpm_key_handle_entries->keyHandleCount);
+	for (i = 0 ; i < tpm_key_handle_entries->keySwapCount ; i++) {
+	    if (tpm_key_handle_entries->tpm_key_swap_entry[i].key != NULL) {
+		(*space)--;
+	    }
+	}
+    }
     return;
 }
 
+/* TPM_KeyHandleEntries_GetMaxKeys() returns the number of keys that can be loaded with
+   'keyHandleCount' slots, plus the swap entries if 'keySwap' is TRUE.
+*/
+
+uint32_t TPM_KeyHandleEntries_GetMaxKeys(uint32_t keyHandleCount,
+					 TPM_BOOL keySwap)
+{
+    uint32_t	maxKeys = keyHandleCount;
+
+    if (keySwap) {
+	maxKeys += TPM_KeyHandleEntries_GetSwapMax(keyHandleCount);
+    }
+    return maxKeys;
+}
+
 /* TPM_KeyHandleEntries_IsEvictSpace() returns 'isSpace' TRUE if there are at least 'minSpace'
    entries that do not have the ownerEvict bit set, FALSE if not.
 */
 
 void TPM_KeyHandleEntries_IsEvictSpace(TPM_BOOL *isSpace,
-				       const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+				       const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
 				       uint32_t minSpace)
 {
     uint32_t evictSpace;
     uint32_t i;
 
-    for (i = 0,	 evictSpace = 0 ; i < TPM_KEY_HANDLES ; i++) {
-	if (tpm_key_handle_entries[i].key == NULL) {	/* if the index is empty */
+    for (i = 0,	 evictSpace = 0 ; i < tpm_key_handle_entries->keyHandleCount ; i++) {
+	/* if the index is empty */
+	if (tpm_key_handle_entries->tpm_key_handle_entry[i].key == NULL) {
 	    evictSpace++;
 	}
 	else {							/* is index is used */
-	    if (!(tpm_key_handle_entries[i].keyControl & TPM_KEY_CONTROL_OWNER_EVICT)) {
+	    if (!(tpm_key_handle_entries->tpm_key_handle_entry[i].keyControl &
+		  TPM_KEY_CONTROL_OWNER_EVICT)) {
 		evictSpace++;	/* space that can be evicted */
 	    }
 	}
@@ -3435,7 +4032,7 @@ void TPM_KeyHandleEntries_IsEvictSpace(TPM_BOOL *isSpace,
 */
 
 TPM_RESULT TPM_KeyHandleEntries_AddKeyEntry(TPM_KEY_HANDLE *tpm_key_handle,		/* i/o */
-					    TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries, /* in */
+					    TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries, /* in */
 					    TPM_KEY *tpm_key,
 					    TPM_BOOL parentPCRStatus,
 					    TPM_KEY_CONTROL keyControl)
@@ -3471,13 +4068,14 @@ TPM_RESULT TPM_KeyHandleEntries_AddKeyEntry(TPM_KEY_HANDLE *tpm_key_handle,		/*
 
 TPM_RESULT TPM_KeyHandleEntries_AddEntry(TPM_KEY_HANDLE *tpm_key_handle,		/* i/o */
 					 TPM_BOOL keepHandle,				/* input */
-					 TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,	/* input */
+					 TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,	/* input */
 					 TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry)	/* input */
 					 
 {
     TPM_RESULT			rc = 0;
     uint32_t			index;
     TPM_BOOL			isSpace;
+    TPM_KEY_HANDLE_ENTRY	*tpm_key_handle_entry_new;
     
     printf(" TPM_KeyHandleEntries_AddEntry: handle %08x, keepHandle %u\n",
 	   *tpm_key_handle, keepHandle);
@@ -3488,6 +4086,15 @@ TPM_RESULT TPM_KeyHandleEntries_AddEntry(TPM_KEY_HANDLE *tpm_key_handle,		/* i/o
 	    rc = TPM_FAIL;
 	}
     }
+    /* generate the handle first, since a swapped key found by TPM_KeyHandleEntries_GetEntry() is
+       moved to a slot */
+    if (rc == 0) {
+	rc = TPM_Handle_GenerateHandle(tpm_key_handle,			/* I/O */
+				       tpm_key_handle_entries,		/* handle array */
+				       keepHandle,
+				       TRUE,				/* isKeyHandle */
+				       (TPM_GETENTRY_FUNCTION_T)TPM_KeyHandleEntries_GetEntry);
+    }
     /* is there an empty entry, get the location index */
     if (rc == 0) {
 	TPM_KeyHandleEntries_IsSpace(&isSpace, &index, tpm_key_handle_entries);
@@ -3496,42 +4103,344 @@ TPM_RESULT TPM_KeyHandleEntries_AddEntry(TPM_KEY_HANDLE *tpm_key_handle,		/* i/o
 	    rc = TPM_NOSPACE;
 	}
     }
-    if (rc == 0) {
-	rc = TPM_Handle_GenerateHandle(tpm_key_handle,			/* I/O */
-				       tpm_key_handle_entries,		/* handle array */
-				       keepHandle,
-				       TRUE,				/* isKeyHandle */
-				       (TPM_GETENTRY_FUNCTION_T)TPM_KeyHandleEntries_GetEntry);
+    /* if the slots are full, swap out the least recently used key */
+    if ((rc == 0) && (tpm_key_handle_entries->tpm_key_handle_entry[index].key != NULL)) {
+	rc = TPM_KeyHandleEntries_SwapOut(tpm_key_handle_entries, index);
     }
     if (rc == 0) {
-	tpm_key_handle_entries[index].handle = *tpm_key_handle;
-	tpm_key_handle_entries[index].key = tpm_key_handle_entry->key;
-	tpm_key_handle_entries[index].keyControl = tpm_key_handle_entry->keyControl;
-	tpm_key_handle_entries[index].parentPCRStatus = tpm_key_handle_entry->parentPCRStatus;
+	tpm_key_handle_entry_new = &(tpm_key_handle_entries->tpm_key_handle_entry[index]);
+	tpm_key_handle_entry_new->handle = *tpm_key_handle;
+	tpm_key_handle_entry_new->key = tpm_key_handle_entry->key;
+	tpm_key_handle_entry_new->keyControl = tpm_key_handle_entry->keyControl;
+	tpm_key_handle_entry_new->parentPCRStatus = tpm_key_handle_entry->parentPCRStatus;
+	tpm_key_handle_entry_new->lastUse = ++(tpm_key_handle_entries->keyHandleTick);
+	tpm_key_handle_entries->keyHandleNext = index + 1;
 	printf("  TPM_KeyHandleEntries_AddEntry: Index %u key handle %08x key pointer %p\n",
-	       index, tpm_key_handle_entries[index].handle, tpm_key_handle_entries[index].key);
+	       index, tpm_key_handle_entry_new->handle, tpm_key_handle_entry_new->key);
+	TPM_KeyHandleEntries_HashAdd(tpm_key_handle_entries, index);
     }
     return rc;
 }
 
-/* TPM_KeyHandleEntries_GetEntry() searches all entries for the entry matching the handle, and
-   returns that entry */
+/* TPM_KeyHandleEntries_GetLocation() returns the entry at 'location', a slot below keyHandleCount,
+   else a swap entry.
+*/
+
+static TPM_KEY_HANDLE_ENTRY *
+TPM_KeyHandleEntries_GetLocation(const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
+				 uint32_t location)
+{
+    if (location < tpm_key_handle_entries->keyHandleCount) {
+	return &(tpm_key_handle_entries->tpm_key_handle_entry[location]);
+    }
+    return &(tpm_key_handle_entries->tpm_key_swap_entry
+	     [location - tpm_key_handle_entries->keyHandleCount]);
+}
+
+/* TPM_KeyHandleEntries_GetVictim() returns 'isVictim' TRUE and the position in 'index' of the least
+   recently used key that is not owner evict, FALSE if there is none.
+
+   Since there are at least 2 slots more than owner evict keys, a key being added or moved back
+   from the swap entries does not swap out the key used just before.
+*/
+
+static void TPM_KeyHandleEntries_GetVictim(TPM_BOOL *isVictim,
+					   uint32_t *index,
+					   const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
+{
+    uint32_t			i;
+    const TPM_KEY_HANDLE_ENTRY	*tpm_key_handle_entry;
+
+    for (i = 0, *isVictim = FALSE ; i < tpm_key_handle_entries->keyHandleCount ; i++) {
+	tpm_key_handle_entry = &(tpm_key_handle_entries->tpm_key_handle_entry[i]);
+	if ((tpm_key_handle_entry->key != NULL) &&
+	    !(tpm_key_handle_entry->keyControl & TPM_KEY_CONTROL_OWNER_EVICT) &&
+	    (!(*isVictim) ||
+	     (tpm_key_handle_entry->lastUse <
+	      tpm_key_handle_entries->tpm_key_handle_entry[*index].lastUse))) {
+	    *isVictim = TRUE;
+	    *index = i;
+	}
+    }
+    return;
+}
+
+/* TPM_KeyHandleEntries_SwapOut() moves the key in slot 'index' to the swap entries, leaving the
+   slot empty.  The key keeps its handle.
+*/
+
+static TPM_RESULT TPM_KeyHandleEntries_SwapOut(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
+					       uint32_t index)
+{
+    TPM_RESULT	rc = 0;
+    uint32_t	swapIndex;
+
+    if (rc == 0) {
+	if (tpm_key_handle_entries->keySwapCount == tpm_key_handle_entries->keySwapAlloc) {
+	    rc = TPM_KeyHandleEntries_SwapGrow(tpm_key_handle_entries);
+	}
+    }
+    if (rc == 0) {
+	swapIndex = tpm_key_handle_entries->keySwapCount;
+	printf("  TPM_KeyHandleEntries_SwapOut: Key handle %08x from slot %u to swap %u\n",
+	       tpm_key_handle_entries->tpm_key_handle_entry[index].handle, index, swapIndex);
+	tpm_key_handle_entries->tpm_key_swap_entry[swapIndex] =
+	    tpm_key_handle_entries->tpm_key_handle_entry[index];
+	tpm_key_handle_entries->keySwapCount++;
+	TPM_KeyHandleEntry_Init(&(tpm_key_handle_entries->tpm_key_handle_entry[index]));
+	TPM_KeyHandleEntries_HashAdd(tpm_key_handle_entries,
+				     tpm_key_handle_entries->keyHandleCount + swapIndex);
+    }
+    return rc;
+}
+
+/* TPM_KeyHandleEntries_SwapGrow() makes room for a swap entry.
+
+   Deleted swap entries are removed if they are at least a quarter of the entries.  Otherwise the
+   entries are doubled, up to TPM_KeyHandleEntries_GetSwapMax().  Either way the locations change,
+   so that the hash table is rebuilt.
+
+   Returns TPM_NOSPACE if there is no room.
+*/
+
+static TPM_RESULT TPM_KeyHandleEntries_SwapGrow(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
+{
+    TPM_RESULT	rc = 0;
+    uint32_t	swapUsed;
+    uint32_t	swapAlloc;
+    uint32_t	hashSize;
+    uint32_t	i;
+
+    for (i = 0, swapUsed = 0 ; i < tpm_key_handle_entries->keySwapCount ; i++) {
+	if (tpm_key_handle_entries->tpm_key_swap_entry[i].key != NULL) {
+	    tpm_key_handle_entries->tpm_key_swap_entry[swapUsed] =
+		tpm_key_handle_entries->tpm_key_swap_entry[i];
+	    swapUsed++;
+	}
+    }
+    swapAlloc = tpm_key_handle_entries->keySwapAlloc;
+    if ((swapAlloc - swapUsed) < (swapAlloc / 4) || (swapUsed == swapAlloc)) {
+	if (swapAlloc == 0) {
+	    swapAlloc = tpm_key_handle_entries->keyHandleCount;
+	}
+	else {
+	    swapAlloc *= 2;
+	}
+	if (swapAlloc > TPM_KeyHandleEntries_GetSwapMax(tpm_key_handle_entries->keyHandleCount)) {
+	    swapAlloc = TPM_KeyHandleEntries_GetSwapMax(tpm_key_handle_entries->keyHandleCount);
+	}
+    }
+    printf("  TPM_KeyHandleEntries_SwapGrow: %u of %u swap entries used, allocating %u\n",
+	   swapUsed, tpm_key_handle_entries->keySwapAlloc, swapAlloc);
+    if (rc == 0) {
+	if (swapUsed == swapAlloc) {
+	    printf("TPM_KeyHandleEntries_SwapGrow: Error, %u swap entries full\n", swapAlloc);
+	    rc = TPM_NOSPACE;
+	}
+    }
+    /* grow the hash table first, so that it always has room for all locations */
+    if ((rc == 0) && (swapAlloc > tpm_key_handle_entries->keySwapAlloc)) {
+	for (hashSize = tpm_key_handle_entries->keyHandleHashSize ;
+	     hashSize < (tpm_key_handle_entries->keyHandleCount + swapAlloc) * 4 ;
+	     hashSize *= 2);
+	if (hashSize > tpm_key_handle_entries->keyHandleHashSize) {
+	    rc = TPM_Realloc((unsigned char **)&(tpm_key_handle_entries->keyHandleHash),
+			     hashSize * sizeof(uint32_t));
+	    if (rc == 0) {
+		tpm_key_handle_entries->keyHandleHashSize = hashSize;
+	    }
+	}
+	if (rc == 0) {
+	    rc = TPM_Realloc((unsigned char **)&(tpm_key_handle_entries->tpm_key_swap_entry),
+			     swapAlloc * sizeof(TPM_KEY_HANDLE_ENTRY));
+	}
+	if (rc == 0) {
+	    tpm_key_handle_entries->keySwapAlloc = swapAlloc;
+	}
+    }
+    /* the compacted entries are valid even if the allocation failed */
+    for (i = swapUsed ; i < tpm_key_handle_entries->keySwapCount ; i++) {
+	TPM_KeyHandleEntry_Init(&(tpm_key_handle_entries->tpm_key_swap_entry[i]));
+    }
+    tpm_key_handle_entries->keySwapCount = swapUsed;
+    TPM_KeyHandleEntries_HashBuild(tpm_key_handle_entries);
+    return rc;
+}
+
+/* TPM_KeyHandleEntries_GetSwapMax() returns the maximum number of swap entries.
+
+   The slots and swap entries together are at most TPM_KEY_LOCATIONS_MAX, so that the uint16_t of
+   the standard getcap can list all handles.
+*/
+
+static uint32_t TPM_KeyHandleEntries_GetSwapMax(uint32_t keyHandleCount)
+{
+    uint32_t	swapMax = 0;
+
+    if (keyHandleCount < TPM_KEY_LOCATIONS_MAX) {
+	swapMax = TPM_KEY_LOCATIONS_MAX - keyHandleCount;
+    }
+    if (swapMax > TPM_KEY_SWAP_ENTRIES_MAX) {
+	swapMax = TPM_KEY_SWAP_ENTRIES_MAX;
+    }
+    return swapMax;
+}
+
+/* TPM_KeyHandleEntries_SwapIn() moves the swapped key at 'location' to a slot, returned in 'index'.
+
+   If the slots are full, the least recently used key that is not owner evict takes the place of
+   the key in the swap entries.
+*/
+
+static void TPM_KeyHandleEntries_SwapIn(uint32_t *index,
+					TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
+					uint32_t location)
+{
+    TPM_BOOL			isSpace;
+    TPM_KEY_HANDLE_ENTRY	*tpm_key_swap_entry;
+    TPM_KEY_HANDLE_ENTRY	tpm_key_handle_entry;
+
+    TPM_KeyHandleEntries_GetFree(&isSpace, index, tpm_key_handle_entries);
+    if (!isSpace) {
+	/* always succeeds, since there are at least 2 slots more than owner evict keys */
+	TPM_KeyHandleEntries_GetVictim(&isSpace, index, tpm_key_handle_entries);
+    }
+    tpm_key_swap_entry = TPM_KeyHandleEntries_GetLocation(tpm_key_handle_entries, location);
+    printf("  TPM_KeyHandleEntries_SwapIn: Key handle %08x from swap %u to slot %u\n",
+	   tpm_key_swap_entry->handle, location - tpm_key_handle_entries->keyHandleCount, *index);
+    tpm_key_handle_entry = tpm_key_handle_entries->tpm_key_handle_entry[*index];
+    tpm_key_handle_entries->tpm_key_handle_entry[*index] = *tpm_key_swap_entry;
+    *tpm_key_swap_entry = tpm_key_handle_entry;
+    TPM_KeyHandleEntries_HashAdd(tpm_key_handle_entries, *index);
+    if (tpm_key_swap_entry->key != NULL) {
+	TPM_KeyHandleEntries_HashAdd(tpm_key_handle_entries, location);
+    }
+    return;
+}
+
+/* TPM_KeyHandleEntries_HashAdd() adds the entry at 'location' to the keyHandleHash table.
+
+   Entries are deleted or moved without updating the table, so that a bucket may refer to an entry
+   that was deleted or reused for another handle.  When half of the buckets are used, the table is
+   rebuilt from the entries, which drops those buckets.
+*/
+
+static void TPM_KeyHandleEntries_HashAdd(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
+					 uint32_t location)
+{
+    uint32_t	hashMask = tpm_key_handle_entries->keyHandleHashSize - 1;
+    uint32_t	bucket;
+    TPM_BOOL	done;
+
+    if ((tpm_key_handle_entries->keyHandleHashUsed + 1) * 2 >
+	tpm_key_handle_entries->keyHandleHashSize) {
+	TPM_KeyHandleEntries_HashBuild(tpm_key_handle_entries);
+    }
+    else {
+	for (bucket = TPM_KeyHandleEntries_Hash
+		 (TPM_KeyHandleEntries_GetLocation(tpm_key_handle_entries, location)->handle,
+		  hashMask),
+		 done = FALSE ;
+	     !done ;
+	     bucket = (bucket + 1) & hashMask) {
+
+	    /* the entry may already be in the chain from an earlier handle */
+	    if (tpm_key_handle_entries->keyHandleHash[bucket] == location + 1) {
+		done = TRUE;
+	    }
+	    else if (tpm_key_handle_entries->keyHandleHash[bucket] == 0) {
+		tpm_key_handle_entries->keyHandleHash[bucket] = location + 1;
+		tpm_key_handle_entries->keyHandleHashUsed++;
+		done = TRUE;
+	    }
+	}
+    }
+    return;
+}
+
+/* TPM_KeyHandleEntries_HashBuild() rebuilds the keyHandleHash table from the slots and swap
+   entries.
+*/
+
+static void TPM_KeyHandleEntries_HashBuild(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
+{
+    uint32_t	hashMask = tpm_key_handle_entries->keyHandleHashSize - 1;
+    uint32_t	bucket;
+    uint32_t	location;
+    TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry;
+
+    printf("  TPM_KeyHandleEntries_HashBuild: Rebuilding %u buckets\n", hashMask + 1);
+    memset(tpm_key_handle_entries->keyHandleHash, 0, (hashMask + 1) * sizeof(uint32_t));
+    tpm_key_handle_entries->keyHandleHashUsed = 0;
+    for (location = 0 ;
+	 location < (tpm_key_handle_entries->keyHandleCount +
+		     tpm_key_handle_entries->keySwapCount) ;
+	 location++) {
+	tpm_key_handle_entry = TPM_KeyHandleEntries_GetLocation(tpm_key_handle_entries, location);
+	if (tpm_key_handle_entry->key != NULL) {
+	    for (bucket = TPM_KeyHandleEntries_Hash(tpm_key_handle_entry->handle, hashMask) ;
+		 tpm_key_handle_entries->keyHandleHash[bucket] != 0 ;
+		 bucket = (bucket + 1) & hashMask);
+	    tpm_key_handle_entries->keyHandleHash[bucket] = location + 1;
+	    tpm_key_handle_entries->keyHandleHashUsed++;
+	}
+    }
+    return;
+}
+
+/* TPM_KeyHandleEntries_Hash() returns the first keyHandleHash bucket for the handle.
+
+   Handles are usually random, but a caller may suggest any value.
+*/
+
+static uint32_t TPM_KeyHandleEntries_Hash(TPM_KEY_HANDLE tpm_key_handle,
+					  uint32_t hashMask)
+{
+    uint32_t	hash;
+
+    hash = tpm_key_handle * 0x9e3779b1;
+    hash ^= hash >> 16;
+    return hash & hashMask;
+}
+
+/* TPM_KeyHandleEntries_GetEntry() searches the keyHandleHash table for the entry matching the
+   handle, and returns that entry.
+
+   A bucket may refer to an entry that was deleted or reused for another handle, see
+   TPM_KeyHandleEntries_HashAdd(), so the entry is checked.
+
+   A swapped key is moved back to a slot, which may swap out another key.  An entry returned
+   earlier may then hold a different key, so that callers must not keep an entry across calls.
+   The TPM_KEY itself is not moved.
+*/
 
 TPM_RESULT TPM_KeyHandleEntries_GetEntry(TPM_KEY_HANDLE_ENTRY **tpm_key_handle_entry,
-					 TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+					 TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
 					 TPM_KEY_HANDLE tpm_key_handle)
 {
-    TPM_RESULT	rc = 0;
-    size_t	i;
-    TPM_BOOL	found;
+    TPM_RESULT		rc = 0;
+    uint32_t		hashMask = tpm_key_handle_entries->keyHandleHashSize - 1;
+    uint32_t		bucket;
+    uint32_t		location = 0;
+    uint32_t		index;
+    TPM_KEY_HANDLE_ENTRY *entry;
+    TPM_BOOL		found = FALSE;
 
     printf(" TPM_KeyHandleEntries_GetEntry: Get entry for handle %08x\n", tpm_key_handle);
-    for (i = 0, found = FALSE ; (i < TPM_KEY_HANDLES) && !found ; i++) {
-	/* first test for matching handle.  Then check for non-NULL to insure that entry is valid */
-	if ((tpm_key_handle_entries[i].handle == tpm_key_handle) &&
-	    tpm_key_handle_entries[i].key != NULL) {	/* found */
-	    found = TRUE;
-	    *tpm_key_handle_entry = &(tpm_key_handle_entries[i]);
+    if (tpm_key_handle_entries->keyHandleHashSize > 0) {
+	for (bucket = TPM_KeyHandleEntries_Hash(tpm_key_handle, hashMask) ;
+	     !found && (tpm_key_handle_entries->keyHandleHash[bucket] != 0) ;
+	     bucket = (bucket + 1) & hashMask) {
+
+	    location = tpm_key_handle_entries->keyHandleHash[bucket] - 1;
+	    entry = TPM_KeyHandleEntries_GetLocation(tpm_key_handle_entries, location);
+	    /* first test for matching handle.  Then check for non-NULL to insure that entry is
+	       valid */
+	    if ((entry->handle == tpm_key_handle) &&
+		entry->key != NULL) {	/* found */
+		found = TRUE;
+		*tpm_key_handle_entry = entry;
+	    }
 	}
     }
     if (!found) {
@@ -3540,12 +4449,17 @@ TPM_RESULT TPM_KeyHandleEntries_GetEntry(TPM_KEY_HANDLE_ENTRY **tpm_key_handle_e
     }
     else {
 	printf("  TPM_KeyHandleEntries_GetEntry: key handle %08x found\n", tpm_key_handle);
+	if (location >= tpm_key_handle_entries->keyHandleCount) {
+	    TPM_KeyHandleEntries_SwapIn(&index, tpm_key_handle_entries, location);
+	    *tpm_key_handle_entry = &(tpm_key_handle_entries->tpm_key_handle_entry[index]);
+	}
+	(*tpm_key_handle_entry)->lastUse = ++(tpm_key_handle_entries->keyHandleTick);
     }
     return rc;
 }
 
 /* TPM_KeyHandleEntries_GetNextEntry() gets the next valid TPM_KEY_HANDLE_ENTRY at or after the
-   'start' index.
+   'start' index.  The slots are followed by the swap entries.
 
    The current position is returned in 'current'.  For iteration, the next 'start' should be
    'current' + 1.
@@ -3558,15 +4472,20 @@ TPM_RESULT TPM_KeyHandleEntries_GetEntry(TPM_KEY_HANDLE_ENTRY **tpm_key_handle_e
 
 TPM_RESULT TPM_KeyHandleEntries_GetNextEntry(TPM_KEY_HANDLE_ENTRY **tpm_key_handle_entry,
 					     size_t *current,
-					     TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+					     TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
 					     size_t start)
 {
     TPM_RESULT	rc = TPM_RETRY;
+    TPM_KEY_HANDLE_ENTRY *entry;
 
     printf(" TPM_KeyHandleEntries_GetNextEntry: Start %lu\n", (unsigned long)start);
-    for (*current = start ; *current < TPM_KEY_HANDLES ; (*current)++) {
-	if (tpm_key_handle_entries[*current].key != NULL) {
-	    *tpm_key_handle_entry = &(tpm_key_handle_entries[*current]);
+    for (*current = start ;
+	 *current < (tpm_key_handle_entries->keyHandleCount +
+		     tpm_key_handle_entries->keySwapCount) ;
+	 (*current)++) {
+	entry = TPM_KeyHandleEntries_GetLocation(tpm_key_handle_entries, *current);
+	if (entry->key != NULL) {
+	    *tpm_key_handle_entry = entry;
 	    rc = 0;	/* found an entry */
 	    break;
 	}
@@ -3654,7 +4573,7 @@ TPM_RESULT TPM_KeyHandleEntries_GetKey(TPM_KEY **tpm_key,
     /* If not one of the special key handles, search for the handle in the list */
     if ((rc == 0) && !found) {
 	rc = TPM_KeyHandleEntries_GetEntry(&tpm_key_handle_entry,
-					   tpm_state->tpm_key_handle_entries,
+					   &(tpm_state->tpm_key_handle_entries),
 					   tpm_key_handle);
 	if (rc != 0) {
 	    printf("TPM_KeyHandleEntries_GetKey: Error, key handle %08x not found\n",
@@ -3690,7 +4609,7 @@ TPM_RESULT TPM_KeyHandleEntries_GetKey(TPM_KEY **tpm_key,
 /* TPM_KeyHandleEntries_SetParentPCRStatus() updates the parentPCRStatus member of the
    TPM_KEY_HANDLE_ENTRY */
 
-TPM_RESULT TPM_KeyHandleEntries_SetParentPCRStatus(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+TPM_RESULT TPM_KeyHandleEntries_SetParentPCRStatus(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
 						   TPM_KEY_HANDLE tpm_key_handle,
 						   TPM_BOOL parentPCRStatus)
 {
@@ -3718,7 +4637,7 @@ TPM_RESULT TPM_KeyHandleEntries_SetParentPCRStatus(TPM_KEY_HANDLE_ENTRY *tpm_key
    handle entries table.
 */
 
-TPM_RESULT TPM_KeyHandleEntries_OwnerEvictLoad(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+TPM_RESULT TPM_KeyHandleEntries_OwnerEvictLoad(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
 					       unsigned char **stream,
 					       uint32_t *stream_size)
 {
@@ -3789,11 +4708,12 @@ TPM_RESULT TPM_KeyHandleEntries_OwnerEvictLoad(TPM_KEY_HANDLE_ENTRY *tpm_key_han
 */
 
 TPM_RESULT TPM_KeyHandleEntries_OwnerEvictStore(TPM_STORE_BUFFER *sbuffer,
-						const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries)
+						const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
 {
     TPM_RESULT	rc = 0;
     uint16_t 	count;
     uint16_t	i;		/* the uint16_t corresponds to the standard getcap */
+    const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry;
 
     printf(" TPM_KeyHandleEntries_OwnerEvictStore:\n");
     /* append the owner evict version number to the stream */
@@ -3808,25 +4728,46 @@ TPM_RESULT TPM_KeyHandleEntries_OwnerEvictStore(TPM_STORE_BUFFER *sbuffer,
     if (rc == 0) {
 	rc = TPM_Sbuffer_Append16(sbuffer, count); 
     }
-    for (i = 0 ; (rc == 0) && (i < TPM_KEY_HANDLES) ; i++) {
+    for (i = 0 ; (rc == 0) && (i < tpm_key_handle_entries->keyHandleCount) ; i++) {
+	tpm_key_handle_entry = &(tpm_key_handle_entries->tpm_key_handle_entry[i]);
 	/* if the slot is occupied */
-	if (tpm_key_handle_entries[i].key != NULL) {
+	if (tpm_key_handle_entry->key != NULL) {
 	    /* if the key is owner evict */
-	    if ((tpm_key_handle_entries[i].keyControl & TPM_KEY_CONTROL_OWNER_EVICT)) {
+	    if ((tpm_key_handle_entry->keyControl & TPM_KEY_CONTROL_OWNER_EVICT)) {
 		/* store it */
-		rc = TPM_KeyHandleEntry_Store(sbuffer, &(tpm_key_handle_entries[i]));
+		rc = TPM_KeyHandleEntry_Store(sbuffer, tpm_key_handle_entry);
 	    }
 	}
     }
     return rc;
 }
 
+/* TPM_KeyHandleEntries_OwnerEvictSizeOf() returns the number of bytes
+   TPM_KeyHandleEntries_OwnerEvictStore() serializes */
+
+uint32_t TPM_KeyHandleEntries_OwnerEvictSizeOf(const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
+{
+    uint32_t	size;
+    uint16_t	i;
+    const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry;
+
+    size = sizeof(uint16_t) + sizeof(uint16_t);		/* tag, count */
+    for (i = 0 ; i < tpm_key_handle_entries->keyHandleCount ; i++) {
+	tpm_key_handle_entry = &(tpm_key_handle_entries->tpm_key_handle_entry[i]);
+	if ((tpm_key_handle_entry->key != NULL) &&
+	    (tpm_key_handle_entry->keyControl & TPM_KEY_CONTROL_OWNER_EVICT)) {
+	    size += TPM_KeyHandleEntry_SizeOf(tpm_key_handle_entry);
+	}
+    }
+    return size;
+}
+
 /* TPM_KeyHandleEntries_OwnerEvictGetCount returns the number of owner evict key entries
  */
 
 TPM_RESULT
 TPM_KeyHandleEntries_OwnerEvictGetCount(uint16_t *count,
-					const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries)
+					const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
 {
     TPM_RESULT	rc = 0;
     uint16_t	i;		/* the uint16_t corresponds to the standard getcap */
@@ -3834,11 +4775,12 @@ TPM_KeyHandleEntries_OwnerEvictGetCount(uint16_t *count,
     printf(" TPM_KeyHandleEntries_OwnerEvictGetCount:\n");
     /* count the number of loaded owner evict handles */
     if (rc == 0) {
-	for (i = 0 , *count = 0 ; i < TPM_KEY_HANDLES ; i++) {
+	for (i = 0 , *count = 0 ; i < tpm_key_handle_entries->keyHandleCount ; i++) {
 	    /* if the slot is occupied */
-	    if (tpm_key_handle_entries[i].key != NULL) {
+	    if (tpm_key_handle_entries->tpm_key_handle_entry[i].key != NULL) {
 		/* if the key is owner evict */
-		if ((tpm_key_handle_entries[i].keyControl & TPM_KEY_CONTROL_OWNER_EVICT)) {
+		if ((tpm_key_handle_entries->tpm_key_handle_entry[i].keyControl &
+		     TPM_KEY_CONTROL_OWNER_EVICT)) {
 		    (*count)++;		/* count it */
 		}
 	    }
@@ -3860,22 +4802,199 @@ TPM_KeyHandleEntries_OwnerEvictGetCount(uint16_t *count,
 
 */
 
-void TPM_KeyHandleEntries_OwnerEvictDelete(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries)
+void TPM_KeyHandleEntries_OwnerEvictDelete(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
 {
     uint16_t	i;		/* the uint16_t corresponds to the standard getcap */
 
-    for (i = 0 ; i < TPM_KEY_HANDLES ; i++) {
+    for (i = 0 ; i < tpm_key_handle_entries->keyHandleCount ; i++) {
 	/* if the slot is occupied */
-	if (tpm_key_handle_entries[i].key != NULL) {
+	if (tpm_key_handle_entries->tpm_key_handle_entry[i].key != NULL) {
 	    /* if the key is owner evict */
-	    if ((tpm_key_handle_entries[i].keyControl & TPM_KEY_CONTROL_OWNER_EVICT)) {
-		TPM_KeyHandleEntry_Delete(&(tpm_key_handle_entries[i]));
+	    if ((tpm_key_handle_entries->tpm_key_handle_entry[i].keyControl &
+		 TPM_KEY_CONTROL_OWNER_EVICT)) {
+		TPM_KeyHandleEntry_Delete(&(tpm_key_handle_entries->tpm_key_handle_entry[i]));
 	    }
 	}
     }
     return;
 }
 
+/*
+  Key Cache
+*/
+
+/* TPM_KeyCache_Init() initializes the TPM_KEY_CACHE structure without entries, which disables the
+   cache.  TPM_KeyCache_Alloc() allocates them.
+*/
+
+void TPM_KeyCache_Init(TPM_KEY_CACHE *tpm_key_cache)
+{
+    printf(" TPM_KeyCache_Init:\n");
+    tpm_key_cache->keyCacheCount = 0;
+    tpm_key_cache->keyCacheTick = 0;
+    tpm_key_cache->tpm_key_cache_entry = NULL;
+    return;
+}
+
+/* TPM_KeyCache_Alloc() allocates 'keyCacheCount' empty entries.  0 leaves the cache disabled.
+
+   The structure must be initialized and have no entries.
+*/
+
+TPM_RESULT TPM_KeyCache_Alloc(TPM_KEY_CACHE *tpm_key_cache,
+			      uint32_t keyCacheCount)
+{
+    TPM_RESULT	rc = 0;
+    uint32_t	i;
+
+    printf(" TPM_KeyCache_Alloc: %u entries\n", keyCacheCount);
+    if (rc == 0) {
+	if (keyCacheCount > TPM_KEY_CACHE_ENTRIES_MAX) {
+	    printf("TPM_KeyCache_Alloc: Error, %u entries greater than %u\n",
+		   keyCacheCount, TPM_KEY_CACHE_ENTRIES_MAX);
+	    rc = TPM_BAD_PARAMETER;
+	}
+    }
+    if ((rc == 0) && (keyCacheCount > 0)) {
+	rc = TPM_Malloc((unsigned char **)&(tpm_key_cache->tpm_key_cache_entry),
+			keyCacheCount * sizeof(TPM_KEY_CACHE_ENTRY));
+	if (rc == 0) {
+	    tpm_key_cache->keyCacheCount = keyCacheCount;
+	    for (i = 0 ; i < keyCacheCount ; i++) {
+		TPM_KeyCacheEntry_Init(&(tpm_key_cache->tpm_key_cache_entry[i]));
+	    }
+	}
+    }
+    return rc;
+}
+
+/* TPM_KeyCache_Delete() zeroes and frees all entries
+*/
+
+void TPM_KeyCache_Delete(TPM_KEY_CACHE *tpm_key_cache)
+{
+    printf(" TPM_KeyCache_Delete:\n");
+    TPM_KeyCache_Flush(tpm_key_cache);
+    free(tpm_key_cache->tpm_key_cache_entry);
+    TPM_KeyCache_Init(tpm_key_cache);
+    return;
+}
+
+/* TPM_KeyCache_Flush() zeroes and frees the decrypted data of all entries.  The entries remain
+   allocated.
+*/
+
+void TPM_KeyCache_Flush(TPM_KEY_CACHE *tpm_key_cache)
+{
+    uint32_t	i;
+
+    printf(" TPM_KeyCache_Flush:\n");
+    for (i = 0 ; i < tpm_key_cache->keyCacheCount ; i++) {
+	TPM_KeyCacheEntry_Delete(&(tpm_key_cache->tpm_key_cache_entry[i]));
+    }
+    return;
+}
+
+/* TPM_KeyCache_GetEntry() returns the decrypted data in 'decryptData' and 'decryptDataLength' if
+   'encDataDigest' was decrypted by the parent key with 'parentDigest', else NULL.
+
+   The data belongs to the cache.
+*/
+
+void TPM_KeyCache_GetEntry(const unsigned char **decryptData,
+			   uint32_t *decryptDataLength,
+			   TPM_KEY_CACHE *tpm_key_cache,
+			   TPM_DIGEST parentDigest,
+			   TPM_DIGEST encDataDigest)
+{
+    uint32_t		i;
+    TPM_KEY_CACHE_ENTRY	*tpm_key_cache_entry;
+
+    *decryptData = NULL;
+    for (i = 0 ; i < tpm_key_cache->keyCacheCount ; i++) {
+	tpm_key_cache_entry = &(tpm_key_cache->tpm_key_cache_entry[i]);
+	if ((tpm_key_cache_entry->decryptData != NULL) &&
+	    (TPM_Digest_Compare(tpm_key_cache_entry->encDataDigest, encDataDigest) == 0) &&
+	    (TPM_Digest_Compare(tpm_key_cache_entry->parentDigest, parentDigest) == 0)) {
+
+	    printf("  TPM_KeyCache_GetEntry: Found entry %u\n", i);
+	    tpm_key_cache_entry->lastUse = ++(tpm_key_cache->keyCacheTick);
+	    *decryptData = tpm_key_cache_entry->decryptData;
+	    *decryptDataLength = tpm_key_cache_entry->decryptDataLength;
+	    break;
+	}
+    }
+    return;
+}
+
+/* TPM_KeyCache_AddEntry() adds a copy of 'decryptData', the decryption of 'encDataDigest' by the
+   parent key with 'parentDigest'.  If the cache is full, the least recently used entry is zeroed
+   and replaced.
+*/
+
+TPM_RESULT TPM_KeyCache_AddEntry(TPM_KEY_CACHE *tpm_key_cache,
+				 TPM_DIGEST parentDigest,
+				 TPM_DIGEST encDataDigest,
+				 const unsigned char *decryptData,
+				 uint32_t decryptDataLength)
+{
+    TPM_RESULT		rc = 0;
+    uint32_t		i;
+    uint32_t		index;
+    TPM_KEY_CACHE_ENTRY	*tpm_key_cache_entry;
+
+    /* an empty entry is older than any used entry */
+    for (i = 0, index = 0 ; i < tpm_key_cache->keyCacheCount ; i++) {
+	if (tpm_key_cache->tpm_key_cache_entry[i].decryptData == NULL) {
+	    index = i;
+	    break;
+	}
+	if (tpm_key_cache->tpm_key_cache_entry[i].lastUse <
+	    tpm_key_cache->tpm_key_cache_entry[index].lastUse) {
+	    index = i;
+	}
+    }
+    printf("  TPM_KeyCache_AddEntry: Entry %u\n", index);
+    tpm_key_cache_entry = &(tpm_key_cache->tpm_key_cache_entry[index]);
+    TPM_KeyCacheEntry_Delete(tpm_key_cache_entry);
+    if (rc == 0) {
+	rc = TPM_Malloc(&(tpm_key_cache_entry->decryptData), decryptDataLength);
+    }
+    if (rc == 0) {
+	memcpy(tpm_key_cache_entry->decryptData, decryptData, decryptDataLength);
+	tpm_key_cache_entry->decryptDataLength = decryptDataLength;
+	TPM_Digest_Copy(tpm_key_cache_entry->parentDigest, parentDigest);
+	TPM_Digest_Copy(tpm_key_cache_entry->encDataDigest, encDataDigest);
+	tpm_key_cache_entry->lastUse = ++(tpm_key_cache->keyCacheTick);
+    }
+    return rc;
+}
+
+/* TPM_KeyCacheEntry_Init() initializes an empty entry */
+
+static void TPM_KeyCacheEntry_Init(TPM_KEY_CACHE_ENTRY *tpm_key_cache_entry)
+{
+    TPM_Digest_Init(tpm_key_cache_entry->parentDigest);
+    TPM_Digest_Init(tpm_key_cache_entry->encDataDigest);
+    tpm_key_cache_entry->decryptData = NULL;
+    tpm_key_cache_entry->decryptDataLength = 0;
+    tpm_key_cache_entry->lastUse = 0;
+    return;
+}
+
+/* TPM_KeyCacheEntry_Delete() zeroes and frees the decrypted data, which holds a private key, and
+   empties the entry */
+
+static void TPM_KeyCacheEntry_Delete(TPM_KEY_CACHE_ENTRY *tpm_key_cache_entry)
+{
+    if (tpm_key_cache_entry->decryptData != NULL) {
+	memset(tpm_key_cache_entry->decryptData, 0, tpm_key_cache_entry->decryptDataLength);
+	free(tpm_key_cache_entry->decryptData);
+    }
+    TPM_KeyCacheEntry_Init(tpm_key_cache_entry);
+    return;
+}
+
 /*
   Processing Functions
 */
@@ -5244,7 +6363,7 @@ TPM_RESULT TPM_Process_EvictKey(tpm_state_t *tpm_state,
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_EvictKey: Evicting handle %08x\n", evictHandle);
 	returnCode = TPM_KeyHandleEntries_GetEntry(&tpm_key_handle_entry,
-						   tpm_state->tpm_key_handle_entries,
+						   &(tpm_state->tpm_key_handle_entries),
 						   evictHandle);
 	if (returnCode != TPM_SUCCESS) {
 	    printf("TPM_Process_EvictKey: Error, key handle %08x not found\n",
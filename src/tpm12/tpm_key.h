@@ -72,6 +72,11 @@ TPM_RESULT TPM_Key_StorePubData(TPM_STORE_BUFFER *sbuffer,
 TPM_RESULT TPM_Key_StoreClear(TPM_STORE_BUFFER *sbuffer,
 			      TPM_BOOL isEK,
                               TPM_KEY *tpm_key);
+uint32_t   TPM_Key_SizeOfPubData(TPM_BOOL isEK,
+				 const TPM_KEY *tpm_key);
+uint32_t   TPM_Key_SizeOf(const TPM_KEY *tpm_key);
+uint32_t   TPM_Key_SizeOfClear(TPM_BOOL isEK,
+			       const TPM_KEY *tpm_key);
 
 void       TPM_Key_Delete(TPM_KEY *tpm_key);
 
@@ -125,7 +130,8 @@ TPM_RESULT TPM_Key_CheckPubDataDigest(TPM_KEY *tpm_key);
 TPM_RESULT TPM_Key_GenerateEncData(TPM_KEY *tpm_key,
                                    TPM_KEY *parent_key);
 TPM_RESULT TPM_Key_DecryptEncData(TPM_KEY *tpm_key,
-                                  TPM_KEY *parent_key);
+                                  TPM_KEY *parent_key,
+                                  TPM_KEY_CACHE *tpm_key_cache);
 
 TPM_RESULT TPM_Key_GetStoreAsymkey(TPM_STORE_ASYMKEY **tpm_store_asymkey,
                                    TPM_KEY *tpm_key);
@@ -142,6 +148,19 @@ TPM_RESULT TPM_Key_GetPrimeFactorP(uint32_t 		*pbytes,
 TPM_RESULT TPM_Key_GetPrivateKey(uint32_t	*dbytes,
                                  unsigned char  **darr,
                                  TPM_KEY        *tpm_key);
+TPM_RESULT TPM_Key_GetCRTParameters(uint32_t		*pbytes,
+                                   unsigned char	**parr,
+                                   uint32_t		*qbytes,
+                                   unsigned char	**qarr,
+                                   uint32_t		*dpbytes,
+                                   unsigned char	**dparr,
+                                   uint32_t		*dqbytes,
+                                   unsigned char	**dqarr,
+                                   uint32_t		*qinvbytes,
+                                   unsigned char	**qinvarr,
+                                   TPM_KEY		*tpm_key);
+TPM_RESULT TPM_Key_GetRSAKeyToken(TPM_RSA_KEY_TOKEN	*rsa_key_token,
+				  TPM_KEY		*tpm_key);
 TPM_RESULT TPM_Key_GetExponent(uint32_t		*ebytes,
                                unsigned char    **earr,
                                TPM_KEY  *tpm_key);
@@ -191,6 +210,7 @@ TPM_RESULT TPM_KeyParms_Load(TPM_KEY_PARMS *tpm_key_parms,
                              uint32_t *stream_size);
 TPM_RESULT TPM_KeyParms_Store(TPM_STORE_BUFFER *sbuffer,
                               TPM_KEY_PARMS *tpm_key_parms);
+uint32_t   TPM_KeyParms_SizeOf(const TPM_KEY_PARMS *tpm_key_parms);
 void       TPM_KeyParms_Delete(TPM_KEY_PARMS *tpm_key_parms);
 TPM_RESULT TPM_KeyParms_GetRSAKeyParms(TPM_RSA_KEY_PARMS **tpm_rsa_key_parms,
                                        TPM_KEY_PARMS *tpm_key_parms);
@@ -213,6 +233,7 @@ TPM_RESULT TPM_Pubkey_Load(TPM_PUBKEY *tpm_pubkey,
                            uint32_t *stream_size);
 TPM_RESULT TPM_Pubkey_Store(TPM_STORE_BUFFER *sbuffer,
                             TPM_PUBKEY *tpm_pubkey);
+uint32_t   TPM_Pubkey_SizeOf(const TPM_PUBKEY *tpm_pubkey);
 void       TPM_Pubkey_Delete(TPM_PUBKEY *tpm_pubkey);
 
 TPM_RESULT TPM_Pubkey_Set(TPM_PUBKEY *tpm_pubkey,
@@ -236,6 +257,7 @@ TPM_RESULT TPM_KeyHandleEntry_Load(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry,
                                    uint32_t *stream_size);
 TPM_RESULT TPM_KeyHandleEntry_Store(TPM_STORE_BUFFER *sbuffer,
                                     const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry);
+uint32_t   TPM_KeyHandleEntry_SizeOf(const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry);
 void       TPM_KeyHandleEntry_Delete(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry);
 
 TPM_RESULT TPM_KeyHandleEntry_FlushSpecific(tpm_state_t *tpm_state,
@@ -245,38 +267,46 @@ TPM_RESULT TPM_KeyHandleEntry_FlushSpecific(tpm_state_t *tpm_state,
   TPM_KEY_HANDLE_ENTRY entries list
 */
 
-void       TPM_KeyHandleEntries_Init(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries);
-void       TPM_KeyHandleEntries_Delete(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries);
+void       TPM_KeyHandleEntries_Init(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries);
+TPM_RESULT TPM_KeyHandleEntries_Alloc(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
+                                      uint32_t keyHandleCount,
+                                      TPM_BOOL keySwap);
+TPM_RESULT TPM_KeyHandleEntries_Resize(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
+                                       uint32_t keyHandleCount);
+void       TPM_KeyHandleEntries_Delete(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries);
 
 TPM_RESULT TPM_KeyHandleEntries_Load(tpm_state_t *tpm_state,
 				     unsigned char **stream,
 				     uint32_t *stream_size);
 TPM_RESULT TPM_KeyHandleEntries_Store(TPM_STORE_BUFFER *sbuffer,
 				      tpm_state_t *tpm_state);
+uint32_t   TPM_KeyHandleEntries_SizeOf(tpm_state_t *tpm_state);
 
 TPM_RESULT TPM_KeyHandleEntries_StoreHandles(TPM_STORE_BUFFER *sbuffer,
-                                             const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries);
-TPM_RESULT TPM_KeyHandleEntries_DeleteHandle(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+                                             const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries);
+TPM_RESULT TPM_KeyHandleEntries_DeleteHandle(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
                                              TPM_KEY_HANDLE tpm_key_handle);
 
 void       TPM_KeyHandleEntries_IsSpace(TPM_BOOL *isSpace, uint32_t *index,
-                                        const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries);
+                                        const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries);
 void       TPM_KeyHandleEntries_GetSpace(uint32_t *space,
-                                         const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries);
+                                         const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries);
+uint32_t   TPM_KeyHandleEntries_GetMaxKeys(uint32_t keyHandleCount,
+                                           TPM_BOOL keySwap);
 void       TPM_KeyHandleEntries_IsEvictSpace(TPM_BOOL *isSpace,
-                                             const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+                                             const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
                                              uint32_t minSpace);
 TPM_RESULT TPM_KeyHandleEntries_AddKeyEntry(TPM_KEY_HANDLE *tpm_key_handle,
-                                            TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+                                            TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
                                             TPM_KEY *tpm_key,
                                             TPM_BOOL parentPCRStatus,
                                             TPM_KEY_CONTROL keyControl);
 TPM_RESULT TPM_KeyHandleEntries_AddEntry(TPM_KEY_HANDLE *tpm_key_handle,
                                          TPM_BOOL keepHandle,
-                                         TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+                                         TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
                                          TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry);
 TPM_RESULT TPM_KeyHandleEntries_GetEntry(TPM_KEY_HANDLE_ENTRY **tpm_key_handle_entry,
-                                         TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+                                         TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
                                          TPM_KEY_HANDLE tpm_key_handle);
 TPM_RESULT TPM_KeyHandleEntries_GetKey(TPM_KEY **tpm_key,
                                        TPM_BOOL *parentPCRStatus,
@@ -285,22 +315,44 @@ TPM_RESULT TPM_KeyHandleEntries_GetKey(TPM_KEY **tpm_key,
                                        TPM_BOOL readOnly,
                                        TPM_BOOL ignorePCRs,
                                        TPM_BOOL allowEK);
-TPM_RESULT TPM_KeyHandleEntries_SetParentPCRStatus(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+TPM_RESULT TPM_KeyHandleEntries_SetParentPCRStatus(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
                                                    TPM_KEY_HANDLE tpm_key_handle,
                                                    TPM_BOOL parentPCRStatus);
 TPM_RESULT TPM_KeyHandleEntries_GetNextEntry(TPM_KEY_HANDLE_ENTRY **tpm_key_handle_entry,
                                              size_t *current,
-                                             TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+                                             TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
                                              size_t start);
 
-TPM_RESULT TPM_KeyHandleEntries_OwnerEvictLoad(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+TPM_RESULT TPM_KeyHandleEntries_OwnerEvictLoad(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
 					       unsigned char **stream, uint32_t *stream_size);
 TPM_RESULT TPM_KeyHandleEntries_OwnerEvictStore(TPM_STORE_BUFFER *sbuffer,
-						const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries);
+						const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries);
+uint32_t   TPM_KeyHandleEntries_OwnerEvictSizeOf(const TPM_KEY_HANDLE_ENTRIES
+						 *tpm_key_handle_entries);
 TPM_RESULT TPM_KeyHandleEntries_OwnerEvictGetCount(uint16_t *count,
-						   const TPM_KEY_HANDLE_ENTRY
+						   const TPM_KEY_HANDLE_ENTRIES
 						   *tpm_key_handle_entries);
-void       TPM_KeyHandleEntries_OwnerEvictDelete(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries);
+void       TPM_KeyHandleEntries_OwnerEvictDelete(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries);
+
+/*
+  TPM_KEY_CACHE decrypted key blobs
+*/
+
+void       TPM_KeyCache_Init(TPM_KEY_CACHE *tpm_key_cache);
+TPM_RESULT TPM_KeyCache_Alloc(TPM_KEY_CACHE *tpm_key_cache,
+                              uint32_t keyCacheCount);
+void       TPM_KeyCache_Delete(TPM_KEY_CACHE *tpm_key_cache);
+void       TPM_KeyCache_Flush(TPM_KEY_CACHE *tpm_key_cache);
+void       TPM_KeyCache_GetEntry(const unsigned char **decryptData,
+                                 uint32_t *decryptDataLength,
+                                 TPM_KEY_CACHE *tpm_key_cache,
+                                 TPM_DIGEST parentDigest,
+                                 TPM_DIGEST encDataDigest);
+TPM_RESULT TPM_KeyCache_AddEntry(TPM_KEY_CACHE *tpm_key_cache,
+                                 TPM_DIGEST parentDigest,
+                                 TPM_DIGEST encDataDigest,
+                                 const unsigned char *decryptData,
+                                 uint32_t decryptDataLength);
 
 /* TPM_RSA_KEY_PARMS */
 
@@ -310,6 +362,7 @@ TPM_RESULT TPM_RSAKeyParms_Load(TPM_RSA_KEY_PARMS *tpm_rsa_key_parms,
                                 uint32_t *stream_size);
 TPM_RESULT TPM_RSAKeyParms_Store(TPM_STORE_BUFFER *sbuffer,
                                  const TPM_RSA_KEY_PARMS *tpm_rsa_key_parms);
+uint32_t   TPM_RSAKeyParms_SizeOf(const TPM_RSA_KEY_PARMS *tpm_rsa_key_parms);
 void       TPM_RSAKeyParms_Delete(TPM_RSA_KEY_PARMS *tpm_rsa_key_parms);
 
 TPM_RESULT TPM_RSAKeyParms_Copy(TPM_RSA_KEY_PARMS *tpm_rsa_key_parms_dest,
@@ -331,6 +384,8 @@ TPM_RESULT TPM_StoreAsymkey_Load(TPM_STORE_ASYMKEY *tpm_store_asymkey,
 TPM_RESULT TPM_StoreAsymkey_Store(TPM_STORE_BUFFER *sbuffer,
 				  TPM_BOOL isEK,
                                   const TPM_STORE_ASYMKEY *tpm_store_asymkey);
+uint32_t   TPM_StoreAsymkey_SizeOf(TPM_BOOL isEK,
+				   const TPM_STORE_ASYMKEY *tpm_store_asymkey);
 void       TPM_StoreAsymkey_Delete(TPM_STORE_ASYMKEY *tpm_store_asymkey);
 
 TPM_RESULT TPM_StoreAsymkey_GenerateEncData(TPM_SIZED_BUFFER *encData,
@@ -375,6 +430,7 @@ void       TPM_StorePrivkey_Delete(TPM_STORE_PRIVKEY *tpm_store_privkey);
 TPM_RESULT TPM_StorePrivkey_Convert(TPM_STORE_ASYMKEY *tpm_store_asymkey,
                                     TPM_KEY_PARMS *tpm_key_parms,
                                     TPM_SIZED_BUFFER *pubKey);
+TPM_RESULT TPM_StorePrivkey_SetCRT(TPM_STORE_PRIVKEY *tpm_store_privkey);
 
 
 /* Command Processing Functions */
@@ -0,0 +1,472 @@
+/********************************************************************************/
+/*										*/
+/*				TPM Key Pair Pool				*/
+/*		       IBM Thomas J. Watson Research Center			*/
+/*										*/
+/* (c) Copyright IBM Corporation 2015.						*/
+/*										*/
+/* All rights reserved.								*/
+/* 										*/
+/* Redistribution and use in source and binary forms, with or without		*/
+/* modification, are permitted provided that the following conditions are	*/
+/* met:										*/
+/* 										*/
+/* Redistributions of source code must retain the above copyright notice,	*/
+/* this list of conditions and the following disclaimer.			*/
+/* 										*/
+/* Redistributions in binary form must reproduce the above copyright		*/
+/* notice, this list of conditions and the following disclaimer in the		*/
+/* documentation and/or other materials provided with the distribution.		*/
+/* 										*/
+/* Neither the names of the IBM Corporation nor the names of its		*/
+/* contributors may be used to endorse or promote products derived from		*/
+/* this software without specific prior written permission.			*/
+/* 										*/
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS		*/
+/* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT		*/
+/* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR	*/
+/* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT		*/
+/* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,	*/
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT		*/
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,	*/
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY	*/
+/* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT		*/
+/* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE	*/
+/* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
+/********************************************************************************/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_CRYPTO
+#include "tpm_crypto.h"
+#include "tpm_debug.h"
+#include "tpm_error.h"
+#include "tpm_key.h"
+
+#include "tpm_keypool.h"
+
+/* The key pair pool holds RSA key pairs that a worker thread generated in advance, so that the
+   commands that create keys need not wait for the key generation.
+
+   The pool is shared by all TPM instances.  It keeps up to 'tpm_key_pool_depth' key pairs for each
+   of up to TPM_KEY_POOL_CLASSES combinations of key size and public exponent.  The default 2048
+   bit key is always pre-generated.  Other combinations are added when a key of that size and
+   exponent was generated successfully, as long as there is room.
+
+   A key pair is handed out once and removed from the pool.  If the pool has no key pair of the
+   requested size and exponent, the key pair is generated synchronously as before.
+
+   All variables below are protected by 'tpm_key_pool_lock'.
+*/
+
+#define TPM_KEY_POOL_EXPONENT_MAX	8	/* the largest public exponent in bytes */
+
+typedef struct tdTPM_KEY_POOL_ENTRY {
+    unsigned char	*n;	/* public key - modulus */
+    unsigned char	*p;	/* private key prime */
+    unsigned char	*q;	/* private key prime */
+    unsigned char	*d;	/* private key (private exponent) */
+} TPM_KEY_POOL_ENTRY;
+
+typedef struct tdTPM_KEY_POOL_CLASS {
+    int			num_bits;	/* key size in bits, 0 for an unused class */
+    unsigned char	earr[TPM_KEY_POOL_EXPONENT_MAX];
+    uint32_t		e_size;
+    uint32_t		count;		/* number of valid entries */
+    TPM_KEY_POOL_ENTRY	entries[TPM_KEY_POOL_DEPTH_MAX];
+} TPM_KEY_POOL_CLASS;
+
+static pthread_mutex_t	tpm_key_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	tpm_key_pool_cond = PTHREAD_COND_INITIALIZER;	/* wakes the worker */
+static pthread_t	tpm_key_pool_thread;
+static TPM_BOOL		tpm_key_pool_running = FALSE;	/* the worker thread exists */
+static TPM_BOOL		tpm_key_pool_stop = FALSE;	/* the worker thread must exit */
+static TPM_BOOL		tpm_key_pool_started = FALSE;	/* the crypto library is initialized */
+static uint32_t		tpm_key_pool_users = 0;		/* TPM instances using the pool */
+static uint32_t		tpm_key_pool_depth = 0;		/* 0 disables the pool */
+static TPM_KEY_POOL_CLASS tpm_key_pool_classes[TPM_KEY_POOL_CLASSES];
+
+/* local prototypes */
+
+static void		   *TPM_KeyPool_Worker(void *arg);
+static void		   TPM_KeyPool_StartWorker(void);
+static void		   TPM_KeyPool_StopWorker(void);
+static TPM_KEY_POOL_CLASS  *TPM_KeyPool_GetClass(int num_bits,
+						 const unsigned char *earr,
+						 uint32_t e_size);
+static void		   TPM_KeyPool_AddClass(int num_bits,
+						const unsigned char *earr,
+						uint32_t e_size);
+static void		   TPM_KeyPoolClass_Trim(TPM_KEY_POOL_CLASS *tpm_key_pool_class,
+						 uint32_t depth);
+static void		   TPM_KeyPoolEntry_Delete(TPM_KEY_POOL_ENTRY *tpm_key_pool_entry,
+						   int num_bits);
+
+/* TPM_KeyPool_SetDepth() sets the number of key pairs kept for each key size and public exponent.
+   0 stops the worker thread and zeroes and frees all pre-generated key pairs.
+
+   Unlike the other TPM properties, the depth takes effect immediately for all TPM instances.
+
+   Returns TPM_BAD_PARAMETER if 'depth' is greater than TPM_KEY_POOL_DEPTH_MAX.
+*/
+
+TPM_RESULT TPM_KeyPool_SetDepth(uint32_t depth)
+{
+    TPM_RESULT	rc = 0;
+    size_t	i;
+
+    printf("TPM_KeyPool_SetDepth: %u\n", depth);
+    if (depth > TPM_KEY_POOL_DEPTH_MAX) {
+	printf("TPM_KeyPool_SetDepth: Error, %u greater than %u\n",
+	       depth, TPM_KEY_POOL_DEPTH_MAX);
+	rc = TPM_BAD_PARAMETER;
+    }
+    if ((rc == 0) && (depth == 0)) {
+	TPM_KeyPool_StopWorker();
+    }
+    if (rc == 0) {
+	pthread_mutex_lock(&tpm_key_pool_lock);
+	tpm_key_pool_depth = depth;
+	for (i = 0 ; i < TPM_KEY_POOL_CLASSES ; i++) {
+	    TPM_KeyPoolClass_Trim(&(tpm_key_pool_classes[i]), depth);
+	}
+	pthread_mutex_unlock(&tpm_key_pool_lock);
+    }
+    if ((rc == 0) && (depth > 0)) {
+	TPM_KeyPool_StartWorker();
+    }
+    return rc;
+}
+
+/* TPM_KeyPool_GetDepth() returns the number of key pairs kept for each key size and public
+   exponent
+*/
+
+uint32_t TPM_KeyPool_GetDepth(void)
+{
+    uint32_t	depth;
+
+    pthread_mutex_lock(&tpm_key_pool_lock);
+    depth = tpm_key_pool_depth;
+    pthread_mutex_unlock(&tpm_key_pool_lock);
+    return depth;
+}
+
+/* TPM_KeyPool_Start() is called for each TPM instance created, once the crypto library is
+   initialized.  From then on, the worker thread runs while the depth is not 0, until
+   TPM_KeyPool_Stop() was called for each of the instances.
+
+   The worker thread is best effort.  If it cannot be created, key pairs are generated
+   synchronously.
+*/
+
+void TPM_KeyPool_Start(void)
+{
+    printf(" TPM_KeyPool_Start:\n");
+    pthread_mutex_lock(&tpm_key_pool_lock);
+    tpm_key_pool_started = TRUE;
+    tpm_key_pool_users++;
+    if (TPM_KeyPool_GetClass(TPM_KEY_RSA_NUMBITS, tpm_default_rsa_exponent, 3) == NULL) {
+	TPM_KeyPool_AddClass(TPM_KEY_RSA_NUMBITS, tpm_default_rsa_exponent, 3);
+    }
+    pthread_mutex_unlock(&tpm_key_pool_lock);
+    TPM_KeyPool_StartWorker();
+    return;
+}
+
+/* TPM_KeyPool_Stop() is called when a TPM instance is terminated.  When no instance is left, it
+   stops the worker thread and zeroes and frees all pre-generated key pairs.  The depth is kept for
+   the instances created afterwards.
+*/
+
+void TPM_KeyPool_Stop(void)
+{
+    TPM_BOOL	last;
+    size_t	i;
+
+    printf(" TPM_KeyPool_Stop:\n");
+    pthread_mutex_lock(&tpm_key_pool_lock);
+    if (tpm_key_pool_users > 0) {
+	tpm_key_pool_users--;
+    }
+    last = (tpm_key_pool_users == 0);
+    if (last) {
+	tpm_key_pool_started = FALSE;
+    }
+    pthread_mutex_unlock(&tpm_key_pool_lock);
+    if (last) {
+	TPM_KeyPool_StopWorker();
+	pthread_mutex_lock(&tpm_key_pool_lock);
+	for (i = 0 ; i < TPM_KEY_POOL_CLASSES ; i++) {
+	    TPM_KeyPoolClass_Trim(&(tpm_key_pool_classes[i]), 0);
+	}
+	pthread_mutex_unlock(&tpm_key_pool_lock);
+	/* an instance created meanwhile restarts the worker thread */
+	TPM_KeyPool_StartWorker();
+    }
+    return;
+}
+
+/* TPM_KeyPool_GenerateKeyPair() returns an RSA key pair as TPM_RSAGenerateKeyPair() does.  It takes
+   a pre-generated key pair from the pool if there is one, else it generates the key pair.
+
+   'n', 'p', 'q', 'd' must be freed by the caller
+*/
+
+TPM_RESULT TPM_KeyPool_GenerateKeyPair(unsigned char **n,	/* public key - modulus */
+				       unsigned char **p,	/* private key prime */
+				       unsigned char **q,	/* private key prime */
+				       unsigned char **d,	/* private key (private exponent) */
+				       int num_bits,		/* key size in bits */
+				       const unsigned char *earr,	/* public exponent */
+				       uint32_t e_size)
+{
+    TPM_RESULT		rc = 0;
+    TPM_BOOL		found = FALSE;
+    TPM_KEY_POOL_CLASS	*tpm_key_pool_class;
+    TPM_KEY_POOL_ENTRY	*tpm_key_pool_entry;
+
+    printf(" TPM_KeyPool_GenerateKeyPair: num_bits %d\n", num_bits);
+    pthread_mutex_lock(&tpm_key_pool_lock);
+    if (tpm_key_pool_depth > 0) {
+	tpm_key_pool_class = TPM_KeyPool_GetClass(num_bits, earr, e_size);
+	if ((tpm_key_pool_class != NULL) && (tpm_key_pool_class->count > 0)) {
+	    tpm_key_pool_class->count--;
+	    tpm_key_pool_entry = &(tpm_key_pool_class->entries[tpm_key_pool_class->count]);
+	    *n = tpm_key_pool_entry->n;
+	    *p = tpm_key_pool_entry->p;
+	    *q = tpm_key_pool_entry->q;
+	    *d = tpm_key_pool_entry->d;
+	    memset(tpm_key_pool_entry, 0, sizeof(TPM_KEY_POOL_ENTRY));
+	    found = TRUE;
+	    printf("  TPM_KeyPool_GenerateKeyPair: Pre-generated, %u left\n",
+		   tpm_key_pool_class->count);
+	    /* refill */
+	    pthread_cond_signal(&tpm_key_pool_cond);
+	}
+    }
+    pthread_mutex_unlock(&tpm_key_pool_lock);
+    if (!found) {
+	rc = TPM_RSAGenerateKeyPair(n, p, q, d, num_bits, earr, e_size);
+	/* the key size and exponent are valid, pre-generate them from now on */
+	if (rc == 0) {
+	    pthread_mutex_lock(&tpm_key_pool_lock);
+	    if ((tpm_key_pool_depth > 0) &&
+		(TPM_KeyPool_GetClass(num_bits, earr, e_size) == NULL)) {
+		TPM_KeyPool_AddClass(num_bits, earr, e_size);
+		pthread_cond_signal(&tpm_key_pool_cond);
+	    }
+	    pthread_mutex_unlock(&tpm_key_pool_lock);
+	}
+    }
+    return rc;
+}
+
+/* TPM_KeyPool_Worker() is the worker thread.  It generates key pairs while a class is not full and
+   waits otherwise.  The lock is not held during the key generation.
+*/
+
+static void *TPM_KeyPool_Worker(void *arg)
+{
+    TPM_RESULT		rc;
+    size_t		i;
+    TPM_KEY_POOL_CLASS	*tpm_key_pool_class;
+    TPM_KEY_POOL_ENTRY	tpm_key_pool_entry;
+    int			num_bits;
+    unsigned char	earr[TPM_KEY_POOL_EXPONENT_MAX];
+    uint32_t		e_size;
+
+    arg = arg;	/* not used */
+    printf(" TPM_KeyPool_Worker: Started\n");
+    pthread_mutex_lock(&tpm_key_pool_lock);
+    while (!tpm_key_pool_stop) {
+	/* find a class that is not full */
+	for (i = 0, tpm_key_pool_class = NULL ; i < TPM_KEY_POOL_CLASSES ; i++) {
+	    if ((tpm_key_pool_classes[i].num_bits != 0) &&
+		(tpm_key_pool_classes[i].count < tpm_key_pool_depth)) {
+		tpm_key_pool_class = &(tpm_key_pool_classes[i]);
+		break;
+	    }
+	}
+	if (tpm_key_pool_class == NULL) {
+	    pthread_cond_wait(&tpm_key_pool_cond, &tpm_key_pool_lock);
+	    continue;
+	}
+	num_bits = tpm_key_pool_class->num_bits;
+	e_size = tpm_key_pool_class->e_size;
+	memcpy(earr, tpm_key_pool_class->earr, e_size);
+	pthread_mutex_unlock(&tpm_key_pool_lock);
+	rc = TPM_RSAGenerateKeyPair(&(tpm_key_pool_entry.n),
+				    &(tpm_key_pool_entry.p),
+				    &(tpm_key_pool_entry.q),
+				    &(tpm_key_pool_entry.d),
+				    num_bits, earr, e_size);
+	pthread_mutex_lock(&tpm_key_pool_lock);
+	/* the class may have been trimmed while the lock was released */
+	if (rc != 0) {
+	    /* do not retry a failing key generation forever */
+	    printf("TPM_KeyPool_Worker: Error generating a %d bit key, class removed\n",
+		   num_bits);
+	    TPM_KeyPoolClass_Trim(tpm_key_pool_class, 0);
+	    tpm_key_pool_class->num_bits = 0;
+	}
+	else if (!tpm_key_pool_stop &&
+		 (tpm_key_pool_class->count < tpm_key_pool_depth)) {
+	    tpm_key_pool_class->entries[tpm_key_pool_class->count] = tpm_key_pool_entry;
+	    tpm_key_pool_class->count++;
+	}
+	else {
+	    TPM_KeyPoolEntry_Delete(&tpm_key_pool_entry, num_bits);
+	}
+    }
+    pthread_mutex_unlock(&tpm_key_pool_lock);
+    printf(" TPM_KeyPool_Worker: Stopped\n");
+    return NULL;
+}
+
+/* TPM_KeyPool_StartWorker() creates the worker thread if the crypto library is initialized, the
+   depth is not 0 and the thread does not exist yet.  Otherwise it wakes the existing thread.
+*/
+
+static void TPM_KeyPool_StartWorker(void)
+{
+    int		irc;
+
+    pthread_mutex_lock(&tpm_key_pool_lock);
+    if (tpm_key_pool_running) {
+	pthread_cond_signal(&tpm_key_pool_cond);
+    }
+    else if (tpm_key_pool_started && (tpm_key_pool_depth > 0)) {
+	tpm_key_pool_stop = FALSE;
+	irc = pthread_create(&tpm_key_pool_thread, NULL, TPM_KeyPool_Worker, NULL);
+	if (irc == 0) {
+	    tpm_key_pool_running = TRUE;
+	}
+	else {
+	    printf("TPM_KeyPool_StartWorker: Error %d creating the worker thread\n", irc);
+	}
+    }
+    pthread_mutex_unlock(&tpm_key_pool_lock);
+    return;
+}
+
+/* TPM_KeyPool_StopWorker() stops the worker thread and waits until it exited.  A key generation in
+   progress is completed first.
+*/
+
+static void TPM_KeyPool_StopWorker(void)
+{
+    TPM_BOOL	running;
+
+    pthread_mutex_lock(&tpm_key_pool_lock);
+    running = tpm_key_pool_running;
+    if (running) {
+	tpm_key_pool_stop = TRUE;
+	pthread_cond_signal(&tpm_key_pool_cond);
+    }
+    pthread_mutex_unlock(&tpm_key_pool_lock);
+    if (running) {
+	pthread_join(tpm_key_pool_thread, NULL);
+	pthread_mutex_lock(&tpm_key_pool_lock);
+	tpm_key_pool_running = FALSE;
+	pthread_mutex_unlock(&tpm_key_pool_lock);
+    }
+    return;
+}
+
+/* TPM_KeyPool_GetClass() returns the class of the key size and public exponent, or NULL.
+
+   The caller must hold the lock.
+*/
+
+static TPM_KEY_POOL_CLASS *TPM_KeyPool_GetClass(int num_bits,
+						const unsigned char *earr,
+						uint32_t e_size)
+{
+    size_t		i;
+    TPM_KEY_POOL_CLASS	*tpm_key_pool_class;
+
+    for (i = 0 ; i < TPM_KEY_POOL_CLASSES ; i++) {
+	tpm_key_pool_class = &(tpm_key_pool_classes[i]);
+	if ((tpm_key_pool_class->num_bits == num_bits) &&
+	    (tpm_key_pool_class->e_size == e_size) &&
+	    (memcmp(tpm_key_pool_class->earr, earr, e_size) == 0)) {
+	    return tpm_key_pool_class;
+	}
+    }
+    return NULL;
+}
+
+/* TPM_KeyPool_AddClass() adds a class for the key size and public exponent to an unused class.  If
+   all classes are in use or the exponent is too large, nothing is added.
+
+   The caller must hold the lock.
+*/
+
+static void TPM_KeyPool_AddClass(int num_bits,
+				 const unsigned char *earr,
+				 uint32_t e_size)
+{
+    size_t		i;
+    TPM_KEY_POOL_CLASS	*tpm_key_pool_class;
+
+    if (e_size > TPM_KEY_POOL_EXPONENT_MAX) {
+	return;
+    }
+    for (i = 0 ; i < TPM_KEY_POOL_CLASSES ; i++) {
+	tpm_key_pool_class = &(tpm_key_pool_classes[i]);
+	if (tpm_key_pool_class->num_bits == 0) {
+	    printf("  TPM_KeyPool_AddClass: %d bits in class %lu\n", num_bits, (unsigned long)i);
+	    tpm_key_pool_class->num_bits = num_bits;
+	    memcpy(tpm_key_pool_class->earr, earr, e_size);
+	    tpm_key_pool_class->e_size = e_size;
+	    tpm_key_pool_class->count = 0;
+	    break;
+	}
+    }
+    return;
+}
+
+/* TPM_KeyPoolClass_Trim() zeroes and frees the entries of the class beyond 'depth'.
+
+   The caller must hold the lock.
+*/
+
+static void TPM_KeyPoolClass_Trim(TPM_KEY_POOL_CLASS *tpm_key_pool_class,
+				  uint32_t depth)
+{
+    while (tpm_key_pool_class->count > depth) {
+	tpm_key_pool_class->count--;
+	TPM_KeyPoolEntry_Delete(&(tpm_key_pool_class->entries[tpm_key_pool_class->count]),
+				tpm_key_pool_class->num_bits);
+    }
+    return;
+}
+
+/* TPM_KeyPoolEntry_Delete() zeroes and frees a key pair of 'num_bits' */
+
+static void TPM_KeyPoolEntry_Delete(TPM_KEY_POOL_ENTRY *tpm_key_pool_entry,
+				    int num_bits)
+{
+    if (tpm_key_pool_entry->n != NULL) {
+	memset(tpm_key_pool_entry->n, 0, num_bits/8);
+    }
+    if (tpm_key_pool_entry->p != NULL) {
+	memset(tpm_key_pool_entry->p, 0, num_bits/16);
+    }
+    if (tpm_key_pool_entry->q != NULL) {
+	memset(tpm_key_pool_entry->q, 0, num_bits/16);
+    }
+    if (tpm_key_pool_entry->d != NULL) {
+	memset(tpm_key_pool_entry->d, 0, num_bits/8);
+    }
+    free(tpm_key_pool_entry->n);
+    free(tpm_key_pool_entry->p);
+    free(tpm_key_pool_entry->q);
+    free(tpm_key_pool_entry->d);
+    memset(tpm_key_pool_entry, 0, sizeof(TPM_KEY_POOL_ENTRY));
+    return;
+}
@@ -42,6 +42,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "tpm_arena.h"
 #include "tpm_auth.h"
 #include "tpm_crypto.h"
 #include "tpm_cryptoh.h"
@@ -755,7 +756,7 @@ TPM_RESULT TPM_Process_LoadMaintenanceArchive(tpm_state_t *tpm_state,
     */
     TPM_SizedBuffer_Delete(&archive);			/* @1 */
     TPM_Key_Delete(&newSrk);				/* @2 */
-    free(x1InnerWrap);					/* @3 */
+    TPM_Arena_Free(x1InnerWrap);				/* @3 */
     free(r1InnerWrapKey);				/* @4 */
     free(o1Oaep);					/* @5 */
     TPM_StoreAsymkey_Delete(&srk_store_asymkey);	/* @6 */
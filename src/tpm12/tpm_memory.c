@@ -45,6 +45,7 @@
 #include "tpm_error.h"
 
 #include "tpm_memory.h"
+#include "tpm_arena.h"
 
 /* TPM_Malloc() is a general purpose wrapper around malloc()
  */
@@ -87,6 +88,8 @@ TPM_RESULT TPM_Malloc(unsigned char **buffer, uint32_t size)
 }
 
 /* TPM_Realloc() is a general purpose wrapper around realloc()
+
+   A buffer allocated from the per command arena is moved to the heap, see TPM_Arena_Realloc().
  */
 
 TPM_RESULT TPM_Realloc(unsigned char **buffer,
@@ -102,15 +105,18 @@ TPM_RESULT TPM_Realloc(unsigned char **buffer,
             rc = TPM_SIZE;
         }       
     }
-    if (rc == 0) {
+    if ((rc == 0) && TPM_Arena_Contains(*buffer)) {
+        rc = TPM_Arena_Realloc(buffer, size);
+    }
+    else if (rc == 0) {
         tmpptr = realloc(*buffer, size);
         if (tmpptr == NULL) {
             printf("TPM_Realloc: Error reallocating %u bytes\n", size);
             rc = TPM_SIZE;
         }
-    }
-    if (rc == 0) {
-        *buffer = tmpptr;
+        if (rc == 0) {
+            *buffer = tmpptr;
+        }
     }
     return rc;
 }
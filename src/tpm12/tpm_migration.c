@@ -41,6 +41,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "tpm_arena.h"
 #include "tpm_auth.h"
 #include "tpm_crypto.h"
 #include "tpm_cryptoh.h"
@@ -1304,7 +1305,7 @@ TPM_RESULT TPM_Process_CreateMigrationBlob(tpm_state_t *tpm_state,
     TPM_SizedBuffer_Delete(&encData);			/* @2 */
     TPM_SizedBuffer_Delete(&random);			/* @3 */
     TPM_SizedBuffer_Delete(&outData);			/* @4 */
-    free(d1Decrypt);					/* @5 */
+    TPM_Arena_Free(d1Decrypt);					/* @5 */
     TPM_StoreAsymkey_Delete(&d1AsymKey);		/* @6 */
     TPM_Sbuffer_Delete(&mka_sbuffer);			/* @7 */
     return rcf;
@@ -1635,7 +1636,7 @@ TPM_RESULT TPM_Process_ConvertMigrationBlob(tpm_state_t *tpm_state,
     TPM_SizedBuffer_Delete(&inData);		/* @1 */
     TPM_SizedBuffer_Delete(&random);		/* @2 */
     TPM_SizedBuffer_Delete(&outData);		/* @3 */
-    free(d1Decrypt);				/* @4 */
+    TPM_Arena_Free(d1Decrypt);				/* @4 */
     free(o1Oaep);				/* @5 */
     TPM_StoreAsymkey_Delete(&d2AsymKey);	/* @6 */
     TPM_Sbuffer_Delete(&d2_sbuffer);		/* @7 */
@@ -2174,7 +2175,7 @@ TPM_RESULT TPM_Process_MigrateKey(tpm_state_t *tpm_state,
     */
     TPM_SizedBuffer_Delete(&inData);	/* @1 */
     TPM_SizedBuffer_Delete(&outData);	/* @2 */
-    free(decrypt_data);			/* @3 */
+    TPM_Arena_Free(decrypt_data);			/* @3 */
     TPM_Pubkey_Delete(&pubKey);		/* @4 */
     return rcf;
 }
@@ -3392,7 +3393,7 @@ TPM_RESULT TPM_Process_CMK_CreateBlob(tpm_state_t *tpm_state,
     /*
       cleanup
     */
-    free(d1Decrypt);					/* @1 */
+    TPM_Arena_Free(d1Decrypt);					/* @1 */
     TPM_Migrationkeyauth_Delete(&migrationKeyAuth);	/* @2 */
     TPM_SizedBuffer_Delete(&msaListBuffer);		/* @3 */
     TPM_SizedBuffer_Delete(&restrictTicketBuffer);	/* @4 */
@@ -4276,7 +4277,7 @@ TPM_RESULT TPM_Process_CMK_ConvertMigration(tpm_state_t *tpm_state,
     TPM_SizedBuffer_Delete(&msaListBuffer);	/* @3 */
     TPM_SizedBuffer_Delete(&random);		/* @4 */
     TPM_SizedBuffer_Delete(&outData);		/* @5 */
-    free(d1Decrypt);				/* @6 */
+    TPM_Arena_Free(d1Decrypt);				/* @6 */
     TPM_MsaComposite_Delete(&msaList);		/* @7 */
     TPM_StoreAsymkey_Delete(&d2AsymKey);	/* @8 */
     TPM_Sbuffer_Delete(&d2_sbuffer);		/* @9 */
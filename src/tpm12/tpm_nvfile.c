@@ -39,22 +39,34 @@
 
 /* This module abstracts out all NVRAM read and write operations.
 
-   This implementation uses standard, portable C files.
+   This implementation uses POSIX files.
 
    The basic high level abstractions are:
 
         TPM_NVRAM_LoadData();
+        TPM_NVRAM_MapData();
         TPM_NVRAM_StoreData();
+        TPM_NVRAM_AppendData();
         TPM_NVRAM_DeleteName();
 
    They take a 'name' that is mapped to a rooted file name.
 */
 
+#ifdef __linux__
+#define _GNU_SOURCE		/* syncfs() */
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_NVRAM
 #include "tpm_debug.h"
 #include "tpm_error.h"
 #include "tpm_memory.h"
@@ -69,9 +81,21 @@
 
 /* local prototypes */
 
-static void       TPM_NVRAM_GetFilenameForName(char *filename,
+static TPM_RESULT TPM_NVRAM_GetFilenameForName(char *filename,
 					       uint32_t tpm_number,
-                                               const char *name);
+                                               const char *name,
+                                               const char *suffix);
+static TPM_RESULT TPM_NVRAM_OpenForRead(int *fd,
+                                        uint32_t *length,
+                                        const char *filename);
+static TPM_RESULT TPM_NVRAM_WriteAll(int fd,
+                                     const unsigned char *data,
+                                     uint32_t length,
+                                     const char *filename);
+static TPM_RESULT TPM_NVRAM_SyncData(int fd,
+                                     const char *filename);
+static TPM_RESULT TPM_NVRAM_SyncDirectory(void);
+static TPM_RESULT TPM_NVRAM_GroupCommit(void);
 
 
 /* A file name in NVRAM is composed of 3 parts:
@@ -86,19 +110,50 @@ static void       TPM_NVRAM_GetFilenameForName(char *filename,
   used once in TPM_NVRAM_Init().
 
   One root path is used for all virtual TPM's, so it can be a static variable.
+
+  It is only written by TPM_NVRAM_Init() before any TPM instance exists and is read-only afterwards,
+  so TPM instances can access it concurrently without locking.
 */
 
-char state_directory[FILENAME_MAX];
+static char state_directory[FILENAME_MAX];
+
+/* Durability
+
+   Each write is made durable before it returns.  A file is replaced by writing and syncing a
+   temporary file and renaming it over the file.
+
+   If the TPM_NV_SYNC_DIRECTORY environment variable is set to 1, the state directory is also
+   synced after a file was created or renamed, so that the new name is durable as well.
+
+   If the TPM_NV_GROUP_COMMIT environment variable is set to 1, concurrent writes from different
+   TPM instances share one sync of the file system holding the state directory instead of each
+   syncing its file: the first writer to find no sync in progress becomes the leader and syncs all
+   writes completed so far, the others wait for a sync that started after their write completed.
+
+   The counters are protected by group_commit_lock.
+*/
+
+static TPM_BOOL		sync_directory = FALSE;		/* set by TPM_NVRAM_Init() */
+static TPM_BOOL		group_commit = FALSE;		/* set by TPM_NVRAM_Init() */
+static int		state_directory_fd = -1;	/* for fsync() and syncfs() */
+static pthread_mutex_t	group_commit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	group_commit_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t		group_commit_written;		/* number of completed writes */
+static uint64_t		group_commit_synced;		/* number of durable writes */
+static TPM_BOOL		group_commit_syncing = FALSE;	/* a leader is syncing */
 
 /* TPM_NVRAM_Init() is called once at startup.  It does any NVRAM required initialization.
 
-   This function sets some static variables that are used by all TPM's.
+   This function sets some static variables that are used by all TPM's.  It must not be called
+   while a TPM instance is processing a command.
 */
 
 TPM_RESULT TPM_NVRAM_Init(void)
 {
     TPM_RESULT  rc = 0;
     char        *tpm_state_path;
+    char        *tpm_group_commit;
+    char        *tpm_sync_directory;
     size_t      length;
 
 #ifdef TPM_LIBTPMS_CALLBACKS
@@ -113,6 +168,11 @@ TPM_RESULT TPM_NVRAM_Init(void)
 #endif
 
     printf(" TPM_NVRAM_Init:\n");
+    /* a previous TPMLIB_MainInit() may have opened a different state directory */
+    if (state_directory_fd >= 0) {
+        close(state_directory_fd);
+        state_directory_fd = -1;
+    }
 #ifdef TPM_NV_DISK
     /* TPM_NV_DISK TPM emulation stores in local directory determined by environment variable. */
     if (rc == 0) {
@@ -136,6 +196,73 @@ TPM_RESULT TPM_NVRAM_Init(void)
         strcpy(state_directory, tpm_state_path);
         printf("TPM_NVRAM_Init: Rooted state path %s\n", state_directory);
     }
+    if (rc == 0) {
+        tpm_group_commit = getenv("TPM_NV_GROUP_COMMIT");
+        group_commit = (tpm_group_commit != NULL) && (strcmp(tpm_group_commit, "1") == 0);
+        tpm_sync_directory = getenv("TPM_NV_SYNC_DIRECTORY");
+        sync_directory = (tpm_sync_directory != NULL) && (strcmp(tpm_sync_directory, "1") == 0);
+    }
+    if ((rc == 0) && (group_commit || sync_directory)) {
+        printf("TPM_NVRAM_Init: Group commit %u, directory sync %u\n",
+               group_commit, sync_directory);
+        state_directory_fd = open(state_directory,
+                                  O_RDONLY | O_DIRECTORY | O_CLOEXEC);	/* closed by next init */
+        if (state_directory_fd < 0) {
+            printf("TPM_NVRAM_Init: Error (fatal), opening %s failed, %s\n",
+                   state_directory, strerror(errno));
+            rc = TPM_FAIL;
+        }
+    }
+    return rc;
+}
+
+/* TPM_NVRAM_OpenForRead() opens the rooted 'filename' for reading and returns its 'length'.
+
+   Returns
+        0 on success.
+        TPM_RETRY on non-existent file (non-fatal, first time start up)
+        TPM_FAIL on failure (fatal), since it should never occur
+*/
+
+static TPM_RESULT TPM_NVRAM_OpenForRead(int *fd,
+                                        uint32_t *length,
+                                        const char *filename)
+{
+    TPM_RESULT  rc = 0;
+    int         irc;
+    struct stat statbuf;
+
+    printf("  TPM_NVRAM_OpenForRead: Opening file %s\n", filename);
+    *fd = open(filename, O_RDONLY);                           /* closed by caller */
+    if (*fd < 0) {     /* if failure, determine cause */
+        if (errno == ENOENT) {
+            printf("TPM_NVRAM_OpenForRead: No such file %s\n", filename);
+            rc = TPM_RETRY;         /* first time start up */
+        }
+        else {
+            printf("TPM_NVRAM_OpenForRead: Error (fatal) opening %s for read, %s\n",
+                   filename, strerror(errno));
+            rc = TPM_FAIL;
+        }
+    }
+    /* determine the file length */
+    if (rc == 0) {
+        irc = fstat(*fd, &statbuf);
+        if (irc != 0) {
+            printf("TPM_NVRAM_OpenForRead: Error (fatal) fstat'ing %s, %s\n",
+                   filename, strerror(errno));
+            rc = TPM_FAIL;
+        }
+    }
+    if (rc == 0) {
+        if ((uint64_t)statbuf.st_size > 0xffffffff) {
+            printf("TPM_NVRAM_OpenForRead: Error (fatal) %s is too large\n", filename);
+            rc = TPM_FAIL;
+        }
+        else {
+            *length = (uint32_t)statbuf.st_size;      	/* save the length */
+        }
+    }
     return rc;
 }
 
@@ -155,10 +282,9 @@ TPM_RESULT TPM_NVRAM_LoadData(unsigned char **data,     /* freed by caller */
                               const char *name) 
 {
     TPM_RESULT  rc = 0;
-    long        lrc;
-    size_t      src;
-    int         irc;
-    FILE        *file = NULL;
+    ssize_t     src;
+    uint32_t    offset;
+    int         fd = -1;
     char        filename[FILENAME_MAX]; /* rooted file name from name */
 
 #ifdef TPM_LIBTPMS_CALLBACKS
@@ -178,48 +304,10 @@ TPM_RESULT TPM_NVRAM_LoadData(unsigned char **data,     /* freed by caller */
     /* open the file */
     if (rc == 0) {
         /* map name to the rooted filename */
-        TPM_NVRAM_GetFilenameForName(filename, tpm_number, name);
-        printf("  TPM_NVRAM_LoadData: Opening file %s\n", filename);
-        file = fopen(filename, "rb");                           /* closed @1 */
-        if (file == NULL) {     /* if failure, determine cause */
-            if (errno == ENOENT) {
-                printf("TPM_NVRAM_LoadData: No such file %s\n", filename);
-                rc = TPM_RETRY;         /* first time start up */
-            }
-            else {
-                printf("TPM_NVRAM_LoadData: Error (fatal) opening %s for read, %s\n",
-                       filename, strerror(errno));
-                rc = TPM_FAIL;
-            }
-        }
-    }
-    /* determine the file length */
-    if (rc == 0) {
-        irc = fseek(file, 0L, SEEK_END);        /* seek to end of file */
-        if (irc == -1L) {
-            printf("TPM_NVRAM_LoadData: Error (fatal) fseek'ing %s, %s\n",
-                   filename, strerror(errno));
-            rc = TPM_FAIL;
-        }
+        rc = TPM_NVRAM_GetFilenameForName(filename, tpm_number, name, "");
     }
     if (rc == 0) {
-        lrc = ftell(file);                      /* get position in the stream */
-        if (lrc == -1L) {
-            printf("TPM_NVRAM_LoadData: Error (fatal) ftell'ing %s, %s\n",
-                   filename, strerror(errno));
-            rc = TPM_FAIL;
-        }
-        else {
-            *length = (uint32_t)lrc;      	/* save the length */
-        }
-    }
-    if (rc == 0) {
-        irc = fseek(file, 0L, SEEK_SET);        /* seek back to the beginning of the file */
-        if (irc == -1L) {
-            printf("TPM_NVRAM_LoadData: Error (fatal) fseek'ing %s, %s\n",
-                   filename, strerror(errno));
-            rc = TPM_FAIL;
-        }
+        rc = TPM_NVRAM_OpenForRead(&fd, length, filename);	/* closed @1 */
     }
     /* allocate a buffer for the actual data */
     if ((rc == 0) && *length != 0) {
@@ -231,24 +319,193 @@ TPM_RESULT TPM_NVRAM_LoadData(unsigned char **data,     /* freed by caller */
 	}
     }
     /* read the contents of the file into the data buffer */
+    for (offset = 0 ; (rc == 0) && (offset < *length) ; offset += src) {
+        src = read(fd, *data + offset, *length - offset);
+        if ((src < 0) && (errno == EINTR)) {
+            src = 0;
+        }
+        else if (src <= 0) {
+            printf("TPM_NVRAM_LoadData: Error (fatal), data read of %u only read %u\n",
+                   *length, offset);
+            rc = TPM_FAIL;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);             /* @1 */
+    }
+    if (rc != 0) {
+        free(*data);
+        *data = NULL;
+        *length = 0;
+    }
+    return rc;
+}
+
+/* TPM_NVRAM_MapData() is TPM_NVRAM_LoadData() for data that is only read while it is
+   deserialized.
+
+   The default implementation maps the file instead of copying it into a buffer.  'mapped'
+   indicates how 'data' must be released, which TPM_NVRAM_UnmapData() does.  A registered load
+   callback is called as for TPM_NVRAM_LoadData().
+
+   Returns as TPM_NVRAM_LoadData().
+*/
+
+TPM_RESULT TPM_NVRAM_MapData(unsigned char **data,	/* released by TPM_NVRAM_UnmapData() */
+                             uint32_t *length,
+                             TPM_BOOL *mapped,
+                             uint32_t tpm_number,
+                             const char *name)
+{
+    TPM_RESULT  rc = 0;
+    void        *addr;
+    int         fd = -1;
+    char        filename[FILENAME_MAX]; /* rooted file name from name */
+
+#ifdef TPM_LIBTPMS_CALLBACKS
+    struct libtpms_callbacks *cbs = TPMLIB_GetCallbacks();
+
+    /* the buffer of a user-provided function is freed */
+    if (cbs->tpm_nvram_loaddata) {
+        *mapped = FALSE;
+        rc = TPM_NVRAM_LoadData(data, length, tpm_number, name);
+        return rc;
+    }
+#endif
+
+    printf(" TPM_NVRAM_MapData: From file %s\n", name);
+    *mapped = FALSE;
+    *data = NULL;
+    *length = 0;
+    if (rc == 0) {
+        /* map name to the rooted filename */
+        rc = TPM_NVRAM_GetFilenameForName(filename, tpm_number, name, "");
+    }
+    if (rc == 0) {
+        rc = TPM_NVRAM_OpenForRead(&fd, length, filename);	/* closed @1 */
+    }
+    /* an empty file cannot be mapped and loads as NULL,0 */
     if ((rc == 0) && *length != 0) {
-        src = fread(*data, 1, *length, file);
-        if (src != *length) {
-            printf("TPM_NVRAM_LoadData: Error (fatal), data read of %u only read %lu\n",
-                   *length, (unsigned long)src);
+        printf(" TPM_NVRAM_MapData: Mapping %u bytes of data\n", *length);
+        /* a private mapping, since the deserializers take a writable stream, and it survives
+           TPM_NVRAM_StoreData() replacing the file */
+        addr = mmap(NULL, *length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            printf("TPM_NVRAM_MapData: Error (fatal) mapping %s, %s\n",
+                   filename, strerror(errno));
+            *length = 0;
             rc = TPM_FAIL;
         }
+        else {
+            *data = addr;
+            *mapped = TRUE;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);             /* @1 */
     }
-    /* close the file */
-    if (file != NULL) {
-        printf(" TPM_NVRAM_LoadData: Closing file %s\n", filename);
-        irc = fclose(file);             /* @1 */
+    return rc;
+}
+
+/* TPM_NVRAM_UnmapData() releases 'data' returned by TPM_NVRAM_MapData() */
+
+void TPM_NVRAM_UnmapData(unsigned char *data,
+                         uint32_t length,
+                         TPM_BOOL mapped)
+{
+    if (mapped) {
+        munmap(data, length);
+    }
+    else {
+        free(data);
+    }
+    return;
+}
+
+/* TPM_NVRAM_SyncData() makes the data written to 'fd' durable, by sharing a file system sync with
+   other writers if group commit is enabled.
+
+   Returns
+        0 on success
+        TPM_FAIL if the sync failed
+*/
+
+static TPM_RESULT TPM_NVRAM_SyncData(int fd,
+                                     const char *filename)
+{
+    TPM_RESULT  rc = 0;
+    int         irc;
+
+    if (group_commit) {
+        rc = TPM_NVRAM_GroupCommit();
+    }
+    else {
+#ifdef __APPLE__
+        irc = fsync(fd);
+#else
+        irc = fdatasync(fd);
+#endif
         if (irc != 0) {
-            printf("TPM_NVRAM_LoadData: Error (fatal) closing file %s\n", filename);
+            printf("TPM_NVRAM_SyncData: Error (fatal) syncing %s, %s\n",
+                   filename, strerror(errno));
             rc = TPM_FAIL;
         }
-        else {
-            printf(" TPM_NVRAM_LoadData: Closed file %s\n", filename);
+    }
+    return rc;
+}
+
+/* TPM_NVRAM_SyncDirectory() makes a file creation, rename, or removal durable if
+   TPM_NV_SYNC_DIRECTORY is enabled.
+
+   Returns
+        0 on success
+        TPM_FAIL if the sync failed
+*/
+
+static TPM_RESULT TPM_NVRAM_SyncDirectory(void)
+{
+    TPM_RESULT  rc = 0;
+    int         irc;
+
+    if (sync_directory) {
+        irc = fsync(state_directory_fd);
+        if (irc != 0) {
+            printf("TPM_NVRAM_SyncDirectory: Error (fatal) syncing %s, %s\n",
+                   state_directory, strerror(errno));
+            rc = TPM_FAIL;
+        }
+    }
+    return rc;
+}
+
+/* TPM_NVRAM_WriteAll() writes all 'length' bytes of 'data' to 'fd'
+
+   Returns
+        0 on success
+        TPM_FAIL if the write failed
+*/
+
+static TPM_RESULT TPM_NVRAM_WriteAll(int fd,
+                                     const unsigned char *data,
+                                     uint32_t length,
+                                     const char *filename)
+{
+    TPM_RESULT  rc = 0;
+    ssize_t     src;
+    uint32_t    offset;
+
+    printf("  TPM_NVRAM_WriteAll: Writing %u bytes of data\n", length);
+    for (offset = 0 ; (rc == 0) && (offset < length) ; offset += src) {
+        src = write(fd, data + offset, length - offset);
+        if (src < 0) {
+            if (errno == EINTR) {
+                src = 0;
+            }
+            else {
+                printf("TPM_NVRAM_WriteAll: Error (fatal), data write of %u to %s only wrote %u, "
+                       "%s\n", length, filename, offset, strerror(errno));
+                rc = TPM_FAIL;
+            }
         }
     }
     return rc;
@@ -256,6 +513,9 @@ TPM_RESULT TPM_NVRAM_LoadData(unsigned char **data,     /* freed by caller */
 
 /* TPM_NVRAM_StoreData stores 'data' of 'length' to the rooted 'filename'
 
+   The data is written to a temporary file that is made durable and then renamed over 'filename',
+   so that a crash leaves either the previous or the new data.
+
    Returns
         0 on success
         TPM_FAIL for other fatal errors
@@ -267,10 +527,10 @@ TPM_RESULT TPM_NVRAM_StoreData(const unsigned char *data,
                                const char *name)
 {
     TPM_RESULT  rc = 0;
-    uint32_t      lrc;
     int         irc;
-    FILE        *file = NULL;
+    int         fd = -1;
     char        filename[FILENAME_MAX]; /* rooted file name from name */
+    char        tmpname[FILENAME_MAX];  /* rooted temporary file name */
 
 #ifdef TPM_LIBTPMS_CALLBACKS
     struct libtpms_callbacks *cbs = TPMLIB_GetCallbacks();
@@ -285,57 +545,225 @@ TPM_RESULT TPM_NVRAM_StoreData(const unsigned char *data,
 
     printf(" TPM_NVRAM_StoreData: To name %s\n", name);
     if (rc == 0) {
-        /* map name to the rooted filename */
-        TPM_NVRAM_GetFilenameForName(filename, tpm_number, name);
-        /* open the file */
-        printf(" TPM_NVRAM_StoreData: Opening file %s\n", filename);
-        file = fopen(filename, "wb");                           /* closed @1 */
-        if (file == NULL) {
+        /* map name to the rooted filenames */
+        rc = TPM_NVRAM_GetFilenameForName(filename, tpm_number, name, "");
+    }
+    if (rc == 0) {
+        rc = TPM_NVRAM_GetFilenameForName(tmpname, tpm_number, name, TPM_NV_TEMP_SUFFIX);
+    }
+    if (rc == 0) {
+        /* open the temporary file */
+        printf(" TPM_NVRAM_StoreData: Opening file %s\n", tmpname);
+        fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0666);	/* closed @1 */
+        if (fd < 0) {
             printf("TPM_NVRAM_StoreData: Error (fatal) opening %s for write failed, %s\n",
-                   filename, strerror(errno));
+                   tmpname, strerror(errno));
             rc = TPM_FAIL;
         }
     }
     /* write the data to the file */
     if (rc == 0) {
-        printf("  TPM_NVRAM_StoreData: Writing %u bytes of data\n", length);
-        lrc = fwrite(data, 1, length, file);
-        if (lrc != length) {
-            printf("TPM_NVRAM_StoreData: Error (fatal), data write of %u only wrote %u\n",
-                   length, lrc);
+        rc = TPM_NVRAM_WriteAll(fd, data, length, tmpname);
+    }
+    /* the data must be durable before the rename */
+    if (rc == 0) {
+        rc = TPM_NVRAM_SyncData(fd, tmpname);
+    }
+    if (fd >= 0) {
+        irc = close(fd);             /* @1 */
+        if (irc != 0) {
+            printf("TPM_NVRAM_StoreData: Error (fatal) closing file\n");
             rc = TPM_FAIL;
         }
     }
-    if (file != NULL) {
-        printf("  TPM_NVRAM_StoreData: Closing file %s\n", filename);
-        irc = fclose(file);             /* @1 */
+    if (rc == 0) {
+        printf("  TPM_NVRAM_StoreData: Renaming %s to %s\n", tmpname, filename);
+        irc = rename(tmpname, filename);
         if (irc != 0) {
-            printf("TPM_NVRAM_StoreData: Error (fatal) closing file\n");
+            printf("TPM_NVRAM_StoreData: Error (fatal) renaming %s, %s\n",
+                   tmpname, strerror(errno));
             rc = TPM_FAIL;
         }
-        else {
-            printf("  TPM_NVRAM_StoreData: Closed file %s\n", filename);
+    }
+    if (rc == 0) {
+        rc = TPM_NVRAM_SyncDirectory();
+    }
+    else if (fd >= 0) {
+        remove(tmpname);
+    }
+    return rc;
+}
+
+
+/* TPM_NVRAM_AppendData appends 'data' of 'length' to the rooted 'filename', creating the file if
+   it does not exist
+
+   Returns
+        0 on success
+        TPM_FAIL for other fatal errors
+*/
+
+TPM_RESULT TPM_NVRAM_AppendData(const unsigned char *data,
+                                uint32_t length,
+                                uint32_t tpm_number,
+                                const char *name)
+{
+    TPM_RESULT  rc = 0;
+    int         irc;
+    int         fd = -1;
+    TPM_BOOL    created = FALSE;
+    char        filename[FILENAME_MAX]; /* rooted file name from name */
+
+#ifdef TPM_LIBTPMS_CALLBACKS
+    struct libtpms_callbacks *cbs = TPMLIB_GetCallbacks();
+
+    /* call user-provided function if available, otherwise execute
+       default behavior */
+    if (cbs->tpm_nvram_appenddata) {
+        rc = cbs->tpm_nvram_appenddata(data, length, tpm_number, name);
+        return rc;
+    }
+#endif
+
+    printf(" TPM_NVRAM_AppendData: To name %s\n", name);
+    if (rc == 0) {
+        /* map name to the rooted filename */
+        rc = TPM_NVRAM_GetFilenameForName(filename, tpm_number, name, "");
+    }
+    if (rc == 0) {
+        /* open the file */
+        printf(" TPM_NVRAM_AppendData: Opening file %s\n", filename);
+        fd = open(filename, O_WRONLY | O_APPEND);		/* closed @1 */
+        if ((fd < 0) && (errno == ENOENT)) {
+            fd = open(filename, O_WRONLY | O_APPEND | O_CREAT, 0666);
+            created = TRUE;
         }
+        if (fd < 0) {
+            printf("TPM_NVRAM_AppendData: Error (fatal) opening %s for append failed, %s\n",
+                   filename, strerror(errno));
+            rc = TPM_FAIL;
+        }
+    }
+    /* append the data to the file */
+    if (rc == 0) {
+        rc = TPM_NVRAM_WriteAll(fd, data, length, filename);
+    }
+    if (rc == 0) {
+        rc = TPM_NVRAM_SyncData(fd, filename);
+    }
+    if (fd >= 0) {
+        irc = close(fd);             /* @1 */
+        if (irc != 0) {
+            printf("TPM_NVRAM_AppendData: Error (fatal) closing file\n");
+            rc = TPM_FAIL;
+        }
+    }
+    if ((rc == 0) && created) {
+        rc = TPM_NVRAM_SyncDirectory();
     }
     return rc;
 }
 
+/* TPM_NVRAM_IsAppendSupported() returns TRUE if TPM_NVRAM_AppendData() can be used.
+
+   Registered storage callbacks that predate the append callback only support replacing all of
+   the data of a name.
+*/
+
+TPM_BOOL TPM_NVRAM_IsAppendSupported(void)
+{
+#ifdef TPM_LIBTPMS_CALLBACKS
+    struct libtpms_callbacks *cbs = TPMLIB_GetCallbacks();
+
+    if (cbs->tpm_nvram_storedata && !cbs->tpm_nvram_appenddata) {
+        return FALSE;
+    }
+#endif
+    return TRUE;
+}
+
+
+/* TPM_NVRAM_GroupCommit() returns when all writes completed before the call are durable.
+
+   Returns
+        0 on success
+        TPM_FAIL if the sync failed
+*/
+
+static TPM_RESULT TPM_NVRAM_GroupCommit(void)
+{
+    TPM_RESULT  rc = 0;
+    uint64_t    ticket;
+    uint64_t    target;
+    int         irc;
+
+    pthread_mutex_lock(&group_commit_lock);
+    ticket = ++group_commit_written;
+    while ((rc == 0) && (group_commit_synced < ticket)) {
+        /* a sync in progress may have started before this write completed */
+        if (group_commit_syncing) {
+            pthread_cond_wait(&group_commit_cond, &group_commit_lock);
+        }
+        /* become the leader and sync all writes completed so far */
+        else {
+            group_commit_syncing = TRUE;
+            target = group_commit_written;
+            printf(" TPM_NVRAM_GroupCommit: Syncing %lu writes\n",
+                   (unsigned long)(target - group_commit_synced));
+            pthread_mutex_unlock(&group_commit_lock);
+#ifdef __linux__
+            irc = syncfs(state_directory_fd);
+#else
+            sync();
+            irc = 0;
+#endif
+            pthread_mutex_lock(&group_commit_lock);
+            group_commit_syncing = FALSE;
+            if (irc == 0) {
+                group_commit_synced = target;
+            }
+            else {
+                printf("TPM_NVRAM_GroupCommit: Error (fatal) sync failed, %s\n",
+                       strerror(errno));
+                rc = TPM_FAIL;
+            }
+            pthread_cond_broadcast(&group_commit_cond);
+        }
+    }
+    pthread_mutex_unlock(&group_commit_lock);
+    return rc;
+}
 
 /* TPM_NVRAM_GetFilenameForName() constructs a rooted file name from the name.
 
    The filename is of the form:
 
-   state_directory/tpm_number.name
+   state_directory/tpm_number.name suffix
+
+   'filename' must have FILENAME_MAX bytes.
+
+   Returns TPM_FAIL if the file name does not fit.
 */
 
-static void TPM_NVRAM_GetFilenameForName(char *filename,        /* output: rooted filename */
-					 uint32_t tpm_number,
-                                         const char *name)      /* input: abstract name */
+static TPM_RESULT TPM_NVRAM_GetFilenameForName(char *filename,  /* output: rooted filename */
+					       uint32_t tpm_number,
+                                               const char *name, /* input: abstract name */
+                                               const char *suffix)
 {
+    TPM_RESULT  rc = 0;
+    int         n;
+
     printf(" TPM_NVRAM_GetFilenameForName: For name %s\n", name);
-    sprintf(filename, "%s/%02lx.%s", state_directory, (unsigned long)tpm_number, name);
-    printf("  TPM_NVRAM_GetFilenameForName: File name %s\n", filename);
-    return;
+    n = snprintf(filename, FILENAME_MAX, "%s/%02lx.%s%s",
+                 state_directory, (unsigned long)tpm_number, name, suffix);
+    if ((n < 0) || (n >= FILENAME_MAX)) {
+        printf("TPM_NVRAM_GetFilenameForName: Error (fatal), file name too long\n");
+        rc = TPM_FAIL;
+    }
+    if (rc == 0) {
+        printf("  TPM_NVRAM_GetFilenameForName: File name %s\n", filename);
+    }
+    return rc;
 }
 
 /* TPM_NVRAM_DeleteName() deletes the 'name' from NVRAM
@@ -369,7 +797,9 @@ TPM_RESULT TPM_NVRAM_DeleteName(uint32_t tpm_number,
     
     printf(" TPM_NVRAM_DeleteName: Name %s\n", name);
     /* map name to the rooted filename */
-    TPM_NVRAM_GetFilenameForName(filename, tpm_number, name);
+    if (rc == 0) {
+        rc = TPM_NVRAM_GetFilenameForName(filename, tpm_number, name, "");
+    }
     if (rc == 0) {
         irc = remove(filename);
         if ((irc != 0) &&               /* if the remove failed */
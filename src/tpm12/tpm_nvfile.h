@@ -42,13 +42,18 @@
 
 #include "tpm_types.h"
 
-/* characters in the TPM base file name, 14 for file name, slash, NUL terminator, etc.
+/* characters in the TPM base file name, 14 for file name, slash, NUL terminator, temporary file
+   suffix, etc.
 
    This macro is used once during initialization to ensure that the TPM_PATH environment variable
    length will not cause the rooted file name to overflow file name buffers.
 */
 
-#define TPM_FILENAME_MAX 20
+#define TPM_FILENAME_MAX 24
+
+/* suffix of the temporary file that replaces a file */
+
+#define TPM_NV_TEMP_SUFFIX ".tmp"
 
 TPM_RESULT TPM_NVRAM_Init(void);
 
@@ -60,10 +65,23 @@ TPM_RESULT TPM_NVRAM_LoadData(unsigned char **data,
                               uint32_t *length,
 			      uint32_t tpm_number,
                               const char *name);
+TPM_RESULT TPM_NVRAM_MapData(unsigned char **data,
+                             uint32_t *length,
+                             TPM_BOOL *mapped,
+                             uint32_t tpm_number,
+                             const char *name);
+void       TPM_NVRAM_UnmapData(unsigned char *data,
+                               uint32_t length,
+                               TPM_BOOL mapped);
 TPM_RESULT TPM_NVRAM_StoreData(const unsigned char *data,
                                uint32_t length,
 			       uint32_t tpm_number,
                                const char *name);
+TPM_RESULT TPM_NVRAM_AppendData(const unsigned char *data,
+                                uint32_t length,
+                                uint32_t tpm_number,
+                                const char *name);
+TPM_BOOL   TPM_NVRAM_IsAppendSupported(void);
 TPM_RESULT TPM_NVRAM_DeleteName(uint32_t tpm_number,
 				const char *name,
                                 TPM_BOOL mustExist);
@@ -45,6 +45,7 @@
 #include "tpm_auth.h"
 #include "tpm_crypto.h"
 #include "tpm_cryptoh.h"
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_NVRAM
 #include "tpm_debug.h"
 #include "tpm_digest.h"
 #include "tpm_error.h"
@@ -61,6 +62,10 @@
 
 #include "tpm_nvram.h"
 
+static TPM_RESULT TPM_NVIndexEntries_HashBuild(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries);
+static uint32_t TPM_NVIndexEntries_Hash(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries,
+					TPM_NV_INDEX nvIndex);
+
 /*
   NV Defined Space Utilities
 */
@@ -292,6 +297,21 @@ TPM_RESULT TPM_NVDataPublic_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_NVDataPublic_SizeOf() returns the number of bytes TPM_NVDataPublic_Store() serializes with
+   the same 'optimize' setting */
+
+uint32_t TPM_NVDataPublic_SizeOf(const TPM_NV_DATA_PUBLIC *tpm_nv_data_public,
+				 TPM_BOOL optimize)
+{
+    return sizeof(uint16_t) +			/* tag */
+	sizeof(TPM_NV_INDEX) +
+	TPM_PCRInfoShort_SizeOf(&(tpm_nv_data_public->pcrInfoRead), optimize) +
+	TPM_PCRInfoShort_SizeOf(&(tpm_nv_data_public->pcrInfoWrite), optimize) +
+	sizeof(uint16_t) + sizeof(uint32_t) +	/* TPM_NV_ATTRIBUTES */
+	(3 * sizeof(TPM_BOOL)) +
+	sizeof(uint32_t);			/* dataSize */
+}
+
 /* TPM_NVDataPublic_Delete()
 
    No-OP if the parameter is NULL, else:
@@ -435,6 +455,24 @@ TPM_RESULT TPM_NVDataSensitive_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_NVDataSensitive_SizeOf() returns the number of bytes TPM_NVDataSensitive_Store() serializes */
+
+uint32_t TPM_NVDataSensitive_SizeOf(const TPM_NV_DATA_SENSITIVE *tpm_nv_data_sensitive)
+{
+    TPM_RESULT		rc = 0;
+    uint32_t		size;
+    TPM_BOOL		isGPIO = FALSE;
+
+    size = sizeof(uint16_t) +			/* tag */
+	   TPM_NVDataPublic_SizeOf(&(tpm_nv_data_sensitive->pubInfo), TRUE) +
+	   TPM_SECRET_SIZE;
+    rc = TPM_NVDataSensitive_IsGPIO(&isGPIO, tpm_nv_data_sensitive->pubInfo.nvIndex);
+    if ((rc == 0) && !isGPIO) {
+	size += tpm_nv_data_sensitive->pubInfo.dataSize;
+    }
+    return size;
+}
+
 /* TPM_NVDataSensitive_Delete()
 
    No-OP if the parameter is NULL, else:
@@ -567,6 +605,9 @@ void TPM_NVIndexEntries_Init(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries)
     printf(" TPM_NVIndexEntries_Init:\n");
     tpm_nv_index_entries->nvIndexCount = 0;
     tpm_nv_index_entries->tpm_nvindex_entry = NULL;
+    tpm_nv_index_entries->nvIndexHashSize = 0;
+    tpm_nv_index_entries->nvIndexHashUsed = 0;
+    tpm_nv_index_entries->nvIndexHash = NULL;
     return;
 }
 
@@ -590,6 +631,7 @@ void TPM_NVIndexEntries_Delete(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries)
     }
     /* free the array */
     free(tpm_nv_index_entries->tpm_nvindex_entry);
+    free(tpm_nv_index_entries->nvIndexHash);
     TPM_NVIndexEntries_Init(tpm_nv_index_entries);
     return;
 }
@@ -677,6 +719,9 @@ TPM_RESULT TPM_NVIndexEntries_Load(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries,
 	    }
 	}
     }
+    if (rc == 0) {
+	rc = TPM_NVIndexEntries_HashBuild(tpm_nv_index_entries);
+    }
     return rc;
 }
 
@@ -723,6 +768,22 @@ TPM_RESULT TPM_NVIndexEntries_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_NVIndexEntries_SizeOf() returns the number of bytes TPM_NVIndexEntries_Store() serializes */
+
+uint32_t TPM_NVIndexEntries_SizeOf(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries)
+{
+    uint32_t 	size;
+    size_t 	i;
+
+    size = sizeof(uint16_t) + sizeof(uint32_t);		/* tag, count */
+    for (i = 0 ; i < tpm_nv_index_entries->nvIndexCount ; i++) {
+	if (tpm_nv_index_entries->tpm_nvindex_entry[i].pubInfo.nvIndex != TPM_NV_INDEX_LOCK) {
+	    size += TPM_NVDataSensitive_SizeOf(&(tpm_nv_index_entries->tpm_nvindex_entry[i]));
+	}
+    }
+    return size;
+}
+
 /* TPM_NVIndexEntries_StClear() steps through each entry in the NV TPM_NV_INDEX_ENTRIES array,
    setting the volatile flags to FALSE.
 */
@@ -846,6 +907,23 @@ TPM_RESULT TPM_NVIndexEntries_StoreVolatile(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_NVIndexEntries_SizeOfVolatile() returns the number of bytes
+   TPM_NVIndexEntries_StoreVolatile() serializes */
+
+uint32_t TPM_NVIndexEntries_SizeOfVolatile(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries)
+{
+    uint32_t 	size;
+    size_t 	i;
+
+    size = sizeof(uint16_t) + sizeof(uint32_t);		/* tag, usedCount */
+    for (i = 0 ; i < tpm_nv_index_entries->nvIndexCount ; i++) {
+	if (tpm_nv_index_entries->tpm_nvindex_entry[i].pubInfo.nvIndex != TPM_NV_INDEX_LOCK) {
+	    size += 2 * sizeof(TPM_BOOL);		/* bReadSTClear, bWriteSTClear */
+	}
+    }
+    return size;
+}
+
 /* TPM_NVIndexEntries_GetVolatile() saves an array of the NV defined space volatile flags.
 
    The array is used during a rollback, since the volatile flags are not stored in NVRAM
@@ -978,11 +1056,13 @@ TPM_RESULT TPM_NVIndexEntries_GetFreeEntry(TPM_NV_DATA_SENSITIVE **tpm_nv_data_s
     printf(" TPM_NVIndexEntries_GetFreeEntry: Searching %u slots\n",
 	   tpm_nv_index_entries->nvIndexCount);
     /* for debug - trace the entire TPM_NV_INDEX_ENTRIES array */
-    for (i = 0 ; i < tpm_nv_index_entries->nvIndexCount ; i++) {
-	*tpm_nv_data_sensitive = &(tpm_nv_index_entries->tpm_nvindex_entry[i]);
-	printf("   TPM_NVIndexEntries_GetFreeEntry: slot %lu entry %08x\n",
-	       (unsigned long)i, (*tpm_nv_data_sensitive)->pubInfo.nvIndex);
-    }    
+    if (TPM_TRACE_ENABLED(TPMLIB_TRACE_LEVEL_DEBUG, TPM_TRACE_CATEGORY)) {
+	for (i = 0 ; i < tpm_nv_index_entries->nvIndexCount ; i++) {
+	    *tpm_nv_data_sensitive = &(tpm_nv_index_entries->tpm_nvindex_entry[i]);
+	    printf("   TPM_NVIndexEntries_GetFreeEntry: slot %lu entry %08x\n",
+		   (unsigned long)i, (*tpm_nv_data_sensitive)->pubInfo.nvIndex);
+	}
+    }
     /* search the existing array for a free entry */
     for (i = 0 ; (rc == 0) && (i < tpm_nv_index_entries->nvIndexCount) && !done ; i++) {
 	*tpm_nv_data_sensitive = &(tpm_nv_index_entries->tpm_nvindex_entry[i]);
@@ -1011,6 +1091,10 @@ TPM_RESULT TPM_NVIndexEntries_GetFreeEntry(TPM_NV_DATA_SENSITIVE **tpm_nv_data_s
 
 /* TPM_NVIndexEntries_GetEntry() gets the TPM_NV_DATA_SENSITIVE entry corresponding to nvIndex.
 
+   The entry is found through the nvIndexHash table.  Entries are deleted and their slots reused
+   without updating the table, so a bucket only refers to an entry if the entry still has the
+   nvIndex.  Other buckets are skipped, and they are dropped when the table is rebuilt.
+
    Returns TPM_BADINDEX on non-existent nvIndex
 */
 
@@ -1019,39 +1103,38 @@ TPM_RESULT TPM_NVIndexEntries_GetEntry(TPM_NV_DATA_SENSITIVE **tpm_nv_data_sensi
 				       TPM_NV_INDEX nvIndex)
 {
     TPM_RESULT			rc = 0;
-    size_t 			i;
-    TPM_BOOL			found;
+    uint32_t			bucket;
+    uint32_t			slot;
+    TPM_BOOL			found = FALSE;
     
     printf(" TPM_NVIndexEntries_GetEntry: Getting NV index %08x in %u slots\n",
 	   nvIndex, tpm_nv_index_entries->nvIndexCount);
-    /* for debug tracing */
-    for (i = 0 ; i < tpm_nv_index_entries->nvIndexCount ; i++) {
-	*tpm_nv_data_sensitive = &(tpm_nv_index_entries->tpm_nvindex_entry[i]);
-	printf("   TPM_NVIndexEntries_GetEntry: slot %lu entry %08x\n",
-	       (unsigned long)i, (*tpm_nv_data_sensitive)->pubInfo.nvIndex);
-    }    
     /* check for the special index that indicates an empty entry */
     if (rc == 0) {
 	if (nvIndex == TPM_NV_INDEX_LOCK) {
 	    rc = TPM_BADINDEX;
 	}
     }
-    for (i = 0 , found = FALSE ;
-	 (rc == 0) && (i < tpm_nv_index_entries->nvIndexCount) && !found ;
-	 i++) {
-
-	*tpm_nv_data_sensitive = &(tpm_nv_index_entries->tpm_nvindex_entry[i]);
-	if ((*tpm_nv_data_sensitive)->pubInfo.nvIndex == nvIndex) {
-	    printf("  TPM_NVIndexEntries_GetEntry: Found NV index at slot %lu\n", (unsigned long)i);
-	    printf("   TPM_NVIndexEntries_GetEntry: permission %08x dataSize %u\n",
-		   (*tpm_nv_data_sensitive)->pubInfo.permission.attributes,
-		   (*tpm_nv_data_sensitive)->pubInfo.dataSize);
-	    printf("   TPM_NVIndexEntries_GetEntry: "
-		   "bReadSTClear %02x bWriteSTClear %02x bWriteDefine %02x\n",
-		   (*tpm_nv_data_sensitive)->pubInfo.bReadSTClear,
-		   (*tpm_nv_data_sensitive)->pubInfo.bWriteSTClear,
-		   (*tpm_nv_data_sensitive)->pubInfo.bWriteDefine);
-	    found = TRUE;
+    /* probe until the entry or an empty bucket is found */
+    if ((rc == 0) && (tpm_nv_index_entries->nvIndexHashSize > 0)) {
+	for (bucket = TPM_NVIndexEntries_Hash(tpm_nv_index_entries, nvIndex) ;
+	     !found && (tpm_nv_index_entries->nvIndexHash[bucket] != 0) ;
+	     bucket = (bucket + 1) & (tpm_nv_index_entries->nvIndexHashSize - 1)) {
+
+	    slot = tpm_nv_index_entries->nvIndexHash[bucket] - 1;
+	    *tpm_nv_data_sensitive = &(tpm_nv_index_entries->tpm_nvindex_entry[slot]);
+	    if ((*tpm_nv_data_sensitive)->pubInfo.nvIndex == nvIndex) {
+		printf("  TPM_NVIndexEntries_GetEntry: Found NV index at slot %u\n", slot);
+		printf("   TPM_NVIndexEntries_GetEntry: permission %08x dataSize %u\n",
+		       (*tpm_nv_data_sensitive)->pubInfo.permission.attributes,
+		       (*tpm_nv_data_sensitive)->pubInfo.dataSize);
+		printf("   TPM_NVIndexEntries_GetEntry: "
+		       "bReadSTClear %02x bWriteSTClear %02x bWriteDefine %02x\n",
+		       (*tpm_nv_data_sensitive)->pubInfo.bReadSTClear,
+		       (*tpm_nv_data_sensitive)->pubInfo.bWriteSTClear,
+		       (*tpm_nv_data_sensitive)->pubInfo.bWriteDefine);
+		found = TRUE;
+	    }
 	}
     }
     if (rc == 0) {
@@ -1063,11 +1146,113 @@ TPM_RESULT TPM_NVIndexEntries_GetEntry(TPM_NV_DATA_SENSITIVE **tpm_nv_data_sensi
     return rc;
 }
 
+/* TPM_NVIndexEntries_AddEntry() adds the entry, which must be in the TPM_NV_INDEX_ENTRIES array, to
+   the nvIndexHash table after its nvIndex was set.
+
+   The table is rebuilt from the array when it becomes half full.
+*/
+
+TPM_RESULT TPM_NVIndexEntries_AddEntry(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries,
+				       TPM_NV_DATA_SENSITIVE *tpm_nv_data_sensitive)
+{
+    TPM_RESULT		rc = 0;
+    uint32_t		bucket;
+    uint32_t		slot;
+    TPM_BOOL		done = FALSE;
+
+    slot = tpm_nv_data_sensitive - tpm_nv_index_entries->tpm_nvindex_entry;
+    printf(" TPM_NVIndexEntries_AddEntry: NV index %08x at slot %u\n",
+	   tpm_nv_data_sensitive->pubInfo.nvIndex, slot);
+    if ((tpm_nv_index_entries->nvIndexHashUsed + 1) * 2 > tpm_nv_index_entries->nvIndexHashSize) {
+	rc = TPM_NVIndexEntries_HashBuild(tpm_nv_index_entries);
+	done = TRUE;
+    }
+    for (bucket = TPM_NVIndexEntries_Hash(tpm_nv_index_entries,
+					  tpm_nv_data_sensitive->pubInfo.nvIndex) ;
+	 !done ;
+	 bucket = (bucket + 1) & (tpm_nv_index_entries->nvIndexHashSize - 1)) {
+
+	/* the slot may already be in the chain from an earlier index */
+	if (tpm_nv_index_entries->nvIndexHash[bucket] == slot + 1) {
+	    done = TRUE;
+	}
+	else if (tpm_nv_index_entries->nvIndexHash[bucket] == 0) {
+	    tpm_nv_index_entries->nvIndexHash[bucket] = slot + 1;
+	    tpm_nv_index_entries->nvIndexHashUsed++;
+	    done = TRUE;
+	}
+    }
+    return rc;
+}
+
+/* TPM_NVIndexEntries_HashBuild() rebuilds the nvIndexHash table from the used entries of the
+   TPM_NV_INDEX_ENTRIES array, sized so that it is at most a quarter full.
+*/
+
+static TPM_RESULT TPM_NVIndexEntries_HashBuild(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries)
+{
+    TPM_RESULT		rc = 0;
+    uint32_t		usedCount;
+    uint32_t		hashSize;
+    uint32_t		bucket;
+    uint32_t		slot;
+    TPM_NV_INDEX	nvIndex;
+
+    if (rc == 0) {
+	rc = TPM_NVIndexEntries_GetUsedCount(&usedCount, tpm_nv_index_entries);
+    }
+    if (rc == 0) {
+	for (hashSize = TPM_NV_INDEX_HASH_MIN ; hashSize < usedCount * 4 ; hashSize *= 2);
+	printf(" TPM_NVIndexEntries_HashBuild: %u buckets for %u entries\n", hashSize, usedCount);
+	if (hashSize != tpm_nv_index_entries->nvIndexHashSize) {
+	    rc = TPM_Realloc((unsigned char **)&(tpm_nv_index_entries->nvIndexHash),
+			     hashSize * sizeof(uint32_t));
+	}
+    }
+    if (rc == 0) {
+	tpm_nv_index_entries->nvIndexHashSize = hashSize;
+	tpm_nv_index_entries->nvIndexHashUsed = 0;
+	memset(tpm_nv_index_entries->nvIndexHash, 0, hashSize * sizeof(uint32_t));
+	for (slot = 0 ; slot < tpm_nv_index_entries->nvIndexCount ; slot++) {
+	    nvIndex = tpm_nv_index_entries->tpm_nvindex_entry[slot].pubInfo.nvIndex;
+	    if (nvIndex != TPM_NV_INDEX_LOCK) {
+		for (bucket = TPM_NVIndexEntries_Hash(tpm_nv_index_entries, nvIndex) ;
+		     tpm_nv_index_entries->nvIndexHash[bucket] != 0 ;
+		     bucket = (bucket + 1) & (hashSize - 1));
+		tpm_nv_index_entries->nvIndexHash[bucket] = slot + 1;
+		tpm_nv_index_entries->nvIndexHashUsed++;
+	    }
+	}
+    }
+    /* without a table, no entry can be found */
+    else {
+	free(tpm_nv_index_entries->nvIndexHash);
+	tpm_nv_index_entries->nvIndexHash = NULL;
+	tpm_nv_index_entries->nvIndexHashSize = 0;
+	tpm_nv_index_entries->nvIndexHashUsed = 0;
+    }
+    return rc;
+}
+
+/* TPM_NVIndexEntries_Hash() returns the first nvIndexHash bucket for nvIndex */
+
+static uint32_t TPM_NVIndexEntries_Hash(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries,
+					TPM_NV_INDEX nvIndex)
+{
+    uint32_t	hash;
+
+    /* indexes differ in their high bits (purview, D bit) as well as their low bits */
+    hash = nvIndex * 0x9e3779b1;
+    hash ^= hash >> 16;
+    return hash & (tpm_nv_index_entries->nvIndexHashSize - 1);
+}
+
 /* TPM_NVIndexEntries_GetUsedCount() returns the number of used entries in the TPM_NV_INDEX_ENTRIES
    array.
 
-   At startup, all entries will be used.  If an NV index is deleted, the entryis marked unused, but
-   the TPM_NV_INDEX_ENTRIES space is not reclaimed until the next startup.
+   At startup, all entries will be used.  If an NV index is deleted, the entry is marked unused.
+   TPM_NVIndexEntries_GetFreeEntry() reuses it for the next defined index, but the
+   TPM_NV_INDEX_ENTRIES array does not shrink until the next startup.
 */
 
 TPM_RESULT TPM_NVIndexEntries_GetUsedCount(uint32_t *count,
@@ -1976,7 +2161,7 @@ TPM_RESULT TPM_Process_NVWriteValue(tpm_state_t *tpm_state,
     /* input parameters */
     TPM_NV_INDEX	nvIndex;	/* The index of the area to set */
     uint32_t		offset = 0;	/* The offset into the NV Area */
-    TPM_SIZED_BUFFER	data;		/* The data to set the area to */
+    TPM_SIZED_BUFFER_VIEW	data;		/* The data to set the area to */
     TPM_AUTHHANDLE	authHandle;	/* The authorization handle used for TPM Owner */
     TPM_NONCE		nonceOdd;	/* Nonce generated by caller */
     TPM_BOOL	continueAuthSession = TRUE;	/* The continue use flag for the authorization
@@ -1997,6 +2182,7 @@ TPM_RESULT TPM_Process_NVWriteValue(tpm_state_t *tpm_state,
     TPM_BOOL			done = FALSE;
     TPM_BOOL			dir = FALSE;
     TPM_BOOL			writeAllNV = FALSE;	/* flag to write back NV */
+    TPM_BOOL			writeIndexData = FALSE;	/* flag that the index data changed */
     TPM_NV_DATA_SENSITIVE	*d1NvdataSensitive;
     uint32_t			s1Last;
     TPM_BOOL			physicalPresence;
@@ -2012,7 +2198,7 @@ TPM_RESULT TPM_Process_NVWriteValue(tpm_state_t *tpm_state,
     TPM_DIGEST		outParamDigest;
 
     printf("TPM_Process_NVWriteValue: Ordinal Entry\n");
-    TPM_SizedBuffer_Init(&data);			/* freed @1 */
+    TPM_SizedBufferView_Init(&data);		/* borrowed from the command */
     /*
       get inputs
     */
@@ -2026,7 +2212,7 @@ TPM_RESULT TPM_Process_NVWriteValue(tpm_state_t *tpm_state,
 	returnCode = TPM_Load32(&offset, &command, &paramSize);
     }
     if (returnCode == TPM_SUCCESS) {
-	returnCode = TPM_SizedBuffer_Load(&data, &command, &paramSize);
+	returnCode = TPM_SizedBufferView_Load(&data, &command, &paramSize);
     }
     /* save the ending point of inParam's for authorization and auditing */
     inParamEnd = command;
@@ -2330,6 +2516,7 @@ TPM_RESULT TPM_Process_NVWriteValue(tpm_state_t *tpm_state,
 			/* must write TPM_PERMANENT_DATA back to NVRAM, set this flag after
 			   strucuture is written */
 			writeAllNV = TRUE;
+			writeIndexData = TRUE;
 		    }
 		    else {
 			printf("TPM_Process_NVWriteValue: Same data, no copy\n");
@@ -2380,9 +2567,19 @@ TPM_RESULT TPM_Process_NVWriteValue(tpm_state_t *tpm_state,
 	    tpm_state->tpm_permanent_data.noOwnerNVWrite = nv1;
 	}
     }
-    returnCode = TPM_PermanentAll_NVStore(tpm_state,
-					  writeAllNV,
-					  returnCode);
+    /* if only the index data changed, append the write to the NV index data log */
+    if (writeIndexData && !nv1Incremented) {
+	returnCode = TPM_PermanentAll_NVStoreData(tpm_state,
+						  writeAllNV,
+						  nvIndex, offset,
+						  data.buffer, data.size,
+						  returnCode);
+    }
+    else {
+	returnCode = TPM_PermanentAll_NVStore(tpm_state,
+					      writeAllNV,
+					      returnCode);
+    }
     /*
       response
     */
@@ -2441,7 +2638,6 @@ TPM_RESULT TPM_Process_NVWriteValue(tpm_state_t *tpm_state,
     /*
       cleanup
     */
-    TPM_SizedBuffer_Delete(&data);			/* @1 */
     return rcf;
 }
 
@@ -2467,7 +2663,7 @@ TPM_RESULT TPM_Process_NVWriteValueAuth(tpm_state_t *tpm_state,
     /* input parameters */
     TPM_NV_INDEX	nvIndex;	/* The index of the area to set */
     uint32_t		offset = 0;	/* The offset into the chunk */
-    TPM_SIZED_BUFFER	data;		/* The data to set the area to */
+    TPM_SIZED_BUFFER_VIEW	data;		/* The data to set the area to */
     TPM_AUTHHANDLE	authHandle;	/* The authorization handle used for NV element
 					   authorization */
     TPM_NONCE		nonceOdd;	/* Nonce generated by system associated with authHandle */
@@ -2488,6 +2684,7 @@ TPM_RESULT TPM_Process_NVWriteValueAuth(tpm_state_t *tpm_state,
     TPM_NV_DATA_SENSITIVE	*d1NvdataSensitive;
     uint32_t			s1Last;
     TPM_BOOL			writeAllNV = FALSE;	/* flag to write back NV */
+    TPM_BOOL			writeIndexData = FALSE;	/* flag that the index data changed */
     TPM_BOOL			physicalPresence;
     TPM_BOOL			isGPIO;
 
@@ -2497,7 +2694,7 @@ TPM_RESULT TPM_Process_NVWriteValueAuth(tpm_state_t *tpm_state,
     TPM_DIGEST		outParamDigest;
 
     printf("TPM_Process_NVWriteValueAuth: Ordinal Entry\n");
-    TPM_SizedBuffer_Init(&data);			/* freed @1 */
+    TPM_SizedBufferView_Init(&data);		/* borrowed from the command */
     /*
       get inputs
     */
@@ -2513,7 +2710,7 @@ TPM_RESULT TPM_Process_NVWriteValueAuth(tpm_state_t *tpm_state,
     }
     /* get data parameter */
     if (returnCode == TPM_SUCCESS) {
-	returnCode = TPM_SizedBuffer_Load(&data, &command, &paramSize);
+	returnCode = TPM_SizedBufferView_Load(&data, &command, &paramSize);
     }
     /* save the ending point of inParam's for authorization and auditing */
     inParamEnd = command;
@@ -2714,6 +2911,7 @@ TPM_RESULT TPM_Process_NVWriteValueAuth(tpm_state_t *tpm_state,
 			/* must write TPM_PERMANENT_DATA back to NVRAM, set this flag after
 			   strucuture is written */
 			writeAllNV = TRUE;
+			writeIndexData = TRUE;
 		    }
 		    else {
 			printf("TPM_Process_NVWriteValueAuth: Same data, no copy\n");
@@ -2735,10 +2933,19 @@ TPM_RESULT TPM_Process_NVWriteValueAuth(tpm_state_t *tpm_state,
 	d1NvdataSensitive->pubInfo.bReadSTClear = FALSE;
 	printf("TPM_Process_NVWriteValueAuth: Writing data to NVRAM\n");
     }
-    /* write back TPM_PERMANENT_DATA if required */
-    returnCode = TPM_PermanentAll_NVStore(tpm_state,
-					  writeAllNV,
-					  returnCode);
+    /* write back TPM_PERMANENT_DATA if required, only the index data changed */
+    if (writeIndexData) {
+	returnCode = TPM_PermanentAll_NVStoreData(tpm_state,
+						  writeAllNV,
+						  nvIndex, offset,
+						  data.buffer, data.size,
+						  returnCode);
+    }
+    else {
+	returnCode = TPM_PermanentAll_NVStore(tpm_state,
+					      writeAllNV,
+					      returnCode);
+    }
     /*
       response
     */
@@ -2797,7 +3004,6 @@ TPM_RESULT TPM_Process_NVWriteValueAuth(tpm_state_t *tpm_state,
     /*
       cleanup
     */
-    TPM_SizedBuffer_Delete(&data);			/* @1 */
     return rcf;
 }
 
@@ -3262,6 +3468,9 @@ TPM_RESULT TPM_Process_NVDefineSpace(tpm_state_t *tpm_state,
 	/* assign the empty slot to the index now so it will be counted as used space during the
 	   serialization. */
 	pubInfo->nvIndex = newNVIndex;
+	returnCode = TPM_NVIndexEntries_AddEntry(&(tpm_state->tpm_nv_index_entries), d1_new);
+    }
+    if ((returnCode == TPM_SUCCESS) && !done) {
 	/* 12.a. Reserve NV space for pubInfo -> dataSize
 
 	   NOTE: Action is out or order.  Must allocate data space now so that the serialization
@@ -76,6 +76,8 @@ TPM_RESULT TPM_NVDataPublic_Load(TPM_NV_DATA_PUBLIC *tpm_nv_data_public,
 TPM_RESULT TPM_NVDataPublic_Store(TPM_STORE_BUFFER *sbuffer,
                                   const TPM_NV_DATA_PUBLIC *tpm_nv_data_public,
 				  TPM_BOOL optimize);
+uint32_t   TPM_NVDataPublic_SizeOf(const TPM_NV_DATA_PUBLIC *tpm_nv_data_public,
+				   TPM_BOOL optimize);
 void       TPM_NVDataPublic_Delete(TPM_NV_DATA_PUBLIC *tpm_nv_data_public);
 
 /*
@@ -89,6 +91,7 @@ TPM_RESULT TPM_NVDataSensitive_Load(TPM_NV_DATA_SENSITIVE *tpm_nv_data_sensitive
                                     uint32_t *stream_size);
 TPM_RESULT TPM_NVDataSensitive_Store(TPM_STORE_BUFFER *sbuffer,
                                      const TPM_NV_DATA_SENSITIVE *tpm_nv_data_sensitive);
+uint32_t   TPM_NVDataSensitive_SizeOf(const TPM_NV_DATA_SENSITIVE *tpm_nv_data_sensitive);
 void       TPM_NVDataSensitive_Delete(TPM_NV_DATA_SENSITIVE *tpm_nv_data_sensitive);
 
 TPM_RESULT TPM_NVDataSensitive_IsValidIndex(TPM_NV_INDEX nvIndex);
@@ -107,12 +110,14 @@ TPM_RESULT TPM_NVIndexEntries_Load(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries,
 				   uint32_t *stream_size);
 TPM_RESULT TPM_NVIndexEntries_Store(TPM_STORE_BUFFER *sbuffer,
 				    TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries);
+uint32_t   TPM_NVIndexEntries_SizeOf(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries);
 void       TPM_NVIndexEntries_StClear(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries);
 TPM_RESULT TPM_NVIndexEntries_LoadVolatile(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries,
 					   unsigned char **stream,
 					   uint32_t *stream_size);
 TPM_RESULT TPM_NVIndexEntries_StoreVolatile(TPM_STORE_BUFFER *sbuffer,
 					    TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries);
+uint32_t   TPM_NVIndexEntries_SizeOfVolatile(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries);
 TPM_RESULT TPM_NVIndexEntries_GetVolatile(TPM_NV_DATA_ST **tpm_nv_data_st,
 					  TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries);
 TPM_RESULT TPM_NVIndexEntries_SetVolatile(TPM_NV_DATA_ST *tpm_nv_data_st,
@@ -122,6 +127,8 @@ TPM_RESULT TPM_NVIndexEntries_GetFreeEntry(TPM_NV_DATA_SENSITIVE **tpm_nv_data_s
 TPM_RESULT TPM_NVIndexEntries_GetEntry(TPM_NV_DATA_SENSITIVE **tpm_nv_data_sensitive,
 				       TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries,
 				       TPM_NV_INDEX nvIndex);
+TPM_RESULT TPM_NVIndexEntries_AddEntry(TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries,
+				       TPM_NV_DATA_SENSITIVE *tpm_nv_data_sensitive);
 TPM_RESULT TPM_NVIndexEntries_GetUsedCount(uint32_t *count,
 					   TPM_NV_INDEX_ENTRIES *tpm_nv_index_entries);
 TPM_RESULT TPM_NVIndexEntries_GetNVList(TPM_STORE_BUFFER *sbuffer,
@@ -69,6 +69,14 @@
 #define TPM_MAX_NV_DEFINED_SIZE 2100
 #endif
 
+/* TPM_NV_INDEX_HASH_MIN is the minimum number of buckets in the hash table used to look up NV
+   indexes.  It must be a power of 2.
+*/
+
+#ifndef TPM_NV_INDEX_HASH_MIN
+#define TPM_NV_INDEX_HASH_MIN 16
+#endif
+
 /* TPM_MAX_NV_SPACE defines the maximum NV space for non-volatile state.
 
    It does not include the area used for TPM_SaveState.
@@ -92,6 +100,17 @@
 #error "TPM_MAX_NV_SPACE is not defined"
 #endif
 
+/* TPM_NV_LOG_MAX is the size at which the NV index data log is compacted by writing the full
+   non-volatile state.
+
+   A larger value makes more NV index writes cost only the size of the written data, at the expense
+   of NV space and of replaying the log at startup.
+*/
+
+#ifndef TPM_NV_LOG_MAX
+#define TPM_NV_LOG_MAX 16384
+#endif
+
 /* TPM_MAX_SAVESTATE_SPACE defines the maximum NV space for TPM saved state.
 
    It is used by TPM_SaveState
@@ -135,4 +154,25 @@
 #error "TPM_MAX_VOLATILESTATE_SPACE is not defined"
 #endif
 
+/* TPM_KEY_HANDLE_SPACE is the NV space for TPM saved and volatile state of each key slot.
+
+   TPM_MAX_SAVESTATE_SPACE and TPM_MAX_VOLATILESTATE_SPACE allow for TPM_KEY_HANDLES key slots.  The
+   _KEYS() macros add the space for the key slots beyond TPM_KEY_HANDLES of an instance created with
+   more.
+*/
+
+#ifndef TPM_KEY_HANDLE_SPACE
+#define TPM_KEY_HANDLE_SPACE 0
+#endif
+
+#define TPM_KEY_HANDLES_EXTRA_SPACE(keyHandles)				\
+    (((keyHandles) > TPM_KEY_HANDLES) ?					\
+     ((keyHandles) - TPM_KEY_HANDLES) * TPM_KEY_HANDLE_SPACE : 0)
+
+#define TPM_MAX_SAVESTATE_SPACE_KEYS(keyHandles)			\
+    (TPM_MAX_SAVESTATE_SPACE + TPM_KEY_HANDLES_EXTRA_SPACE(keyHandles))
+
+#define TPM_MAX_VOLATILESTATE_SPACE_KEYS(keyHandles)			\
+    (TPM_MAX_VOLATILESTATE_SPACE + TPM_KEY_HANDLES_EXTRA_SPACE(keyHandles))
+
 #endif
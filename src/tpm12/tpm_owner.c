@@ -937,7 +937,7 @@ TPM_RESULT TPM_OwnerClearCommon(tpm_state_t *tpm_state,
 	   /* returns TPM_RETRY when at the end of the table, terminates loop */
 	   (TPM_KeyHandleEntries_GetNextEntry(&tpm_key_handle_entry,
 					      &current,
-					      tpm_state->tpm_key_handle_entries,
+					      &(tpm_state->tpm_key_handle_entries),
 					      start)) == 0) {
 	printf("TPM_OwnerClearCommon: Flushing key handle %08x\n",
 	       tpm_key_handle_entry->handle);
@@ -953,7 +953,10 @@ TPM_RESULT TPM_OwnerClearCommon(tpm_state_t *tpm_state,
     /* a.This includes owner evict keys */
     if (rc == 0) {
 	printf("TPM_OwnerClearCommon: Deleting owner evict keys\n");
-	TPM_KeyHandleEntries_OwnerEvictDelete(tpm_state->tpm_key_handle_entries);
+	TPM_KeyHandleEntries_OwnerEvictDelete(&(tpm_state->tpm_key_handle_entries));
+	/* keys decrypted by the SRK and its descendants */
+	printf("TPM_OwnerClearCommon: Flushing decrypted key blob cache\n");
+	TPM_KeyCache_Flush(&(tpm_state->tpm_key_cache));
     }
     /* 4.  The TPM MUST NOT modify the following TPM_PERMANENT_DATA items
        a. endorsementKey 
@@ -54,6 +54,7 @@
 #include "tpm_nonce.h"
 #include "tpm_process.h"
 #include "tpm_sizedbuffer.h"
+#include "tpm_slab.h"
 #include "tpm_types.h"
 #include "tpm_ver.h"
 
@@ -561,6 +562,21 @@ TPM_RESULT TPM_PCRs_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_PCRs_SizeOf() returns the number of bytes TPM_PCRs_Store() serializes */
+
+uint32_t TPM_PCRs_SizeOf(const TPM_PCR_ATTRIBUTES *tpm_pcr_attributes)
+{
+    uint32_t	size = 0;
+    size_t	i;
+
+    for (i = 0 ; i < TPM_NUM_PCR ; i++) {
+	if (!(tpm_pcr_attributes[i].pcrReset)) {
+	    size += TPM_DIGEST_SIZE;
+	}
+    }
+    return size;
+}
+
 /*
   TPM_PCR_COMPOSITE
 */
@@ -805,6 +821,30 @@ TPM_RESULT TPM_PCRInfoShort_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_PCRInfoShort_SizeOf() returns the number of bytes TPM_PCRInfoShort_Store() serializes with
+   the same 'optimize' setting */
+
+uint32_t TPM_PCRInfoShort_SizeOf(const TPM_PCR_INFO_SHORT *tpm_pcr_info_short,
+				 TPM_BOOL optimize)
+{
+    TPM_RESULT	rc = 0;
+    uint32_t	size;
+    TPM_BOOL 	pcrUsage = TRUE;
+
+    size = TPM_PCRSelection_SizeOf(&(tpm_pcr_info_short->pcrSelection)) +
+	   sizeof(TPM_LOCALITY_SELECTION);
+    if (optimize) {
+	rc = TPM_PCRSelection_GetPCRUsage(&pcrUsage,
+					  &(tpm_pcr_info_short->pcrSelection),
+					  0);	/* start_index */
+    }
+    /* on error, the store fails as well, so the size is irrelevant */
+    if ((rc != 0) || pcrUsage) {
+	size += TPM_DIGEST_SIZE;
+    }
+    return size;
+}
+
 /* TPM_PCRInfoShort_Delete()
 
    No-OP if the parameter is NULL, else:
@@ -843,7 +883,8 @@ TPM_RESULT TPM_PCRInfoShort_Create(TPM_PCR_INFO_SHORT **tpm_pcr_info_short)
 	}
     }
     if (rc == 0) {
-	rc = TPM_Malloc((unsigned char **)tpm_pcr_info_short, sizeof(TPM_PCR_INFO_SHORT));
+	rc = TPM_Slab_Malloc((unsigned char **)tpm_pcr_info_short, TPM_SLAB_PCR_INFO_SHORT,
+			     sizeof(TPM_PCR_INFO_SHORT));
     }
     return rc;
 }
@@ -1241,6 +1282,14 @@ TPM_RESULT TPM_PCRInfo_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_PCRInfo_SizeOf() returns the number of bytes TPM_PCRInfo_Store() serializes */
+
+uint32_t TPM_PCRInfo_SizeOf(const TPM_PCR_INFO *tpm_pcr_info)
+{
+    return TPM_PCRSelection_SizeOf(&(tpm_pcr_info->pcrSelection)) +
+	(2 * TPM_DIGEST_SIZE);
+}
+
 /* TPM_PCRInfo_Delete()
 
    No-OP if the parameter is NULL, else:
@@ -1279,7 +1328,8 @@ TPM_RESULT TPM_PCRInfo_Create(TPM_PCR_INFO **tpm_pcr_info)
 	}
     }
     if (rc == 0) {
-	rc = TPM_Malloc((unsigned char **)tpm_pcr_info, sizeof(TPM_PCR_INFO));
+	rc = TPM_Slab_Malloc((unsigned char **)tpm_pcr_info, TPM_SLAB_PCR_INFO,
+			     sizeof(TPM_PCR_INFO));
     }
     return rc;
 }
@@ -1729,6 +1779,17 @@ TPM_RESULT TPM_PCRInfoLong_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_PCRInfoLong_SizeOf() returns the number of bytes TPM_PCRInfoLong_Store() serializes */
+
+uint32_t TPM_PCRInfoLong_SizeOf(const TPM_PCR_INFO_LONG *tpm_pcr_info_long)
+{
+    return sizeof(uint16_t) +					/* tag */
+	(2 * sizeof(TPM_LOCALITY_SELECTION)) +
+	TPM_PCRSelection_SizeOf(&(tpm_pcr_info_long->creationPCRSelection)) +
+	TPM_PCRSelection_SizeOf(&(tpm_pcr_info_long->releasePCRSelection)) +
+	(2 * TPM_DIGEST_SIZE);
+}
+
 /* TPM_PCRInfoLong_Delete()
 
    No-OP if the parameter is NULL, else:
@@ -1767,7 +1828,8 @@ TPM_RESULT TPM_PCRInfoLong_Create(TPM_PCR_INFO_LONG **tpm_pcr_info_long)
 	}
     }
     if (rc == 0) {
-	rc = TPM_Malloc((unsigned char **)tpm_pcr_info_long, sizeof(TPM_PCR_INFO_LONG));
+	rc = TPM_Slab_Malloc((unsigned char **)tpm_pcr_info_long, TPM_SLAB_PCR_INFO_LONG,
+			     sizeof(TPM_PCR_INFO_LONG));
     }
     return rc;
 }
@@ -2087,6 +2149,13 @@ TPM_RESULT TPM_PCRSelection_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_PCRSelection_SizeOf() returns the number of bytes TPM_PCRSelection_Store() serializes */
+
+uint32_t TPM_PCRSelection_SizeOf(const TPM_PCR_SELECTION *tpm_pcr_selection)
+{
+    return sizeof(uint16_t) + tpm_pcr_selection->sizeOfSelect;
+}
+
 
 /* TPM_PCRSelection_Delete()
 
@@ -98,6 +98,7 @@ TPM_RESULT TPM_PCRSelection_Load(TPM_PCR_SELECTION *tpm_pcr_selection,
                                  uint32_t *stream_size);
 TPM_RESULT TPM_PCRSelection_Store(TPM_STORE_BUFFER *sbuffer,
                                   const TPM_PCR_SELECTION *tpm_pcr_selection);
+uint32_t   TPM_PCRSelection_SizeOf(const TPM_PCR_SELECTION *tpm_pcr_selection);
 void       TPM_PCRSelection_Delete(TPM_PCR_SELECTION *tpm_pcr_selection);
 /* copy */
 TPM_RESULT TPM_PCRSelection_Copy(TPM_PCR_SELECTION *destination,
@@ -143,6 +144,7 @@ TPM_RESULT TPM_PCRs_Load(TPM_PCRVALUE *tpm_pcrs,
 TPM_RESULT TPM_PCRs_Store(TPM_STORE_BUFFER *sbuffer,
                           TPM_PCRVALUE *tpm_pcrs,
                           const TPM_PCR_ATTRIBUTES *tpm_pcr_attributes);
+uint32_t   TPM_PCRs_SizeOf(const TPM_PCR_ATTRIBUTES *tpm_pcr_attributes);
 
 /*
   TPM_PCR_INFO
@@ -154,6 +156,7 @@ TPM_RESULT TPM_PCRInfo_Load(TPM_PCR_INFO *tpm_pcr_info,
                             uint32_t *stream_size);
 TPM_RESULT TPM_PCRInfo_Store(TPM_STORE_BUFFER *sbuffer,
                              const TPM_PCR_INFO *tpm_pcr_info);
+uint32_t   TPM_PCRInfo_SizeOf(const TPM_PCR_INFO *tpm_pcr_info);
 void       TPM_PCRInfo_Delete(TPM_PCR_INFO *tpm_pcr_info);
 /* create */
 TPM_RESULT TPM_PCRInfo_Create(TPM_PCR_INFO **tpm_pcr_info);
@@ -197,6 +200,7 @@ TPM_RESULT TPM_PCRInfoLong_Load(TPM_PCR_INFO_LONG *tpm_pcr_info_long,
                                 uint32_t *stream_size);
 TPM_RESULT TPM_PCRInfoLong_Store(TPM_STORE_BUFFER *sbuffer,
                                  const TPM_PCR_INFO_LONG *tpm_pcr_info_long);
+uint32_t   TPM_PCRInfoLong_SizeOf(const TPM_PCR_INFO_LONG *tpm_pcr_info_long);
 void       TPM_PCRInfoLong_Delete(TPM_PCR_INFO_LONG *tpm_pcr_info_long);
 /* create */
 TPM_RESULT TPM_PCRInfoLong_Create(TPM_PCR_INFO_LONG **tpm_pcr_info_long);
@@ -236,6 +240,8 @@ TPM_RESULT TPM_PCRInfoShort_Load(TPM_PCR_INFO_SHORT *tpm_pcr_info_short,
 TPM_RESULT TPM_PCRInfoShort_Store(TPM_STORE_BUFFER *sbuffer,
                                   const TPM_PCR_INFO_SHORT *tpm_pcr_info_short,
 				  TPM_BOOL optimize);
+uint32_t   TPM_PCRInfoShort_SizeOf(const TPM_PCR_INFO_SHORT *tpm_pcr_info_short,
+				   TPM_BOOL optimize);
 void       TPM_PCRInfoShort_Delete(TPM_PCR_INFO_SHORT *tpm_pcr_info_short);
 /* create */
 TPM_RESULT TPM_PCRInfoShort_Create(TPM_PCR_INFO_SHORT **tpm_pcr_info_short);
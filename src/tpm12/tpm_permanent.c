@@ -51,12 +51,14 @@
 #include "tpm_error.h"
 #include "tpm_global.h"
 #include "tpm_key.h"
+#include "tpm_load.h"
 #include "tpm_nonce.h"
 #include "tpm_nvfile.h"
 #include "tpm_nvfilename.h"
 #include "tpm_nvram.h"
 #include "tpm_pcr.h"
 #include "tpm_secret.h"
+#include "tpm_statistics.h"
 #include "tpm_storage.h"
 #include "tpm_structures.h"
 #include "tpm_types.h"
@@ -65,6 +67,14 @@
 
 #include "tpm_permanent.h"
 
+/* local prototypes */
+
+static TPM_RESULT TPM_PermanentAll_NVLogLoad(tpm_state_t *tpm_state);
+static TPM_RESULT TPM_PermanentAll_NVLogReplay(tpm_state_t *tpm_state,
+					       unsigned char *log,
+					       uint32_t log_size);
+static TPM_RESULT TPM_PermanentAll_Rollback(tpm_state_t *tpm_state);
+
 /*
   TPM_PERMANENT_FLAGS
 */
@@ -175,6 +185,13 @@ TPM_RESULT TPM_PermanentFlags_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_PermanentFlags_SizeOf() returns the number of bytes TPM_PermanentFlags_Store() serializes */
+
+uint32_t TPM_PermanentFlags_SizeOf(void)
+{
+    return sizeof(uint16_t) + sizeof(uint32_t);	/* tag, bitmap */
+}
+
 /* TPM_PermanentFlags_StoreBytes() serializes the TPM_PERMANENT_FLAGS structure as bytes
 
  */
@@ -868,6 +885,42 @@ TPM_RESULT TPM_PermanentData_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_PermanentData_SizeOf() returns the number of bytes TPM_PermanentData_Store() serializes */
+
+uint32_t TPM_PermanentData_SizeOf(TPM_PERMANENT_DATA *tpm_permanent_data)
+{
+    uint32_t	size;
+
+    size = sizeof(uint16_t) +			/* tag */
+	   TPM_SECRET_SIZE +			/* tpmProof */
+	   TPM_NONCE_SIZE +			/* EKReset */
+	   TPM_SECRET_SIZE +			/* ownerAuth */
+	   TPM_SECRET_SIZE +			/* operatorAuth */
+	   TPM_DIGEST_SIZE +			/* authDIR */
+	   sizeof(BYTE);			/* manuMaintPub present */
+#ifndef TPM_NOMAINTENANCE
+    size += TPM_Pubkey_SizeOf(&(tpm_permanent_data->manuMaintPub));
+#endif
+    size += TPM_Key_SizeOfClear(TRUE, &(tpm_permanent_data->endorsementKey)) +
+	    TPM_Key_SizeOfClear(FALSE, &(tpm_permanent_data->srk)) +
+	    TPM_SymmetricKeyData_SizeOf(tpm_permanent_data->contextKey) +
+	    TPM_SymmetricKeyData_SizeOf(tpm_permanent_data->delegateKey) +
+	    TPM_CounterValue_SizeOf() +		/* auditMonotonicCounter */
+	    TPM_Counters_SizeOf() +
+	    (TPM_ORDINALS_MAX/CHAR_BIT) +	/* ordinalAuditStatus */
+	    TPM_FamilyTable_SizeOf(FALSE) +
+	    TPM_DelegateTable_SizeOf(&(tpm_permanent_data->delegateTable)) +
+	    sizeof(uint32_t) +			/* lastFamilyID */
+	    sizeof(uint32_t) +			/* noOwnerNVWrite */
+	    sizeof(TPM_CMK_DELEGATE) +		/* restrictDelegate */
+	    TPM_NONCE_SIZE +			/* tpmDAASeed */
+	    (3 * sizeof(BYTE)) +		/* ownerInstalled, tscOrdinalAuditStatus,
+						   allowLoadMaintPub */
+	    TPM_NONCE_SIZE +			/* daaProof */
+	    TPM_SymmetricKeyData_SizeOf(tpm_permanent_data->daaBlobKey);
+    return size;
+}
+
 /* TPM_PermanentData_Delete()
 
    No-OP if the parameter is NULL, else:
@@ -993,7 +1046,7 @@ TPM_RESULT TPM_PermanentAll_Load(tpm_state_t *tpm_state,
     }
     /* owner evict keys deserialize from stream */
     if (rc == 0) {
-	rc = TPM_KeyHandleEntries_OwnerEvictLoad(tpm_state->tpm_key_handle_entries,
+	rc = TPM_KeyHandleEntries_OwnerEvictLoad(&(tpm_state->tpm_key_handle_entries),
 						 stream, stream_size);
     }
     /* NV defined space deserialize from stream */
@@ -1047,6 +1100,10 @@ TPM_RESULT TPM_PermanentAll_Store(TPM_STORE_BUFFER *sbuffer,	/* freed by caller
     TPM_DIGEST		tpm_digest;
 
     printf(" TPM_PermanentAll_Store:\n");
+    /* allocate the stream once */
+    if (rc == 0) {
+	rc = TPM_Sbuffer_Reserve(sbuffer, TPM_PermanentAll_SizeOf(tpm_state));
+    }
     /* overall format tag */
     if (rc == 0) {
 	rc = TPM_Sbuffer_Append16(sbuffer, TPM_TAG_NVSTATE_V1);
@@ -1064,7 +1121,7 @@ TPM_RESULT TPM_PermanentAll_Store(TPM_STORE_BUFFER *sbuffer,	/* freed by caller
     /* serialize owner evict keys */
     if (rc == 0) {
 	rc = TPM_KeyHandleEntries_OwnerEvictStore(sbuffer,
-						  tpm_state->tpm_key_handle_entries);
+						  &(tpm_state->tpm_key_handle_entries));
     }
     /* serialize NV defined space */
     if (rc == 0) {
@@ -1091,11 +1148,26 @@ TPM_RESULT TPM_PermanentAll_Store(TPM_STORE_BUFFER *sbuffer,	/* freed by caller
     return rc;
 }
 
+/* TPM_PermanentAll_SizeOf() returns the number of bytes TPM_PermanentAll_Store() serializes,
+   including the integrity digest */
+
+uint32_t TPM_PermanentAll_SizeOf(tpm_state_t *tpm_state)
+{
+    return sizeof(uint16_t) +			/* tag */
+	TPM_PermanentData_SizeOf(&(tpm_state->tpm_permanent_data)) +
+	TPM_PermanentFlags_SizeOf() +
+	TPM_KeyHandleEntries_OwnerEvictSizeOf(&(tpm_state->tpm_key_handle_entries)) +
+	TPM_NVIndexEntries_SizeOf(&(tpm_state->tpm_nv_index_entries)) +
+	TPM_DIGEST_SIZE;
+}
+
 /* TPM_PermanentAll_NVLoad()
 
    Deserialize the TPM_PERMANENT_DATA, TPM_PERMANENT_FLAGS, owner evict keys, and NV defined
    space from a stream read from the NV file TPM_PERMANENT_ALL_NAME.
 
+   The stream is kept in tpm_permanent_shadow for a roll back.
+
    Returns:
 
    0 success
@@ -1109,6 +1181,7 @@ TPM_RESULT TPM_PermanentAll_NVLoad(tpm_state_t *tpm_state)
     unsigned char	*stream = NULL;
     unsigned char	*stream_start = NULL;
     uint32_t		stream_size;
+    uint32_t		stream_size_start = 0;
 
     printf(" TPM_PermanentAll_NVLoad:\n");
     if (rc == 0) {
@@ -1122,12 +1195,36 @@ TPM_RESULT TPM_PermanentAll_NVLoad(tpm_state_t *tpm_state)
     /* deserialize from stream */
     if (rc == 0) {
 	stream_start = stream;			/* save starting point for free() */
+	stream_size_start = stream_size;
 	rc = TPM_PermanentAll_Load(tpm_state, &stream, &stream_size);
 	if (rc != 0) {
 	    printf("TPM_PermanentAll_NVLoad: Error (fatal) loading deserializing NV state\n");
 	    rc = TPM_FAIL;
 	}
     }
+    /* the integrity digest that follows the stream starts the NV index data log chain */
+    if (rc == 0) {
+	TPM_Digest_Copy(tpm_state->tpm_nv_log_digest, stream);
+	tpm_state->tpm_nv_log_size = 0;
+	TPM_Sbuffer_Zero(&(tpm_state->tpm_nv_log_shadow));	/* NV index data may be secret */
+	TPM_Sbuffer_Clear(&(tpm_state->tpm_nv_log_shadow));
+	if (TPM_NVRAM_IsAppendSupported()) {
+	    rc = TPM_PermanentAll_NVLogLoad(tpm_state);
+	}
+    }
+    /* keep the stream for a roll back, the previous one holds secrets */
+    if (rc == 0) {
+	TPM_Sbuffer_Zero(&(tpm_state->tpm_permanent_shadow));
+	TPM_Sbuffer_Delete(&(tpm_state->tpm_permanent_shadow));
+	rc = TPM_Sbuffer_Set(&(tpm_state->tpm_permanent_shadow),
+			     stream_start, stream_size_start, stream_size_start);
+    }
+    if (rc == 0) {
+	stream_start = NULL;			/* now owned by tpm_permanent_shadow */
+    }
+    if (stream_start != NULL) {
+	memset(stream_start, 0, stream_size_start);
+    }
     free(stream_start); /* @1 */
     return rc;
 }
@@ -1139,10 +1236,15 @@ TPM_RESULT TPM_PermanentAll_NVLoad(tpm_state_t *tpm_state)
 
    If writeAllNV is TRUE and rcIn is not TPM_SUCCESS, this indicates that the ordinal
    modified the in-memory TPM_PERMANENT_DATA and/or TPM_PERMANENT_FLAGS structures (perhaps only
-   partially) and then detected an error.  Since the command is failing, roll back the structure by
-   reading the NV file.	 If the read then fails, this is a fatal error.
+   partially) and then detected an error.  Since the command is failing, roll back the structure to
+   the state last written, see TPM_PermanentAll_Rollback().  If the roll back fails, this is a
+   fatal error.
 
    Similarly, if writeAllNV is TRUE and the actual NV write fails, this is a fatal error.
+
+   While TPM_Process() coalesces writes, a write only marks the state dirty and
+   TPM_PermanentAll_NVFlush() writes it once after the ordinal.  A roll back then also discards
+   the changes of the ordinal that were marked dirty before the error.
 */
 
 TPM_RESULT TPM_PermanentAll_NVStore(tpm_state_t *tpm_state,
@@ -1153,12 +1255,17 @@ TPM_RESULT TPM_PermanentAll_NVStore(tpm_state_t *tpm_state,
     TPM_STORE_BUFFER	sbuffer;	/* safe buffer for storing binary data */
     const unsigned char *buffer;
     uint32_t		length;
-    TPM_NV_DATA_ST 	*tpm_nv_data_st = NULL;	/* array of saved NV index volatile flags */ 
+    uint64_t		startTime;
 
     printf(" TPM_PermanentAll_NVStore: write flag %u\n", writeAllNV);
     TPM_Sbuffer_Init(&sbuffer);			/* freed @1 */
     if (writeAllNV) {
-	if (rcIn == TPM_SUCCESS) {
+	if ((rcIn == TPM_SUCCESS) && tpm_state->tpm_nv_coalesce) {
+	    printf("  TPM_PermanentAll_NVStore: Deferring write\n");
+	    tpm_state->tpm_nv_dirty = TRUE;
+	}
+	else if (rcIn == TPM_SUCCESS) {
+	    TPM_Statistics_StartTimer(&startTime);
 	    /* serialize state to be written to NV */
 	    if (rc == 0) {
 		rc = TPM_PermanentAll_Store(&sbuffer,
@@ -1181,44 +1288,40 @@ TPM_RESULT TPM_PermanentAll_NVStore(tpm_state_t *tpm_state,
 					 tpm_state->tpm_number,
 					 TPM_PERMANENT_ALL_NAME); 
 	    }
+	    /* the full state includes all NV index data, start a new log */
+	    if (rc == 0) {
+		TPM_Digest_Copy(tpm_state->tpm_nv_log_digest, buffer + length - TPM_DIGEST_SIZE);
+		TPM_Sbuffer_Zero(&(tpm_state->tpm_nv_log_shadow));
+		TPM_Sbuffer_Clear(&(tpm_state->tpm_nv_log_shadow));
+		if (tpm_state->tpm_nv_log_size != 0) {
+		    tpm_state->tpm_nv_log_size = 0;
+		    rc = TPM_NVRAM_DeleteName(tpm_state->tpm_number,
+					      TPM_NV_LOG_NAME,
+					      FALSE);
+		}
+	    }
+	    /* keep the written state for a roll back, the previous one is freed with sbuffer */
+	    if (rc == 0) {
+		TPM_STORE_BUFFER previous = tpm_state->tpm_permanent_shadow;
+		tpm_state->tpm_permanent_shadow = sbuffer;
+		sbuffer = previous;
+	    }
+	    TPM_Statistics_StopTimer(startTime, TPM_STATISTICS_NVSTORE);
 	    if (rc != 0) {
 		printf("TPM_PermanentAll_NVStore: Error (fatal), "
 		       "NV structure in-memory caches are in invalid state\n");
 		rc = TPM_FAIL;
 	    }
 	}
-	else {	
+	else {
 	    /* An in-memory structure was altered, but the ordinal had a subsequent error.  Since
-	       the structure is in an invalid state, roll back to the previous value by reading the
-	       NV file. */
+	       the structure is in an invalid state, roll back to the previous value. */
 	    printf("  TPM_PermanentAll_NVStore: Ordinal error, "
 		   "rolling back NV structure cache\n");
-	    /* Save a copy of the NV defined space volatile state.  It is not stored in NV, so it
-	       will be destroyed during the rollback. */
-	    /* get a copy of the NV volatile flags, to be used during a rollback */
-	    if (rc == 0) {
-		rc = TPM_NVIndexEntries_GetVolatile(&tpm_nv_data_st,	/* freed @2 */
-						    &(tpm_state->tpm_nv_index_entries));
-	    }
-	    /* Returns TPM_RETRY on non-existent file */
-	    if (rc == 0) {
-		printf(" TPM_PermanentAllNVStore: Deleting TPM_PERMANENT_DATA structure\n");
-		TPM_PermanentData_Delete(&(tpm_state->tpm_permanent_data), TRUE);
-		printf(" TPM_PermanentAllNVStore: Deleting owner evict keys\n");
-		TPM_KeyHandleEntries_OwnerEvictDelete(tpm_state->tpm_key_handle_entries);
-		printf(" TPM_PermanentAllNVStore: Deleting NV defined space \n");
-		TPM_NVIndexEntries_Delete(&(tpm_state->tpm_nv_index_entries));
-		printf(" TPM_PermanentAllNVStore: "
-		       "Rereading TPM_PERMANENT_DATA, TPM_PERMANENT_FLAGS, owner evict keys\n");
-		/* re-allocate TPM_PERMANENT_DATA data structures */
-		rc = TPM_PermanentData_Init(&(tpm_state->tpm_permanent_data), TRUE);
-	    }
+	    rc = TPM_PermanentAll_Rollback(tpm_state);
+	    /* the state is now the one last written */
 	    if (rc == 0) {
-		rc = TPM_PermanentAll_NVLoad(tpm_state);
-	    }
-	    if (rc == 0) {
-		rc = TPM_NVIndexEntries_SetVolatile(tpm_nv_data_st,
-						    &(tpm_state->tpm_nv_index_entries));
+		tpm_state->tpm_nv_dirty = FALSE;
 	    }
 	    /* after a successful rollback, return the ordinal's original error code */
 	    if (rc == 0) {
@@ -1230,15 +1333,356 @@ TPM_RESULT TPM_PermanentAll_NVStore(tpm_state_t *tpm_state,
 		       "Permanent Data, Flags, or owner evict keys structure is invalid\n");
 		rc = TPM_FAIL;
 	    }
-		
 	}
     }
     /* no write required, no-op */
     else {
 	rc = rcIn;
     }
+    /* the serialized state, or the replaced roll back copy, holds secrets */
+    TPM_Sbuffer_Zero(&sbuffer);
+    TPM_Sbuffer_Delete(&sbuffer);	/* @1 */
+    return rc;
+}
+
+/* TPM_PermanentAll_Rollback() restores the TPM_PERMANENT_DATA, TPM_PERMANENT_FLAGS, owner evict
+   keys, and NV defined space to the state last written to or read from NVRAM.
+
+   The state is deserialized from tpm_permanent_shadow and the NV index data log records in
+   tpm_nv_log_shadow are replayed onto it, so that a failing ordinal does not read NVRAM.  The NV
+   file is read only if there is no copy.
+
+   The NV defined space volatile state is not stored in NV and is preserved.
+*/
+
+static TPM_RESULT TPM_PermanentAll_Rollback(tpm_state_t *tpm_state)
+{
+    TPM_RESULT		rc = 0;
+    TPM_NV_DATA_ST 	*tpm_nv_data_st = NULL;	/* array of saved NV index volatile flags */
+    const unsigned char *buffer;
+    uint32_t		length;
+    unsigned char	*stream;
+    uint32_t		stream_size;
+    const unsigned char *log;
+    uint32_t		log_size;
+
+    printf(" TPM_PermanentAll_Rollback:\n");
+    /* Save a copy of the NV defined space volatile state.  It is not stored in NV, so it will be
+       destroyed during the rollback. */
+    if (rc == 0) {
+	rc = TPM_NVIndexEntries_GetVolatile(&tpm_nv_data_st,	/* freed @1 */
+					    &(tpm_state->tpm_nv_index_entries));
+    }
+    if (rc == 0) {
+	printf("  TPM_PermanentAll_Rollback: Deleting TPM_PERMANENT_DATA structure\n");
+	TPM_PermanentData_Delete(&(tpm_state->tpm_permanent_data), TRUE);
+	printf("  TPM_PermanentAll_Rollback: Deleting owner evict keys\n");
+	TPM_KeyHandleEntries_OwnerEvictDelete(&(tpm_state->tpm_key_handle_entries));
+	printf("  TPM_PermanentAll_Rollback: Deleting NV defined space \n");
+	TPM_NVIndexEntries_Delete(&(tpm_state->tpm_nv_index_entries));
+	/* re-allocate TPM_PERMANENT_DATA data structures */
+	rc = TPM_PermanentData_Init(&(tpm_state->tpm_permanent_data), TRUE);
+    }
+    if (rc == 0) {
+	TPM_Sbuffer_Get(&(tpm_state->tpm_permanent_shadow), &buffer, &length);
+	/* no copy, reread TPM_PERMANENT_DATA, TPM_PERMANENT_FLAGS, owner evict keys */
+	if (length == 0) {
+	    printf("  TPM_PermanentAll_Rollback: Rereading NV state\n");
+	    rc = TPM_PermanentAll_NVLoad(tpm_state);
+	}
+	else {
+	    printf("  TPM_PermanentAll_Rollback: Restoring %u bytes\n", length);
+	    /* TPM_PermanentAll_Load() does not alter the stream */
+	    stream = (unsigned char *)buffer;
+	    stream_size = length;
+	    rc = TPM_PermanentAll_Load(tpm_state, &stream, &stream_size);
+	    /* the integrity digest that follows the stream starts the NV index data log chain */
+	    if (rc == 0) {
+		TPM_Digest_Copy(tpm_state->tpm_nv_log_digest, stream);
+		tpm_state->tpm_nv_log_size = 0;
+		TPM_Sbuffer_Get(&(tpm_state->tpm_nv_log_shadow), &log, &log_size);
+		rc = TPM_PermanentAll_NVLogReplay(tpm_state, (unsigned char *)log, log_size);
+	    }
+	    /* the copy holds only valid records */
+	    if ((rc == 0) && (tpm_state->tpm_nv_log_size != log_size)) {
+		printf("TPM_PermanentAll_Rollback: Error (fatal) log replay ends at %u of %u\n",
+		       tpm_state->tpm_nv_log_size, log_size);
+		rc = TPM_FAIL;
+	    }
+	}
+    }
+    if (rc == 0) {
+	rc = TPM_NVIndexEntries_SetVolatile(tpm_nv_data_st,
+					    &(tpm_state->tpm_nv_index_entries));
+    }
+    free(tpm_nv_data_st);		/* @1 */
+    return rc;
+}
+
+/* TPM_PermanentAll_NVFlush() ends coalescing writes and writes the permanent state if a write was
+   deferred.
+
+   If rcIn is not TPM_SUCCESS, the ordinal failed fatally and nothing is written.  Returns rcIn or
+   the error of the write, which is fatal.
+*/
+
+TPM_RESULT TPM_PermanentAll_NVFlush(tpm_state_t *tpm_state,
+				    TPM_RESULT rcIn)
+{
+    TPM_RESULT		rc = rcIn;
+
+    printf(" TPM_PermanentAll_NVFlush: dirty %u\n", tpm_state->tpm_nv_dirty);
+    tpm_state->tpm_nv_coalesce = FALSE;
+    if ((rc == TPM_SUCCESS) && tpm_state->tpm_nv_dirty) {
+	tpm_state->tpm_nv_dirty = FALSE;
+	rc = TPM_PermanentAll_NVStore(tpm_state, TRUE, TPM_SUCCESS);
+    }
+    return rc;
+}
+
+/*
+  NV index data log
+
+  TPM_NV_WriteValue and TPM_NV_WriteValueAuth usually change only the data of an NV index.  Rather
+  than rewriting all non-volatile state in TPM_PERMANENT_ALL_NAME, such a write appends a record
+  to TPM_NV_LOG_NAME:
+
+	TPM_TAG_NVLOG_V1
+	nvIndex
+	offset
+	dataSize
+	data
+	SHA-1 digest of the previous digest and the above fields
+
+  The digest chain starts with the integrity digest of the TPM_PERMANENT_ALL_NAME state that the log
+  applies to.  A log that was left behind by an older state fails the check at its first record
+  and a partially written record fails at its own digest.  Replay stops at the first record that
+  fails the check.
+
+  Writing the full state, either for any other change or when the log grows beyond TPM_NV_LOG_MAX,
+  deletes the log.
+*/
+
+/* TPM_PermanentAll_NVLogLoad() replays the NV index data log onto the NV defined space loaded from
+   TPM_PERMANENT_ALL_NAME.
+
+   tpm_nv_log_digest must hold the integrity digest of that state.  The valid records are kept in
+   tpm_nv_log_shadow.  A stale or partially written tail is removed so that new records follow the
+   last valid one.
+*/
+
+static TPM_RESULT TPM_PermanentAll_NVLogLoad(tpm_state_t *tpm_state)
+{
+    TPM_RESULT		rc = 0;
+    unsigned char	*log = NULL;
+    uint32_t		log_size = 0;
+    TPM_BOOL		mapped = FALSE;
+
+    printf(" TPM_PermanentAll_NVLogLoad:\n");
+    /* Returns TPM_RETRY on non-existent file */
+    if (rc == 0) {
+	rc = TPM_NVRAM_MapData(&log,			/* freed @1 */
+			       &log_size,
+			       &mapped,
+			       tpm_state->tpm_number,
+			       TPM_NV_LOG_NAME);
+	if (rc == TPM_RETRY) {
+	    rc = 0;
+	}
+    }
+    if (rc == 0) {
+	rc = TPM_PermanentAll_NVLogReplay(tpm_state, log, log_size);
+    }
+    if (rc == 0) {
+	rc = TPM_Sbuffer_Append(&(tpm_state->tpm_nv_log_shadow),
+				log, tpm_state->tpm_nv_log_size);
+    }
+    /* remove a stale or partially written tail */
+    if ((rc == 0) && (tpm_state->tpm_nv_log_size != log_size)) {
+	if (tpm_state->tpm_nv_log_size == 0) {
+	    rc = TPM_NVRAM_DeleteName(tpm_state->tpm_number,
+				      TPM_NV_LOG_NAME,
+				      FALSE);
+	}
+	else {
+	    rc = TPM_NVRAM_StoreData(log,
+				     tpm_state->tpm_nv_log_size,
+				     tpm_state->tpm_number,
+				     TPM_NV_LOG_NAME);
+	}
+    }
+    TPM_NVRAM_UnmapData(log, log_size, mapped);	/* @1 */
+    return rc;
+}
+
+/* TPM_PermanentAll_NVLogReplay() applies the valid records of 'log' to the NV defined space,
+   starting the digest chain at tpm_nv_log_digest.
+
+   Replay stops at the first invalid record.  tpm_nv_log_digest and tpm_nv_log_size are updated to
+   the last valid record.
+*/
+
+static TPM_RESULT TPM_PermanentAll_NVLogReplay(tpm_state_t *tpm_state,
+					       unsigned char *log,
+					       uint32_t log_size)
+{
+    TPM_RESULT		rc = 0;
+    unsigned char	*stream;
+    uint32_t		stream_size;
+    unsigned char	*record;
+    TPM_TAG		tag;
+    TPM_NV_INDEX	nvIndex;
+    uint32_t		offset;
+    uint32_t		dataSize;
+    TPM_DIGEST		tpm_digest;
+    TPM_NV_DATA_SENSITIVE *d1NvdataSensitive;
+    TPM_BOOL		done = FALSE;
+
+    printf(" TPM_PermanentAll_NVLogReplay: %u bytes\n", log_size);
+    stream = log;
+    stream_size = log_size;
+    while ((rc == 0) && !done && (stream_size > 0)) {
+	record = stream;
+	/* a record header is tag, nvIndex, offset, dataSize */
+	if (stream_size < sizeof(uint16_t) + (3 * sizeof(uint32_t)) + TPM_DIGEST_SIZE) {
+	    done = TRUE;
+	}
+	if (!done) {
+	    TPM_Load16(&tag, &stream, &stream_size);
+	    TPM_Load32(&nvIndex, &stream, &stream_size);
+	    TPM_Load32(&offset, &stream, &stream_size);
+	    TPM_Load32(&dataSize, &stream, &stream_size);
+	    if ((tag != TPM_TAG_NVLOG_V1) ||
+		(dataSize > stream_size - TPM_DIGEST_SIZE)) {
+		done = TRUE;
+	    }
+	}
+	if (!done) {
+	    rc = TPM_SHA1(tpm_digest,
+			  TPM_DIGEST_SIZE, tpm_state->tpm_nv_log_digest,
+			  (uint32_t)(stream - record) + dataSize, record,
+			  0, NULL);
+	    if ((rc == 0) && (TPM_Digest_Compare(tpm_digest, stream + dataSize) != 0)) {
+		printf("  TPM_PermanentAll_NVLogReplay: Log ends at %u of %u bytes\n",
+		       tpm_state->tpm_nv_log_size, log_size);
+		done = TRUE;
+	    }
+	}
+	/* a valid record must apply to a defined index */
+	if ((rc == 0) && !done) {
+	    printf("  TPM_PermanentAll_NVLogReplay: nvIndex %08x offset %u dataSize %u\n",
+		   nvIndex, offset, dataSize);
+	    rc = TPM_NVIndexEntries_GetEntry(&d1NvdataSensitive,
+					     &(tpm_state->tpm_nv_index_entries),
+					     nvIndex);
+	    if ((rc == 0) &&
+		((offset > d1NvdataSensitive->pubInfo.dataSize) ||
+		 (dataSize > d1NvdataSensitive->pubInfo.dataSize - offset))) {
+		rc = TPM_FAIL;
+	    }
+	    if (rc != 0) {
+		printf("TPM_PermanentAll_NVLogReplay: Error (fatal) record for nvIndex %08x\n",
+		       nvIndex);
+		rc = TPM_FAIL;
+	    }
+	}
+	if ((rc == 0) && !done) {
+	    memcpy(d1NvdataSensitive->data + offset, stream, dataSize);
+	    stream += dataSize + TPM_DIGEST_SIZE;
+	    stream_size -= dataSize + TPM_DIGEST_SIZE;
+	    TPM_Digest_Copy(tpm_state->tpm_nv_log_digest, tpm_digest);
+	    tpm_state->tpm_nv_log_size = stream - log;
+	}
+    }
+    return rc;
+}
+
+/* TPM_PermanentAll_NVStoreData() stores a write of 'data' of 'dataSize' at 'offset' of the NV index
+   'nvIndex' that has already been applied to the in-memory NV defined space.
+
+   It is called instead of TPM_PermanentAll_NVStore() if the write is the only change to the
+   non-volatile state and has the same 'writeAllNV' and 'rcIn' semantics.  The write is appended to
+   the NV index data log.  If the log would grow beyond TPM_NV_LOG_MAX or the storage does not
+   support appending, the full state is written instead.
+*/
+
+TPM_RESULT TPM_PermanentAll_NVStoreData(tpm_state_t *tpm_state,
+					TPM_BOOL writeAllNV,
+					TPM_NV_INDEX nvIndex,
+					uint32_t offset,
+					const unsigned char *data,
+					uint32_t dataSize,
+					TPM_RESULT rcIn)
+{
+    TPM_RESULT		rc = 0;
+    TPM_STORE_BUFFER	sbuffer;	/* safe buffer for storing binary data */
+    const unsigned char *buffer;
+    uint32_t		length;
+    TPM_DIGEST		tpm_digest;
+    uint64_t		startTime;
+
+    printf(" TPM_PermanentAll_NVStoreData: write flag %u\n", writeAllNV);
+    TPM_Sbuffer_Init(&sbuffer);			/* freed @1 */
+    /* a pending write of the full state includes the data */
+    if (!writeAllNV || (rcIn != TPM_SUCCESS) || tpm_state->tpm_nv_dirty ||
+	!TPM_NVRAM_IsAppendSupported() ||
+	(tpm_state->tpm_nv_log_size + dataSize > TPM_NV_LOG_MAX)) {
+	rc = TPM_PermanentAll_NVStore(tpm_state, writeAllNV, rcIn);
+    }
+    else {
+	TPM_Statistics_StartTimer(&startTime);
+	/* serialize the record */
+	if (rc == 0) {
+	    rc = TPM_Sbuffer_Append16(&sbuffer, TPM_TAG_NVLOG_V1);
+	}
+	if (rc == 0) {
+	    rc = TPM_Sbuffer_Append32(&sbuffer, nvIndex);
+	}
+	if (rc == 0) {
+	    rc = TPM_Sbuffer_Append32(&sbuffer, offset);
+	}
+	if (rc == 0) {
+	    rc = TPM_Sbuffer_Append32(&sbuffer, dataSize);
+	}
+	if (rc == 0) {
+	    rc = TPM_Sbuffer_Append(&sbuffer, data, dataSize);
+	}
+	/* chain the record to the previous one */
+	if (rc == 0) {
+	    TPM_Sbuffer_Get(&sbuffer, &buffer, &length);
+	    rc = TPM_SHA1(tpm_digest,
+			  TPM_DIGEST_SIZE, tpm_state->tpm_nv_log_digest,
+			  length, buffer,
+			  0, NULL);
+	}
+	if (rc == 0) {
+	    rc = TPM_Sbuffer_Append(&sbuffer, tpm_digest, TPM_DIGEST_SIZE);
+	}
+	if (rc == 0) {
+	    TPM_Sbuffer_Get(&sbuffer, &buffer, &length);
+	    printf("  TPM_PermanentAll_NVStoreData: Appending %u bytes at %u\n",
+		   length, tpm_state->tpm_nv_log_size);
+	    rc = TPM_NVRAM_AppendData(buffer,
+				      length,
+				      tpm_state->tpm_number,
+				      TPM_NV_LOG_NAME);
+	}
+	/* keep the record for a roll back */
+	if (rc == 0) {
+	    rc = TPM_Sbuffer_Append(&(tpm_state->tpm_nv_log_shadow), buffer, length);
+	}
+	TPM_Statistics_StopTimer(startTime, TPM_STATISTICS_NVSTORE);
+	if (rc == 0) {
+	    TPM_Digest_Copy(tpm_state->tpm_nv_log_digest, tpm_digest);
+	    tpm_state->tpm_nv_log_size += length;
+	}
+	else {
+	    printf("TPM_PermanentAll_NVStoreData: Error (fatal), "
+		   "NV structure in-memory caches are in invalid state\n");
+	    rc = TPM_FAIL;
+	}
+    }
     TPM_Sbuffer_Delete(&sbuffer);	/* @1 */
-    free(tpm_nv_data_st);		/* @2 */
     return rc;
 }
 
@@ -1261,6 +1705,12 @@ TPM_RESULT TPM_PermanentAll_NVDelete(uint32_t tpm_number,
 				  TPM_PERMANENT_ALL_NAME,
 				  mustExist);
     }
+    /* remove the NV index data log, which does not exist after a full write */
+    if ((rc == 0) && TPM_NVRAM_IsAppendSupported()) {
+	rc = TPM_NVRAM_DeleteName(tpm_number,
+				  TPM_NV_LOG_NAME,
+				  FALSE);
+    }
     return rc;
 }
 
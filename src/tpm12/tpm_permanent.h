@@ -54,6 +54,7 @@ TPM_RESULT TPM_PermanentFlags_Load(TPM_PERMANENT_FLAGS *tpm_permanent_flags,
                                    uint32_t *stream_size);
 TPM_RESULT TPM_PermanentFlags_Store(TPM_STORE_BUFFER *sbuffer,
                                     const TPM_PERMANENT_FLAGS *tpm_permanent_flags);
+uint32_t   TPM_PermanentFlags_SizeOf(void);
 TPM_RESULT TPM_PermanentFlags_LoadBitmap(TPM_PERMANENT_FLAGS *tpm_permanent_flags,
 					 TPM_TAG permanentFlagsVersion,
 					 uint32_t tpm_bitmap);
@@ -75,6 +76,7 @@ TPM_RESULT TPM_PermanentData_Load(TPM_PERMANENT_DATA *tpm_permanent_data,
 TPM_RESULT TPM_PermanentData_Store(TPM_STORE_BUFFER *sbuffer,
                                    TPM_PERMANENT_DATA *tpm_permanent_data,
                                    TPM_BOOL instanceData);
+uint32_t   TPM_PermanentData_SizeOf(TPM_PERMANENT_DATA *tpm_permanent_data);
 void       TPM_PermanentData_Delete(TPM_PERMANENT_DATA *tpm_permanent_data,
                                     TPM_BOOL instanceData);
 void       TPM_PermanentData_Zero(TPM_PERMANENT_DATA *tpm_permanent_data,
@@ -93,11 +95,21 @@ TPM_RESULT TPM_PermanentAll_Store(TPM_STORE_BUFFER *sbuffer,
 				  const unsigned char **buffer,
 				  uint32_t *length,
 				  tpm_state_t *tpm_state);
+uint32_t   TPM_PermanentAll_SizeOf(tpm_state_t *tpm_state);
 
 TPM_RESULT TPM_PermanentAll_NVLoad(tpm_state_t *tpm_state);
 TPM_RESULT TPM_PermanentAll_NVStore(tpm_state_t *tpm_state,
 				    TPM_BOOL writeAllNV,
 				    TPM_RESULT rcIn);
+TPM_RESULT TPM_PermanentAll_NVFlush(tpm_state_t *tpm_state,
+				    TPM_RESULT rcIn);
+TPM_RESULT TPM_PermanentAll_NVStoreData(tpm_state_t *tpm_state,
+					TPM_BOOL writeAllNV,
+					TPM_NV_INDEX nvIndex,
+					uint32_t offset,
+					const unsigned char *data,
+					uint32_t dataSize,
+					TPM_RESULT rcIn);
 TPM_RESULT TPM_PermanentAll_NVDelete(uint32_t tpm_number,
 				     TPM_BOOL mustExist);
 
@@ -124,7 +124,7 @@ TPM_RESULT TPM_IO_GetPhysicalPresence(TPM_BOOL *physicalPresence,
 
 TPM_RESULT TPM_IO_GPIO_Write(TPM_NV_INDEX nvIndex,
                              uint32_t dataSize,
-                             BYTE *data,
+                             const BYTE *data,
 			     uint32_t tpm_number)
 {
     TPM_RESULT  rc = 0;
@@ -54,7 +54,7 @@ TPM_RESULT TPM_IO_GetPhysicalPresence(TPM_BOOL *physicalPresence,
 				      uint32_t tpm_number);
 TPM_RESULT TPM_IO_GPIO_Write(TPM_NV_INDEX nvIndex,
                              uint32_t dataSize,
-                             BYTE *data,
+                             const BYTE *data,
 			     uint32_t tpm_number);
 TPM_RESULT TPM_IO_GPIO_Read(TPM_NV_INDEX nvIndex,
                             uint32_t dataSize,
@@ -47,6 +47,7 @@
 #endif
 
 #include "tpm_admin.h"
+#include "tpm_arena.h"
 #include "tpm_audit.h"
 #include "tpm_auth.h"
 #include "tpm_constants.h"
@@ -55,6 +56,7 @@
 #include "tpm_cryptoh.h"
 #include "tpm_crypto.h"
 #include "tpm_daa.h"
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_PROCESS
 #include "tpm_debug.h"
 #include "tpm_delegate.h"
 #include "tpm_error.h"
@@ -73,7 +75,9 @@
 #include "tpm_platform.h"
 #include "tpm_session.h"
 #include "tpm_sizedbuffer.h"
+#include "tpm_slab.h"
 #include "tpm_startup.h"
+#include "tpm_statistics.h"
 #include "tpm_storage.h"
 #include "tpm_ticks.h"
 #include "tpm_transport.h"
@@ -99,12 +103,12 @@ static TPM_RESULT TPM_GetCapability_CapProperty(TPM_STORE_BUFFER *capabilityResp
 						uint32_t capProperty);
 static TPM_RESULT TPM_GetCapability_CapVersion(TPM_STORE_BUFFER *capabilityResponse);
 static TPM_RESULT TPM_GetCapability_CapCheckLoaded(TPM_STORE_BUFFER *capabilityResponse,
-						   const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry,
+						   const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
 						   TPM_SIZED_BUFFER *subCap);
 static TPM_RESULT TPM_GetCapability_CapSymMode(TPM_STORE_BUFFER *capabilityResponse,
 					       TPM_SYM_MODE symMode);
 static TPM_RESULT TPM_GetCapability_CapKeyStatus(TPM_STORE_BUFFER *capabilityResponse,
-						 TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+						 TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
 						 uint32_t tpm_key_handle);
 static TPM_RESULT TPM_GetCapability_CapMfr(TPM_STORE_BUFFER *capabilityResponse,
 					   tpm_state_t *tpm_state,
@@ -2048,25 +2052,116 @@ static TPM_ORDINAL_TABLE tpm_ordinal_table[] =
    Ordinal Table Utilities
 */
 
+/* The ordinal index maps an ordinal directly to its tpm_ordinal_table entry, so that the per
+   command lookups are a single indexed load rather than a table scan.
+
+   TPM ordinals are 0x00000000 - 0x000000ff and TSC ordinals are 0x40000000 - 0x400000ff, so the
+   low byte of the ordinal plus the TPM_CONNECTION_COMMAND bit form the index.  Other ordinals are
+   not in the table.
+
+   The index is built once by TPM_OrdinalTable_Init() and is read only afterwards.
+*/
+
+static TPM_ORDINAL_TABLE *tpm_ordinal_index[TPM_ORDINAL_INDEX_SIZE];
+static TPM_BOOL tpm_ordinal_index_init = FALSE;
+
+/* TPM_OrdinalTable_Index() returns the tpm_ordinal_index position for the ordinal.
+
+   If the ordinal cannot be in the table, TPM_BAD_ORDINAL is returned
+*/
+
+TPM_RESULT TPM_OrdinalTable_Index(size_t *index,
+				  TPM_COMMAND_CODE ordinal)
+{
+    TPM_RESULT	rc = 0;
+
+    if ((ordinal & ~(TPM_CONNECTION_COMMAND | 0xff)) != 0) {
+	rc = TPM_BAD_ORDINAL;
+    }
+    else if ((ordinal & TPM_CONNECTION_COMMAND) != 0) {
+	*index = 0x100 + (ordinal & 0xff);
+    }
+    else {
+	*index = ordinal;
+    }
+    return rc;
+}
+
+/* TPM_OrdinalTable_IndexOrdinal() returns the ordinal for a tpm_ordinal_index position.  It is the
+   inverse of TPM_OrdinalTable_Index().
+*/
+
+void TPM_OrdinalTable_IndexOrdinal(TPM_COMMAND_CODE *ordinal,
+				   size_t index)
+{
+    if (index >= 0x100) {
+	*ordinal = TPM_CONNECTION_COMMAND | (index & 0xff);
+    }
+    else {
+	*ordinal = index;
+    }
+    return;
+}
+
+/* TPM_OrdinalTable_Init() builds the ordinal index from tpm_ordinal_table.
+
+   It must be called once before the first command is processed.  Returns TPM_FAIL if an ordinal
+   in the table cannot be indexed, which is a programming error.
+*/
+
+TPM_RESULT TPM_OrdinalTable_Init(void)
+{
+    TPM_RESULT	rc = 0;
+    size_t	i;
+    size_t	index;
+
+    printf(" TPM_OrdinalTable_Init:\n");
+    if (!tpm_ordinal_index_init) {
+	for (i = 0 ; (rc == 0) && (i < (sizeof(tpm_ordinal_table)/sizeof(TPM_ORDINAL_TABLE))) ;
+	     i++) {
+	    rc = TPM_OrdinalTable_Index(&index, tpm_ordinal_table[i].ordinal);
+	    if ((rc == 0) && (tpm_ordinal_index[index] != NULL)) {
+		rc = TPM_BAD_ORDINAL;	/* duplicate entry */
+	    }
+	    if (rc == 0) {
+		tpm_ordinal_index[index] = &(tpm_ordinal_table[i]);
+	    }
+	    else {
+		printf("TPM_OrdinalTable_Init: Error (fatal), cannot index ordinal %08x\n",
+		       tpm_ordinal_table[i].ordinal);
+		rc = TPM_FAIL;
+	    }
+	}
+	if (rc == 0) {
+	    tpm_ordinal_index_init = TRUE;
+	}
+	else {
+	    memset(tpm_ordinal_index, 0, sizeof(tpm_ordinal_index));
+	}
+    }
+    return rc;
+}
+
 /* TPM_OrdinalTable_GetEntry() gets the table entry for the ordinal.
 
    If the ordinal is not in the table, TPM_BAD_ORDINAL is returned
 */
 
 TPM_RESULT TPM_OrdinalTable_GetEntry(TPM_ORDINAL_TABLE **entry,
-				     TPM_ORDINAL_TABLE *ordinalTable,
 				     TPM_COMMAND_CODE ordinal)
 {
-    TPM_RESULT	rc = TPM_BAD_ORDINAL;
-    size_t	i;
+    TPM_RESULT	rc = 0;
+    size_t	index;
 
     /* printf(" TPM_OrdinalTable_GetEntry: Ordinal %08x\n", ordinal); */
     *entry = NULL;
-    for (i = 0 ; i < (sizeof(tpm_ordinal_table)/sizeof(TPM_ORDINAL_TABLE)) ; i++) {
-	if (ordinalTable[i].ordinal == ordinal) {	/* if found */
-	    *entry = &(ordinalTable[i]);		/* return the entry */
-	    rc = 0;					/* return found */
-	    break;
+    if (rc == 0) {
+	rc = TPM_OrdinalTable_Index(&index, ordinal);
+    }
+    if (rc == 0) {
+	*entry = tpm_ordinal_index[index];
+	if (*entry == NULL) {
+	    rc = TPM_BAD_ORDINAL;
 	}
     }
     return rc;
@@ -2078,7 +2173,6 @@ TPM_RESULT TPM_OrdinalTable_GetEntry(TPM_ORDINAL_TABLE **entry,
 */
 
 void TPM_OrdinalTable_GetProcessFunction(tpm_process_function_t *tpm_process_function,
-					 TPM_ORDINAL_TABLE *ordinalTable,
 					 TPM_COMMAND_CODE ordinal)
 {
     TPM_RESULT	rc = 0;
@@ -2087,7 +2181,7 @@ void TPM_OrdinalTable_GetProcessFunction(tpm_process_function_t *tpm_process_fun
     printf(" TPM_OrdinalTable_GetProcessFunction: Ordinal %08x\n", ordinal);
 
     if (rc == 0) {
-	rc = TPM_OrdinalTable_GetEntry(&entry, ordinalTable, ordinal);
+	rc = TPM_OrdinalTable_GetEntry(&entry, ordinal);
     }
     if (rc == 0) {	/* if found */
 #ifdef TPM_V12
@@ -2115,7 +2209,7 @@ void TPM_OrdinalTable_GetAuditable(TPM_BOOL *auditable,
     
     printf(" TPM_OrdinalTable_GetAuditable: Ordinal %08x\n", ordinal);
     if (rc == 0) {
-	rc = TPM_OrdinalTable_GetEntry(&entry, tpm_ordinal_table, ordinal);
+	rc = TPM_OrdinalTable_GetEntry(&entry, ordinal);
     }
     /* if not found, unimplemented, not auditable */
     if (rc != 0) {
@@ -2152,7 +2246,7 @@ void TPM_OrdinalTable_GetAuditDefault(TPM_BOOL *auditDefault,
     TPM_ORDINAL_TABLE *entry;
 
     if (rc == 0) {
-	rc = TPM_OrdinalTable_GetEntry(&entry, tpm_ordinal_table, ordinal);
+	rc = TPM_OrdinalTable_GetEntry(&entry, ordinal);
     }
     /* if not found, unimplemented, not auditable */
     if (rc != 0) {
@@ -2178,7 +2272,7 @@ TPM_RESULT TPM_OrdinalTable_GetOwnerPermission(uint16_t *ownerPermissionBlock,
     TPM_ORDINAL_TABLE *entry;
 
     if (rc == 0) {
-	rc = TPM_OrdinalTable_GetEntry(&entry, tpm_ordinal_table, ordinal);
+	rc = TPM_OrdinalTable_GetEntry(&entry, ordinal);
     }
     if (rc == 0) {
 	*ownerPermissionBlock = entry->ownerPermissionBlock;
@@ -2205,7 +2299,7 @@ TPM_RESULT TPM_OrdinalTable_GetKeyPermission(uint16_t *keyPermissionBlock,
     TPM_ORDINAL_TABLE *entry;
 
     if (rc == 0) {
-	rc = TPM_OrdinalTable_GetEntry(&entry, tpm_ordinal_table, ordinal);
+	rc = TPM_OrdinalTable_GetEntry(&entry, ordinal);
     }
     if (rc == 0) {
 	*keyPermissionBlock = entry->keyPermissionBlock;
@@ -2241,7 +2335,7 @@ TPM_RESULT TPM_OrdinalTable_ParseWrappedCmd(uint32_t *datawStart,
 					    uint32_t *keyHandle2Index,
 					    TPM_COMMAND_CODE *ordinal,
 					    TPM_BOOL *transportWrappable,
-					    TPM_SIZED_BUFFER *wrappedCmd)
+					    const TPM_SIZED_BUFFER_VIEW *wrappedCmd)
 {
     TPM_RESULT		rc = 0;
     uint32_t		stream_size;
@@ -2257,7 +2351,7 @@ TPM_RESULT TPM_OrdinalTable_ParseWrappedCmd(uint32_t *datawStart,
     if (rc == 0) {
 	/* make temporary copies so the wrappedCmd is not touched */
 	/* FIXME might want to return paramSize and tag and move the wrappedCmd pointers */
-	stream = wrappedCmd->buffer;
+	stream = (unsigned char *)wrappedCmd->buffer;	/* only read */
 	stream_size = wrappedCmd->size;
 	/* parse the three standard input parameters, check paramSize against wrappedCmd->size */
 	rc = TPM_Process_GetCommandParams(&tag, &paramSize, ordinal,
@@ -2266,7 +2360,7 @@ TPM_RESULT TPM_OrdinalTable_ParseWrappedCmd(uint32_t *datawStart,
     /* get the entry from the ordinal table */
     if (rc == 0) {
 	printf("  TPM_OrdinalTable_ParseWrappedCmd: ordinal %08x\n", *ordinal);
-	rc = TPM_OrdinalTable_GetEntry(&entry, tpm_ordinal_table, *ordinal);
+	rc = TPM_OrdinalTable_GetEntry(&entry, *ordinal);
     }
     if (rc == 0) {
 	/* datawStart indexes into the dataW area, skip the standard 3 inputs and the handles */
@@ -2374,7 +2468,7 @@ TPM_RESULT TPM_OrdinalTable_ParseWrappedRsp(uint32_t *datawStart,
     /* get the entry from the ordinal table */
     if (rc == 0) {
 	printf(" TPM_OrdinalTable_ParseWrappedRsp: returnCode %08x\n", *rcw);
-	rc = TPM_OrdinalTable_GetEntry(&entry, tpm_ordinal_table, ordinal);
+	rc = TPM_OrdinalTable_GetEntry(&entry, ordinal);
     }
     /* parse the success return code case */
     if ((rc == 0) && (*rcw == TPM_SUCCESS)) {
@@ -2420,14 +2514,15 @@ TPM_RESULT TPM_OrdinalTable_ParseWrappedRsp(uint32_t *datawStart,
     return rc;
 }
 
-void TPM_KeyHandleEntries_Trace(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries);
+void TPM_KeyHandleEntries_Trace(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries);
 
-void TPM_KeyHandleEntries_Trace(TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries)
+void TPM_KeyHandleEntries_Trace(TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries)
 {
     size_t i;
-    for (i = 0 ; (i < 4) && (i < TPM_KEY_HANDLES) ; i++) {
+    for (i = 0 ; (i < 4) && (i < tpm_key_handle_entries->keyHandleCount) ; i++) {
 	printf("TPM_KeyHandleEntries_Trace: %lu handle %08x tpm_key %p\n",
-	       (unsigned long)i, tpm_key_handle_entries[i].handle, tpm_key_handle_entries[i].key);
+	       (unsigned long)i, tpm_key_handle_entries->tpm_key_handle_entry[i].handle,
+	       tpm_key_handle_entries->tpm_key_handle_entry[i].key);
     }
     return;
 }
@@ -2472,13 +2567,16 @@ void TPM_State_Trace(tpm_state_t *tpm_state)
    'response_size' - the number of valid bytes in buffer
    
    '*response_total' - the total number of allocated or reallocated bytes
+
+   'targetInstance' is the TPM instance that processes the command.
 */
 
 TPM_RESULT TPM_ProcessA(unsigned char **response,
 			uint32_t *response_size,
 			uint32_t *response_total,
 			unsigned char *command,		/* complete command array */
-			uint32_t command_size)		/* actual bytes in command */
+			uint32_t command_size,		/* actual bytes in command */
+			tpm_state_t *targetInstance)	/* global TPM state */
 
 {
     TPM_RESULT rc = 0;
@@ -2494,11 +2592,10 @@ TPM_RESULT TPM_ProcessA(unsigned char **response,
     if (rc == 0) {
 	rc = TPM_Process(&responseSbuffer,
 			 command,		/* complete command array */
-			 command_size);		/* actual bytes in command */
-
-    }
-    /* get the response parameters from the sbuffer */
-    if (rc == 0) {
+			 command_size,		/* actual bytes in command */
+			 targetInstance);
+	/* get the response parameters from the sbuffer, even on error, since the buffer may have
+	   been reallocated */
 	TPM_Sbuffer_GetAll(&responseSbuffer,
 			   response,
 			   response_size,
@@ -2507,10 +2604,71 @@ TPM_RESULT TPM_ProcessA(unsigned char **response,
     return rc;
 }
 
+/* TPM_ProcessInto() is an alternate to TPM_ProcessA() that serializes the response directly into
+   the caller's 'response' buffer of 'response_total' bytes.  The buffer is never reallocated.
+
+   On output, 'response_size' is the number of valid bytes in the buffer.
+
+   Returns:
+	0 on success
+
+	TPM_SIZE if the buffer is too small.  If it holds at least an error response, the command was
+	processed and the buffer holds a TPM_SIZE error response.  A buffer of TPM_BUFFER_MAX bytes
+	always suffices.
+
+	other non-zero values on a fatal error preventing the command from being processed.  The
+	response is invalid in this case.
+*/
+
+TPM_RESULT TPM_ProcessInto(unsigned char *response,
+			   uint32_t response_total,
+			   uint32_t *response_size,
+			   unsigned char *command,		/* complete command array */
+			   uint32_t command_size,		/* actual bytes in command */
+			   tpm_state_t *targetInstance)		/* global TPM state */
+{
+    TPM_RESULT		rc = 0;
+    TPM_STORE_BUFFER	responseSbuffer;
+    const unsigned char *buffer;
+
+    *response_size = 0;
+    /* the buffer must hold at least an error response */
+    if (rc == 0) {
+	if ((response == NULL) ||
+	    (response_total < (sizeof(TPM_TAG) + sizeof(uint32_t) + sizeof(TPM_RESULT)))) {
+	    TPM_TRACE_ERROR("TPM_ProcessInto: Error, response buffer size %u too small\n",
+			    response_total);
+	    rc = TPM_SIZE;
+	}
+    }
+    if (rc == 0) {
+	TPM_Sbuffer_SetFixed(&responseSbuffer, response, response_total);
+	rc = TPM_Process(&responseSbuffer,
+			 command,		/* complete command array */
+			 command_size,		/* actual bytes in command */
+			 targetInstance);
+    }
+    if (rc == 0) {
+	TPM_Sbuffer_Get(&responseSbuffer, &buffer, response_size);
+	if (responseSbuffer.overflow) {
+	    rc = TPM_SIZE;
+	}
+    }
+    return rc;
+}
+
 /* Process the command from the host to the TPM.
 
    'command_size' is the actual size of the command stream.
 
+   'targetInstance' is the TPM instance that processes the command.  If it is NULL, an error
+   response is returned.
+
+   If 'response' is empty and does not overlap 'command', the ordinal serializes its response
+   directly into it.  Otherwise the response is built in the instance's ordinalResponse buffer and
+   appended after the ordinal completed, so that a caller may pass the same buffer for the command
+   and the response.
+
    Returns:
        0 on success
 
@@ -2520,7 +2678,8 @@ TPM_RESULT TPM_ProcessA(unsigned char **response,
 
 TPM_RESULT TPM_Process(TPM_STORE_BUFFER *response,
 		       unsigned char *command,		/* complete command array */
-		       uint32_t command_size)		/* actual bytes in command */
+		       uint32_t command_size,		/* actual bytes in command */
+		       tpm_state_t *targetInstance)	/* global TPM state */
 {
     TPM_RESULT		rc = 0;				/* fatal error, no response */
     TPM_RESULT		returnCode = TPM_SUCCESS;	/* fatal error in ordinal processing,
@@ -2529,47 +2688,76 @@ TPM_RESULT TPM_Process(TPM_STORE_BUFFER *response,
     uint32_t		paramSize = 0;
     TPM_COMMAND_CODE	ordinal = 0;
     tpm_process_function_t tpm_process_function = NULL;	/* based on ordinal */
-    tpm_state_t		*targetInstance = NULL;		/* TPM global state */
     TPM_STORE_BUFFER	localBuffer;		/* for response if instance was not found */
-    TPM_STORE_BUFFER	*sbuffer;		/* either localBuffer or the instance response
-						   buffer */
+    TPM_STORE_BUFFER	*ordinalResponse;	/* either localBuffer, 'response' or the instance
+						   response buffer */
+    TPM_STATISTICS	*tpm_statistics;	/* NULL if statistics are not collected */
+    uint64_t		startTime;
 
     TPM_Sbuffer_Init(&localBuffer);	/* freed @1 */
-    /* get the global TPM state */
+    ordinalResponse = &localBuffer;
+    /* check the global TPM state */
     if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
-	targetInstance = tpm_instances[0];
+	if (targetInstance == NULL) {
+	    TPM_TRACE_ERROR("TPM_Process: Error, no TPM instance\n");
+	    returnCode = TPM_FAIL;
+	}
     }
     if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
-	/* clear the response form the previous ordinal, the response buffer is reused */
-	TPM_Sbuffer_Clear(&(targetInstance->tpm_stclear_data.ordinalResponse));
+	/* an empty response receives the ordinal response directly, which saves a copy.  A response
+	   buffer overlapping the command would overwrite the command parameters, or free them when
+	   reallocated, while the ordinal still reads them. */
+	if ((response->buffer_current == response->buffer) &&
+	    !TPM_Sbuffer_IsOverlap(response, command, command_size)) {
+	    ordinalResponse = response;
+	}
+	else {
+	    ordinalResponse = &(targetInstance->tpm_stclear_data.ordinalResponse);
+	    /* clear the response form the previous ordinal, the response buffer is reused */
+	    TPM_Sbuffer_Clear(ordinalResponse);
+	}
 	/* extract the standard command parameters from the command stream */
 	returnCode = TPM_Process_GetCommandParams(&tag, &paramSize, &ordinal,
 						  &command, &command_size);
     }	 
-    /* preprocessing common to all ordinals */
+    /* preprocessing common to all ordinals.  The statistics sample starts before it, so that
+       commands rejected by the preprocessing are counted as errors of their ordinal. */
     if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
+	TPM_Statistics_Begin(&tpm_statistics, &startTime, targetInstance);
 	returnCode = TPM_Process_Preprocess(targetInstance, ordinal, NULL);
+	if (returnCode != TPM_SUCCESS) {
+	    TPM_Statistics_End(tpm_statistics, startTime, ordinal, returnCode, ordinalResponse);
+	}
     }
-    /* NOTE Only for debugging */
     if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
-	TPM_KeyHandleEntries_Trace(targetInstance->tpm_key_handle_entries);
+	TPM_TRACE_INFO("TPM_Process: Ordinal %08x\n", ordinal);
+    }
+    /* NOTE Only for debugging */
+    if ((rc == 0) && (returnCode == TPM_SUCCESS) &&
+	TPM_TRACE_ENABLED(TPMLIB_TRACE_LEVEL_DEBUG, TPM_TRACE_CATEGORY)) {
+	TPM_KeyHandleEntries_Trace(&(targetInstance->tpm_key_handle_entries));
     }
     /* process the ordinal */
     if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
 	/* get the processing function from the ordinal table */
-	TPM_OrdinalTable_GetProcessFunction(&tpm_process_function, tpm_ordinal_table, ordinal);
+	TPM_OrdinalTable_GetProcessFunction(&tpm_process_function, ordinal);
+	TPM_Arena_Begin(&(targetInstance->tpm_arena));
+	TPM_SlabPool_Begin(&(targetInstance->tpm_slab_pool));
+	/* write the permanent state at most once for the command, after processing it */
+	targetInstance->tpm_nv_coalesce = TRUE;
 	/* call the processing function to execute the command */
-	returnCode = tpm_process_function(targetInstance,
-					  &(targetInstance->tpm_stclear_data.ordinalResponse),
+	returnCode = tpm_process_function(targetInstance, ordinalResponse,
 					  tag, command_size, ordinal, command,
 					  NULL);	/* not from encrypted transport */
+	returnCode = TPM_PermanentAll_NVFlush(targetInstance, returnCode);
+	TPM_SlabPool_End(&(targetInstance->tpm_slab_pool));
+	TPM_Arena_End(&(targetInstance->tpm_arena));
+	TPM_Statistics_End(tpm_statistics, startTime, ordinal, returnCode, ordinalResponse);
     }
     /* NOTE Only for debugging */
-    if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
-	TPM_KeyHandleEntries_Trace(targetInstance->tpm_key_handle_entries);
-    }
-    /* NOTE Only for debugging */
-    if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
+    if ((rc == 0) && (returnCode == TPM_SUCCESS) &&
+	TPM_TRACE_ENABLED(TPMLIB_TRACE_LEVEL_DEBUG, TPM_TRACE_CATEGORY)) {
+	TPM_KeyHandleEntries_Trace(&(targetInstance->tpm_key_handle_entries));
 	TPM_State_Trace(targetInstance);
     }
 #ifdef TPM_VOLATILE_STORE
@@ -2580,9 +2768,8 @@ TPM_RESULT TPM_Process(TPM_STORE_BUFFER *response,
 #endif	/* TPM_VOLATILE_STORE */
     /* If the ordinal processing function returned without a fatal error, append its ordinalResponse
        to the output response buffer */
-    if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
-	returnCode = TPM_Sbuffer_AppendSBuffer(response,
-					       &(targetInstance->tpm_stclear_data.ordinalResponse));
+    if ((rc == 0) && (returnCode == TPM_SUCCESS) && (ordinalResponse != response)) {
+	returnCode = TPM_Sbuffer_AppendSBuffer(response, ordinalResponse);
     }
     if ((rc == 0) && (returnCode != TPM_SUCCESS)) {
 	/* gets here if:
@@ -2594,29 +2781,24 @@ TPM_RESULT TPM_Process(TPM_STORE_BUFFER *response,
 	   returnCode should be the response
 	   errors here are fatal, can't create an error response
 	*/
-	/* if it failed after the target instance was found, use the instance's response buffer */
-	if (targetInstance != NULL) {
-	    sbuffer = &(targetInstance->tpm_stclear_data.ordinalResponse);
-	}
-	/* if it failed before even the target instance was found, use a local buffer */
-	else {
-	    sbuffer = &localBuffer;
-	}
+	/* if it failed before even the target instance was found, ordinalResponse is the local
+	   buffer */
 	if (rc == 0) {
 	    /* it's not even known whether the initial response was stored, so just start
 	       over */
-	    TPM_Sbuffer_Clear(sbuffer);
+	    TPM_Sbuffer_Clear(ordinalResponse);
 	    /* store the tag, paramSize, and returnCode */
-	    printf("TPM_Process: Ordinal returnCode %08x %u\n",
-		   returnCode, returnCode);
-	    rc = TPM_Sbuffer_StoreInitialResponse(sbuffer, TPM_TAG_RQU_COMMAND, returnCode);
+	    TPM_TRACE_ERROR("TPM_Process: Ordinal %08x returnCode %08x %u\n",
+			    ordinal, returnCode, returnCode);
+	    rc = TPM_Sbuffer_StoreInitialResponse(ordinalResponse, TPM_TAG_RQU_COMMAND,
+						  returnCode);
 	}
 	/* call this to handle the TPM_FAIL causing the TPM going into failure mode */
 	if (rc == 0) {
-	    rc = TPM_Sbuffer_StoreFinalResponse(sbuffer, returnCode, targetInstance);
+	    rc = TPM_Sbuffer_StoreFinalResponse(ordinalResponse, returnCode, targetInstance);
 	}
-	if (rc == 0) {
-	    rc = TPM_Sbuffer_AppendSBuffer(response, sbuffer);
+	if ((rc == 0) && (ordinalResponse != response)) {
+	    rc = TPM_Sbuffer_AppendSBuffer(response, ordinalResponse);
 	}
     }
     /*
@@ -2677,7 +2859,7 @@ TPM_RESULT TPM_Process_Wrapped(TPM_STORE_BUFFER *response,
     /* process the ordinal */
     if ((rc == 0) && (returnCode == TPM_SUCCESS)) {
 	/* get the processing function from the ordinal table */
-	TPM_OrdinalTable_GetProcessFunction(&tpm_process_function, tpm_ordinal_table, ordinal);
+	TPM_OrdinalTable_GetProcessFunction(&tpm_process_function, ordinal);
 	/* call the processing function to execute the command */
 	returnCode = tpm_process_function(targetInstance, &ordinalResponse,
 					  tag, command_size, ordinal, command,
@@ -3632,11 +3814,11 @@ TPM_RESULT TPM_GetCapabilityCommon(TPM_STORE_BUFFER *capabilityResponse,
 	/* This is command is available for backwards compatibility. It is the same as
 	   TPM_CAP_HANDLE with a resource type of keys. */
 	rc = TPM_KeyHandleEntries_StoreHandles(capabilityResponse,
-					       tpm_state->tpm_key_handle_entries);
+					       &(tpm_state->tpm_key_handle_entries));
 	break;
       case TPM_CAP_CHECK_LOADED: 
 	rc = TPM_GetCapability_CapCheckLoaded(capabilityResponse,
-					      tpm_state->tpm_key_handle_entries,
+					      &(tpm_state->tpm_key_handle_entries),
 					      subCap);
 	break;
       case TPM_CAP_SYM_MODE:
@@ -3651,7 +3833,7 @@ TPM_RESULT TPM_GetCapabilityCommon(TPM_STORE_BUFFER *capabilityResponse,
       case TPM_CAP_KEY_STATUS: 
 	if (subCap->size == sizeof(uint32_t)) {
 	    rc = TPM_GetCapability_CapKeyStatus(capabilityResponse,
-						tpm_state->tpm_key_handle_entries,
+						&(tpm_state->tpm_key_handle_entries),
 						subCap32);
 	}
 	else {
@@ -3744,7 +3926,7 @@ static TPM_RESULT TPM_GetCapability_CapOrd(TPM_STORE_BUFFER *capabilityResponse,
     tpm_process_function_t	tpm_process_function;
     TPM_BOOL			supported;
 
-    TPM_OrdinalTable_GetProcessFunction(&tpm_process_function, tpm_ordinal_table, ordinal);
+    TPM_OrdinalTable_GetProcessFunction(&tpm_process_function, ordinal);
     /* determine of the ordinal is supported */
     if (tpm_process_function != TPM_Process_Unused) {
 	supported = TRUE;
@@ -3882,7 +4064,7 @@ static TPM_RESULT TPM_GetCapability_CapProperty(TPM_STORE_BUFFER *capabilityResp
 	break;
       case TPM_CAP_PROP_KEYS:	/* Returns the number of 2048-bit RSA keys that can be loaded. This
 				   MAY vary with time and circumstances. */
-	TPM_KeyHandleEntries_GetSpace(&uint32, tpm_state->tpm_key_handle_entries);
+	TPM_KeyHandleEntries_GetSpace(&uint32, &(tpm_state->tpm_key_handle_entries));
 	printf(" TPM_GetCapability_CapProperty: TPM_CAP_PROP_KEYS %u\n", uint32);
 	rc = TPM_Sbuffer_Append32(capabilityResponse, uint32);
 	break;
@@ -3930,8 +4112,11 @@ static TPM_RESULT TPM_GetCapability_CapProperty(TPM_STORE_BUFFER *capabilityResp
 	break;
       case TPM_CAP_PROP_MAX_KEYS:	/* The maximum number of 2048 RSA keys that the TPM can
 					   support. The number does not include the EK or SRK. */
-	printf(" TPM_GetCapability_CapProperty: TPM_CAP_PROP_MAX_KEYS %u\n", TPM_KEY_HANDLES);
-	rc = TPM_Sbuffer_Append32(capabilityResponse, TPM_KEY_HANDLES);
+	/* swapped keys count as loaded */
+	uint32 = TPM_KeyHandleEntries_GetMaxKeys(tpm_state->tpm_key_handle_entries.keyHandleCount,
+						 tpm_state->tpm_key_handle_entries.keySwap);
+	printf(" TPM_GetCapability_CapProperty: TPM_CAP_PROP_MAX_KEYS %u\n", uint32);
+	rc = TPM_Sbuffer_Append32(capabilityResponse, uint32);
 	break;
       case TPM_CAP_PROP_OWNER:	/* A value of TRUE indicates that the TPM has successfully installed
 				   an owner. */
@@ -4098,7 +4283,7 @@ static TPM_RESULT TPM_GetCapability_CapVersion(TPM_STORE_BUFFER *capabilityRespo
 */
 
 static TPM_RESULT TPM_GetCapability_CapCheckLoaded(TPM_STORE_BUFFER *capabilityResponse,
-						   const TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry,
+						   const TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
 						   TPM_SIZED_BUFFER *subCap)
 {
     TPM_RESULT		rc = 0;
@@ -4117,7 +4302,7 @@ static TPM_RESULT TPM_GetCapability_CapCheckLoaded(TPM_STORE_BUFFER *capabilityR
     }
     if (rc == 0) {
 	if (keyParms.algorithmID == TPM_ALG_RSA) {
-	    TPM_KeyHandleEntries_IsSpace(&isSpace, &index, tpm_key_handle_entry);
+	    TPM_KeyHandleEntries_IsSpace(&isSpace, &index, tpm_key_handle_entries);
 	}
 	else {
 	    printf(" TPM_GetCapability_CapCheckLoaded: algorithmID %08x is not TPM_ALG_RSA %08x\n",
@@ -4152,7 +4337,7 @@ static TPM_RESULT TPM_GetCapability_CapSymMode(TPM_STORE_BUFFER *capabilityRespo
  */
 
 static TPM_RESULT TPM_GetCapability_CapKeyStatus(TPM_STORE_BUFFER *capabilityResponse,
-						 TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entries,
+						 TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries,
 						 uint32_t tpm_key_handle)
 {
     TPM_RESULT			rc = 0;
@@ -4301,7 +4486,7 @@ static TPM_RESULT TPM_GetCapability_CapHandle(TPM_STORE_BUFFER *capabilityRespon
       case TPM_RT_KEY:
 	printf("  TPM_GetCapability_CapHandle: TPM_RT_KEY\n");
 	rc = TPM_KeyHandleEntries_StoreHandles(capabilityResponse,
-					       tpm_state->tpm_key_handle_entries);
+					       &(tpm_state->tpm_key_handle_entries));
 	break;
       case TPM_RT_AUTH:
 	printf("  TPM_GetCapability_CapHandle: TPM_RT_AUTH\n");
@@ -97,10 +97,18 @@ TPM_RESULT TPM_ProcessA(unsigned char **response,
 			uint32_t *response_size,
 			uint32_t *response_total,
 			unsigned char *command,
-			uint32_t command_size);
+			uint32_t command_size,
+			tpm_state_t *targetInstance);
+TPM_RESULT TPM_ProcessInto(unsigned char *response,
+			   uint32_t response_total,
+			   uint32_t *response_size,
+			   unsigned char *command,
+			   uint32_t command_size,
+			   tpm_state_t *targetInstance);
 TPM_RESULT TPM_Process(TPM_STORE_BUFFER *response,
                        unsigned char *command,
-                       uint32_t command_size);
+                       uint32_t command_size,
+                       tpm_state_t *targetInstance);
 TPM_RESULT TPM_Process_Wrapped(TPM_STORE_BUFFER *response,
                                unsigned char *command,
                                uint32_t command_size,
@@ -225,11 +233,17 @@ typedef struct tdTPM_ORDINAL_TABLE {
                                                            hardware TPM instance  */
 } TPM_ORDINAL_TABLE;
 
+/* ordinals 0x00-0xff and the connection commands 0x40000000-0x400000ff */
+#define TPM_ORDINAL_INDEX_SIZE 0x200
+
+TPM_RESULT TPM_OrdinalTable_Init(void);
+TPM_RESULT TPM_OrdinalTable_Index(size_t *index,
+                                  TPM_COMMAND_CODE ordinal);
+void       TPM_OrdinalTable_IndexOrdinal(TPM_COMMAND_CODE *ordinal,
+                                         size_t index);
 TPM_RESULT TPM_OrdinalTable_GetEntry(TPM_ORDINAL_TABLE **entry,
-                                     TPM_ORDINAL_TABLE *ordinalTable,
                                      TPM_COMMAND_CODE ordinal);
 void       TPM_OrdinalTable_GetProcessFunction(tpm_process_function_t *tpm_process_function,
-                                               TPM_ORDINAL_TABLE *ordinalTable,
                                                TPM_COMMAND_CODE ordinal);
 void       TPM_OrdinalTable_GetAuditable(TPM_BOOL *auditable,
                                          TPM_COMMAND_CODE ordinal);
@@ -248,7 +262,7 @@ TPM_RESULT TPM_OrdinalTable_ParseWrappedCmd(uint32_t *datawStart,
                                             uint32_t *keyHandle2Index,
                                             TPM_COMMAND_CODE *ordinal,
                                             TPM_BOOL *transportWrappable,
-                                            TPM_SIZED_BUFFER *wrappedCmd);
+                                            const TPM_SIZED_BUFFER_VIEW *wrappedCmd);
 TPM_RESULT TPM_OrdinalTable_ParseWrappedRsp(uint32_t *datawStart,
                                             uint32_t *datawLen,
                                             TPM_RESULT *rcw,
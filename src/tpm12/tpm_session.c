@@ -46,6 +46,7 @@
 #include "tpm_crypto.h"
 #include "tpm_cryptoh.h"
 #include "tpm_daa.h"
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_SESSION
 #include "tpm_debug.h"
 #include "tpm_delegate.h"
 #include "tpm_digest.h"
@@ -59,6 +60,7 @@
 #include "tpm_process.h"
 #include "tpm_permanent.h"
 #include "tpm_secret.h"
+#include "tpm_slab.h"
 #include "tpm_transport.h"
 #include "tpm_types.h"
 
@@ -110,6 +112,7 @@ void TPM_AuthSessionData_Init(TPM_AUTH_SESSION_DATA *tpm_auth_session_data)
     TPM_Secret_Init(tpm_auth_session_data->sharedSecret);
     TPM_Digest_Init(tpm_auth_session_data->entityDigest);
     TPM_DelegatePublic_Init(&(tpm_auth_session_data->pub));
+    TPM_HmacState_Init(&(tpm_auth_session_data->hmacState));
     tpm_auth_session_data->valid = FALSE;
     return;
 }
@@ -217,6 +220,20 @@ TPM_RESULT TPM_AuthSessionData_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_AuthSessionData_SizeOf() returns the number of bytes TPM_AuthSessionData_Store() serializes */
+
+uint32_t TPM_AuthSessionData_SizeOf(const TPM_AUTH_SESSION_DATA *tpm_auth_session_data)
+{
+    return sizeof(TPM_HANDLE) +
+	sizeof(TPM_PROTOCOL_ID) +
+	sizeof(BYTE) +				/* entityTypeByte */
+	sizeof(BYTE) +				/* adipEncScheme */
+	TPM_NONCE_SIZE +			/* nonceEven */
+	TPM_NONCE_SIZE +			/* sharedSecret */
+	TPM_DIGEST_SIZE +			/* entityDigest */
+	TPM_DelegatePublic_SizeOf(&(tpm_auth_session_data->pub));
+}
+
 /* TPM_AuthSessionData_Delete()
 
    No-OP if the parameter is NULL, else:
@@ -231,6 +248,7 @@ void TPM_AuthSessionData_Delete(TPM_AUTH_SESSION_DATA *tpm_auth_session_data)
     printf(" TPM_AuthSessionData_Delete:\n");
     if (tpm_auth_session_data != NULL) {
 	TPM_DelegatePublic_Delete(&(tpm_auth_session_data->pub));
+	TPM_HmacState_Delete(&(tpm_auth_session_data->hmacState));
 	TPM_AuthSessionData_Init(tpm_auth_session_data);
     }
     return;
@@ -252,6 +270,7 @@ void TPM_AuthSessionData_Copy(TPM_AUTH_SESSION_DATA *dest_auth_session_data,
     TPM_Secret_Copy(dest_auth_session_data->sharedSecret, src_auth_session_data->sharedSecret);
     TPM_Digest_Copy(dest_auth_session_data->entityDigest, src_auth_session_data->entityDigest);
     TPM_DelegatePublic_Copy(&(dest_auth_session_data->pub), &(src_auth_session_data->pub));
+    TPM_HmacState_Init(&(dest_auth_session_data->hmacState));
     dest_auth_session_data->valid= src_auth_session_data->valid;
 }
 
@@ -493,6 +512,22 @@ TPM_RESULT TPM_AuthSessions_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_AuthSessions_SizeOf() returns the number of bytes TPM_AuthSessions_Store() serializes */
+
+uint32_t TPM_AuthSessions_SizeOf(TPM_AUTH_SESSION_DATA *authSessions)
+{
+    uint32_t	size;
+    size_t	i;
+
+    size = sizeof(uint32_t);			/* activeCount */
+    for (i = 0 ; i < TPM_MIN_AUTH_SESSIONS ; i++) {
+	if ((authSessions[i]).valid) {
+	    size += TPM_AuthSessionData_SizeOf(&(authSessions[i]));
+	}
+    }
+    return size;
+}
+
 /* TPM_AuthSessions_Delete() terminates all sessions
 
 */
@@ -1062,6 +1097,13 @@ TPM_RESULT TPM_ContextList_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_ContextList_SizeOf() returns the number of bytes TPM_ContextList_Store() serializes */
+
+uint32_t TPM_ContextList_SizeOf(void)
+{
+    return TPM_MIN_SESSION_LIST * sizeof(uint32_t);
+}
+
 /* TPM_ContextList_GetSpace() returns 'space', the number of unused context list entries.
 
    If 'space' is non-zero, 'entry' points to the first unused index.
@@ -2900,7 +2942,7 @@ TPM_RESULT TPM_Process_FlushSpecific(tpm_state_t *tpm_state,
 	    if (returnCode == TPM_SUCCESS) {
 		printf("TPM_Process_FlushSpecific: Flushing key handle %08x\n", handle);
 		returnCode = TPM_KeyHandleEntries_GetEntry(&tpm_key_handle_entry,
-							   tpm_state->tpm_key_handle_entries,
+							   &(tpm_state->tpm_key_handle_entries),
 							   handle);
 		/* 7. Validate that R1 determined by resourceType and handle points to a valid
 		   allocated resource.	Return TPM_BAD_PARAMETER on error. */
@@ -3137,7 +3179,7 @@ TPM_RESULT TPM_Process_SaveContext(tpm_state_t *tpm_state,
 	    printf("TPM_Process_SaveContext: Resource is key handle %08x\n", handle);
 	    /* check if the key handle is valid */
 	    returnCode = TPM_KeyHandleEntries_GetEntry(&tpm_key_handle_entry,
-						       tpm_state->tpm_key_handle_entries,
+						       &(tpm_state->tpm_key_handle_entries),
 						       handle);
 	    break;
 	  case TPM_RT_AUTH:
@@ -3745,7 +3787,7 @@ TPM_RESULT TPM_Process_LoadContext(tpm_state_t *tpm_state,
 	  case TPM_RT_KEY:
 	    returnCode = TPM_KeyHandleEntries_AddEntry(&(b1ContextBlob.handle),
 						       keepHandle,
-						       tpm_state->tpm_key_handle_entries,
+						       &(tpm_state->tpm_key_handle_entries),
 						       &tpm_key_handle_entry);
 	    key_added = TRUE;
 	    break;
@@ -3824,11 +3866,11 @@ TPM_RESULT TPM_Process_LoadContext(tpm_state_t *tpm_state,
     /* if there was a failure, roll back */
     if ((rcf != 0) || (returnCode != TPM_SUCCESS)) {
 	TPM_Key_Delete(tpm_key_handle_entry.key);	/* free on error */
-	free(tpm_key_handle_entry.key);			/* free on error */
+	TPM_Slab_Free(tpm_key_handle_entry.key);	/* free on error */
 	if (key_added) {
 	    /* if there was a failure and inKey was stored in the handle list, free the handle.
 	       Ignore errors, since only one error code can be returned. */
-	    TPM_KeyHandleEntries_DeleteHandle(tpm_state->tpm_key_handle_entries,
+	    TPM_KeyHandleEntries_DeleteHandle(&(tpm_state->tpm_key_handle_entries),
 					      b1ContextBlob.handle);
 	}
 	if (auth_session_added) {
@@ -3881,7 +3923,7 @@ static TPM_RESULT TPM_LoadContext_CheckKeyLoaded(tpm_state_t *tpm_state,
     /* normal case, key is in the key handle list */
     else {
 	rc = TPM_KeyHandleEntries_GetEntry(&key_handle_entry,
-					   tpm_state->tpm_key_handle_entries,
+					   &(tpm_state->tpm_key_handle_entries),
 					   entityHandle);
 	if (rc == 0) {
 	    TPM_Digest_Copy(entityDigest, key_handle_entry->key->tpm_store_asymkey->pubDataDigest);
@@ -3917,7 +3959,7 @@ static TPM_RESULT TPM_LoadContext_CheckKeyLoadedByDigest(tpm_state_t *tpm_state,
 	   /* returns TPM_RETRY when at the end of the table, terminates loop */
 	   (TPM_KeyHandleEntries_GetNextEntry(&key_handle_entry,
 					      &current,
-					      tpm_state->tpm_key_handle_entries,
+					      &(tpm_state->tpm_key_handle_entries),
 					      start)) == 0) {
 	
 
@@ -4211,7 +4253,7 @@ TPM_RESULT TPM_Process_KeyControlOwner(tpm_state_t *tpm_state,
     /* get the key corresponding to the keyHandle parameter */
     if (returnCode == TPM_SUCCESS) {
 	returnCode = TPM_KeyHandleEntries_GetEntry(&tpm_key_handle_entry,
-						   tpm_state->tpm_key_handle_entries,
+						   &(tpm_state->tpm_key_handle_entries),
 						   keyHandle);
 	if (returnCode != TPM_SUCCESS) {
 	    printf("TPM_Process_KeyControlOwner: Error, key handle not loaded\n");
@@ -4260,7 +4302,7 @@ TPM_RESULT TPM_Process_KeyControlOwner(tpm_state_t *tpm_state,
 		       OwnerEvict bit set, on error return TPM_NOSPACE */
 		    if (returnCode == TPM_SUCCESS) {
 			TPM_KeyHandleEntries_IsEvictSpace(&isSpace,
-							  tpm_state->tpm_key_handle_entries,
+							  &(tpm_state->tpm_key_handle_entries),
 							  2);	/* minSpace */
 			if (!isSpace) {
 			    printf("TPM_Process_KeyControlOwner: Error, "
@@ -4282,7 +4324,7 @@ TPM_RESULT TPM_Process_KeyControlOwner(tpm_state_t *tpm_state,
 		    if (returnCode == TPM_SUCCESS) {
 			returnCode = TPM_KeyHandleEntries_OwnerEvictGetCount
 				     (&ownerEvictCount,
-				      tpm_state->tpm_key_handle_entries);
+				      &(tpm_state->tpm_key_handle_entries));
 		    }
 		    /* check that the number of owner evict key slots will not be exceeded */
 		    if (returnCode == TPM_SUCCESS) {
@@ -4510,7 +4552,7 @@ TPM_RESULT TPM_Process_SaveKeyContext(tpm_state_t *tpm_state,
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_SaveKeyContext: Handle %08x\n", keyHandle);
 	returnCode = TPM_KeyHandleEntries_GetEntry(&tpm_key_handle_entry,
-						   tpm_state->tpm_key_handle_entries,
+						   &(tpm_state->tpm_key_handle_entries),
 						   keyHandle);
     }
     /* use the contextNonceKey to invalidate a blob at power up */
@@ -4809,7 +4851,7 @@ TPM_RESULT TPM_Process_LoadKeyContext(tpm_state_t *tpm_state,
 	       keyContextBlob.handle);
 	/* check if the key handle is free */
 	getRc = TPM_KeyHandleEntries_GetEntry(&used_key_handle_entry,
-					      tpm_state->tpm_key_handle_entries,
+					      &(tpm_state->tpm_key_handle_entries),
 					      keyContextBlob.handle);
 	/* GetEntry TPM_SUCCESS means the handle is already used */
 	if (getRc == TPM_SUCCESS) {
@@ -4824,7 +4866,7 @@ TPM_RESULT TPM_Process_LoadKeyContext(tpm_state_t *tpm_state,
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_LoadKeyContext: Checking for table space\n");
 	TPM_KeyHandleEntries_IsSpace(&isSpace, &index,
-				     tpm_state->tpm_key_handle_entries);
+				     &(tpm_state->tpm_key_handle_entries));
 	/* if there is no space, return error */
 	if (!isSpace) {
 	    printf("TPM_Process_LoadKeyContext: Error, no room in table\n");
@@ -4836,7 +4878,7 @@ TPM_RESULT TPM_Process_LoadKeyContext(tpm_state_t *tpm_state,
 	printf("TPM_Process_LoadKeyContext: Adding entry to table\n");
 	returnCode = TPM_KeyHandleEntries_AddEntry(&keyHandle,
 						   FALSE,		/* keep handle */
-						   tpm_state->tpm_key_handle_entries,
+						   &(tpm_state->tpm_key_handle_entries),
 						   &tpm_key_handle_entry);
 	key_added = TRUE;
     }
@@ -4890,11 +4932,11 @@ TPM_RESULT TPM_Process_LoadKeyContext(tpm_state_t *tpm_state,
     /* if there was a failure, roll back */
     if ((rcf != 0) || (returnCode != TPM_SUCCESS)) {
 	TPM_Key_Delete(tpm_key_handle_entry.key);	/* @5 */
-	free(tpm_key_handle_entry.key);			/* @5 */
+	TPM_Slab_Free(tpm_key_handle_entry.key);	/* @5 */
 	if (key_added) {
 	    /* if there was a failure and a key was stored in the handle list, free the handle.
 	       Ignore errors, since only one error code can be returned. */
-	    TPM_KeyHandleEntries_DeleteHandle(tpm_state->tpm_key_handle_entries, keyHandle);
+	    TPM_KeyHandleEntries_DeleteHandle(&(tpm_state->tpm_key_handle_entries), keyHandle);
 	}
     }
     return rcf;
@@ -54,6 +54,7 @@ TPM_RESULT TPM_AuthSessions_Load(TPM_AUTH_SESSION_DATA *authSessions,
                                  uint32_t *stream_size);
 TPM_RESULT TPM_AuthSessions_Store(TPM_STORE_BUFFER *sbuffer,
                                   TPM_AUTH_SESSION_DATA *authSessions);
+uint32_t   TPM_AuthSessions_SizeOf(TPM_AUTH_SESSION_DATA *authSessions);
 void       TPM_AuthSessions_Delete(TPM_AUTH_SESSION_DATA *authSessions);
 
 
@@ -107,6 +108,7 @@ TPM_RESULT TPM_AuthSessionData_Load(TPM_AUTH_SESSION_DATA *tpm_auth_session_data
                                     uint32_t *stream_size);
 TPM_RESULT TPM_AuthSessionData_Store(TPM_STORE_BUFFER *sbuffer,
                                      const TPM_AUTH_SESSION_DATA *tpm_auth_session_data);
+uint32_t   TPM_AuthSessionData_SizeOf(const TPM_AUTH_SESSION_DATA *tpm_auth_session_data);
 void       TPM_AuthSessionData_Delete(TPM_AUTH_SESSION_DATA *tpm_auth_session_data);
 
 
@@ -135,6 +137,7 @@ TPM_RESULT TPM_ContextList_Load(uint32_t *contextList,
                                 uint32_t *stream_size);
 TPM_RESULT TPM_ContextList_Store(TPM_STORE_BUFFER *sbuffer,
                                  const uint32_t *contextList);
+uint32_t   TPM_ContextList_SizeOf(void);
 
 TPM_RESULT TPM_ContextList_StoreHandles(TPM_STORE_BUFFER *sbuffer,
                                         const uint32_t *contextList);
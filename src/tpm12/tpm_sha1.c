@@ -0,0 +1,450 @@
+/********************************************************************************/
+/*										*/
+/*				SHA-1 Engine					*/
+/*		       IBM Thomas J. Watson Research Center			*/
+/*										*/
+/* (c) Copyright IBM Corporation 2015.						*/
+/*										*/
+/* All rights reserved.								*/
+/* 										*/
+/* Redistribution and use in source and binary forms, with or without		*/
+/* modification, are permitted provided that the following conditions are	*/
+/* met:										*/
+/* 										*/
+/* Redistributions of source code must retain the above copyright notice,	*/
+/* this list of conditions and the following disclaimer.			*/
+/* 										*/
+/* Redistributions in binary form must reproduce the above copyright		*/
+/* notice, this list of conditions and the following disclaimer in the		*/
+/* documentation and/or other materials provided with the distribution.		*/
+/* 										*/
+/* Neither the names of the IBM Corporation nor the names of its		*/
+/* contributors may be used to endorse or promote products derived from		*/
+/* this software without specific prior written permission.			*/
+/* 										*/
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS		*/
+/* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT		*/
+/* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR	*/
+/* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT		*/
+/* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,	*/
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT		*/
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,	*/
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY	*/
+/* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT		*/
+/* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE	*/
+/* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
+/********************************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_CRYPTO
+#include "tpm_debug.h"
+#include "tpm_error.h"
+
+#include "tpm_sha1.h"
+
+/* The built-in SHA-1 engine hashes without allocating a context and without going through the
+   crypto library, which is what the HMAC, MGF1, OAEP and digest paths need.
+
+   The compression function is selected once at runtime.  On x86 processors with the SHA
+   extensions, these are used.  Otherwise the portable C implementation is used.
+
+   The crypto library SHA-1 functions are still used where the context is serialized, see
+   TPM_Sha1Context_Store().
+*/
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ >= 5)))
+#define TPM_SHA1_X86_SHA
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+/* a compression function hashes 'blocks' blocks of TPM_SHA1_BLOCK_SIZE bytes into 'h' */
+
+typedef void (*TPM_SHA1_BLOCKS_FUNCTION)(uint32_t *h, const unsigned char *data, size_t blocks);
+
+static void TPM_SHA1_Blocks(uint32_t *h, const unsigned char *data, size_t blocks);
+#ifdef TPM_SHA1_X86_SHA
+static void TPM_SHA1_BlocksX86(uint32_t *h, const unsigned char *data, size_t blocks);
+#endif
+static void TPM_SHA1_Select(void);
+
+static const uint32_t tpm_sha1_h0[TPM_SHA1_STATE_WORDS] = {
+    0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+};
+
+static TPM_SHA1_BLOCKS_FUNCTION tpm_sha1_blocks = TPM_SHA1_Blocks;
+static pthread_once_t tpm_sha1_once = PTHREAD_ONCE_INIT;
+
+/* TPM_SHA1_Select() selects the compression function for this processor */
+
+static void TPM_SHA1_Select(void)
+{
+#ifdef TPM_SHA1_X86_SHA
+    unsigned int eax, ebx, ecx, edx;
+    TPM_BOOL sse = FALSE;
+
+    /* leaf 1: SSSE3 and SSE4.1 */
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+	sse = ((ecx & (1 << 9)) != 0) && ((ecx & (1 << 19)) != 0);
+    }
+    /* leaf 7: SHA */
+    if (sse && (__get_cpuid_max(0, NULL) >= 7)) {
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	if ((ebx & (1 << 29)) != 0) {
+	    printf(" TPM_SHA1_Select: Using the x86 SHA extensions\n");
+	    tpm_sha1_blocks = TPM_SHA1_BlocksX86;
+	}
+    }
+#endif
+    return;
+}
+
+/* TPM_SHA1Ctx_Init() initializes the context for a new hash */
+
+void TPM_SHA1Ctx_Init(TPM_SHA1_CTX *ctx)
+{
+    TPM_SHA1Ctx_SetState(ctx, tpm_sha1_h0, 0);
+    return;
+}
+
+/* TPM_SHA1Ctx_SetState() initializes the context to continue from the chaining value 'state',
+   after 'length' bytes, a multiple of the block size, were hashed.
+*/
+
+void TPM_SHA1Ctx_SetState(TPM_SHA1_CTX *ctx,
+			  const uint32_t *state,
+			  uint32_t length)
+{
+    pthread_once(&tpm_sha1_once, TPM_SHA1_Select);
+    memcpy(ctx->h, state, sizeof(ctx->h));
+    ctx->length = length;
+    ctx->num = 0;
+    return;
+}
+
+/* TPM_SHA1Ctx_GetState() gets the chaining value from the context.  The context must have hashed a
+   multiple of the block size, so that no data is buffered.
+*/
+
+TPM_RESULT TPM_SHA1Ctx_GetState(uint32_t *state,
+				const TPM_SHA1_CTX *ctx)
+{
+    TPM_RESULT	rc = 0;
+
+    if (ctx->num != 0) {
+	printf("TPM_SHA1Ctx_GetState: Error (fatal), %u bytes buffered\n", ctx->num);
+	rc = TPM_FAIL;
+    }
+    if (rc == 0) {
+	memcpy(state, ctx->h, sizeof(ctx->h));
+    }
+    return rc;
+}
+
+/* TPM_SHA1Ctx_Update() adds 'length' bytes of 'data' to the hash */
+
+void TPM_SHA1Ctx_Update(TPM_SHA1_CTX *ctx,
+			const unsigned char *data,
+			uint32_t length)
+{
+    uint32_t	n;
+    size_t	blocks;
+
+    ctx->length += length;
+    /* complete a partial block */
+    if (ctx->num != 0) {
+	n = TPM_SHA1_BLOCK_SIZE - ctx->num;
+	if (length < n) {
+	    n = length;
+	}
+	memcpy(ctx->block + ctx->num, data, n);
+	ctx->num += n;
+	data += n;
+	length -= n;
+	if (ctx->num < TPM_SHA1_BLOCK_SIZE) {
+	    return;
+	}
+	tpm_sha1_blocks(ctx->h, ctx->block, 1);
+	ctx->num = 0;
+    }
+    /* hash full blocks directly from the caller's buffer */
+    blocks = length / TPM_SHA1_BLOCK_SIZE;
+    if (blocks != 0) {
+	tpm_sha1_blocks(ctx->h, data, blocks);
+	data += blocks * TPM_SHA1_BLOCK_SIZE;
+	length -= blocks * TPM_SHA1_BLOCK_SIZE;
+    }
+    /* buffer the rest */
+    if (length != 0) {
+	memcpy(ctx->block, data, length);
+    }
+    ctx->num = length;
+    return;
+}
+
+/* TPM_SHA1Ctx_Final() pads the hash and returns the digest 'md'.  The context is cleared.
+ */
+
+void TPM_SHA1Ctx_Final(TPM_DIGEST md,
+		       TPM_SHA1_CTX *ctx)
+{
+    uint64_t	bits = ctx->length << 3;
+    size_t	i;
+
+    ctx->block[ctx->num++] = 0x80;
+    /* if the length does not fit, pad this block and start another */
+    if (ctx->num > TPM_SHA1_BLOCK_SIZE - 8) {
+	memset(ctx->block + ctx->num, 0, TPM_SHA1_BLOCK_SIZE - ctx->num);
+	tpm_sha1_blocks(ctx->h, ctx->block, 1);
+	ctx->num = 0;
+    }
+    memset(ctx->block + ctx->num, 0, TPM_SHA1_BLOCK_SIZE - 8 - ctx->num);
+    for (i = 0 ; i < 8 ; i++) {
+	ctx->block[TPM_SHA1_BLOCK_SIZE - 1 - i] = (unsigned char)(bits >> (8 * i));
+    }
+    tpm_sha1_blocks(ctx->h, ctx->block, 1);
+    for (i = 0 ; i < TPM_SHA1_STATE_WORDS ; i++) {
+	md[4 * i]     = (unsigned char)(ctx->h[i] >> 24);
+	md[4 * i + 1] = (unsigned char)(ctx->h[i] >> 16);
+	md[4 * i + 2] = (unsigned char)(ctx->h[i] >> 8);
+	md[4 * i + 3] = (unsigned char)(ctx->h[i]);
+    }
+    TPM_SHA1Ctx_Delete(ctx);
+    return;
+}
+
+/* TPM_SHA1Ctx_Delete() clears the context, which may hold secret data such as an HMAC key block */
+
+void TPM_SHA1Ctx_Delete(TPM_SHA1_CTX *ctx)
+{
+    volatile unsigned char *p = (volatile unsigned char *)ctx;
+    size_t i;
+
+    /* volatile so that clearing a stack context is not optimized away */
+    for (i = 0 ; i < sizeof(TPM_SHA1_CTX) ; i++) {
+	p[i] = 0;
+    }
+    return;
+}
+
+/*
+  Compression functions
+*/
+
+#define TPM_SHA1_ROL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+/* TPM_SHA1_Blocks() is the portable compression function */
+
+static void TPM_SHA1_Blocks(uint32_t *h, const unsigned char *data, size_t blocks)
+{
+    uint32_t	w[16];
+    uint32_t	a, b, c, d, e, f, k, t;
+    size_t	i;
+
+    for ( ; blocks > 0 ; blocks--, data += TPM_SHA1_BLOCK_SIZE) {
+	for (i = 0 ; i < 16 ; i++) {
+	    w[i] = ((uint32_t)data[4 * i] << 24) | ((uint32_t)data[4 * i + 1] << 16) |
+		   ((uint32_t)data[4 * i + 2] << 8) | (uint32_t)data[4 * i + 3];
+	}
+	a = h[0];
+	b = h[1];
+	c = h[2];
+	d = h[3];
+	e = h[4];
+	for (i = 0 ; i < 80 ; i++) {
+	    /* the message schedule is kept in a circular buffer of 16 words */
+	    if (i >= 16) {
+		t = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15];
+		w[i & 15] = TPM_SHA1_ROL(t, 1);
+	    }
+	    if (i < 20) {
+		f = (b & c) | (~b & d);
+		k = 0x5a827999;
+	    }
+	    else if (i < 40) {
+		f = b ^ c ^ d;
+		k = 0x6ed9eba1;
+	    }
+	    else if (i < 60) {
+		f = (b & c) | (b & d) | (c & d);
+		k = 0x8f1bbcdc;
+	    }
+	    else {
+		f = b ^ c ^ d;
+		k = 0xca62c1d6;
+	    }
+	    t = TPM_SHA1_ROL(a, 5) + f + e + k + w[i & 15];
+	    e = d;
+	    d = c;
+	    c = TPM_SHA1_ROL(b, 30);
+	    b = a;
+	    a = t;
+	}
+	h[0] += a;
+	h[1] += b;
+	h[2] += c;
+	h[3] += d;
+	h[4] += e;
+    }
+    memset(w, 0, sizeof(w));
+    return;
+}
+
+#ifdef TPM_SHA1_X86_SHA
+
+/* Four rounds with the x86 SHA extensions.
+
+   'e' is the E value with the message words 'm' added, 'enext' receives the working variables for
+   the E value of the next four rounds.
+*/
+
+#define TPM_SHA1_X86_ROUNDS(f, e, enext, m)			\
+    e = _mm_sha1nexte_epu32(e, m);				\
+    enext = abcd;						\
+    abcd = _mm_sha1rnds4_epu32(abcd, e, f)
+
+/* Message schedule while hashing the message words 'm'.  'mprev', 'mnext' and 'mnext2' are the
+   words of the previous, the next and the one after the next four rounds.
+*/
+
+#define TPM_SHA1_X86_MSG1(m, mprev)	mprev = _mm_sha1msg1_epu32(mprev, m)
+#define TPM_SHA1_X86_XOR(m, mnext2)	mnext2 = _mm_xor_si128(mnext2, m)
+#define TPM_SHA1_X86_MSG2(m, mnext)	mnext = _mm_sha1msg2_epu32(mnext, m)
+
+#define TPM_SHA1_X86_SCHEDULE(m, mnext, mnext2, mprev)		\
+    TPM_SHA1_X86_MSG1(m, mprev);				\
+    TPM_SHA1_X86_XOR(m, mnext2);				\
+    TPM_SHA1_X86_MSG2(m, mnext)
+
+/* TPM_SHA1_BlocksX86() is the compression function using the x86 SHA extensions */
+
+__attribute__((target("sha,ssse3,sse4.1")))
+static void TPM_SHA1_BlocksX86(uint32_t *h, const unsigned char *data, size_t blocks)
+{
+    __m128i abcd, abcd_save, e0, e0_save, e1;
+    __m128i m0, m1, m2, m3;
+    /* reverses the bytes of the big endian message words and the order of the words */
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    abcd = _mm_loadu_si128((const __m128i *)h);
+    abcd = _mm_shuffle_epi32(abcd, 0x1b);
+    e0 = _mm_set_epi32((int)h[4], 0, 0, 0);
+
+    for ( ; blocks > 0 ; blocks--, data += TPM_SHA1_BLOCK_SIZE) {
+	abcd_save = abcd;
+	e0_save = e0;
+
+	m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), mask);
+	m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), mask);
+	m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), mask);
+	m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), mask);
+
+	/* rounds 0-19 */
+	e0 = _mm_add_epi32(e0, m0);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+	TPM_SHA1_X86_ROUNDS(0, e1, e0, m1);
+	TPM_SHA1_X86_MSG1(m1, m0);
+	TPM_SHA1_X86_ROUNDS(0, e0, e1, m2);
+	TPM_SHA1_X86_MSG1(m2, m1);
+	TPM_SHA1_X86_XOR(m2, m0);
+	TPM_SHA1_X86_ROUNDS(0, e1, e0, m3);
+	TPM_SHA1_X86_SCHEDULE(m3, m0, m1, m2);
+	TPM_SHA1_X86_ROUNDS(0, e0, e1, m0);
+	TPM_SHA1_X86_SCHEDULE(m0, m1, m2, m3);
+	/* rounds 20-39 */
+	TPM_SHA1_X86_ROUNDS(1, e1, e0, m1);
+	TPM_SHA1_X86_SCHEDULE(m1, m2, m3, m0);
+	TPM_SHA1_X86_ROUNDS(1, e0, e1, m2);
+	TPM_SHA1_X86_SCHEDULE(m2, m3, m0, m1);
+	TPM_SHA1_X86_ROUNDS(1, e1, e0, m3);
+	TPM_SHA1_X86_SCHEDULE(m3, m0, m1, m2);
+	TPM_SHA1_X86_ROUNDS(1, e0, e1, m0);
+	TPM_SHA1_X86_SCHEDULE(m0, m1, m2, m3);
+	TPM_SHA1_X86_ROUNDS(1, e1, e0, m1);
+	TPM_SHA1_X86_SCHEDULE(m1, m2, m3, m0);
+	/* rounds 40-59 */
+	TPM_SHA1_X86_ROUNDS(2, e0, e1, m2);
+	TPM_SHA1_X86_SCHEDULE(m2, m3, m0, m1);
+	TPM_SHA1_X86_ROUNDS(2, e1, e0, m3);
+	TPM_SHA1_X86_SCHEDULE(m3, m0, m1, m2);
+	TPM_SHA1_X86_ROUNDS(2, e0, e1, m0);
+	TPM_SHA1_X86_SCHEDULE(m0, m1, m2, m3);
+	TPM_SHA1_X86_ROUNDS(2, e1, e0, m1);
+	TPM_SHA1_X86_SCHEDULE(m1, m2, m3, m0);
+	TPM_SHA1_X86_ROUNDS(2, e0, e1, m2);
+	TPM_SHA1_X86_SCHEDULE(m2, m3, m0, m1);
+	/* rounds 60-79 */
+	TPM_SHA1_X86_ROUNDS(3, e1, e0, m3);
+	TPM_SHA1_X86_SCHEDULE(m3, m0, m1, m2);
+	TPM_SHA1_X86_ROUNDS(3, e0, e1, m0);
+	TPM_SHA1_X86_SCHEDULE(m0, m1, m2, m3);
+	TPM_SHA1_X86_ROUNDS(3, e1, e0, m1);
+	TPM_SHA1_X86_XOR(m1, m3);
+	TPM_SHA1_X86_MSG2(m1, m2);
+	TPM_SHA1_X86_ROUNDS(3, e0, e1, m2);
+	TPM_SHA1_X86_MSG2(m2, m3);
+	TPM_SHA1_X86_ROUNDS(3, e1, e0, m3);
+
+	/* add the working variables to the chaining value */
+	e0 = _mm_sha1nexte_epu32(e0, e0_save);
+	abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+    abcd = _mm_shuffle_epi32(abcd, 0x1b);
+    _mm_storeu_si128((__m128i *)h, abcd);
+    h[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+    return;
+}
+
+#endif	/* TPM_SHA1_X86_SHA */
+
+/* TPM_SHA1Ctx_Test() is the known answer test of the SHA-1 engine.  If the selected compression
+   function is not the portable one, both must give the same result.
+
+   Returns TPM_FAILEDSELFTEST on error
+*/
+
+TPM_RESULT TPM_SHA1Ctx_Test(void)
+{
+    TPM_RESULT		rc = 0;
+    TPM_SHA1_CTX	ctx;
+    TPM_DIGEST		actual;
+    uint32_t		state[TPM_SHA1_STATE_WORDS];
+    unsigned char	buffer[3 * TPM_SHA1_BLOCK_SIZE + 7];
+    size_t		i;
+    const unsigned char buffer1[] = "abc";
+    const unsigned char expect1[] = {0xa9,0x99,0x3e,0x36,0x47,
+				     0x06,0x81,0x6a,0xba,0x3e,
+				     0x25,0x71,0x78,0x50,0xc2,
+				     0x6c,0x9c,0xd0,0xd8,0x9d};
+
+    printf(" TPM_SHA1Ctx_Test:\n");
+    TPM_SHA1Ctx_Init(&ctx);
+    TPM_SHA1Ctx_Update(&ctx, buffer1, sizeof(buffer1) - 1);
+    TPM_SHA1Ctx_Final(actual, &ctx);
+    if (memcmp(actual, expect1, TPM_DIGEST_SIZE) != 0) {
+	printf("TPM_SHA1Ctx_Test: Error in known answer test\n");
+	rc = TPM_FAILEDSELFTEST;
+    }
+    /* compare the selected and the portable compression function over several blocks */
+    if ((rc == 0) && (tpm_sha1_blocks != TPM_SHA1_Blocks)) {
+	for (i = 0 ; i < sizeof(buffer) ; i++) {
+	    buffer[i] = (unsigned char)(i * 7 + 1);
+	}
+	memcpy(state, tpm_sha1_h0, sizeof(state));
+	TPM_SHA1_Blocks(state, buffer, sizeof(buffer) / TPM_SHA1_BLOCK_SIZE);
+	TPM_SHA1Ctx_Init(&ctx);
+	TPM_SHA1Ctx_Update(&ctx, buffer, 5);
+	TPM_SHA1Ctx_Update(&ctx, buffer + 5, sizeof(buffer) - 5);
+	if ((ctx.num != sizeof(buffer) % TPM_SHA1_BLOCK_SIZE) ||
+	    (memcmp(state, ctx.h, sizeof(state)) != 0)) {
+	    printf("TPM_SHA1Ctx_Test: Error, compression functions differ\n");
+	    rc = TPM_FAILEDSELFTEST;
+	}
+	TPM_SHA1Ctx_Delete(&ctx);
+    }
+    return rc;
+}
@@ -0,0 +1,74 @@
+/********************************************************************************/
+/*										*/
+/*				SHA-1 Engine					*/
+/*		       IBM Thomas J. Watson Research Center			*/
+/*										*/
+/* (c) Copyright IBM Corporation 2015.						*/
+/*										*/
+/* All rights reserved.								*/
+/* 										*/
+/* Redistribution and use in source and binary forms, with or without		*/
+/* modification, are permitted provided that the following conditions are	*/
+/* met:										*/
+/* 										*/
+/* Redistributions of source code must retain the above copyright notice,	*/
+/* this list of conditions and the following disclaimer.			*/
+/* 										*/
+/* Redistributions in binary form must reproduce the above copyright		*/
+/* notice, this list of conditions and the following disclaimer in the		*/
+/* documentation and/or other materials provided with the distribution.		*/
+/* 										*/
+/* Neither the names of the IBM Corporation nor the names of its		*/
+/* contributors may be used to endorse or promote products derived from		*/
+/* this software without specific prior written permission.			*/
+/* 										*/
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS		*/
+/* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT		*/
+/* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR	*/
+/* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT		*/
+/* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,	*/
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT		*/
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,	*/
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY	*/
+/* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT		*/
+/* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE	*/
+/* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
+/********************************************************************************/
+
+#ifndef TPM_SHA1_H
+#define TPM_SHA1_H
+
+#include "tpm_structures.h"
+#include "tpm_types.h"
+
+#define TPM_SHA1_BLOCK_SIZE	64
+
+/* TPM_SHA1_CTX is the context of the built-in SHA-1 engine.
+
+   It is meant to be allocated on the stack.  It is as secret as the data hashed, so it must be
+   cleared using TPM_SHA1Ctx_Delete().
+*/
+
+typedef struct tdTPM_SHA1_CTX {
+    uint32_t		h[TPM_SHA1_STATE_WORDS];	/* chaining value */
+    uint64_t		length;				/* bytes hashed, including 'block' */
+    uint32_t		num;				/* bytes buffered in 'block' */
+    unsigned char	block[TPM_SHA1_BLOCK_SIZE];
+} TPM_SHA1_CTX;
+
+void       TPM_SHA1Ctx_Init(TPM_SHA1_CTX *ctx);
+void       TPM_SHA1Ctx_SetState(TPM_SHA1_CTX *ctx,
+				const uint32_t *state,
+				uint32_t length);
+TPM_RESULT TPM_SHA1Ctx_GetState(uint32_t *state,
+				const TPM_SHA1_CTX *ctx);
+void       TPM_SHA1Ctx_Update(TPM_SHA1_CTX *ctx,
+			      const unsigned char *data,
+			      uint32_t length);
+void       TPM_SHA1Ctx_Final(TPM_DIGEST md,
+			     TPM_SHA1_CTX *ctx);
+void       TPM_SHA1Ctx_Delete(TPM_SHA1_CTX *ctx);
+
+TPM_RESULT TPM_SHA1Ctx_Test(void);
+
+#endif
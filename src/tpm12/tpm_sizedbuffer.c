@@ -41,6 +41,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "tpm_arena.h"
 #include "tpm_cryptoh.h"
 #include "tpm_debug.h"
 #include "tpm_error.h"
@@ -96,6 +97,85 @@ TPM_RESULT TPM_SizedBuffer_Load(TPM_SIZED_BUFFER *tpm_sized_buffer,     /* resul
     return rc;
 }
 
+/* TPM_SizedBuffer_LoadTransient() is an alternative to TPM_SizedBuffer_Load() for a command
+   parameter that does not outlive the command.  The buffer is allocated from the per command arena,
+   see TPM_Arena_Malloc().
+
+   The buffer must not be kept beyond the command or freed other than by TPM_SizedBuffer_Delete().
+*/
+
+TPM_RESULT TPM_SizedBuffer_LoadTransient(TPM_SIZED_BUFFER *tpm_sized_buffer,     /* result */
+					 unsigned char **stream,	/* pointer to next parameter */
+					 uint32_t *stream_size)		/* stream size left */
+{
+    TPM_RESULT  rc = 0;
+    
+    printf("  TPM_SizedBuffer_LoadTransient:\n");
+    if (rc == 0) {
+        rc = TPM_Load32(&(tpm_sized_buffer->size), stream, stream_size);
+    }
+    /* if the size is not 0 */
+    if ((rc == 0) && (tpm_sized_buffer->size > 0)) {
+        /* check the size before allocating, so that a bad size does not use up the arena */
+        if (tpm_sized_buffer->size > *stream_size) {
+            printf("TPM_SizedBuffer_LoadTransient: Error, size %u greater than stream %u\n",
+                   tpm_sized_buffer->size, *stream_size);
+            rc = TPM_BAD_PARAM_SIZE;
+        }
+        /* allocate memory for the buffer */
+        if (rc == 0) {
+            rc = TPM_Arena_Malloc(&(tpm_sized_buffer->buffer), tpm_sized_buffer->size);
+        }
+        /* copy the buffer */
+        if (rc == 0) {
+            rc = TPM_Loadn(tpm_sized_buffer->buffer, tpm_sized_buffer->size, stream, stream_size);
+        }
+    }
+    return rc;
+}
+
+/* TPM_SizedBufferView_Init() sets members to default values */
+
+void TPM_SizedBufferView_Init(TPM_SIZED_BUFFER_VIEW *tpm_sized_buffer_view)
+{
+    tpm_sized_buffer_view->size = 0;
+    tpm_sized_buffer_view->buffer = NULL;
+    return;
+}
+
+/* TPM_SizedBufferView_Load() is an alternative to TPM_SizedBuffer_Load() for a command parameter
+   that is only read.  Rather than copying the data, the view points into the stream.
+
+   The stream must not change while the view is used.  For a command parameter, this is the
+   processing of the ordinal.  The view is not freed.
+*/
+
+TPM_RESULT TPM_SizedBufferView_Load(TPM_SIZED_BUFFER_VIEW *tpm_sized_buffer_view, /* result */
+				    unsigned char **stream,	/* pointer to next parameter */
+				    uint32_t *stream_size)	/* stream size left */
+{
+    TPM_RESULT  rc = 0;
+    
+    printf("  TPM_SizedBufferView_Load:\n");
+    if (rc == 0) {
+        rc = TPM_Load32(&(tpm_sized_buffer_view->size), stream, stream_size);
+    }
+    if (rc == 0) {
+        if (tpm_sized_buffer_view->size > *stream_size) {
+            printf("TPM_SizedBufferView_Load: Error, size %u greater than stream %u\n",
+                   tpm_sized_buffer_view->size, *stream_size);
+            rc = TPM_BAD_PARAM_SIZE;
+        }
+    }
+    /* if the size is not 0, point to the data and skip it */
+    if ((rc == 0) && (tpm_sized_buffer_view->size > 0)) {
+        tpm_sized_buffer_view->buffer = *stream;
+        *stream += tpm_sized_buffer_view->size;
+        *stream_size -= tpm_sized_buffer_view->size;
+    }
+    return rc;
+}
+
 /* TPM_SizedBuffer_Set() reallocs a sized buffer and copies 'size' bytes of 'data' into it.
 
    If the sized buffer already has data, the buffer is realloc'ed.
@@ -212,7 +292,7 @@ void TPM_SizedBuffer_Delete(TPM_SIZED_BUFFER *tpm_sized_buffer)
 {
     printf("  TPM_SizedBuffer_Delete:\n");
     if (tpm_sized_buffer != NULL) {
-        free(tpm_sized_buffer->buffer);
+        TPM_Arena_Free(tpm_sized_buffer->buffer);
         TPM_SizedBuffer_Init(tpm_sized_buffer);
     }
     return;
@@ -47,6 +47,13 @@ void       TPM_SizedBuffer_Init(TPM_SIZED_BUFFER *tpm_sized_buffer);
 TPM_RESULT TPM_SizedBuffer_Load(TPM_SIZED_BUFFER *tpm_sized_buffer,
                                 unsigned char **stream,
                                 uint32_t *stream_size);
+TPM_RESULT TPM_SizedBuffer_LoadTransient(TPM_SIZED_BUFFER *tpm_sized_buffer,
+					 unsigned char **stream,
+					 uint32_t *stream_size);
+void       TPM_SizedBufferView_Init(TPM_SIZED_BUFFER_VIEW *tpm_sized_buffer_view);
+TPM_RESULT TPM_SizedBufferView_Load(TPM_SIZED_BUFFER_VIEW *tpm_sized_buffer_view,
+				    unsigned char **stream,
+				    uint32_t *stream_size);
 TPM_RESULT TPM_SizedBuffer_Store(TPM_STORE_BUFFER *sbuffer,
                                  const TPM_SIZED_BUFFER *tpm_sized_buffer); 
 TPM_RESULT TPM_SizedBuffer_Set(TPM_SIZED_BUFFER *tpm_sized_buffer,
@@ -0,0 +1,331 @@
+/********************************************************************************/
+/*										*/
+/*			   Pools of Fixed Size Objects				*/
+/*		       IBM Thomas J. Watson Research Center			*/
+/*										*/
+/* (c) Copyright IBM Corporation 2015.						*/
+/*										*/
+/* All rights reserved.								*/
+/* 										*/
+/* Redistribution and use in source and binary forms, with or without		*/
+/* modification, are permitted provided that the following conditions are	*/
+/* met:										*/
+/* 										*/
+/* Redistributions of source code must retain the above copyright notice,	*/
+/* this list of conditions and the following disclaimer.			*/
+/* 										*/
+/* Redistributions in binary form must reproduce the above copyright		*/
+/* notice, this list of conditions and the following disclaimer in the		*/
+/* documentation and/or other materials provided with the distribution.		*/
+/* 										*/
+/* Neither the names of the IBM Corporation nor the names of its		*/
+/* contributors may be used to endorse or promote products derived from		*/
+/* this software without specific prior written permission.			*/
+/* 										*/
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS		*/
+/* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT		*/
+/* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR	*/
+/* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT		*/
+/* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,	*/
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT		*/
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,	*/
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY	*/
+/* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT		*/
+/* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE	*/
+/* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
+/********************************************************************************/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_PROCESS
+#include "tpm_constants.h"
+#include "tpm_debug.h"
+#include "tpm_error.h"
+#include "tpm_memory.h"
+
+#include "tpm_slab.h"
+
+/* Keys, PCR selections and the other fixed size structures that commands create and delete over
+   and over are allocated from per type pools of the TPM instance processing the command rather
+   than from the heap.
+
+   Each type has its own TPM_SLAB.  Objects are carved from slabs of TPM_SLAB_OBJECTS objects, and
+   a freed object is put on the free list of its type, from which the next allocation is taken.
+   Types that hold secrets are zeroized when freed.  The slabs are freed when the TPM instance is
+   deleted.
+
+   While a command is processed, the instance's pool is the thread specific 'current' pool, as for
+   the arena, see TPM_Arena_Malloc().  Without a current pool, for example while the state is
+   loaded at startup, TPM_Slab_Malloc() falls back to TPM_Malloc().
+
+   Each object is preceded by a header pointing to the TPM_SLAB it belongs to, or NULL for a heap
+   object.  TPM_Slab_Free() thereby returns an object to the right pool, even outside a command,
+   and it can free an object without knowing its type.  Therefore, an object must always be
+   released with TPM_Slab_Free(), never with free().
+*/
+
+#define TPM_SLAB_ALIGN		16			/* alignment of each object */
+#define TPM_SLAB_HEADER		TPM_SLAB_ALIGN		/* header before each object and slab */
+
+/* the header of an object */
+
+typedef struct tdTPM_SLAB_OBJECT {
+    TPM_SLAB *slab;		/* TPM_SLAB holding the object, NULL for a heap object */
+    unsigned char *next;	/* next object on the free list */
+} TPM_SLAB_OBJECT;
+
+#if TPM_SLAB_TYPES != TPMLIB_POOLS
+#error "TPM_SLAB_TYPES must match TPMLIB_POOLS"
+#endif
+
+/* types that hold secrets */
+
+static const TPM_BOOL tpm_slab_zeroize[TPM_SLAB_TYPES] = {
+    FALSE,	/* TPM_SLAB_KEY, points to the TPM_STORE_ASYMKEY */
+    TRUE,	/* TPM_SLAB_STORE_ASYMKEY */
+    FALSE,	/* TPM_SLAB_PCR_INFO */
+    FALSE,	/* TPM_SLAB_PCR_INFO_LONG */
+    FALSE,	/* TPM_SLAB_PCR_INFO_SHORT */
+    TRUE,	/* TPM_SLAB_SYMMETRIC_KEY */
+    FALSE	/* TPM_SLAB_RSA_KEY_PARMS */
+};
+
+static pthread_key_t	tpm_slab_current;
+static pthread_once_t	tpm_slab_once = PTHREAD_ONCE_INIT;
+
+static void TPM_Slab_KeyCreate(void)
+{
+    pthread_key_create(&tpm_slab_current, NULL);
+    return;
+}
+
+/* TPM_SlabPool_Current() returns the pool of the command being processed by this thread, or NULL */
+
+static TPM_SLAB_POOL *TPM_SlabPool_Current(void)
+{
+    pthread_once(&tpm_slab_once, TPM_Slab_KeyCreate);
+    return pthread_getspecific(tpm_slab_current);
+}
+
+/* TPM_SlabPool_Init() sets members to default values.  Slabs are allocated on first use. */
+
+void TPM_SlabPool_Init(TPM_SLAB_POOL *tpm_slab_pool)
+{
+    size_t	type;
+
+    for (type = 0 ; type < TPM_SLAB_TYPES ; type++) {
+	memset(&(tpm_slab_pool->slab[type]), 0, sizeof(TPM_SLAB));
+	tpm_slab_pool->slab[type].zeroize = tpm_slab_zeroize[type];
+    }
+    return;
+}
+
+/* TPM_SlabPool_Delete() zeroizes and frees all slabs.
+
+   It must be called after all objects of the pool were freed.
+*/
+
+void TPM_SlabPool_Delete(TPM_SLAB_POOL *tpm_slab_pool)
+{
+    size_t		type;
+    TPM_SLAB		*slab;
+    unsigned char	*slabBuffer;
+    unsigned char	*next;
+
+    if (tpm_slab_pool != NULL) {
+	for (type = 0 ; type < TPM_SLAB_TYPES ; type++) {
+	    slab = &(tpm_slab_pool->slab[type]);
+	    if (slab->inUse != 0) {
+		printf("TPM_SlabPool_Delete: Error, %u objects of type %lu still in use\n",
+		       slab->inUse, (unsigned long)type);
+	    }
+	    for (slabBuffer = slab->slabList ; slabBuffer != NULL ; slabBuffer = next) {
+		memcpy(&next, slabBuffer, sizeof(unsigned char *));
+		memset(slabBuffer, 0, TPM_SLAB_HEADER + (TPM_SLAB_OBJECTS * slab->objectSize));
+		free(slabBuffer);
+	    }
+	}
+	TPM_SlabPool_Init(tpm_slab_pool);
+    }
+    return;
+}
+
+/* TPM_SlabPool_Begin() makes 'tpm_slab_pool' the current pool for a command processed by this
+   thread */
+
+void TPM_SlabPool_Begin(TPM_SLAB_POOL *tpm_slab_pool)
+{
+    pthread_once(&tpm_slab_once, TPM_Slab_KeyCreate);
+    pthread_setspecific(tpm_slab_current, tpm_slab_pool);
+    return;
+}
+
+/* TPM_SlabPool_End() ends the command.  The objects it allocated remain valid. */
+
+void TPM_SlabPool_End(TPM_SLAB_POOL *tpm_slab_pool)
+{
+    tpm_slab_pool = tpm_slab_pool;	/* to quiet the compiler */
+    pthread_setspecific(tpm_slab_current, NULL);
+    return;
+}
+
+/* TPM_SlabPool_GetStatistics() copies the statistics of the pool to the array 'pools' of
+   TPMLIB_POOLS entries.  If 'reset' is TRUE, the allocation and free counts are cleared.
+
+   The statistics are collected whether or not TPMLIB_SetStatistics() enabled them.
+*/
+
+void TPM_SlabPool_GetStatistics(struct tpmlib_pool_statistics *pools,
+				TPM_SLAB_POOL *tpm_slab_pool,
+				TPM_BOOL reset)
+{
+    size_t	type;
+    TPM_SLAB	*slab;
+
+    for (type = 0 ; type < TPM_SLAB_TYPES ; type++) {
+	slab = &(tpm_slab_pool->slab[type]);
+	pools[type].object_size = slab->objectSize;
+	pools[type].slabs = slab->slabs;
+	pools[type].in_use = slab->inUse;
+	pools[type].available = slab->freeCount;
+	pools[type].allocs = slab->allocs;
+	pools[type].frees = slab->frees;
+	if (reset) {
+	    slab->allocs = 0;
+	    slab->frees = 0;
+	}
+    }
+    return;
+}
+
+/* TPM_Slab_Grow() adds a slab to 'slab' and puts its objects on the free list */
+
+static TPM_RESULT TPM_Slab_Grow(TPM_SLAB *slab)
+{
+    TPM_RESULT		rc = 0;
+    unsigned char	*slabBuffer = NULL;
+    unsigned char	*object;
+    TPM_SLAB_OBJECT	*header;
+    size_t		i;
+
+    if (rc == 0) {
+	rc = TPM_Malloc(&slabBuffer, TPM_SLAB_HEADER + (TPM_SLAB_OBJECTS * slab->objectSize));
+    }
+    if (rc == 0) {
+	TPM_TRACE_DEBUG(" TPM_Slab_Grow: Adding slab %u of %u byte objects\n",
+			slab->slabs + 1, slab->objectSize);
+	memset(slabBuffer, 0, TPM_SLAB_HEADER + (TPM_SLAB_OBJECTS * slab->objectSize));
+	memcpy(slabBuffer, &(slab->slabList), sizeof(unsigned char *));
+	slab->slabList = slabBuffer;
+	slab->slabs++;
+	for (i = 0 ; i < TPM_SLAB_OBJECTS ; i++) {
+	    object = slabBuffer + TPM_SLAB_HEADER + (i * slab->objectSize);
+	    header = (TPM_SLAB_OBJECT *)object;
+	    header->slab = slab;
+	    header->next = slab->freeList;
+	    slab->freeList = object;
+	}
+	slab->freeCount += TPM_SLAB_OBJECTS;
+    }
+    return rc;
+}
+
+/* TPM_Slab_Malloc() is an alternative to TPM_Malloc() for a structure of 'size' bytes and type
+   'type', one of the TPM_SLAB_ values.
+
+   The object is allocated from the current pool if there is one, otherwise from the heap.  Either
+   way, it must be released with TPM_Slab_Free().
+*/
+
+TPM_RESULT TPM_Slab_Malloc(unsigned char **buffer, unsigned int type, uint32_t size)
+{
+    TPM_RESULT		rc = 0;
+    TPM_SLAB_POOL	*tpm_slab_pool;
+    TPM_SLAB		*slab;
+    unsigned char	*object = NULL;
+    TPM_SLAB_OBJECT	*header;
+    TPM_BOOL		done = FALSE;
+
+    /* the same assertion as TPM_Malloc() */
+    if (rc == 0) {
+	if (*buffer != NULL) {
+	    printf("TPM_Slab_Malloc: Error (fatal), *buffer %p should be NULL before malloc\n",
+		   *buffer);
+	    rc = TPM_FAIL;
+	}
+    }
+    if (rc == 0) {
+	tpm_slab_pool = TPM_SlabPool_Current();
+	if ((tpm_slab_pool != NULL) && (type < TPM_SLAB_TYPES)) {
+	    slab = &(tpm_slab_pool->slab[type]);
+	    /* the object size is fixed by the first allocation */
+	    if (slab->objectSize == 0) {
+		slab->objectSize =
+		    TPM_SLAB_HEADER + ((size + TPM_SLAB_ALIGN - 1) & ~(TPM_SLAB_ALIGN - 1));
+	    }
+	    if (size <= (slab->objectSize - TPM_SLAB_HEADER)) {
+		if (slab->freeList == NULL) {
+		    rc = TPM_Slab_Grow(slab);
+		}
+		if (rc == 0) {
+		    object = slab->freeList;
+		    header = (TPM_SLAB_OBJECT *)object;
+		    slab->freeList = header->next;
+		    header->next = NULL;
+		    slab->freeCount--;
+		    slab->inUse++;
+		    slab->allocs++;
+		    done = TRUE;
+		}
+	    }
+	}
+    }
+    if ((rc == 0) && !done) {
+	rc = TPM_Malloc(&object, TPM_SLAB_HEADER + size);
+	if (rc == 0) {
+	    header = (TPM_SLAB_OBJECT *)object;
+	    header->slab = NULL;
+	    header->next = NULL;
+	}
+    }
+    if (rc == 0) {
+	*buffer = object + TPM_SLAB_HEADER;
+    }
+    return rc;
+}
+
+/* TPM_Slab_Free() is the companion to TPM_Slab_Malloc().
+
+   A heap object is freed.  A pool object is put on the free list of its pool, which need not be the
+   current one.  It is a no-op if 'buffer' is NULL.
+*/
+
+void TPM_Slab_Free(void *buffer)
+{
+    unsigned char	*object;
+    TPM_SLAB_OBJECT	*header;
+    TPM_SLAB		*slab;
+
+    if (buffer != NULL) {
+	object = (unsigned char *)buffer - TPM_SLAB_HEADER;
+	header = (TPM_SLAB_OBJECT *)object;
+	slab = header->slab;
+	if (slab == NULL) {
+	    free(object);
+	}
+	else {
+	    if (slab->zeroize) {
+		memset(buffer, 0, slab->objectSize - TPM_SLAB_HEADER);
+	    }
+	    header->next = slab->freeList;
+	    slab->freeList = object;
+	    slab->freeCount++;
+	    slab->inUse--;
+	    slab->frees++;
+	}
+    }
+    return;
+}
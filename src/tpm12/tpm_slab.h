@@ -0,0 +1,58 @@
+/********************************************************************************/
+/*										*/
+/*			   Pools of Fixed Size Objects				*/
+/*		       IBM Thomas J. Watson Research Center			*/
+/*										*/
+/* (c) Copyright IBM Corporation 2015.						*/
+/*										*/
+/* All rights reserved.								*/
+/* 										*/
+/* Redistribution and use in source and binary forms, with or without		*/
+/* modification, are permitted provided that the following conditions are	*/
+/* met:										*/
+/* 										*/
+/* Redistributions of source code must retain the above copyright notice,	*/
+/* this list of conditions and the following disclaimer.			*/
+/* 										*/
+/* Redistributions in binary form must reproduce the above copyright		*/
+/* notice, this list of conditions and the following disclaimer in the		*/
+/* documentation and/or other materials provided with the distribution.		*/
+/* 										*/
+/* Neither the names of the IBM Corporation nor the names of its		*/
+/* contributors may be used to endorse or promote products derived from		*/
+/* this software without specific prior written permission.			*/
+/* 										*/
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS		*/
+/* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT		*/
+/* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR	*/
+/* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT		*/
+/* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,	*/
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT		*/
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,	*/
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY	*/
+/* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT		*/
+/* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE	*/
+/* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
+/********************************************************************************/
+
+#ifndef TPM_SLAB_H
+#define TPM_SLAB_H
+
+#include "tpm_library.h"
+#include "tpm_structures.h"
+#include "tpm_types.h"
+
+void       TPM_SlabPool_Init(TPM_SLAB_POOL *tpm_slab_pool);
+void       TPM_SlabPool_Delete(TPM_SLAB_POOL *tpm_slab_pool);
+
+void       TPM_SlabPool_Begin(TPM_SLAB_POOL *tpm_slab_pool);
+void       TPM_SlabPool_End(TPM_SLAB_POOL *tpm_slab_pool);
+
+void       TPM_SlabPool_GetStatistics(struct tpmlib_pool_statistics *pools,
+				      TPM_SLAB_POOL *tpm_slab_pool,
+				      TPM_BOOL reset);
+
+TPM_RESULT TPM_Slab_Malloc(unsigned char **buffer, unsigned int type, uint32_t size);
+void       TPM_Slab_Free(void *buffer);
+
+#endif
@@ -151,6 +151,10 @@ TPM_RESULT TPM_SaveState_Store(TPM_STORE_BUFFER *sbuffer,
     TPM_DIGEST			tpm_digest;
 
     printf(" TPM_SaveState_Store:\n");
+    /* allocate the stream once */
+    if (rc == 0) {
+	rc = TPM_Sbuffer_Reserve(sbuffer, TPM_SaveState_SizeOf(tpm_state));
+    }
     if (rc == 0) {
 	printf("  TPM_SaveState_Store: Storing PCR's\n");
     }
@@ -209,6 +213,19 @@ TPM_RESULT TPM_SaveState_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_SaveState_SizeOf() returns the number of bytes TPM_SaveState_Store() serializes, including
+   the integrity digest */
+
+uint32_t TPM_SaveState_SizeOf(tpm_state_t *tpm_state)
+{
+    return TPM_StclearData_SizeOf(&(tpm_state->tpm_stclear_data),
+				  tpm_state->tpm_permanent_data.pcrAttrib) +
+	TPM_StclearFlags_SizeOf() +
+	TPM_KeyHandleEntries_SizeOf(tpm_state) +
+	TPM_NVIndexEntries_SizeOfVolatile(&(tpm_state->tpm_nv_index_entries)) +
+	TPM_DIGEST_SIZE;
+}
+
 /* TPM_SaveState_IsSaveKey() determines which keys are saved as part of the saved state.
 
    According to Ryan, all keys must be saved for this to be of use.
@@ -250,25 +267,29 @@ TPM_RESULT TPM_SaveState_NVLoad(tpm_state_t *tpm_state)
     unsigned char	*stream = NULL;
     unsigned char	*stream_start = NULL;
     uint32_t		stream_size;
+    uint32_t		stream_size_start = 0;
+    TPM_BOOL		mapped = FALSE;
     
     printf(" TPM_SaveState_NVLoad:\n");
     if (rc == 0) {
 	/* load from NVRAM.  Returns TPM_RETRY on non-existent file. */
-	rc = TPM_NVRAM_LoadData(&stream,			/* freed @1 */
-				&stream_size,
-				tpm_state->tpm_number,
-				TPM_SAVESTATE_NAME);
+	rc = TPM_NVRAM_MapData(&stream,			/* freed @1 */
+			       &stream_size,
+			       &mapped,
+			       tpm_state->tpm_number,
+			       TPM_SAVESTATE_NAME);
     }
     /* deserialize from stream */
     if (rc == 0) {
-	stream_start = stream;			/* save starting point for free() */
+	stream_start = stream;			/* save starting point for unmap */
+	stream_size_start = stream_size;
 	rc = TPM_SaveState_Load(tpm_state, &stream, &stream_size);
 	if (rc != 0) {
 	    printf("TPM_SaveState_NVLoad: Error (fatal) loading deserializing saved state\n");
 	    rc = TPM_FAIL;
 	}
     }
-    free(stream_start); /* @1 */
+    TPM_NVRAM_UnmapData(stream_start, stream_size_start, mapped);	/* @1 */
     return rc;
 }
 
@@ -282,6 +303,7 @@ TPM_RESULT TPM_SaveState_NVStore(tpm_state_t *tpm_state)
     TPM_STORE_BUFFER	sbuffer;		/* safe buffer for storing binary data */
     const unsigned char *buffer;
     uint32_t		length;
+    uint32_t		maxLength;
 
     printf(" TPM_SaveState_NVStore:\n");
     TPM_Sbuffer_Init(&sbuffer);			/* freed @1 */
@@ -293,10 +315,14 @@ TPM_RESULT TPM_SaveState_NVStore(tpm_state_t *tpm_state)
     }
     /* validate the length of the stream */
     if (rc == 0) {
+	/* swapped keys are stored as well */
+	maxLength = TPM_MAX_SAVESTATE_SPACE_KEYS
+		    (TPM_KeyHandleEntries_GetMaxKeys(tpm_state->tpm_key_handle_entries.keyHandleCount,
+						     tpm_state->tpm_key_handle_entries.keySwap));
 	printf("   TPM_SaveState_NVStore: Require %u bytes\n", length);
-	if (length > TPM_MAX_SAVESTATE_SPACE) {
+	if (length > maxLength) {
 	    printf("TPM_SaveState_NVStore: Error, No space, need %u max %u\n",
-		   length, TPM_MAX_SAVESTATE_SPACE);
+		   length, maxLength);
 	    rc = TPM_NOSPACE;
 	}
     }
@@ -456,13 +482,17 @@ TPM_RESULT TPM_VolatileAll_Store(TPM_STORE_BUFFER *sbuffer,
     TPM_DIGEST			tpm_digest;
 
     printf(" TPM_VolatileAll_Store:\n");
+    /* allocate the stream once */
+    if (rc == 0) {
+	rc = TPM_Sbuffer_Reserve(sbuffer, TPM_VolatileAll_SizeOf(tpm_state));
+    }
     /* overall format tag */
     if (rc == 0) {
 	rc = TPM_Sbuffer_Append16(sbuffer, TPM_TAG_VSTATE_V1);
     }
     /* compiled in TPM parameters */
     if (rc == 0) {
-	rc = TPM_Parameters_Store(sbuffer);
+	rc = TPM_Parameters_Store(sbuffer, tpm_state);
     }
     /* V1 is the TCG standard returned by the getcap.  It's unlikely that this will change */
     if (rc == 0) {
@@ -533,6 +563,34 @@ TPM_RESULT TPM_VolatileAll_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_VolatileAll_SizeOf() returns the number of bytes TPM_VolatileAll_Store() serializes,
+   including the integrity digest */
+
+uint32_t TPM_VolatileAll_SizeOf(tpm_state_t *tpm_state)
+{
+    TPM_PCR_ATTRIBUTES 		pcrAttrib[TPM_NUM_PCR];
+    size_t			i;
+
+    /* as in TPM_VolatileAll_Store(), all PCR's are stored */
+    for (i = 0 ; i < TPM_NUM_PCR ; i++) {
+	pcrAttrib[i].pcrReset = FALSE;
+    }
+    return sizeof(uint16_t) +			/* tag */
+	TPM_Parameters_SizeOf() +
+	sizeof(uint16_t) +			/* TPM_STCLEAR_FLAGS tag */
+	TPM_StclearFlags_SizeOf() +
+	TPM_StanyFlags_SizeOf() +
+	TPM_StclearData_SizeOf(&(tpm_state->tpm_stclear_data), pcrAttrib) +
+	TPM_StanyData_SizeOf() +
+	TPM_KeyHandleEntries_SizeOf(tpm_state) +
+	TPM_Sha1Context_SizeOf(tpm_state->sha1_context) +
+	TPM_Sha1Context_SizeOf(tpm_state->sha1_context_tis) +
+	sizeof(TPM_TRANSHANDLE) +		/* transportHandle */
+	sizeof(uint32_t) +			/* testState */
+	TPM_NVIndexEntries_SizeOfVolatile(&(tpm_state->tpm_nv_index_entries)) +
+	TPM_DIGEST_SIZE;
+}
+
 /* TPM_VolatileAll_NVLoad() deserializes the entire volatile state data from the NV file
    TPM_VOLATILESTATE_NAME.
 
@@ -549,14 +607,17 @@ TPM_RESULT TPM_VolatileAll_NVLoad(tpm_state_t *tpm_state)
     unsigned char	*stream = NULL;
     unsigned char	*stream_start = NULL;
     uint32_t		stream_size;
+    uint32_t		stream_size_start = 0;
+    TPM_BOOL		mapped = FALSE;
     
     printf(" TPM_VolatileAll_NVLoad:\n");
     if (rc == 0) {
 	/* load from NVRAM.  Returns TPM_RETRY on non-existent file. */
-	rc = TPM_NVRAM_LoadData(&stream,			/* freed @1 */
-				&stream_size,
-				tpm_state->tpm_number,
-				TPM_VOLATILESTATE_NAME);
+	rc = TPM_NVRAM_MapData(&stream,			/* freed @1 */
+			       &stream_size,
+			       &mapped,
+			       tpm_state->tpm_number,
+			       TPM_VOLATILESTATE_NAME);
 	/* if the file does not exist, leave the volatile state initial values */
 	if (rc == TPM_RETRY) {
 	    done = TRUE;
@@ -569,7 +630,8 @@ TPM_RESULT TPM_VolatileAll_NVLoad(tpm_state_t *tpm_state)
     }
     /* deserialize from stream */
     if ((rc == 0) && !done) {
-	stream_start = stream;			/* save starting point for free() */
+	stream_start = stream;			/* save starting point for unmap */
+	stream_size_start = stream_size;
 	rc = TPM_VolatileAll_Load(tpm_state, &stream, &stream_size);
 	if (rc != 0) {
 	    printf("TPM_VolatileAll_NVLoad: Error (fatal) loading deserializing state\n");
@@ -581,7 +643,7 @@ TPM_RESULT TPM_VolatileAll_NVLoad(tpm_state_t *tpm_state)
 	tpm_state->testState = TPM_TEST_STATE_FAILURE;
 	
     }
-    free(stream_start); /* @1 */
+    TPM_NVRAM_UnmapData(stream_start, stream_size_start, mapped);	/* @1 */
     return rc;
 }
 
@@ -595,6 +657,7 @@ TPM_RESULT TPM_VolatileAll_NVStore(tpm_state_t *tpm_state)
     TPM_STORE_BUFFER	sbuffer;		/* safe buffer for storing binary data */
     const unsigned char *buffer;
     uint32_t		length;
+    uint32_t		maxLength;
 
     printf(" TPM_VolatileAll_NVStore:\n");
     TPM_Sbuffer_Init(&sbuffer);			/* freed @1 */
@@ -606,10 +669,14 @@ TPM_RESULT TPM_VolatileAll_NVStore(tpm_state_t *tpm_state)
     }
     /* validate the length of the stream */
     if (rc == 0) {
+	/* swapped keys are stored as well */
+	maxLength = TPM_MAX_VOLATILESTATE_SPACE_KEYS
+		    (TPM_KeyHandleEntries_GetMaxKeys(tpm_state->tpm_key_handle_entries.keyHandleCount,
+						     tpm_state->tpm_key_handle_entries.keySwap));
 	printf("   TPM_VolatileAll_NVStore: Require %u bytes\n", length);
-	if (length > TPM_MAX_VOLATILESTATE_SPACE) {
+	if (length > maxLength) {
 	    printf("TPM_VolatileAll_NVStore: Error, No space, need %u max %u\n",
-		   length, TPM_MAX_VOLATILESTATE_SPACE);
+		   length, maxLength);
 	    rc = TPM_NOSPACE;
 	}
     }
@@ -632,6 +699,7 @@ TPM_RESULT TPM_Parameters_Load(unsigned char **stream,
 			       uint32_t *stream_size)
 {
     TPM_RESULT		rc = 0;
+    uint16_t		keyHandles;
 
     printf(" TPM_Parameters_Load:\n");
     if (rc == 0) {
@@ -658,9 +726,12 @@ TPM_RESULT TPM_Parameters_Load(unsigned char **stream,
 	rc = TPM_Parameters_Check16(TPM_RSA_KEY_LENGTH_MAX, "TPM_RSA_KEY_LENGTH_MAX",
 				    stream, stream_size);
     }
+    /* the key slots of the instance that stored the state.  The state can be loaded into an
+       instance with a different number of key slots if the keys fit, see
+       TPM_KeyHandleEntries_Load(). */
     if (rc == 0) {
-	rc = TPM_Parameters_Check16(TPM_KEY_HANDLES, "TPM_KEY_HANDLES",
-				    stream, stream_size);
+	rc = TPM_Load16(&keyHandles, stream, stream_size);
+	printf("  TPM_Parameters_Load: TPM_KEY_HANDLES %u\n", keyHandles);
     }
     if (rc == 0) {
 	rc = TPM_Parameters_Check16(TPM_OWNER_EVICT_KEY_HANDLES, "TPM_OWNER_EVICT_KEY_HANDLES",
@@ -760,7 +831,8 @@ TPM_RESULT TPM_Parameters_Check32(uint32_t expected,
     return rc;
 }
 
-TPM_RESULT TPM_Parameters_Store(TPM_STORE_BUFFER *sbuffer)
+TPM_RESULT TPM_Parameters_Store(TPM_STORE_BUFFER *sbuffer,
+				tpm_state_t *tpm_state)
 {
     TPM_RESULT		rc = 0;
 
@@ -784,7 +856,7 @@ TPM_RESULT TPM_Parameters_Store(TPM_STORE_BUFFER *sbuffer)
 	rc = TPM_Sbuffer_Append16(sbuffer, TPM_RSA_KEY_LENGTH_MAX);
     }
     if (rc == 0) {
-	rc = TPM_Sbuffer_Append16(sbuffer, TPM_KEY_HANDLES);
+	rc = TPM_Sbuffer_Append16(sbuffer, tpm_state->tpm_key_handle_entries.keyHandleCount);
     }
     if (rc == 0) {
 	rc = TPM_Sbuffer_Append16(sbuffer, TPM_OWNER_EVICT_KEY_HANDLES);
@@ -816,6 +888,16 @@ TPM_RESULT TPM_Parameters_Store(TPM_STORE_BUFFER *sbuffer)
     return rc;
 }
 
+/* TPM_Parameters_SizeOf() returns the number of bytes TPM_Parameters_Store() serializes */
+
+uint32_t TPM_Parameters_SizeOf(void)
+{
+    return sizeof(uint16_t) +			/* tag */
+	(2 * sizeof(uint8_t)) +			/* TPM_MAJOR, TPM_MINOR */
+	(12 * sizeof(uint16_t)) +
+	sizeof(uint32_t);			/* TPM_MAX_NV_SPACE */
+}
+
 
 /* 27.5 TPM_Reset rev 105
 
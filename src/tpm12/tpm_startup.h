@@ -62,6 +62,7 @@ TPM_RESULT TPM_SaveState_Load(tpm_state_t *tpm_state,
                               uint32_t *stream_size);
 TPM_RESULT TPM_SaveState_Store(TPM_STORE_BUFFER *sbuffer,
                                tpm_state_t *tpm_state);
+uint32_t   TPM_SaveState_SizeOf(tpm_state_t *tpm_state);
 
 TPM_RESULT TPM_SaveState_NVLoad(tpm_state_t *tpm_state);
 TPM_RESULT TPM_SaveState_NVStore(tpm_state_t *tpm_state);
@@ -80,6 +81,7 @@ TPM_RESULT TPM_VolatileAll_Load(tpm_state_t *tpm_state,
 				uint32_t *stream_size);
 TPM_RESULT TPM_VolatileAll_Store(TPM_STORE_BUFFER *sbuffer,
 				 tpm_state_t *tpm_state);
+uint32_t   TPM_VolatileAll_SizeOf(tpm_state_t *tpm_state);
 TPM_RESULT TPM_VolatileAll_NVLoad(tpm_state_t *tpm_state);
 TPM_RESULT TPM_VolatileAll_NVStore(tpm_state_t *tpm_state);
 
@@ -89,7 +91,9 @@ TPM_RESULT TPM_VolatileAll_NVStore(tpm_state_t *tpm_state);
 
 TPM_RESULT TPM_Parameters_Load(unsigned char **stream,
 			       uint32_t *stream_size);
-TPM_RESULT TPM_Parameters_Store(TPM_STORE_BUFFER *sbuffer);
+TPM_RESULT TPM_Parameters_Store(TPM_STORE_BUFFER *sbuffer,
+				tpm_state_t *tpm_state);
+uint32_t   TPM_Parameters_SizeOf(void);
 TPM_RESULT TPM_Parameters_Check8(uint8_t expected,
 				 const char *parameter,
 				 unsigned char **stream,
@@ -0,0 +1,327 @@
+/********************************************************************************/
+/*										*/
+/*				TPM Statistics					*/
+/*		       IBM Thomas J. Watson Research Center			*/
+/*										*/
+/* (c) Copyright IBM Corporation 2015.						*/
+/*										*/
+/* All rights reserved.								*/
+/* 										*/
+/* Redistribution and use in source and binary forms, with or without		*/
+/* modification, are permitted provided that the following conditions are	*/
+/* met:										*/
+/* 										*/
+/* Redistributions of source code must retain the above copyright notice,	*/
+/* this list of conditions and the following disclaimer.			*/
+/* 										*/
+/* Redistributions in binary form must reproduce the above copyright		*/
+/* notice, this list of conditions and the following disclaimer in the		*/
+/* documentation and/or other materials provided with the distribution.		*/
+/* 										*/
+/* Neither the names of the IBM Corporation nor the names of its		*/
+/* contributors may be used to endorse or promote products derived from		*/
+/* this software without specific prior written permission.			*/
+/* 										*/
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS		*/
+/* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT		*/
+/* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR	*/
+/* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT		*/
+/* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,	*/
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT		*/
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,	*/
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY	*/
+/* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT		*/
+/* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE	*/
+/* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
+/********************************************************************************/
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_PROCESS
+#include "tpm_debug.h"
+#include "tpm_error.h"
+#include "tpm_load.h"
+#include "tpm_memory.h"
+#include "tpm_process.h"
+#include "tpm_slab.h"
+
+#include "tpm_statistics.h"
+
+/* Statistics are collected by all TPM instances once TPMLIB_SetStatistics() has enabled them.
+
+   Each instance collects its statistics in its own TPM_STATISTICS, allocated when the instance
+   processes its first command with statistics enabled.  While an ordinal is processed, the
+   instance's TPM_STATISTICS is also the thread specific 'current' statistics, so that code deep
+   in the call tree, such as the RSA functions, can account for its time without access to the
+   TPM instance.
+*/
+
+static TPM_BOOL		tpm_statistics_enabled = FALSE;
+static pthread_key_t	tpm_statistics_current;
+static pthread_once_t	tpm_statistics_once = PTHREAD_ONCE_INIT;
+
+static void TPM_Statistics_KeyCreate(void)
+{
+    pthread_key_create(&tpm_statistics_current, NULL);
+    return;
+}
+
+/* TPM_Statistics_GetTime() gets a monotonic time in microseconds */
+
+static uint64_t TPM_Statistics_GetTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+/* TPM_Statistics_Enable() enables or disables the collection of statistics.
+
+   It must not be called while commands are being processed.
+*/
+
+void TPM_Statistics_Enable(TPM_BOOL enable)
+{
+    pthread_once(&tpm_statistics_once, TPM_Statistics_KeyCreate);
+    tpm_statistics_enabled = enable;
+    return;
+}
+
+/* TPM_Statistics_Begin() starts the statistics for an ordinal processed by 'tpm_state'.
+
+   '*tpm_statistics' is NULL if statistics are not collected.  Otherwise it must be passed to
+   TPM_Statistics_End() after the ordinal was processed.
+*/
+
+void TPM_Statistics_Begin(TPM_STATISTICS **tpm_statistics,
+			  uint64_t *startTime,
+			  tpm_state_t *tpm_state)
+{
+    TPM_RESULT	rc = 0;
+
+    *tpm_statistics = NULL;
+    if (tpm_statistics_enabled) {
+	if (tpm_state->tpm_statistics == NULL) {
+	    rc = TPM_Malloc((unsigned char **)&(tpm_state->tpm_statistics),
+			    sizeof(TPM_STATISTICS));
+	    if (rc == 0) {
+		memset(tpm_state->tpm_statistics, 0, sizeof(TPM_STATISTICS));
+	    }
+	}
+	/* statistics are best effort, an allocation failure must not fail the command */
+	if (rc == 0) {
+	    *tpm_statistics = tpm_state->tpm_statistics;
+	    pthread_setspecific(tpm_statistics_current, *tpm_statistics);
+	    *startTime = TPM_Statistics_GetTime();
+	}
+    }
+    return;
+}
+
+/* TPM_Statistics_Bucket() returns the histogram bucket for the latency 'usec' */
+
+static size_t TPM_Statistics_Bucket(uint64_t usec)
+{
+    size_t	bucket;
+
+    for (bucket = 0 ; (bucket < (TPMLIB_STATISTICS_BUCKETS - 1)) && (usec >= 2) ; bucket++) {
+	usec >>= 1;
+    }
+    return bucket;
+}
+
+/* TPM_Statistics_End() records the latency and result of the ordinal.
+
+   'response' is the ordinal response, holding the returned error code.  'returnCode' is the fatal
+   error code of the processing function.
+*/
+
+void TPM_Statistics_End(TPM_STATISTICS *tpm_statistics,
+			uint64_t startTime,
+			TPM_COMMAND_CODE ordinal,
+			TPM_RESULT returnCode,
+			TPM_STORE_BUFFER *response)
+{
+    TPM_RESULT			rc = 0;
+    uint64_t			usec;
+    size_t			index;
+    TPM_ORDINAL_STATISTICS	*ordinal_statistics;
+    const unsigned char		*buffer;
+    uint32_t			length;
+
+    if (tpm_statistics != NULL) {
+	usec = TPM_Statistics_GetTime() - startTime;
+	pthread_setspecific(tpm_statistics_current, NULL);
+	rc = TPM_OrdinalTable_Index(&index, ordinal);
+	if (rc == 0) {
+	    if (tpm_statistics->ordinals[index] == NULL) {
+		rc = TPM_Malloc((unsigned char **)&(tpm_statistics->ordinals[index]),
+				sizeof(TPM_ORDINAL_STATISTICS));
+		if (rc == 0) {
+		    memset(tpm_statistics->ordinals[index], 0, sizeof(TPM_ORDINAL_STATISTICS));
+		}
+	    }
+	}
+	if (rc == 0) {
+	    ordinal_statistics = tpm_statistics->ordinals[index];
+	    ordinal_statistics->count++;
+	    /* the response holds tag, paramSize, returnCode */
+	    if (returnCode == TPM_SUCCESS) {
+		TPM_Sbuffer_Get(response, &buffer, &length);
+		if ((length < (sizeof(TPM_TAG) + sizeof(uint32_t) + sizeof(TPM_RESULT))) ||
+		    (LOAD32(buffer, sizeof(TPM_TAG) + sizeof(uint32_t)) != TPM_SUCCESS)) {
+		    ordinal_statistics->errors++;
+		}
+	    }
+	    else {
+		ordinal_statistics->errors++;
+	    }
+	    ordinal_statistics->total_usec += usec;
+	    if (usec > ordinal_statistics->max_usec) {
+		ordinal_statistics->max_usec = usec;
+	    }
+	    ordinal_statistics->histogram[TPM_Statistics_Bucket(usec)]++;
+	}
+    }
+    return;
+}
+
+/* TPM_Statistics_StartTimer() starts timing an operation on behalf of the ordinal being processed.
+
+   '*startTime' is 0 if statistics are not collected.
+*/
+
+void TPM_Statistics_StartTimer(uint64_t *startTime)
+{
+    *startTime = 0;
+    if (tpm_statistics_enabled &&
+	(pthread_getspecific(tpm_statistics_current) != NULL)) {
+	*startTime = TPM_Statistics_GetTime();
+    }
+    return;
+}
+
+/* TPM_Statistics_StopTimer() adds the time since TPM_Statistics_StartTimer() to the 'operation'
+   statistics of the ordinal being processed.
+*/
+
+void TPM_Statistics_StopTimer(uint64_t startTime,
+			      unsigned int operation)
+{
+    TPM_STATISTICS	*tpm_statistics;
+    uint64_t		usec;
+
+    if (startTime != 0) {
+	usec = TPM_Statistics_GetTime() - startTime;
+	tpm_statistics = pthread_getspecific(tpm_statistics_current);
+	if (tpm_statistics != NULL) {
+	    switch (operation) {
+	      case TPM_STATISTICS_NVSTORE:
+		tpm_statistics->nvstore_count++;
+		tpm_statistics->nvstore_usec += usec;
+		break;
+	      case TPM_STATISTICS_RSA:
+		tpm_statistics->rsa_count++;
+		tpm_statistics->rsa_usec += usec;
+		break;
+	    }
+	}
+    }
+    return;
+}
+
+/* TPM_Statistics_Get() returns a copy of 'tpm_statistics' and the statistics of 'tpm_slab_pool' in
+   '*stats', which must be freed by the caller.  Only ordinals that were processed are returned.
+   'tpm_statistics' may be NULL if the instance has not collected any statistics.
+
+   If 'reset' is TRUE, the statistics are cleared.
+*/
+
+TPM_RESULT TPM_Statistics_Get(struct tpmlib_statistics **stats,
+			      TPM_STATISTICS *tpm_statistics,
+			      TPM_SLAB_POOL *tpm_slab_pool,
+			      TPM_BOOL reset)
+{
+    TPM_RESULT	rc = 0;
+    size_t	i;
+    uint32_t	num_ordinals = 0;
+    struct tpmlib_ordinal_statistics *ordinal_stats;
+
+    printf(" TPM_Statistics_Get:\n");
+    *stats = NULL;
+    if (tpm_statistics != NULL) {
+	for (i = 0 ; i < TPM_ORDINAL_INDEX_SIZE ; i++) {
+	    if ((tpm_statistics->ordinals[i] != NULL) &&
+		(tpm_statistics->ordinals[i]->count != 0)) {
+		num_ordinals++;
+	    }
+	}
+    }
+    /* the ordinals array follows the structure in the same allocation */
+    if (rc == 0) {
+	rc = TPM_Malloc((unsigned char **)stats,
+			sizeof(struct tpmlib_statistics) +
+			(num_ordinals * sizeof(struct tpmlib_ordinal_statistics)));
+    }
+    if (rc == 0) {
+	memset(*stats, 0, sizeof(struct tpmlib_statistics));
+	(*stats)->num_ordinals = num_ordinals;
+	(*stats)->ordinals = (struct tpmlib_ordinal_statistics *)(*stats + 1);
+	ordinal_stats = (*stats)->ordinals;
+	TPM_SlabPool_GetStatistics((*stats)->pools, tpm_slab_pool, reset);
+	if (tpm_statistics != NULL) {
+	    (*stats)->nvstore_count = tpm_statistics->nvstore_count;
+	    (*stats)->nvstore_usec = tpm_statistics->nvstore_usec;
+	    (*stats)->rsa_count = tpm_statistics->rsa_count;
+	    (*stats)->rsa_usec = tpm_statistics->rsa_usec;
+	    for (i = 0 ; i < TPM_ORDINAL_INDEX_SIZE ; i++) {
+		if ((tpm_statistics->ordinals[i] != NULL) &&
+		    (tpm_statistics->ordinals[i]->count != 0)) {
+		    TPM_OrdinalTable_IndexOrdinal(&(ordinal_stats->ordinal), i);
+		    ordinal_stats->reserved = 0;
+		    ordinal_stats->count = tpm_statistics->ordinals[i]->count;
+		    ordinal_stats->errors = tpm_statistics->ordinals[i]->errors;
+		    ordinal_stats->total_usec = tpm_statistics->ordinals[i]->total_usec;
+		    ordinal_stats->max_usec = tpm_statistics->ordinals[i]->max_usec;
+		    memcpy(ordinal_stats->histogram, tpm_statistics->ordinals[i]->histogram,
+			   sizeof(ordinal_stats->histogram));
+		    ordinal_stats++;
+		}
+	    }
+	}
+    }
+    if ((rc == 0) && reset && (tpm_statistics != NULL)) {
+	for (i = 0 ; i < TPM_ORDINAL_INDEX_SIZE ; i++) {
+	    if (tpm_statistics->ordinals[i] != NULL) {
+		memset(tpm_statistics->ordinals[i], 0, sizeof(TPM_ORDINAL_STATISTICS));
+	    }
+	}
+	tpm_statistics->nvstore_count = 0;
+	tpm_statistics->nvstore_usec = 0;
+	tpm_statistics->rsa_count = 0;
+	tpm_statistics->rsa_usec = 0;
+    }
+    return rc;
+}
+
+/* TPM_Statistics_Delete() frees the statistics of a TPM instance */
+
+void TPM_Statistics_Delete(TPM_STATISTICS **tpm_statistics)
+{
+    size_t	i;
+
+    if (*tpm_statistics != NULL) {
+	for (i = 0 ; i < TPM_ORDINAL_INDEX_SIZE ; i++) {
+	    free((*tpm_statistics)->ordinals[i]);
+	}
+	free(*tpm_statistics);
+	*tpm_statistics = NULL;
+    }
+    return;
+}
@@ -0,0 +1,95 @@
+/********************************************************************************/
+/*										*/
+/*				TPM Statistics					*/
+/*		       IBM Thomas J. Watson Research Center			*/
+/*										*/
+/* (c) Copyright IBM Corporation 2015.						*/
+/*										*/
+/* All rights reserved.								*/
+/* 										*/
+/* Redistribution and use in source and binary forms, with or without		*/
+/* modification, are permitted provided that the following conditions are	*/
+/* met:										*/
+/* 										*/
+/* Redistributions of source code must retain the above copyright notice,	*/
+/* this list of conditions and the following disclaimer.			*/
+/* 										*/
+/* Redistributions in binary form must reproduce the above copyright		*/
+/* notice, this list of conditions and the following disclaimer in the		*/
+/* documentation and/or other materials provided with the distribution.		*/
+/* 										*/
+/* Neither the names of the IBM Corporation nor the names of its		*/
+/* contributors may be used to endorse or promote products derived from		*/
+/* this software without specific prior written permission.			*/
+/* 										*/
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS		*/
+/* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT		*/
+/* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR	*/
+/* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT		*/
+/* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,	*/
+/* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT		*/
+/* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,	*/
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY	*/
+/* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT		*/
+/* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE	*/
+/* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.		*/
+/********************************************************************************/
+
+
+#ifndef TPM_STATISTICS_H
+#define TPM_STATISTICS_H
+
+#include "tpm_global.h"
+#include "tpm_library.h"
+#include "tpm_process.h"
+#include "tpm_store.h"
+#include "tpm_types.h"
+
+/* operations timed outside of the ordinal processing function */
+
+#define TPM_STATISTICS_NVSTORE	0
+#define TPM_STATISTICS_RSA	1
+
+/* statistics for one ordinal */
+
+typedef struct tdTPM_ORDINAL_STATISTICS {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t total_usec;
+    uint64_t max_usec;
+    uint64_t histogram[TPMLIB_STATISTICS_BUCKETS];
+} TPM_ORDINAL_STATISTICS;
+
+/* statistics for one TPM instance
+
+   'ordinals' is indexed the same way as the ordinal table index.  Entries are allocated on first
+   use.
+*/
+
+typedef struct tdTPM_STATISTICS {
+    TPM_ORDINAL_STATISTICS *ordinals[TPM_ORDINAL_INDEX_SIZE];
+    uint64_t nvstore_count;
+    uint64_t nvstore_usec;
+    uint64_t rsa_count;
+    uint64_t rsa_usec;
+} TPM_STATISTICS;
+
+void       TPM_Statistics_Enable(TPM_BOOL enable);
+void       TPM_Statistics_Begin(TPM_STATISTICS **tpm_statistics,
+				uint64_t *startTime,
+				tpm_state_t *tpm_state);
+void       TPM_Statistics_End(TPM_STATISTICS *tpm_statistics,
+			      uint64_t startTime,
+			      TPM_COMMAND_CODE ordinal,
+			      TPM_RESULT returnCode,
+			      TPM_STORE_BUFFER *response);
+void       TPM_Statistics_StartTimer(uint64_t *startTime);
+void       TPM_Statistics_StopTimer(uint64_t startTime,
+				    unsigned int operation);
+TPM_RESULT TPM_Statistics_Get(struct tpmlib_statistics **stats,
+			      TPM_STATISTICS *tpm_statistics,
+			      TPM_SLAB_POOL *tpm_slab_pool,
+			      TPM_BOOL reset);
+void       TPM_Statistics_Delete(TPM_STATISTICS **tpm_statistics);
+
+#endif
@@ -41,9 +41,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "tpm_arena.h"
 #include "tpm_auth.h"
 #include "tpm_cryptoh.h"
 #include "tpm_crypto.h"
+#define TPM_TRACE_CATEGORY TPMLIB_TRACE_CAT_KEY
 #include "tpm_debug.h"
 #include "tpm_digest.h"
 #include "tpm_error.h"
@@ -54,6 +56,7 @@
 #include "tpm_pcr.h"
 #include "tpm_process.h"
 #include "tpm_secret.h"
+#include "tpm_slab.h"
 #include "tpm_structures.h"
 #include "tpm_ver.h"
 
@@ -363,7 +366,7 @@ TPM_RESULT TPM_SealedData_DecryptEncData(TPM_SEALED_DATA *tpm_sealed_data,	/* re
 	stream_size = decryptDataLength;
 	rc = TPM_SealedData_Load(tpm_sealed_data, &stream, &stream_size);
     }
-    free(decryptData);		/* @1 */
+    TPM_Arena_Free(decryptData);		/* @1 */
     return rc;
 }
 
@@ -563,11 +566,11 @@ void TPM_StoredData_Delete(TPM_STORED_DATA *tpm_stored_data,
 	TPM_SizedBuffer_Delete(&(tpm_stored_data->encData));
 	if (version == 1) {
 	    TPM_PCRInfo_Delete(tpm_stored_data->tpm_seal_info);
-	    free(tpm_stored_data->tpm_seal_info);
+	    TPM_Slab_Free(tpm_stored_data->tpm_seal_info);
 	}
 	else {
 	    TPM_PCRInfoLong_Delete((TPM_PCR_INFO_LONG *)tpm_stored_data->tpm_seal_info);
-	    free(tpm_stored_data->tpm_seal_info);
+	    TPM_Slab_Free(tpm_stored_data->tpm_seal_info);
 	}
 	TPM_StoredData_Init(tpm_stored_data, version);
     }
@@ -710,7 +713,7 @@ static TPM_RESULT TPM_SealCryptCommon(BYTE **o1,	/* freed by caller */
 	TPM_PrintFour("  TPM_SealCryptCommon: output data", *o1);
 	
     }
-    free(x1);				/* @1 */
+    TPM_Arena_Free(x1);				/* @1 */
     return rc;
 }
 
@@ -808,7 +811,7 @@ TPM_RESULT TPM_Process_Seal(tpm_state_t *tpm_state,
     }	
     /* get inData parameter */
     if (returnCode == TPM_SUCCESS) {
-	returnCode = TPM_SizedBuffer_Load(&inData, &command, &paramSize);
+	returnCode = TPM_SizedBuffer_LoadTransient(&inData, &command, &paramSize);
     }	
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_Seal: Sealing %u bytes\n", inData.size);
@@ -1221,7 +1224,7 @@ TPM_RESULT TPM_Process_Sealx(tpm_state_t *tpm_state,
     }	
     /* get inData parameter */
     if (returnCode == TPM_SUCCESS) {
-	returnCode = TPM_SizedBuffer_Load(&inData, &command, &paramSize);
+	returnCode = TPM_SizedBuffer_LoadTransient(&inData, &command, &paramSize);
     }	
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_Sealx: Sealing %u bytes\n", inData.size);
@@ -2071,7 +2074,7 @@ TPM_RESULT TPM_Process_UnBind(tpm_state_t *tpm_state,
     /* get areaToSignSize and areaToSign parameters */
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_UnBind: keyHandle %08x\n", keyHandle);
-	returnCode = TPM_SizedBuffer_Load(&inData, &command, &paramSize);
+	returnCode = TPM_SizedBuffer_LoadTransient(&inData, &command, &paramSize);
     }
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_UnBind: UnBinding %u bytes\n", inData.size);
@@ -2304,7 +2307,7 @@ TPM_RESULT TPM_Process_UnBind(tpm_state_t *tpm_state,
       cleanup
     */
     TPM_SizedBuffer_Delete(&inData);		/* @1 */
-    free(decrypt_data);				/* @2 */
+    TPM_Arena_Free(decrypt_data);				/* @2 */
     TPM_BoundData_Delete(&tpm_bound_data);	/* @3 */
     return rcf;
 }
@@ -2747,7 +2750,8 @@ TPM_RESULT TPM_Process_LoadKey(tpm_state_t *tpm_state,
        storage after the command completes. */
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_LoadKey: parentHandle %08x\n", parentHandle);
-	returnCode = TPM_Malloc((unsigned char **)&inKey, sizeof(TPM_KEY));	/* freed @1 */
+	returnCode = TPM_Slab_Malloc((unsigned char **)&inKey, TPM_SLAB_KEY,
+				     sizeof(TPM_KEY));		/* freed @1 */
     }
     /* get inKey parameter */
     if (returnCode == TPM_SUCCESS) {
@@ -2881,11 +2885,11 @@ TPM_RESULT TPM_Process_LoadKey(tpm_state_t *tpm_state,
     /* if there was a failure, delete inKey */
     if ((rcf != 0) || (returnCode != TPM_SUCCESS)) {
 	TPM_Key_Delete(inKey);	/* @2 */
-	free(inKey);		/* @1 */
+	TPM_Slab_Free(inKey);	/* @1 */
 	if (key_added) {
 	    /* if there was a failure and inKey was stored in the handle list, free the handle.
 	       Ignore errors, since only one error code can be returned. */
-	    TPM_KeyHandleEntries_DeleteHandle(tpm_state->tpm_key_handle_entries, inKeyHandle);
+	    TPM_KeyHandleEntries_DeleteHandle(&(tpm_state->tpm_key_handle_entries), inKeyHandle);
 	}	
     }
     return rcf;
@@ -2982,7 +2986,8 @@ TPM_RESULT TPM_Process_LoadKey2(tpm_state_t *tpm_state,
        storage after the command completes. */
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_LoadKey2: parentHandle %08x\n", parentHandle);
-	returnCode = TPM_Malloc((unsigned char **)&inKey, sizeof(TPM_KEY));	/* freed @1 */
+	returnCode = TPM_Slab_Malloc((unsigned char **)&inKey, TPM_SLAB_KEY,
+				     sizeof(TPM_KEY));		/* freed @1 */
     }
     /* get inKey parameter */
     if (returnCode == TPM_SUCCESS) {
@@ -3117,11 +3122,11 @@ TPM_RESULT TPM_Process_LoadKey2(tpm_state_t *tpm_state,
     /* if there was a failure, delete inKey */
     if ((rcf != 0) || (returnCode != TPM_SUCCESS)) {
 	TPM_Key_Delete(inKey);	/* @2 */
-	free(inKey);		/* @1 */
+	TPM_Slab_Free(inKey);	/* @1 */
 	if (key_added) {
 	    /* if there was a failure and inKey was stored in the handle list, free the handle.
 	       Ignore errors, since only one error code can be returned. */
-	    TPM_KeyHandleEntries_DeleteHandle(tpm_state->tpm_key_handle_entries, inKeyHandle);
+	    TPM_KeyHandleEntries_DeleteHandle(&(tpm_state->tpm_key_handle_entries), inKeyHandle);
 	}	
     }
     return rcf;
@@ -3223,7 +3228,7 @@ static TPM_RESULT TPM_LoadKeyCommon(TPM_KEY_HANDLE	*inKeyHandle,	/* output */
        parentHandle.
     */
     if (rc == TPM_SUCCESS) {
-	rc = TPM_Key_DecryptEncData(inKey, parentKey);
+	rc = TPM_Key_DecryptEncData(inKey, parentKey, &(tpm_state->tpm_key_cache));
     }
     /* 6. Validate the integrity of inKey and decrypted TPM_STORE_ASYMKEY
        a. Reproduce inKey -> TPM_STORE_ASYMKEY -> pubDataDigest using the fields of inKey, and check
@@ -3313,7 +3318,7 @@ static TPM_RESULT TPM_LoadKeyCommon(TPM_KEY_HANDLE	*inKeyHandle,	/* output */
     if (rc == TPM_SUCCESS) {
 	*inKeyHandle = 0;	/* no preferred value */
 	rc = TPM_KeyHandleEntries_AddKeyEntry(inKeyHandle,			/* output */
-					      tpm_state->tpm_key_handle_entries, /* input */
+					      &(tpm_state->tpm_key_handle_entries), /* input */
 					      inKey,				/* input */
 					      parentPCRStatus,
 					      0);			/* keyControl */
@@ -3331,7 +3336,7 @@ static TPM_RESULT TPM_LoadKeyCommon(TPM_KEY_HANDLE	*inKeyHandle,	/* output */
     }
     if (rc == TPM_SUCCESS) {
 	if (parentPCRUsage) {
-	    rc = TPM_KeyHandleEntries_SetParentPCRStatus(tpm_state->tpm_key_handle_entries,
+	    rc = TPM_KeyHandleEntries_SetParentPCRStatus(&(tpm_state->tpm_key_handle_entries),
 							 *inKeyHandle, TRUE);
 	}
     }	
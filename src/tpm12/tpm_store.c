@@ -39,6 +39,7 @@
 
 /* Generally useful utilities to serialize structures to a stream */
 
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -63,6 +64,9 @@
 
 static void       TPM_Sbuffer_AdjustParamSize(TPM_STORE_BUFFER *sbuffer);
 static TPM_RESULT TPM_Sbuffer_AdjustReturnCode(TPM_STORE_BUFFER *sbuffer, TPM_RESULT returnCode);
+static TPM_RESULT TPM_Sbuffer_Grow(TPM_STORE_BUFFER *sbuffer,
+				   size_t data_length,
+				   TPM_BOOL exact);
 
 
 /* TPM_Sbuffer_Init() sets up a new serialize buffer.  It should be called before the first use. */
@@ -72,6 +76,8 @@ void TPM_Sbuffer_Init(TPM_STORE_BUFFER *sbuffer)
     sbuffer->buffer = NULL;
     sbuffer->buffer_current = NULL;
     sbuffer->buffer_end = NULL;
+    sbuffer->fixed = FALSE;
+    sbuffer->overflow = FALSE;
 }
 
 /* TPM_Sbuffer_Load() loads TPM_STORE_BUFFER that has been serialized using
@@ -111,14 +117,30 @@ TPM_RESULT TPM_Sbuffer_Load(TPM_STORE_BUFFER *sbuffer,
 
 /* TPM_Sbuffer_Delete() frees an existing buffer and reinitializes it.  It must be called when a
    TPM_STORE_BUFFER is no longer required, to avoid a memory leak.  The buffer can be reused, but in
-   that case TPM_Sbuffer_Clear would be a better choice. */
+   that case TPM_Sbuffer_Clear would be a better choice.
+
+   A fixed buffer belongs to the caller and is not freed.
+*/
 
 void TPM_Sbuffer_Delete(TPM_STORE_BUFFER *sbuffer)
 {
-    free(sbuffer->buffer);
+    if (!sbuffer->fixed) {
+	free(sbuffer->buffer);
+    }
     TPM_Sbuffer_Init(sbuffer);
 }
 
+/* TPM_Sbuffer_Zero() zeroizes the whole allocated buffer.  It is called before TPM_Sbuffer_Delete()
+   for a buffer that holds secrets, such as a serialized TPM_PERMANENT_DATA. */
+
+void TPM_Sbuffer_Zero(TPM_STORE_BUFFER *sbuffer)
+{
+    if (sbuffer->buffer != NULL) {
+	memset(sbuffer->buffer, 0, sbuffer->buffer_end - sbuffer->buffer);
+    }
+    return;
+}
+
 /* TPM_Sbuffer_Clear() removes all data from an existing buffer, allowing reuse.  Memory is NOT
    freed. */
 
@@ -195,6 +217,135 @@ TPM_RESULT TPM_Sbuffer_Set(TPM_STORE_BUFFER *sbuffer,
 	    sbuffer->buffer_current = NULL;
 	    sbuffer->buffer_end = NULL;
 	}
+	sbuffer->fixed = FALSE;
+	sbuffer->overflow = FALSE;
+    }
+    return rc;
+}
+
+/* TPM_Sbuffer_SetFixed() creates an empty TPM_STORE_BUFFER that serializes into the caller's
+   'buffer' of 'total' bytes.
+
+   The buffer is never reallocated or freed.  An append that does not fit returns TPM_SIZE and sets
+   the overflow flag, so that the caller can tell a too small buffer from other errors.
+*/
+
+void TPM_Sbuffer_SetFixed(TPM_STORE_BUFFER *sbuffer,
+			  unsigned char *buffer,
+			  uint32_t total)
+{
+    sbuffer->buffer = buffer;
+    sbuffer->buffer_current = buffer;
+    sbuffer->buffer_end = buffer + total;
+    sbuffer->fixed = TRUE;
+    sbuffer->overflow = FALSE;
+    return;
+}
+
+/* TPM_Sbuffer_IsOverlap() returns TRUE if the memory of the TPM_STORE_BUFFER, including the part
+   not used yet, overlaps the 'length' bytes at 'data'.
+*/
+
+TPM_BOOL TPM_Sbuffer_IsOverlap(const TPM_STORE_BUFFER *sbuffer,
+			       const unsigned char *data,
+			       uint32_t length)
+{
+    uintptr_t	buffer_start = (uintptr_t)sbuffer->buffer;
+    uintptr_t	buffer_end = (uintptr_t)sbuffer->buffer_end;
+    uintptr_t	data_start = (uintptr_t)data;
+
+    return ((sbuffer->buffer != NULL) && (data != NULL) && (length > 0) &&
+	    (data_start < buffer_end) && (buffer_start < data_start + length));
+}
+
+/* TPM_Sbuffer_Grow() makes room for at least 'data_length' more bytes in the TPM_STORE_BUFFER.
+
+   If 'exact' is TRUE, the buffer grows to exactly the required size.  This is used when the caller
+   knows the final serialized size.  Otherwise the buffer at least doubles, so that a long series
+   of appends costs a logarithmic rather than linear number of realloc's.
+
+   Returns 0 if success, TPM_SIZE if the buffer cannot be allocated or a fixed buffer is full.
+*/
+
+static TPM_RESULT TPM_Sbuffer_Grow(TPM_STORE_BUFFER *sbuffer,
+				   size_t data_length,
+				   TPM_BOOL exact)
+{
+    TPM_RESULT  rc = 0;
+    size_t free_length;         /* length of free bytes in current buffer */
+    size_t current_size;        /* size of current buffer */
+    size_t current_length;      /* bytes in current buffer */
+    size_t new_size;            /* size of new buffer */
+
+    /* cast safe as end is always greater than current */
+    free_length = (size_t)(sbuffer->buffer_end - sbuffer->buffer_current);
+    /* a fixed buffer cannot grow */
+    if (sbuffer->fixed) {
+        printf("TPM_Sbuffer_Grow: Error, %lu bytes do not fit the %lu bytes left\n",
+               (unsigned long)data_length, (unsigned long)free_length);
+        sbuffer->overflow = TRUE;
+        rc = TPM_SIZE;
+    }
+    /* This test will fail long before the add uint32_t overflow */
+    if (rc == 0) {
+        /* cast safe as current is always greater than start */
+        current_length = (size_t)(sbuffer->buffer_current - sbuffer->buffer);
+        if ((current_length + data_length) > TPM_ALLOC_MAX) {
+            printf("TPM_Sbuffer_Grow: "
+                   "Error, size %lu + %lu greater than maximum allowed\n",
+                   (unsigned long)current_length, (unsigned long)data_length);
+            rc = TPM_SIZE;
+        }
+    }
+    if (rc == 0) {
+        /* cast safe as end is always greater than start */
+        current_size = (size_t)(sbuffer->buffer_end - sbuffer->buffer);
+        if (exact) {
+            new_size = current_length + data_length;
+        }
+        else {
+            /* double the buffer, or more if the data requires it */
+            new_size = current_size * 2;
+            if (new_size < (current_length + data_length)) {
+                new_size = current_length + data_length;
+            }
+            /* optimize realloc's by rounding up to the next increment */
+            new_size = (((new_size - 1)/TPM_STORE_BUFFER_INCREMENT) + 1) *
+                       TPM_STORE_BUFFER_INCREMENT;
+            /* but not greater than maximum buffer size */
+            if (new_size > TPM_ALLOC_MAX) {
+                new_size = TPM_ALLOC_MAX;
+            }
+        }
+        rc = TPM_Realloc(&(sbuffer->buffer), new_size);
+    }
+    if (rc == 0) {
+        sbuffer->buffer_end = sbuffer->buffer + new_size;       /* end */
+        sbuffer->buffer_current = sbuffer->buffer + current_length; /* new empty position */
+    }
+    return rc;
+}
+
+/* TPM_Sbuffer_Reserve() ensures that at least 'length' bytes can be appended to the
+   TPM_STORE_BUFFER without a further realloc.
+
+   Callers that can calculate the serialized size of a structure up front (see the _SizeOf()
+   functions) use this to allocate once.  A short reservation is harmless, since an append past it
+   still grows the buffer.
+
+   Returns 0 if success, TPM_SIZE if the buffer cannot be allocated or a fixed buffer is too small.
+*/
+
+TPM_RESULT TPM_Sbuffer_Reserve(TPM_STORE_BUFFER *sbuffer,
+			       size_t length)
+{
+    TPM_RESULT  rc = 0;
+    size_t free_length;         /* length of free bytes in current buffer */
+
+    /* cast safe as end is always greater than current */
+    free_length = (size_t)(sbuffer->buffer_end - sbuffer->buffer_current);
+    if (free_length < length) {
+        rc = TPM_Sbuffer_Grow(sbuffer, length, TRUE);
     }
     return rc;
 }
@@ -202,7 +353,7 @@ TPM_RESULT TPM_Sbuffer_Set(TPM_STORE_BUFFER *sbuffer,
 /* TPM_Sbuffer_Append() is the basic function to append 'data' of size 'data_length' to the
    TPM_STORE_BUFFER
 
-   Returns 0 if success, TPM_SIZE if the buffer cannot be allocated.
+   Returns 0 if success, TPM_SIZE if the buffer cannot be allocated or a fixed buffer is full.
 */
 
 TPM_RESULT TPM_Sbuffer_Append(TPM_STORE_BUFFER *sbuffer,
@@ -211,9 +362,6 @@ TPM_RESULT TPM_Sbuffer_Append(TPM_STORE_BUFFER *sbuffer,
 {
     TPM_RESULT  rc = 0;
     size_t free_length;         /* length of free bytes in current buffer */
-    size_t current_size;        /* size of current buffer */
-    size_t current_length;      /* bytes in current buffer */
-    size_t new_size;            /* size of new buffer */
     
     /* can data fit? */
     if (rc == 0) {
@@ -221,38 +369,7 @@ TPM_RESULT TPM_Sbuffer_Append(TPM_STORE_BUFFER *sbuffer,
         free_length = (size_t)(sbuffer->buffer_end - sbuffer->buffer_current);
         /* if data cannot fit in buffer as sized */
         if (free_length < data_length) {
-            /* This test will fail long before the add uint32_t overflow */
-            if (rc == 0) {
-                /* cast safe as current is always greater than start */
-                current_length = (size_t)(sbuffer->buffer_current - sbuffer->buffer);
-                if ((current_length + data_length) > TPM_ALLOC_MAX) {
-                    printf("TPM_Sbuffer_Append: "
-                           "Error, size %lu + %lu greater than maximum allowed\n",
-                           (unsigned long)current_length, (unsigned long)data_length);
-                    rc = TPM_SIZE;
-                }
-            }
-            if (rc == 0) {
-                /* cast safe as end is always greater than start */
-                current_size = (size_t)(sbuffer->buffer_end - sbuffer->buffer);
-                /* optimize realloc's by rounding up data_length to the next increment */
-                new_size = current_size +       /* currently used */
-                           ((((data_length - 1)/TPM_STORE_BUFFER_INCREMENT) + 1) *
-                            TPM_STORE_BUFFER_INCREMENT);
-                /* but not greater than maximum buffer size */
-                if (new_size > TPM_ALLOC_MAX) {
-                    new_size = TPM_ALLOC_MAX;
-                }
-                printf("   TPM_Sbuffer_Append: data_length %lu, growing from %lu to %lu\n",
-                       (unsigned long)data_length,
-                       (unsigned long)current_size,
-                       (unsigned long)new_size);
-                rc = TPM_Realloc(&(sbuffer->buffer), new_size);
-            }
-            if (rc == 0) {
-                sbuffer->buffer_end = sbuffer->buffer + new_size;       /* end */
-                sbuffer->buffer_current = sbuffer->buffer + current_length; /* new empty position */
-            }
+            rc = TPM_Sbuffer_Grow(sbuffer, data_length, FALSE);
         }
     }
     /* append the data */
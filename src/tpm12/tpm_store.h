@@ -50,6 +50,7 @@ TPM_RESULT TPM_Sbuffer_Load(TPM_STORE_BUFFER *sbuffer,
                             uint32_t *stream_size);
 /* TPM_Sbuffer_Store(): See TPM_Sbuffer_AppendAsSizedBuffer() */
 void       TPM_Sbuffer_Delete(TPM_STORE_BUFFER *sbuffer);
+void       TPM_Sbuffer_Zero(TPM_STORE_BUFFER *sbuffer);
 
 void       TPM_Sbuffer_Clear(TPM_STORE_BUFFER *sbuffer);
 void       TPM_Sbuffer_Get(TPM_STORE_BUFFER *sbuffer,
@@ -63,6 +64,14 @@ TPM_RESULT TPM_Sbuffer_Set(TPM_STORE_BUFFER *sbuffer,
 			   unsigned char *buffer,
 			   const uint32_t length,
 			   const uint32_t total);
+void       TPM_Sbuffer_SetFixed(TPM_STORE_BUFFER *sbuffer,
+				unsigned char *buffer,
+				uint32_t total);
+TPM_BOOL   TPM_Sbuffer_IsOverlap(const TPM_STORE_BUFFER *sbuffer,
+                                 const unsigned char *data,
+                                 uint32_t length);
+TPM_RESULT TPM_Sbuffer_Reserve(TPM_STORE_BUFFER *sbuffer,
+			       size_t length);
 
 TPM_RESULT TPM_Sbuffer_Append(TPM_STORE_BUFFER *sbuffer,
                               const unsigned char *data,
@@ -100,16 +100,79 @@ typedef struct tdTPM_SIZED_BUFFER {
     BYTE *buffer;
 } TPM_SIZED_BUFFER;
 
+/* This structure is a TPM_SIZED_BUFFER borrowed from the command stream, see
+   TPM_SizedBufferView_Load().  'buffer' points into the command bytes rather than to allocated
+   memory.  It is valid while the ordinal is processed and is never freed. */
+
+typedef struct tdTPM_SIZED_BUFFER_VIEW {
+    uint32_t size;
+    const BYTE *buffer;
+} TPM_SIZED_BUFFER_VIEW;
+
 /* This structure implements a safe storage buffer, used throughout the code when serializing
    structures to a stream.
+
+   A fixed buffer is supplied by the caller, see TPM_Sbuffer_SetFixed().  It is never reallocated or
+   freed.  An append that does not fit fails with TPM_SIZE.
 */
 
 typedef struct tdTPM_STORE_BUFFER {
     unsigned char *buffer;              /* beginning of buffer */
     unsigned char *buffer_current;      /* first empty position in buffer */
     unsigned char *buffer_end;          /* one past last valid position in buffer */
+    TPM_BOOL fixed;                     /* buffer is caller supplied */
+    TPM_BOOL overflow;                  /* an append did not fit the fixed buffer */
 } TPM_STORE_BUFFER;
 
+/* This structure implements the per command arena of a TPM instance, see TPM_Arena_Malloc().
+
+   Allocations are carved sequentially from 'buffer' and all of them are released at once when the
+   command completes.
+*/
+
+typedef struct tdTPM_ARENA {
+    unsigned char *buffer;              /* beginning of the arena, NULL until first used */
+    uint32_t size;                      /* total size of the arena */
+    uint32_t used;                      /* bytes allocated by the current command */
+} TPM_ARENA;
+
+/* object types of a TPM_SLAB_POOL, see TPM_Slab_Malloc().  The values are the same as those of the
+   TPMLIB_POOL_ statistics. */
+
+#define TPM_SLAB_KEY			0	/* TPM_KEY */
+#define TPM_SLAB_STORE_ASYMKEY		1	/* TPM_STORE_ASYMKEY */
+#define TPM_SLAB_PCR_INFO		2	/* TPM_PCR_INFO */
+#define TPM_SLAB_PCR_INFO_LONG		3	/* TPM_PCR_INFO_LONG */
+#define TPM_SLAB_PCR_INFO_SHORT		4	/* TPM_PCR_INFO_SHORT */
+#define TPM_SLAB_SYMMETRIC_KEY		5	/* TPM_SYMMETRIC_KEY_DATA */
+#define TPM_SLAB_RSA_KEY_PARMS		6	/* TPM_RSA_KEY_PARMS */
+#define TPM_SLAB_TYPES			7
+
+/* This structure holds the objects of one type of a TPM_SLAB_POOL.
+
+   Objects are carved from slabs of TPM_SLAB_OBJECTS objects.  A freed object is kept on the free
+   list for reuse rather than returned to the heap.  The slabs are only freed with the pool.
+*/
+
+typedef struct tdTPM_SLAB {
+    uint32_t objectSize;                /* bytes per object, including its header */
+    TPM_BOOL zeroize;                   /* objects hold secrets, zeroize them when freed */
+    unsigned char *freeList;            /* first free object, NULL if none */
+    unsigned char *slabList;            /* most recently allocated slab, NULL if none */
+    uint32_t slabs;                     /* number of slabs */
+    uint32_t inUse;                     /* number of allocated objects */
+    uint32_t freeCount;                 /* number of objects on the free list */
+    uint64_t allocs;                    /* allocations since the last statistics reset */
+    uint64_t frees;                     /* frees since the last statistics reset */
+} TPM_SLAB;
+
+/* This structure implements the pools of fixed size objects of a TPM instance, one TPM_SLAB for
+   each TPM_SLAB_ type */
+
+typedef struct tdTPM_SLAB_POOL {
+    TPM_SLAB slab[TPM_SLAB_TYPES];
+} TPM_SLAB_POOL;
+
 /* 5.1 TPM_STRUCT_VER rev 100
 
    This indicates the version of the structure or TPM. 
@@ -701,6 +764,11 @@ typedef struct tdTPM_STORE_PRIVKEY {
     TPM_SIZED_BUFFER d_key;             /* private key */
     TPM_SIZED_BUFFER p_key;             /* private prime factor */
     TPM_SIZED_BUFFER q_key;             /* private prime factor */
+    /* Chinese Remainder Theorem parameters, not serialized.  They are calculated once when the key
+       is generated or loaded and used for all private key operations. */
+    TPM_SIZED_BUFFER dp_key;            /* d mod (p-1) */
+    TPM_SIZED_BUFFER dq_key;            /* d mod (q-1) */
+    TPM_SIZED_BUFFER qinv_key;          /* q^-1 mod p */
 } TPM_STORE_PRIVKEY; 
 
 /* 10.6 TPM_STORE_ASYMKEY rev 87
@@ -829,6 +897,9 @@ typedef struct tdTPM_KEY {
        these structures are always non-NULL. */
     TPM_STORE_ASYMKEY *tpm_store_asymkey;
     TPM_MIGRATE_ASYMKEY *tpm_migrate_asymkey;
+    /* A cache of the crypto library private key token, built on the first private key operation
+       and freed with the key.  It is not serialized. */
+    TPM_RSA_KEY_TOKEN rsa_key_token;
 } TPM_KEY; 
 
 /* 10.3 TPM_KEY12 rev 87
@@ -894,7 +965,7 @@ typedef struct tdTPM_PUBKEY {
 /* Set the default to 3 so that there can be one owner evict key */
 
 #ifndef TPM_KEY_HANDLES 
-#define TPM_KEY_HANDLES 3     /* entries in global TPM_KEY_HANDLE_ENTRY array */
+#define TPM_KEY_HANDLES 3     /* default entries in the TPM_KEY_HANDLE_ENTRIES array */
 #endif
 
 /* TPM_GetCapability uses a uint_16 for the number of key slots */
@@ -929,8 +1000,55 @@ typedef struct tdTPM_KEY_HANDLE_ENTRY {
     TPM_BOOL parentPCRStatus;   /* TRUE if parent of this key uses PCR's */
     TPM_KEY_CONTROL keyControl; /* Attributes that can control various aspects of key usage and
                                    manipulation. */
+    uint32_t lastUse;           /* keyHandleTick when last added or used, not serialized */
 } TPM_KEY_HANDLE_ENTRY; 
 
+/* The key slots of a TPM instance.  The number of entries is set when the instance is created,
+   TPM_KEY_HANDLES by default.
+
+   If keySwap is TRUE, a key that does not fit in the slots evicts the least recently used key that
+   is not owner evict to the swap entries.  A swapped key keeps its handle and is moved back to a
+   slot when it is used, see TPM_KeyHandleEntries_GetEntry().
+*/
+
+typedef struct tdTPM_KEY_HANDLE_ENTRIES {
+    uint32_t keyHandleCount;			/* number of entries */
+    TPM_KEY_HANDLE_ENTRY *tpm_key_handle_entry;	/* array of TPM_KEY_HANDLE_ENTRY */
+    uint32_t keyHandleNext;			/* where TPM_KeyHandleEntries_IsSpace() starts */
+    /* open addressing hash table from handle to the location, a slot below keyHandleCount, else a
+       swap entry.  See TPM_KeyHandleEntries_GetEntry() */
+    uint32_t keyHandleHashSize;			/* number of buckets, a power of 2 */
+    uint32_t keyHandleHashUsed;			/* number of non-empty buckets */
+    uint32_t *keyHandleHash;			/* location + 1, 0 for an empty bucket */
+    uint32_t keyHandleTick;			/* use counter for lastUse */
+    TPM_BOOL keySwap;				/* evict to the swap entries when full */
+    uint32_t keySwapCount;			/* swap entries used, including deleted ones */
+    uint32_t keySwapAlloc;			/* swap entries allocated */
+    TPM_KEY_HANDLE_ENTRY *tpm_key_swap_entry;	/* array of swapped TPM_KEY_HANDLE_ENTRY */
+} TPM_KEY_HANDLE_ENTRIES;
+
+/* A TPM_KEY -> encData decrypted by a parent key, see TPM_Key_DecryptEncData() */
+
+#define TPM_KEY_CACHE_ENTRIES_MAX 1024	/* entries of the TPM_KEY_CACHE array, at most */
+
+typedef struct tdTPM_KEY_CACHE_ENTRY {
+    TPM_DIGEST parentDigest;		/* pubDataDigest of the parent key */
+    TPM_DIGEST encDataDigest;		/* digest of the encData */
+    unsigned char *decryptData;		/* decrypted encData, NULL for an empty entry */
+    uint32_t decryptDataLength;
+    uint32_t lastUse;			/* keyCacheTick when last added or used */
+} TPM_KEY_CACHE_ENTRY;
+
+/* The decrypted key blob cache of a TPM instance, so that loading a recently loaded key again
+   does not require a private key operation.  The number of entries is set when the instance is
+   created, 0 by default, which disables the cache. */
+
+typedef struct tdTPM_KEY_CACHE {
+    uint32_t keyCacheCount;			/* number of entries */
+    uint32_t keyCacheTick;			/* use counter for lastUse */
+    TPM_KEY_CACHE_ENTRY *tpm_key_cache_entry;	/* array of TPM_KEY_CACHE_ENTRY */
+} TPM_KEY_CACHE;
+
 /* 5.12 TPM_MIGRATIONKEYAUTH rev 87
 
    This structure provides the proof that the associated public key has TPM Owner authorization to
@@ -2001,6 +2119,21 @@ typedef struct tdTPM_PERMANENT_DATA {
 
 /* NOTE: Vendor specific */
 
+/* TPM_HMAC_STATE caches the SHA-1 chaining values after the key XOR ipad and the key XOR opad
+   blocks of an HMAC key, so that an HMAC with the same key starts from there.
+
+   vendor specific, never serialized.  The chaining values are as secret as the key.
+*/
+
+#define TPM_SHA1_STATE_WORDS	5
+
+typedef struct tdTPM_HMAC_STATE {
+    TPM_BOOL valid;				/* the states were computed for 'key' */
+    TPM_SECRET key;
+    uint32_t innerState[TPM_SHA1_STATE_WORDS];	/* after key XOR ipad */
+    uint32_t outerState[TPM_SHA1_STATE_WORDS];	/* after key XOR opad */
+} TPM_HMAC_STATE;
+
 typedef struct tdTPM_AUTH_SESSION_DATA {
     /* vendor specific */
     TPM_AUTHHANDLE handle;      /* Handle for a session */
@@ -2012,6 +2145,7 @@ typedef struct tdTPM_AUTH_SESSION_DATA {
     TPM_SECRET sharedSecret;    /* OSAP */
     TPM_DIGEST entityDigest;    /* OSAP tracks which entity established the OSAP session */
     TPM_DELEGATE_PUBLIC pub;    /* DSAP */
+    TPM_HMAC_STATE hmacState;   /* pad states of the last HMAC key, not stored */
     TPM_BOOL valid;             /* added kgold: array entry is valid */
 } TPM_AUTH_SESSION_DATA;
 
@@ -2494,6 +2628,10 @@ typedef struct tdTPM_NV_DATA_SENSITIVE {
 typedef struct tdTPM_NV_INDEX_ENTRIES {
     uint32_t nvIndexCount;			/* number of entries */
     TPM_NV_DATA_SENSITIVE *tpm_nvindex_entry;	/* array of TPM_NV_DATA_SENSITIVE */
+    /* open addressing hash table from nvIndex to the entry, see TPM_NVIndexEntries_GetEntry() */
+    uint32_t nvIndexHashSize;			/* number of buckets, a power of 2 */
+    uint32_t nvIndexHashUsed;			/* number of non-empty buckets */
+    uint32_t *nvIndexHash;			/* entry number + 1, 0 for an empty bucket */
 } TPM_NV_INDEX_ENTRIES;
 
 /* TPM_NV_DATA_ST
@@ -378,6 +378,18 @@ TPM_RESULT TPM_CurrentTicks_StoreAll(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_CurrentTicks_SizeOfAll() returns the number of bytes TPM_CurrentTicks_StoreAll()
+   serializes */
+
+uint32_t TPM_CurrentTicks_SizeOfAll(void)
+{
+    return sizeof(uint16_t) +			/* tag */
+	(2 * sizeof(uint32_t)) +		/* currentTicks */
+	sizeof(uint16_t) +			/* tickRate */
+	TPM_NONCE_SIZE +
+	(2 * sizeof(uint32_t));			/* initialTime */
+}
+
 /* TPM_CurrentTicks_Update() updates the currentTicks member of TPM_CURRENT_TICKS
    relative to the initial time
 
@@ -70,6 +70,7 @@ TPM_RESULT TPM_CurrentTicks_LoadAll(TPM_CURRENT_TICKS *tpm_current_ticks,
 				    uint32_t *stream_size);
 TPM_RESULT TPM_CurrentTicks_StoreAll(TPM_STORE_BUFFER *sbuffer,
 				     const TPM_CURRENT_TICKS *tpm_current_ticks);
+uint32_t   TPM_CurrentTicks_SizeOfAll(void);
 TPM_RESULT TPM_CurrentTicks_Start(TPM_CURRENT_TICKS *tpm_current_ticks);
 TPM_RESULT TPM_CurrentTicks_Update(TPM_CURRENT_TICKS *tpm_current_ticks);
 void       TPM_CurrentTicks_Copy(TPM_CURRENT_TICKS *dest,
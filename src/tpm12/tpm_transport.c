@@ -41,6 +41,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "tpm_arena.h"
 #include "tpm_audit.h"
 #include "tpm_auth.h"
 #include "tpm_crypto.h"
@@ -246,6 +247,29 @@ TPM_RESULT TPM_TransportSessions_Store(TPM_STORE_BUFFER *sbuffer,
     return rc;
 }
 
+/* TPM_TransportSessions_SizeOf() returns the number of bytes TPM_TransportSessions_Store()
+   serializes */
+
+uint32_t TPM_TransportSessions_SizeOf(TPM_TRANSPORT_INTERNAL *transSessions)
+{
+    uint32_t	size;
+    uint32_t	space;		/* free transport session slots */
+
+    TPM_TransportSessions_GetSpace(&space, transSessions);
+    size = sizeof(uint32_t) +			/* activeCount */
+	   ((TPM_MIN_TRANS_SESSIONS - space) *
+	    (sizeof(uint16_t) +			/* tag */
+	     TPM_SECRET_SIZE +			/* authData */
+	     sizeof(uint16_t) +			/* TPM_TRANSPORT_PUBLIC */
+	     sizeof(TPM_TRANSPORT_ATTRIBUTES) +
+	     sizeof(TPM_ALGORITHM_ID) +
+	     sizeof(TPM_ENC_SCHEME) +
+	     sizeof(TPM_TRANSHANDLE) +
+	     TPM_NONCE_SIZE +			/* transNonceEven */
+	     TPM_DIGEST_SIZE));			/* transDigest */
+    return size;
+}
+
 /* TPM_TransportSessions_Delete() terminates all sessions
 
    No-OP if the parameter is NULL, else:
@@ -944,6 +968,7 @@ TPM_RESULT TPM_TransportInternal_Set(TPM_STORE_BUFFER		*response,
     if (rc == 0) {
 	rc = TPM_Authdata_Generate(transAuth,					/* result */
 				   tpm_transport_internal->authData,		/* HMAC key */
+				   NULL,
 				   outParamDigest,				/* params */
 				   tpm_transport_internal->transNonceEven,
 				   transNonceOdd,
@@ -1274,7 +1299,7 @@ TPM_RESULT TPM_TransportAuth_DecryptSecret(TPM_TRANSPORT_AUTH *tpm_transport_aut
 	stream_size = decryptDataLength;
 	rc = TPM_TransportAuth_Load(tpm_transport_auth, &stream, &stream_size);
     }
-    free(decryptData);		/* @1 */
+    TPM_Arena_Free(decryptData);		/* @1 */
     return rc;
 }
 
@@ -1798,7 +1823,7 @@ TPM_RESULT TPM_Process_ExecuteTransport(tpm_state_t *tpm_state,
     TPM_RESULT	returnCode = TPM_SUCCESS;	/* command return code */
 
     /* input parameters */
-    TPM_SIZED_BUFFER	wrappedCmd;		/* The wrapped command */
+    TPM_SIZED_BUFFER_VIEW wrappedCmd;	/* The wrapped command */
     TPM_TRANSHANDLE	transHandle;		/* The transport session handle */
     TPM_NONCE		transNonceOdd;		/* Nonce generated by caller */
     TPM_BOOL		continueTransSession;	/* The continue use flag for the authorization
@@ -1866,7 +1891,7 @@ TPM_RESULT TPM_Process_ExecuteTransport(tpm_state_t *tpm_state,
 
     printf("TPM_Process_ExecuteTransport: Ordinal Entry\n");
     transportInternal = transportInternal;		/* TPM_ExecuteTransport cannot be wrapped */
-    TPM_SizedBuffer_Init(&wrappedCmd);			/* freed @1 */
+    TPM_SizedBufferView_Init(&wrappedCmd);		/* borrowed from the command */
     TPM_SizedBuffer_Init(&wrappedRsp);			/* freed @2 */
     g1Mgf1 = NULL;					/* freed @3 */
     decryptCmd = NULL;					/* freed @4 */
@@ -1884,7 +1909,7 @@ TPM_RESULT TPM_Process_ExecuteTransport(tpm_state_t *tpm_state,
 	/* save the starting point of inParam's for authorization and auditing */
 	/*	inParamStart = command; */
 	/* get wrappedCmd */
-	returnCode = TPM_SizedBuffer_Load(&wrappedCmd, &command, &paramSize);
+	returnCode = TPM_SizedBufferView_Load(&wrappedCmd, &command, &paramSize);
     }	 
     if (returnCode == TPM_SUCCESS) {
 	printf("TPM_Process_ExecuteTransport: wrapped command size %u\n", wrappedCmd.size);
@@ -2533,15 +2558,14 @@ TPM_RESULT TPM_Process_ExecuteTransport(tpm_state_t *tpm_state,
     /*
       cleanup
     */
-    TPM_SizedBuffer_Delete(&wrappedCmd);		/* @1 */
     TPM_SizedBuffer_Delete(&wrappedRsp);		/* @2 */
-    free(g1Mgf1);					/* @3 */
+    TPM_Arena_Free(g1Mgf1);					/* @3 */
     free (decryptCmd);					/* @4 */
     TPM_TransportLogIn_Delete(&l2TransportLogIn);	/* @5 */
     TPM_TransportLogOut_Delete(&l3TransportLogOut);	/* @6 */
     TPM_Sbuffer_Delete(&wrappedRspSbuffer);		/* @7 */
     TPM_Sbuffer_Delete(&currentTicksSbuffer);		/* @8 */
-    free(g2Mgf1);					/* @9 */
+    TPM_Arena_Free(g2Mgf1);					/* @9 */
     TPM_TransportInternal_Delete(&t1TransportCopy);	/* @10 */
     free(encryptRsp);					/* @11 */
     return rcf;
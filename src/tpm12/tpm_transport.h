@@ -75,6 +75,7 @@ TPM_RESULT TPM_TransportSessions_Load(TPM_TRANSPORT_INTERNAL *transSessions,
                                       uint32_t *stream_size);
 TPM_RESULT TPM_TransportSessions_Store(TPM_STORE_BUFFER *sbuffer,
                                        TPM_TRANSPORT_INTERNAL *transSessions);
+uint32_t   TPM_TransportSessions_SizeOf(TPM_TRANSPORT_INTERNAL *transSessions);
 void       TPM_TransportSessions_Delete(TPM_TRANSPORT_INTERNAL *transSessions);
 
 void       TPM_TransportSessions_IsSpace(TPM_BOOL *isSpace, uint32_t *index,
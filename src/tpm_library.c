@@ -44,6 +44,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #ifdef USE_FREEBL_CRYPTO_LIBRARY
 # include <plbase64.h>
@@ -107,6 +108,20 @@ TPM_RESULT TPMLIB_Process(unsigned char **respbuffer, uint32_t *resp_size,
                                  command, command_size);
 }
 
+/*
+ * Send a command to the TPM and have the response written into the
+ * caller's respbuffer of respbufsize bytes. Unlike TPMLIB_Process(),
+ * the buffer is never reallocated; TPM_SIZE is returned if the response
+ * does not fit. resp_size describes the size of the response.
+ */
+TPM_RESULT TPMLIB_ProcessInto(unsigned char *command, uint32_t command_size,
+                              unsigned char *respbuffer, uint32_t respbufsize,
+                              uint32_t *resp_size)
+{
+    return tpm_iface[0]->ProcessInto(command, command_size,
+                                     respbuffer, respbufsize, resp_size);
+}
+
 /*
  * Get the volatile state from the TPM. This function will return the
  * buffer and the length of the buffer to the caller in case everything
@@ -119,10 +134,164 @@ TPM_RESULT TPMLIB_VolatileAll_Store(unsigned char **buffer,
 }
 
 /*
- * Get a property of the TPM. The functions currently only
- * return compile-time #defines but this may change in future
- * versions where we may return parameters with which the TPM
- * was created (rather than compiled).
+ * Locking contract of the handle-based API:
+ *
+ * - TPMLIB_RegisterCallbacks() must be called before the first
+ *   TPM instance is created and must not run concurrently with any
+ *   other function of the library.
+ * - TPMLIB_Instance_Create() may be called concurrently; the creation
+ *   of instances is serialized here so that the library initialization
+ *   common to all instances runs only once.
+ * - All other calls on a TPMLIB_Instance must be serialized by the
+ *   caller. Calls on different instances may run concurrently without
+ *   any locking since an instance does not share mutable state with
+ *   any other instance.
+ * - The legacy functions operating on the single default TPM
+ *   (TPMLIB_MainInit(), TPMLIB_Process(), etc.) must not run
+ *   concurrently with any other function of the library.
+ * - TPMLIB_SetStatistics() must not run concurrently with any other
+ *   function of the library. TPMLIB_Instance_GetStatistics() is a call
+ *   on the instance and must be serialized with its other calls.
+ * - TPMLIB_SetTPMProperty() is serialized with TPMLIB_Instance_Create().
+ *   A caller that creates instances with different parameters from
+ *   different threads must serialize each pair of calls itself.
+ * - TPMLIB_SetTrace() must not run concurrently with any other function
+ *   of the library. The trace callback may be called concurrently from
+ *   different instances. TPMLIB_SetTraceBuffer() and
+ *   TPMLIB_GetTraceBuffer() may be called at any time.
+ */
+static pthread_mutex_t instance_create_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Create a new TPM instance. The library initialization that is common
+ * to all TPM instances (crypto library, NVRAM and common self tests) is
+ * run only once for the first instance created. The permanent state of
+ * the instance is loaded via the NVRAM callbacks using 'tpm_number' and
+ * is created if it does not exist yet.
+ */
+TPM_RESULT TPMLIB_Instance_Create(TPMLIB_Instance **instance,
+                                  uint32_t tpm_number)
+{
+    TPM_RESULT res;
+    TPMLIB_Instance *inst = NULL;
+
+    *instance = NULL;
+
+    res = TPM_Malloc((unsigned char **)&inst, sizeof(*inst));
+    if (res != TPM_SUCCESS)
+        return res;
+
+    inst->iface = tpm_iface[0];
+    pthread_mutex_lock(&instance_create_lock);
+    res = inst->iface->InstanceCreate(&inst->instance, tpm_number);
+    pthread_mutex_unlock(&instance_create_lock);
+    if (res != TPM_SUCCESS) {
+        TPM_Free((unsigned char *)inst);
+        return res;
+    }
+
+    *instance = inst;
+
+    return TPM_SUCCESS;
+}
+
+/*
+ * Free all resources of a TPM instance. Its state in NVRAM is not
+ * touched.
+ */
+void TPMLIB_Instance_Terminate(TPMLIB_Instance *instance)
+{
+    if (instance == NULL)
+        return;
+
+    instance->iface->InstanceTerminate(instance->instance);
+    TPM_Free((unsigned char *)instance);
+}
+
+/*
+ * Send a command to the given TPM instance. See TPMLIB_Process() for
+ * the handling of the response buffer.
+ */
+TPM_RESULT TPMLIB_Instance_Process(TPMLIB_Instance *instance,
+                                   unsigned char **respbuffer,
+                                   uint32_t *resp_size,
+                                   uint32_t *respbufsize,
+                                   unsigned char *command,
+                                   uint32_t command_size)
+{
+    return instance->iface->InstanceProcess(instance->instance,
+                                            respbuffer, resp_size, respbufsize,
+                                            command, command_size);
+}
+
+/*
+ * Send a command to the given TPM instance. See TPMLIB_ProcessInto() for
+ * the handling of the response buffer.
+ */
+TPM_RESULT TPMLIB_Instance_ProcessInto(TPMLIB_Instance *instance,
+                                       unsigned char *command,
+                                       uint32_t command_size,
+                                       unsigned char *respbuffer,
+                                       uint32_t respbufsize,
+                                       uint32_t *resp_size)
+{
+    return instance->iface->InstanceProcessInto(instance->instance,
+                                                command, command_size,
+                                                respbuffer, respbufsize,
+                                                resp_size);
+}
+
+/*
+ * Get the volatile state of the given TPM instance. See
+ * TPMLIB_VolatileAll_Store().
+ */
+TPM_RESULT TPMLIB_Instance_VolatileAll_Store(TPMLIB_Instance *instance,
+                                             unsigned char **buffer,
+                                             uint32_t *buflen)
+{
+    return instance->iface->InstanceVolatileAllStore(instance->instance,
+                                                     buffer, buflen);
+}
+
+/*
+ * Enable or disable the collection of statistics by all TPMs.
+ */
+TPM_RESULT TPMLIB_SetStatistics(TPM_BOOL enable)
+{
+    tpm_iface[0]->SetStatistics(enable);
+
+    return TPM_SUCCESS;
+}
+
+/*
+ * Get the statistics of the TPM used through TPMLIB_MainInit(). The
+ * returned structure must be freed with TPM_Free(). If 'reset' is set,
+ * the statistics are cleared.
+ */
+TPM_RESULT TPMLIB_GetStatistics(struct tpmlib_statistics **stats,
+                                TPM_BOOL reset)
+{
+    return tpm_iface[0]->GetStatistics(stats, reset);
+}
+
+/*
+ * Get the statistics of the given TPM instance. See
+ * TPMLIB_GetStatistics().
+ */
+TPM_RESULT TPMLIB_Instance_GetStatistics(TPMLIB_Instance *instance,
+                                         struct tpmlib_statistics **stats,
+                                         TPM_BOOL reset)
+{
+    return instance->iface->InstanceGetStatistics(instance->instance,
+                                                  stats, reset);
+}
+
+/*
+ * Get a property of the TPM. The functions mostly return compile-time
+ * #defines. Properties that can be set with TPMLIB_SetTPMProperty()
+ * return the parameters with which the next TPM will be created, or
+ * for TPMPROP_TPM_KEY_HANDLES, the key slots of the TPM used through
+ * TPMLIB_MainInit().
  */
 TPM_RESULT TPMLIB_GetTPMProperty(enum TPMLIB_TPMProperty prop,
                                  int *result)
@@ -139,6 +308,61 @@ TPM_RESULT TPMLIB_GetTPMProperty(enum TPMLIB_TPMProperty prop,
     return TPM_SUCCESS;
 }
 
+/*
+ * Set a parameter with which TPMs are created by TPMLIB_MainInit() and
+ * TPMLIB_Instance_Create(). TPMs that already exist are not changed, so
+ * instances may be created with different parameters. The exceptions
+ * are TPMPROP_TPM_KEY_POOL, which applies to all TPMs immediately, and
+ * TPMPROP_TPM_KEY_HANDLES, which only applies to the TPM used through
+ * TPMLIB_MainInit(); the key slots of an instance are set with
+ * TPMLIB_Instance_SetTPMProperty().
+ */
+TPM_RESULT TPMLIB_SetTPMProperty(enum TPMLIB_TPMProperty prop,
+                                 int value)
+{
+    TPM_RESULT res;
+
+    pthread_mutex_lock(&instance_create_lock);
+    res = tpm_iface[0]->SetTPMProperty(prop, value);
+    pthread_mutex_unlock(&instance_create_lock);
+
+    return res;
+}
+
+/*
+ * Get a property of the given TPM instance. See TPMLIB_GetTPMProperty().
+ * Properties that can be set return the values of the instance.
+ */
+TPM_RESULT TPMLIB_Instance_GetTPMProperty(TPMLIB_Instance *instance,
+                                          enum TPMLIB_TPMProperty prop,
+                                          int *result)
+{
+    switch (prop) {
+    case  TPMPROP_TPM_BUFFER_MAX:
+        *result = TPM_BUFFER_MAX;
+        break;
+
+    default:
+        return instance->iface->InstanceGetTPMProperty(instance->instance,
+                                                       prop, result);
+    }
+
+    return TPM_SUCCESS;
+}
+
+/*
+ * Set a property of the given TPM instance. Currently only
+ * TPMPROP_TPM_KEY_HANDLES can be set; the key slots are resized and the
+ * loaded keys are kept.
+ */
+TPM_RESULT TPMLIB_Instance_SetTPMProperty(TPMLIB_Instance *instance,
+                                          enum TPMLIB_TPMProperty prop,
+                                          int value)
+{
+    return instance->iface->InstanceSetTPMProperty(instance->instance,
+                                                   prop, value);
+}
+
 TPM_RESULT TPM_IO_Hash_Start(void)
 {
     return tpm_iface[0]->HashStart();
@@ -344,3 +568,40 @@ TPM_RESULT TPMLIB_DecodeBlob(const char *buffer, enum TPMLIB_BlobType type,
 
     return res;
 }
+
+/*
+ * Set the trace level, the mask of trace categories and an optional
+ * callback receiving the trace messages. Trace messages are written to
+ * stdout if neither a callback nor a trace buffer is set.
+ */
+TPM_RESULT TPMLIB_SetTrace(unsigned int level, uint32_t categories,
+                           TPMLIB_TraceFunction func)
+{
+    if (level > TPMLIB_TRACE_LEVEL_DEBUG)
+        return TPM_BAD_PARAMETER;
+
+    TPM_Trace_Set(level, categories, func);
+
+    return TPM_SUCCESS;
+}
+
+/*
+ * Allocate a ring buffer of 'size' bytes holding the most recent trace
+ * records. A size of 0 frees the buffer.
+ */
+TPM_RESULT TPMLIB_SetTraceBuffer(uint32_t size)
+{
+    return TPM_TraceBuffer_Set(size);
+}
+
+/*
+ * Remove the oldest trace records from the ring buffer and copy them
+ * into the given buffer. Only complete records are copied.
+ */
+TPM_RESULT TPMLIB_GetTraceBuffer(unsigned char *buffer, uint32_t size,
+                                 uint32_t *length)
+{
+    TPM_TraceBuffer_Get(buffer, size, length);
+
+    return TPM_SUCCESS;
+}
@@ -65,17 +65,28 @@
  * BAL: contributes to the ballooning of the state blob
  */
 
+/*
+ * Every 2048 bit key in volatile space accounts for an
+ * increase of maximum of 559 bytes (PCR_INFO_LONG, tied to PCRs).
+ *
+ * TPM_KEY_HANDLES is the default number of key slots of a TPM and
+ * the number the TPM_MAX_SAVESTATE_SPACE and
+ * TPM_MAX_VOLATILESTATE_SPACE below are sized for. Each slot more
+ * or less changes them by TPM_KEY_HANDLE_SPACE bytes.
+ * TPMLIB_SetTPMProperty(TPMPROP_TPM_KEY_HANDLES) sets the number of
+ * slots of the TPM started by TPMLIB_MainInit(), resizing it if it
+ * is running. TPMLIB_Instance_SetTPMProperty() resizes a TPM created
+ * by TPMLIB_Instance_Create(), which starts with the default.
+ */
+#define TPM_KEY_HANDLES                  20            /* SS, VA,  BAL */
+#define TPM_KEY_HANDLE_SPACE            559
+
 /*
  * Do not touch these #define's anymore. They are fixed forever
  * and define the properties of the TPM library and have a
  * direct influence on the size requirements of the TPM's block
  * store and the organization of data inside that block store.
  */
-/*
- * Every 2048 bit key in volatile space accounts for an
- * increase of maximum of 559 bytes (PCR_INFO_LONG, tied to PCRs).
- */
-#define TPM_KEY_HANDLES                  20            /* SS, VA,  BAL */
 
 /*
  * Every 2048 bit key on which the owner evict key flag is set
@@ -55,14 +55,51 @@ struct tpm_interface {
     TPM_RESULT (*Process)(unsigned char **respbuffer, uint32_t *resp_size,
                           uint32_t *respbufsize,
 		          unsigned char *command, uint32_t command_size);
+    TPM_RESULT (*ProcessInto)(unsigned char *command, uint32_t command_size,
+                              unsigned char *respbuffer, uint32_t respbufsize,
+                              uint32_t *resp_size);
     TPM_RESULT (*VolatileAllStore)(unsigned char **buffer, uint32_t *buflen);
     TPM_RESULT (*GetTPMProperty)(enum TPMLIB_TPMProperty prop,
                                  int *result);
+    TPM_RESULT (*SetTPMProperty)(enum TPMLIB_TPMProperty prop,
+                                 int value);
     TPM_RESULT (*TpmEstablishedGet)(TPM_BOOL *tpmEstablished);
     TPM_RESULT (*HashStart)(void);
     TPM_RESULT (*HashData)(const unsigned char *data,
                            uint32_t data_length);
     TPM_RESULT (*HashEnd)(void);
+    /* handle-based instances; 'instance' is private to the TPM implementation */
+    TPM_RESULT (*InstanceCreate)(void **instance, uint32_t tpm_number);
+    void (*InstanceTerminate)(void *instance);
+    TPM_RESULT (*InstanceProcess)(void *instance,
+                                  unsigned char **respbuffer, uint32_t *resp_size,
+                                  uint32_t *respbufsize,
+                                  unsigned char *command, uint32_t command_size);
+    TPM_RESULT (*InstanceProcessInto)(void *instance,
+                                      unsigned char *command, uint32_t command_size,
+                                      unsigned char *respbuffer, uint32_t respbufsize,
+                                      uint32_t *resp_size);
+    TPM_RESULT (*InstanceVolatileAllStore)(void *instance,
+                                           unsigned char **buffer, uint32_t *buflen);
+    void (*SetStatistics)(TPM_BOOL enable);
+    TPM_RESULT (*GetStatistics)(struct tpmlib_statistics **stats, TPM_BOOL reset);
+    TPM_RESULT (*InstanceGetStatistics)(void *instance,
+                                        struct tpmlib_statistics **stats,
+                                        TPM_BOOL reset);
+    TPM_RESULT (*InstanceGetTPMProperty)(void *instance,
+                                         enum TPMLIB_TPMProperty prop,
+                                         int *result);
+    TPM_RESULT (*InstanceSetTPMProperty)(void *instance,
+                                         enum TPMLIB_TPMProperty prop,
+                                         int value);
+};
+
+/*
+ * A TPM instance created through TPMLIB_Instance_Create()
+ */
+struct TPMLIB_Instance {
+    const struct tpm_interface *iface;
+    void *instance;
 };
 
 extern const struct tpm_interface TPM12Interface;
@@ -73,5 +110,27 @@ TPM_RESULT TPM12_IO_Hash_Data(const unsigned char *data,
 			      uint32_t data_length);
 TPM_RESULT TPM12_IO_Hash_End(void);
 TPM_RESULT TPM12_IO_TpmEstablished_Get(TPM_BOOL *tpmEstablished);
+TPM_RESULT TPM12_InstanceCreate(void **instance, uint32_t tpm_number);
+void TPM12_InstanceTerminate(void *instance);
+TPM_RESULT TPM12_InstanceProcess(void *instance,
+                                 unsigned char **respbuffer, uint32_t *resp_size,
+                                 uint32_t *respbufsize,
+                                 unsigned char *command, uint32_t command_size);
+TPM_RESULT TPM12_InstanceProcessInto(void *instance,
+                                     unsigned char *command, uint32_t command_size,
+                                     unsigned char *respbuffer, uint32_t respbufsize,
+                                     uint32_t *resp_size);
+TPM_RESULT TPM12_InstanceVolatileAllStore(void *instance,
+                                          unsigned char **buffer,
+                                          uint32_t *buflen);
+TPM_RESULT TPM12_InstanceGetStatistics(void *instance,
+                                       struct tpmlib_statistics **stats,
+                                       TPM_BOOL reset);
+TPM_RESULT TPM12_InstanceGetTPMProperty(void *instance,
+                                        enum TPMLIB_TPMProperty prop,
+                                        int *result);
+TPM_RESULT TPM12_InstanceSetTPMProperty(void *instance,
+                                        enum TPMLIB_TPMProperty prop,
+                                        int value);
 
 #endif /* TPM_LIBRARY_INTERN_H */
@@ -45,9 +45,12 @@
 #include "tpm12/tpm_debug.h"
 #include "tpm_error.h"
 #include "tpm12/tpm_init.h"
+#include "tpm12/tpm_key.h"
+#include "tpm12/tpm_keypool.h"
 #include "tpm_library_intern.h"
 #include "tpm12/tpm_process.h"
 #include "tpm12/tpm_startup.h"
+#include "tpm12/tpm_statistics.h"
 
 TPM_RESULT TPM12_MainInit(void)
 {
@@ -56,6 +59,8 @@ TPM_RESULT TPM12_MainInit(void)
 
 void TPM12_Terminate(void)
 {
+    if (tpm_instances[0] != NULL)
+        TPM_KeyPool_Stop();
     TPM_Global_Delete(tpm_instances[0]);
     free(tpm_instances[0]);
     tpm_instances[0] = NULL;
@@ -65,13 +70,87 @@ TPM_RESULT TPM12_Process(unsigned char **respbuffer, uint32_t *resp_size,
                          uint32_t *respbufsize,
 		         unsigned char *command, uint32_t command_size)
 {
-    *resp_size = 0;
-    return TPM_ProcessA(respbuffer, resp_size, respbufsize,
-                        command, command_size);
+    return TPM12_InstanceProcess(tpm_instances[0],
+                                 respbuffer, resp_size, respbufsize,
+                                 command, command_size);
+}
+
+TPM_RESULT TPM12_ProcessInto(unsigned char *command, uint32_t command_size,
+                             unsigned char *respbuffer, uint32_t respbufsize,
+                             uint32_t *resp_size)
+{
+    return TPM12_InstanceProcessInto(tpm_instances[0],
+                                     command, command_size,
+                                     respbuffer, respbufsize, resp_size);
 }
 
 TPM_RESULT TPM12_VolatileAllStore(unsigned char **buffer,
                                   uint32_t *buflen)
+{
+    return TPM12_InstanceVolatileAllStore(tpm_instances[0], buffer, buflen);
+}
+
+/*
+ * Create a TPM instance with its own state. The initialization
+ * common to all TPMs is only run for the first instance unless
+ * TPMLIB_MainInit() has already done it.
+ */
+TPM_RESULT TPM12_InstanceCreate(void **instance, uint32_t tpm_number)
+{
+    TPM_RESULT rc = TPM_SUCCESS;
+    tpm_state_t *tpm_state = NULL;
+
+    *instance = NULL;
+
+    if (tpm_number == TPM_ILLEGAL_INSTANCE_HANDLE)
+        return TPM_BAD_PARAMETER;
+
+    if (!TPM_MainInitCommon_IsDone())
+        rc = TPM_MainInitCommon();
+
+    if (rc == TPM_SUCCESS)
+        rc = TPM_MainInitTPM(&tpm_state, tpm_number,
+                             TRUE, /* create if it does not exist */
+                             TPM_KEY_HANDLES);
+
+    if (rc == TPM_SUCCESS)
+        *instance = tpm_state;
+
+    return rc;
+}
+
+void TPM12_InstanceTerminate(void *instance)
+{
+    tpm_state_t *tpm_state = instance;
+
+    if (tpm_state != NULL)
+        TPM_KeyPool_Stop();
+    TPM_Global_Delete(tpm_state);
+    free(tpm_state);
+}
+
+TPM_RESULT TPM12_InstanceProcess(void *instance,
+                                 unsigned char **respbuffer, uint32_t *resp_size,
+                                 uint32_t *respbufsize,
+                                 unsigned char *command, uint32_t command_size)
+{
+    *resp_size = 0;
+    return TPM_ProcessA(respbuffer, resp_size, respbufsize,
+                        command, command_size, instance);
+}
+
+TPM_RESULT TPM12_InstanceProcessInto(void *instance,
+                                     unsigned char *command, uint32_t command_size,
+                                     unsigned char *respbuffer, uint32_t respbufsize,
+                                     uint32_t *resp_size)
+{
+    return TPM_ProcessInto(respbuffer, respbufsize, resp_size,
+                           command, command_size, instance);
+}
+
+TPM_RESULT TPM12_InstanceVolatileAllStore(void *instance,
+                                          unsigned char **buffer,
+                                          uint32_t *buflen)
 {
     TPM_RESULT rc;
     TPM_STORE_BUFFER tsb;
@@ -79,10 +158,10 @@ TPM_RESULT TPM12_VolatileAllStore(unsigned char **buffer,
     uint32_t total;
 
 #ifdef TPM_DEBUG
-    assert(tpm_instances[0] != NULL);
+    assert(instance != NULL);
 #endif
 
-    rc = TPM_VolatileAll_Store(&tsb, tpm_instances[0]);
+    rc = TPM_VolatileAll_Store(&tsb, instance);
 
     if (rc == TPM_SUCCESS) {
         /* caller now owns the buffer and needs to free it */
@@ -96,6 +175,30 @@ TPM_RESULT TPM12_VolatileAllStore(unsigned char **buffer,
     return rc;
 }
 
+void TPM12_SetStatistics(TPM_BOOL enable)
+{
+    TPM_Statistics_Enable(enable);
+}
+
+TPM_RESULT TPM12_GetStatistics(struct tpmlib_statistics **stats,
+                               TPM_BOOL reset)
+{
+    return TPM12_InstanceGetStatistics(tpm_instances[0], stats, reset);
+}
+
+TPM_RESULT TPM12_InstanceGetStatistics(void *instance,
+                                       struct tpmlib_statistics **stats,
+                                       TPM_BOOL reset)
+{
+    tpm_state_t *tpm_state = instance;
+
+    if (tpm_state == NULL)
+        return TPM_FAIL;
+
+    return TPM_Statistics_Get(stats, tpm_state->tpm_statistics,
+                              &(tpm_state->tpm_slab_pool), reset);
+}
+
 TPM_RESULT TPM12_GetTPMProperty(enum TPMLIB_TPMProperty prop,
                                 int *result)
 {
@@ -105,7 +208,7 @@ TPM_RESULT TPM12_GetTPMProperty(enum TPMLIB_TPMProperty prop,
         break;
 
     case  TPMPROP_TPM_KEY_HANDLES:
-        *result = TPM_KEY_HANDLES;
+        *result = TPM_MainInit_GetKeyHandles();
         break;
 
     case  TPMPROP_TPM_OWNER_EVICT_KEY_HANDLES:
@@ -151,11 +254,27 @@ TPM_RESULT TPM12_GetTPMProperty(enum TPMLIB_TPMProperty prop,
         break;
 
     case  TPMPROP_TPM_MAX_SAVESTATE_SPACE:
-        *result = TPM_MAX_SAVESTATE_SPACE;
+        *result = TPM_MAX_SAVESTATE_SPACE_KEYS(
+                      TPM_KeyHandleEntries_GetMaxKeys(TPM_MainInit_GetKeyHandles(),
+                                                      TPM_MainInit_GetKeySwap()));
         break;
 
     case  TPMPROP_TPM_MAX_VOLATILESTATE_SPACE:
-        *result = TPM_MAX_VOLATILESTATE_SPACE;
+        *result = TPM_MAX_VOLATILESTATE_SPACE_KEYS(
+                      TPM_KeyHandleEntries_GetMaxKeys(TPM_MainInit_GetKeyHandles(),
+                                                      TPM_MainInit_GetKeySwap()));
+        break;
+
+    case  TPMPROP_TPM_KEY_SWAP:
+        *result = TPM_MainInit_GetKeySwap();
+        break;
+
+    case  TPMPROP_TPM_KEY_CACHE:
+        *result = TPM_MainInit_GetKeyCache();
+        break;
+
+    case  TPMPROP_TPM_KEY_POOL:
+        *result = TPM_KeyPool_GetDepth();
         break;
 
     default:
@@ -165,14 +284,131 @@ TPM_RESULT TPM12_GetTPMProperty(enum TPMLIB_TPMProperty prop,
     return TPM_SUCCESS;
 }
 
+/*
+ * Get a property of the given TPM instance. The properties that
+ * the instance was created with are its own, the others are the
+ * same as for TPM12_GetTPMProperty().
+ */
+TPM_RESULT TPM12_InstanceGetTPMProperty(void *instance,
+                                        enum TPMLIB_TPMProperty prop,
+                                        int *result)
+{
+    tpm_state_t *tpm_state = instance;
+    TPM_KEY_HANDLE_ENTRIES *tpm_key_handle_entries;
+
+    if (tpm_state == NULL)
+        return TPM_FAIL;
+
+    tpm_key_handle_entries = &(tpm_state->tpm_key_handle_entries);
+
+    switch (prop) {
+    case  TPMPROP_TPM_KEY_HANDLES:
+        *result = tpm_key_handle_entries->keyHandleCount;
+        break;
+
+    case  TPMPROP_TPM_MAX_SAVESTATE_SPACE:
+        *result = TPM_MAX_SAVESTATE_SPACE_KEYS(
+                      TPM_KeyHandleEntries_GetMaxKeys(tpm_key_handle_entries->keyHandleCount,
+                                                      tpm_key_handle_entries->keySwap));
+        break;
+
+    case  TPMPROP_TPM_MAX_VOLATILESTATE_SPACE:
+        *result = TPM_MAX_VOLATILESTATE_SPACE_KEYS(
+                      TPM_KeyHandleEntries_GetMaxKeys(tpm_key_handle_entries->keyHandleCount,
+                                                      tpm_key_handle_entries->keySwap));
+        break;
+
+    case  TPMPROP_TPM_KEY_SWAP:
+        *result = tpm_key_handle_entries->keySwap;
+        break;
+
+    case  TPMPROP_TPM_KEY_CACHE:
+        *result = tpm_state->tpm_key_cache.keyCacheCount;
+        break;
+
+    default:
+        return TPM12_GetTPMProperty(prop, result);
+    }
+
+    return TPM_SUCCESS;
+}
+
+TPM_RESULT TPM12_SetTPMProperty(enum TPMLIB_TPMProperty prop,
+                                int value)
+{
+    switch (prop) {
+    case  TPMPROP_TPM_KEY_HANDLES:
+        if (value < 0)
+            return TPM_BAD_PARAMETER;
+        return TPM_MainInit_SetKeyHandles(value);
+
+    case  TPMPROP_TPM_KEY_SWAP:
+        if ((value != 0) && (value != 1))
+            return TPM_BAD_PARAMETER;
+        TPM_MainInit_SetKeySwap(value);
+        return TPM_SUCCESS;
+
+    case  TPMPROP_TPM_KEY_CACHE:
+        if (value < 0)
+            return TPM_BAD_PARAMETER;
+        return TPM_MainInit_SetKeyCache(value);
+
+    case  TPMPROP_TPM_KEY_POOL:
+        if (value < 0)
+            return TPM_BAD_PARAMETER;
+        return TPM_KeyPool_SetDepth(value);
+
+    default:
+        return TPM_FAIL;
+    }
+}
+
+/*
+ * Set a property of the given TPM instance. Only the number of key
+ * slots can be changed; the slots are resized and the loaded keys
+ * are kept.
+ */
+TPM_RESULT TPM12_InstanceSetTPMProperty(void *instance,
+                                        enum TPMLIB_TPMProperty prop,
+                                        int value)
+{
+    tpm_state_t *tpm_state = instance;
+
+    if (tpm_state == NULL)
+        return TPM_FAIL;
+
+    switch (prop) {
+    case  TPMPROP_TPM_KEY_HANDLES:
+        if (value < 0)
+            return TPM_BAD_PARAMETER;
+        return TPM_KeyHandleEntries_Resize(&(tpm_state->tpm_key_handle_entries),
+                                           value);
+
+    default:
+        return TPM_FAIL;
+    }
+}
+
 const struct tpm_interface TPM12Interface = {
     .MainInit = TPM12_MainInit,
     .Terminate = TPM12_Terminate,
     .Process = TPM12_Process,
+    .ProcessInto = TPM12_ProcessInto,
     .VolatileAllStore = TPM12_VolatileAllStore,
     .GetTPMProperty = TPM12_GetTPMProperty,
+    .SetTPMProperty = TPM12_SetTPMProperty,
     .TpmEstablishedGet = TPM12_IO_TpmEstablished_Get,
     .HashStart = TPM12_IO_Hash_Start,
     .HashData = TPM12_IO_Hash_Data,
     .HashEnd = TPM12_IO_Hash_End,
+    .InstanceCreate = TPM12_InstanceCreate,
+    .InstanceTerminate = TPM12_InstanceTerminate,
+    .InstanceProcess = TPM12_InstanceProcess,
+    .InstanceProcessInto = TPM12_InstanceProcessInto,
+    .InstanceVolatileAllStore = TPM12_InstanceVolatileAllStore,
+    .SetStatistics = TPM12_SetStatistics,
+    .GetStatistics = TPM12_GetStatistics,
+    .InstanceGetStatistics = TPM12_InstanceGetStatistics,
+    .InstanceGetTPMProperty = TPM12_InstanceGetTPMProperty,
+    .InstanceSetTPMProperty = TPM12_InstanceSetTPMProperty,
 };
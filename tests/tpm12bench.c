@@ -0,0 +1,1175 @@
+/*
+ * tpm12bench.c -- benchmark TPM 1.2 commands through TPMLIB_Process()
+ *
+ * The TPM state is kept in memory by the NVRAM callbacks so that the
+ * results do not depend on the file system. Only the time spent in
+ * TPMLIB_Process() is measured; building the commands, computing the
+ * authorization HMACs and setting up sessions are not.
+ *
+ * For the license, see the LICENSE file in the root directory.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libtpms/tpm_types.h>
+#include <libtpms/tpm_library.h>
+#include <libtpms/tpm_error.h>
+#include <libtpms/tpm_memory.h>
+
+#ifndef BENCH_CRYPTO_LIBRARY
+# define BENCH_CRYPTO_LIBRARY "unknown"
+#endif
+
+#define DIGEST_SIZE         20
+#define BUFFER_SIZE         4096
+#define MAX_MODULUS_BYTES   512
+
+#define TAG_RQU_COMMAND         0x00c1
+#define TAG_RQU_AUTH1_COMMAND   0x00c2
+#define TAG_RQU_AUTH2_COMMAND   0x00c3
+
+#define ORD_OIAP                        0x0000000a
+#define ORD_OSAP                        0x0000000b
+#define ORD_TakeOwnership               0x0000000d
+#define ORD_Extend                      0x00000014
+#define ORD_Quote                       0x00000016
+#define ORD_Seal                        0x00000017
+#define ORD_Unseal                      0x00000018
+#define ORD_CreateWrapKey               0x0000001f
+#define ORD_LoadKey2                    0x00000041
+#define ORD_OwnerClear                  0x0000005b
+#define ORD_PhysicalEnable              0x0000006f
+#define ORD_PhysicalSetDeactivated      0x00000072
+#define ORD_CreateEndorsementKeyPair    0x00000078
+#define ORD_ReadPubek                   0x0000007c
+#define ORD_Startup                     0x00000099
+#define ORD_FlushSpecific               0x000000ba
+#define ORD_NV_DefineSpace              0x000000cc
+#define ORD_NV_WriteValue               0x000000cd
+#define ORD_CreateCounter               0x000000dc
+#define ORD_IncrementCounter            0x000000dd
+#define TSC_ORD_PhysicalPresence        0x4000000a
+
+#define ET_KEYHANDLE        0x0001
+#define ET_OWNER            0x0002
+#define KH_SRK              0x40000000
+#define KH_OWNER            0x40000001
+
+#define KEY_SIGNING         0x0010
+#define KEY_STORAGE         0x0011
+#define ES_NONE             0x0001
+#define ES_RSAESOAEP        0x0003
+#define SS_NONE             0x0001
+#define SS_RSASSAPKCS1v15_SHA1 0x0002
+
+#define BENCH_PCR           10
+#define BENCH_NV_INDEX      0x00011000
+#define BENCH_NV_SIZE       64
+
+/*
+ * SHA-1 and HMAC-SHA1 for the authorization protocol
+ */
+typedef struct {
+    uint32_t h[5];
+    uint64_t length;
+    unsigned char block[64];
+    size_t used;
+} sha1_ctx;
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1_compress(sha1_ctx *ctx, const unsigned char *block)
+{
+    uint32_t w[80], a, b, c, d, e, f, k, t;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 |
+               (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+    for (; i < 80; i++)
+        w[i] = ROL32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    a = ctx->h[0]; b = ctx->h[1]; c = ctx->h[2]; d = ctx->h[3]; e = ctx->h[4];
+    for (i = 0; i < 80; i++) {
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        t = ROL32(a, 5) + f + e + k + w[i];
+        e = d; d = c; c = ROL32(b, 30); b = a; a = t;
+    }
+    ctx->h[0] += a; ctx->h[1] += b; ctx->h[2] += c; ctx->h[3] += d; ctx->h[4] += e;
+}
+
+static void sha1_init(sha1_ctx *ctx)
+{
+    static const uint32_t h[5] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+    };
+
+    memcpy(ctx->h, h, sizeof(h));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+static void sha1_update(sha1_ctx *ctx, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    size_t n;
+
+    ctx->length += len;
+    while (len > 0) {
+        n = sizeof(ctx->block) - ctx->used;
+        if (n > len)
+            n = len;
+        memcpy(ctx->block + ctx->used, p, n);
+        ctx->used += n;
+        p += n;
+        len -= n;
+        if (ctx->used == sizeof(ctx->block)) {
+            sha1_compress(ctx, ctx->block);
+            ctx->used = 0;
+        }
+    }
+}
+
+static void sha1_final(sha1_ctx *ctx, unsigned char digest[DIGEST_SIZE])
+{
+    uint64_t bits = ctx->length * 8;
+    unsigned char pad = 0x80;
+    unsigned char len[8];
+    int i;
+
+    sha1_update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->used != 56)
+        sha1_update(ctx, &pad, 1);
+    for (i = 0; i < 8; i++)
+        len[i] = bits >> (56 - 8 * i);
+    sha1_update(ctx, len, 8);
+    for (i = 0; i < DIGEST_SIZE; i++)
+        digest[i] = ctx->h[i / 4] >> (24 - 8 * (i % 4));
+}
+
+static void sha1(unsigned char digest[DIGEST_SIZE],
+                 const void *data1, size_t len1,
+                 const void *data2, size_t len2)
+{
+    sha1_ctx ctx;
+
+    sha1_init(&ctx);
+    sha1_update(&ctx, data1, len1);
+    sha1_update(&ctx, data2, len2);
+    sha1_final(&ctx, digest);
+}
+
+static void hmac_sha1(unsigned char digest[DIGEST_SIZE],
+                      const unsigned char key[DIGEST_SIZE],
+                      const void *data, size_t len)
+{
+    unsigned char pad[64], inner[DIGEST_SIZE];
+    sha1_ctx ctx;
+    int i;
+
+    memset(pad, 0x36, sizeof(pad));
+    for (i = 0; i < DIGEST_SIZE; i++)
+        pad[i] ^= key[i];
+    sha1_init(&ctx);
+    sha1_update(&ctx, pad, sizeof(pad));
+    sha1_update(&ctx, data, len);
+    sha1_final(&ctx, inner);
+
+    memset(pad, 0x5c, sizeof(pad));
+    for (i = 0; i < DIGEST_SIZE; i++)
+        pad[i] ^= key[i];
+    sha1(digest, pad, sizeof(pad), inner, sizeof(inner));
+}
+
+static void get_random(unsigned char *buf, size_t len)
+{
+    while (len-- > 0)
+        *buf++ = rand();
+}
+
+/*
+ * RSA public key encryption with OAEP padding for TPM_TakeOwnership
+ */
+#define MAX_LIMBS (MAX_MODULUS_BYTES / 4)
+
+/* r = r - n if r >= n or if 'carry' is set */
+static void bn_reduce(uint32_t *r, const uint32_t *n, int limbs, uint32_t carry)
+{
+    uint64_t borrow = 0, t;
+    int i;
+
+    if (!carry) {
+        for (i = limbs - 1; i >= 0 && r[i] == n[i]; i--)
+            ;
+        if (i >= 0 && r[i] < n[i])
+            return;
+    }
+    for (i = 0; i < limbs; i++) {
+        t = (uint64_t)r[i] - n[i] - borrow;
+        r[i] = t;
+        borrow = (t >> 32) & 1;
+    }
+}
+
+/* r = a * b mod n */
+static void bn_mulmod(uint32_t *r, const uint32_t *a, const uint32_t *b,
+                      const uint32_t *n, int limbs)
+{
+    uint32_t acc[MAX_LIMBS], carry;
+    uint64_t t;
+    int i, j;
+
+    memset(acc, 0, sizeof(acc));
+    for (i = limbs * 32 - 1; i >= 0; i--) {
+        carry = 0;
+        for (j = 0; j < limbs; j++) {
+            t = ((uint64_t)acc[j] << 1) | carry;
+            acc[j] = t;
+            carry = t >> 32;
+        }
+        bn_reduce(acc, n, limbs, carry);
+        if ((b[i / 32] >> (i % 32)) & 1) {
+            t = 0;
+            for (j = 0; j < limbs; j++) {
+                t += (uint64_t)acc[j] + a[j];
+                acc[j] = t;
+                t >>= 32;
+            }
+            bn_reduce(acc, n, limbs, t);
+        }
+    }
+    memcpy(r, acc, limbs * sizeof(uint32_t));
+}
+
+static void bn_from_bytes(uint32_t *r, const unsigned char *bytes, size_t len, int limbs)
+{
+    size_t i;
+
+    memset(r, 0, limbs * sizeof(uint32_t));
+    for (i = 0; i < len; i++)
+        r[i / 4] |= (uint32_t)bytes[len - 1 - i] << (8 * (i % 4));
+}
+
+static void bn_to_bytes(unsigned char *bytes, size_t len, const uint32_t *a)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        bytes[len - 1 - i] = a[i / 4] >> (8 * (i % 4));
+}
+
+static void mgf1_xor(unsigned char *out, size_t outlen,
+                     const unsigned char *seed, size_t seedlen)
+{
+    unsigned char counter[4], digest[DIGEST_SIZE];
+    uint32_t c;
+    size_t i, n;
+
+    for (c = 0, i = 0; i < outlen; c++) {
+        counter[0] = c >> 24; counter[1] = c >> 16;
+        counter[2] = c >> 8; counter[3] = c;
+        sha1(digest, seed, seedlen, counter, sizeof(counter));
+        for (n = 0; n < DIGEST_SIZE && i < outlen; n++, i++)
+            out[i] ^= digest[n];
+    }
+}
+
+static void rsa_encrypt_oaep(unsigned char *out,
+                             const unsigned char *modulus, size_t modlen,
+                             const unsigned char *msg, size_t msglen)
+{
+    unsigned char em[MAX_MODULUS_BYTES];
+    uint32_t n[MAX_LIMBS], m[MAX_LIMBS], r[MAX_LIMBS];
+    int limbs = (modlen + 3) / 4;
+    int i;
+
+    /* em = 0x00 || seed || DB, DB = SHA1("TCPA") || 0x00... || 0x01 || msg */
+    memset(em, 0, modlen);
+    get_random(em + 1, DIGEST_SIZE);
+    sha1(em + 1 + DIGEST_SIZE, "TCPA", 4, NULL, 0);
+    em[modlen - msglen - 1] = 0x01;
+    memcpy(em + modlen - msglen, msg, msglen);
+    mgf1_xor(em + 1 + DIGEST_SIZE, modlen - 1 - DIGEST_SIZE, em + 1, DIGEST_SIZE);
+    mgf1_xor(em + 1, DIGEST_SIZE, em + 1 + DIGEST_SIZE, modlen - 1 - DIGEST_SIZE);
+
+    /* out = em ^ 65537 mod n */
+    bn_from_bytes(n, modulus, modlen, limbs);
+    bn_from_bytes(m, em, modlen, limbs);
+    memcpy(r, m, sizeof(r));
+    for (i = 0; i < 16; i++)
+        bn_mulmod(r, r, r, n, limbs);
+    bn_mulmod(r, r, m, n, limbs);
+    bn_to_bytes(out, modlen, r);
+}
+
+/*
+ * In-memory NVRAM
+ */
+#define NVRAM_ENTRIES 16
+
+static struct nvram_entry {
+    uint32_t tpm_number;
+    char name[64];
+    unsigned char *data;
+    uint32_t length;
+} nvram[NVRAM_ENTRIES];
+
+static struct nvram_entry *nvram_find(uint32_t tpm_number, const char *name)
+{
+    int i;
+
+    for (i = 0; i < NVRAM_ENTRIES; i++)
+        if (nvram[i].data != NULL && nvram[i].tpm_number == tpm_number &&
+            strcmp(nvram[i].name, name) == 0)
+            return &nvram[i];
+    return NULL;
+}
+
+static TPM_RESULT nvram_init(void)
+{
+    return TPM_SUCCESS;
+}
+
+static TPM_RESULT nvram_loaddata(unsigned char **data, uint32_t *length,
+                                 uint32_t tpm_number, const char *name)
+{
+    struct nvram_entry *entry = nvram_find(tpm_number, name);
+    TPM_RESULT rc;
+
+    if (entry == NULL)
+        return TPM_RETRY;
+    rc = TPM_Malloc(data, entry->length);
+    if (rc != TPM_SUCCESS)
+        return rc;
+    memcpy(*data, entry->data, entry->length);
+    *length = entry->length;
+    return TPM_SUCCESS;
+}
+
+static TPM_RESULT nvram_storedata(const unsigned char *data, uint32_t length,
+                                  uint32_t tpm_number, const char *name)
+{
+    struct nvram_entry *entry = nvram_find(tpm_number, name);
+    unsigned char *copy;
+    int i;
+
+    for (i = 0; entry == NULL && i < NVRAM_ENTRIES; i++)
+        if (nvram[i].data == NULL)
+            entry = &nvram[i];
+    if (entry == NULL || strlen(name) >= sizeof(entry->name))
+        return TPM_FAIL;
+    copy = malloc(length ? length : 1);
+    if (copy == NULL)
+        return TPM_FAIL;
+    memcpy(copy, data, length);
+    free(entry->data);
+    entry->data = copy;
+    entry->length = length;
+    entry->tpm_number = tpm_number;
+    strcpy(entry->name, name);
+    return TPM_SUCCESS;
+}
+
+static TPM_RESULT nvram_appenddata(const unsigned char *data, uint32_t length,
+                                   uint32_t tpm_number, const char *name)
+{
+    struct nvram_entry *entry = nvram_find(tpm_number, name);
+    unsigned char *grown;
+
+    if (entry == NULL)
+        return nvram_storedata(data, length, tpm_number, name);
+    grown = realloc(entry->data, entry->length + length);
+    if (grown == NULL)
+        return TPM_FAIL;
+    memcpy(grown + entry->length, data, length);
+    entry->data = grown;
+    entry->length += length;
+    return TPM_SUCCESS;
+}
+
+static TPM_RESULT nvram_deletename(uint32_t tpm_number, const char *name,
+                                   TPM_BOOL mustExist)
+{
+    struct nvram_entry *entry = nvram_find(tpm_number, name);
+
+    if (entry == NULL)
+        return mustExist ? TPM_FAIL : TPM_SUCCESS;
+    free(entry->data);
+    entry->data = NULL;
+    return TPM_SUCCESS;
+}
+
+static TPM_RESULT io_init(void)
+{
+    return TPM_SUCCESS;
+}
+
+static TPM_RESULT io_getlocality(TPM_MODIFIER_INDICATOR *locality,
+                                 uint32_t tpm_number)
+{
+    *locality = 0;
+    return TPM_SUCCESS;
+}
+
+static TPM_RESULT io_getphysicalpresence(TPM_BOOL *physicalPresence,
+                                         uint32_t tpm_number)
+{
+    *physicalPresence = FALSE;
+    return TPM_SUCCESS;
+}
+
+/*
+ * Commands
+ */
+struct buffer {
+    unsigned char data[BUFFER_SIZE];
+    uint32_t size;
+};
+
+struct session {
+    uint32_t handle;
+    unsigned char nonceEven[DIGEST_SIZE];
+    unsigned char secret[DIGEST_SIZE];      /* HMAC key */
+};
+
+static unsigned char *respbuffer;
+static uint32_t respbufsize;
+static double last_latency;                 /* microseconds */
+
+static void die(const char *what, uint32_t rc)
+{
+    fprintf(stderr, "%s failed with 0x%x\n", what, rc);
+    exit(EXIT_FAILURE);
+}
+
+static void put_bytes(struct buffer *b, const void *data, size_t len)
+{
+    if (b->size + len > sizeof(b->data))
+        die("put_bytes", TPM_SIZE);
+    memcpy(b->data + b->size, data, len);
+    b->size += len;
+}
+
+static void put_u8(struct buffer *b, uint8_t v)
+{
+    put_bytes(b, &v, 1);
+}
+
+static void put_u16(struct buffer *b, uint16_t v)
+{
+    unsigned char d[2] = { v >> 8, v };
+
+    put_bytes(b, d, sizeof(d));
+}
+
+static void put_u32(struct buffer *b, uint32_t v)
+{
+    unsigned char d[4] = { v >> 24, v >> 16, v >> 8, v };
+
+    put_bytes(b, d, sizeof(d));
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/*
+ * Send a command to the TPM and return the response parameters
+ * following the response header in 'resp'. The time spent in
+ * TPMLIB_Process() is stored in last_latency.
+ */
+static uint32_t transmit(uint16_t tag, uint32_t ordinal,
+                         const struct buffer *body, struct buffer *resp)
+{
+    struct buffer cmd = { .size = 0 };
+    struct timespec start, end;
+    uint32_t resp_size = 0;
+    TPM_RESULT rc;
+
+    put_u16(&cmd, tag);
+    put_u32(&cmd, 10 + (body ? body->size : 0));
+    put_u32(&cmd, ordinal);
+    if (body)
+        put_bytes(&cmd, body->data, body->size);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    rc = TPMLIB_Process(&respbuffer, &resp_size, &respbufsize,
+                        cmd.data, cmd.size);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    last_latency = (end.tv_sec - start.tv_sec) * 1e6 +
+                   (end.tv_nsec - start.tv_nsec) / 1e3;
+
+    if (rc != TPM_SUCCESS)
+        die("TPMLIB_Process", rc);
+    if (resp_size < 10 || resp_size - 10 > sizeof(resp->data))
+        die("TPMLIB_Process response", resp_size);
+    resp->size = resp_size - 10;
+    memcpy(resp->data, respbuffer + 10, resp->size);
+    return get_u32(respbuffer + 6);
+}
+
+static void oiap(struct session *s, const unsigned char secret[DIGEST_SIZE])
+{
+    struct buffer resp;
+    uint32_t rc;
+
+    rc = transmit(TAG_RQU_COMMAND, ORD_OIAP, NULL, &resp);
+    if (rc != TPM_SUCCESS)
+        die("OIAP", rc);
+    s->handle = get_u32(resp.data);
+    memcpy(s->nonceEven, resp.data + 4, DIGEST_SIZE);
+    memcpy(s->secret, secret, DIGEST_SIZE);
+}
+
+static void osap(struct session *s, uint16_t entityType, uint32_t entityValue,
+                 const unsigned char secret[DIGEST_SIZE])
+{
+    struct buffer body = { .size = 0 }, resp;
+    unsigned char nonceOddOSAP[DIGEST_SIZE], nonces[2 * DIGEST_SIZE];
+    uint32_t rc;
+
+    get_random(nonceOddOSAP, sizeof(nonceOddOSAP));
+    put_u16(&body, entityType);
+    put_u32(&body, entityValue);
+    put_bytes(&body, nonceOddOSAP, sizeof(nonceOddOSAP));
+    rc = transmit(TAG_RQU_COMMAND, ORD_OSAP, &body, &resp);
+    if (rc != TPM_SUCCESS)
+        die("OSAP", rc);
+    s->handle = get_u32(resp.data);
+    memcpy(s->nonceEven, resp.data + 4, DIGEST_SIZE);
+    /* sharedSecret = HMAC(secret, nonceEvenOSAP || nonceOddOSAP) */
+    memcpy(nonces, resp.data + 4 + DIGEST_SIZE, DIGEST_SIZE);
+    memcpy(nonces + DIGEST_SIZE, nonceOddOSAP, DIGEST_SIZE);
+    hmac_sha1(s->secret, secret, nonces, sizeof(nonces));
+}
+
+/* encrypt an authorization value for an OSAP session (XOR ADIP) */
+static void encauth(unsigned char out[DIGEST_SIZE], const struct session *s,
+                    const unsigned char nonce[DIGEST_SIZE],
+                    const unsigned char auth[DIGEST_SIZE])
+{
+    int i;
+
+    sha1(out, s->secret, DIGEST_SIZE, nonce, DIGEST_SIZE);
+    for (i = 0; i < DIGEST_SIZE; i++)
+        out[i] ^= auth[i];
+}
+
+/*
+ * Send a command authorized by one or two sessions. 'params' are the
+ * parameters covered by the authorization HMAC, 'handles' precede them.
+ * The sessions are kept open and their nonces are updated from the
+ * response.
+ */
+static uint32_t transmit_auth(uint32_t ordinal,
+                              const struct buffer *handles,
+                              const struct buffer *params,
+                              struct session *sessions, int num_sessions,
+                              const unsigned char nonceOdd[DIGEST_SIZE],
+                              struct buffer *resp)
+{
+    struct buffer body = { .size = 0 };
+    unsigned char digest[DIGEST_SIZE], hmac[DIGEST_SIZE];
+    unsigned char data[3 * DIGEST_SIZE + 1];
+    unsigned char ord[4] = { ordinal >> 24, ordinal >> 16, ordinal >> 8, ordinal };
+    uint32_t rc;
+    int i;
+
+    sha1(digest, ord, sizeof(ord), params->data, params->size);
+    if (handles)
+        put_bytes(&body, handles->data, handles->size);
+    put_bytes(&body, params->data, params->size);
+    for (i = 0; i < num_sessions; i++) {
+        /* HMAC(secret, paramDigest || nonceEven || nonceOdd || continue) */
+        memcpy(data, digest, DIGEST_SIZE);
+        memcpy(data + DIGEST_SIZE, sessions[i].nonceEven, DIGEST_SIZE);
+        memcpy(data + 2 * DIGEST_SIZE, nonceOdd, DIGEST_SIZE);
+        data[3 * DIGEST_SIZE] = TRUE;
+        hmac_sha1(hmac, sessions[i].secret, data, sizeof(data));
+        put_u32(&body, sessions[i].handle);
+        put_bytes(&body, nonceOdd, DIGEST_SIZE);
+        put_u8(&body, TRUE);
+        put_bytes(&body, hmac, DIGEST_SIZE);
+    }
+    rc = transmit(num_sessions == 1 ? TAG_RQU_AUTH1_COMMAND : TAG_RQU_AUTH2_COMMAND,
+                  ordinal, &body, resp);
+    if (rc == TPM_SUCCESS) {
+        /* each authorization is nonceEven || continue || resAuth */
+        for (i = 0; i < num_sessions; i++)
+            memcpy(sessions[i].nonceEven,
+                   resp->data + resp->size - (num_sessions - i) * (2 * DIGEST_SIZE + 1),
+                   DIGEST_SIZE);
+    }
+    return rc;
+}
+
+static uint32_t auth1(uint32_t ordinal, const struct buffer *handles,
+                      const struct buffer *params, struct session *s,
+                      struct buffer *resp)
+{
+    unsigned char nonceOdd[DIGEST_SIZE];
+
+    get_random(nonceOdd, sizeof(nonceOdd));
+    return transmit_auth(ordinal, handles, params, s, 1, nonceOdd, resp);
+}
+
+static void simple(uint32_t ordinal, const struct buffer *body, const char *what)
+{
+    struct buffer resp;
+    uint32_t rc;
+
+    rc = transmit(TAG_RQU_COMMAND, ordinal, body, &resp);
+    if (rc != TPM_SUCCESS)
+        die(what, rc);
+}
+
+static void startup(void)
+{
+    struct buffer body = { .size = 0 };
+
+    put_u16(&body, 0x0001);             /* TPM_ST_CLEAR */
+    simple(ORD_Startup, &body, "TPM_Startup");
+}
+
+static void physical_presence(uint16_t pp)
+{
+    struct buffer body = { .size = 0 };
+
+    put_u16(&body, pp);
+    simple(TSC_ORD_PhysicalPresence, &body, "TSC_PhysicalPresence");
+}
+
+static void restart(void)
+{
+    TPM_RESULT rc;
+
+    TPMLIB_Terminate();
+    rc = TPMLIB_MainInit();
+    if (rc != TPM_SUCCESS)
+        die("TPMLIB_MainInit", rc);
+    startup();
+}
+
+/* enable and activate the TPM so that it can be taken ownership of */
+static void enable_activate(void)
+{
+    struct buffer body = { .size = 0 };
+
+    physical_presence(0x0008);          /* TPM_PHYSICAL_PRESENCE_PRESENT */
+    simple(ORD_PhysicalEnable, NULL, "TPM_PhysicalEnable");
+    put_u8(&body, FALSE);
+    simple(ORD_PhysicalSetDeactivated, &body, "TPM_PhysicalSetDeactivated");
+    restart();
+}
+
+static void put_key_parms(struct buffer *b, uint16_t encScheme,
+                          uint16_t sigScheme)
+{
+    put_u32(b, 0x00000001);             /* TPM_ALG_RSA */
+    put_u16(b, encScheme);
+    put_u16(b, sigScheme);
+    put_u32(b, 12);                     /* TPM_RSA_KEY_PARMS */
+    put_u32(b, 2048);
+    put_u32(b, 2);
+    put_u32(b, 0);                      /* default exponent */
+}
+
+static void put_key(struct buffer *b, uint16_t keyUsage, uint16_t encScheme,
+                    uint16_t sigScheme)
+{
+    put_u32(b, 0x01010000);             /* TPM_STRUCT_VER 1.1 */
+    put_u16(b, keyUsage);
+    put_u32(b, 0);                      /* keyFlags */
+    put_u8(b, 0x01);                    /* TPM_AUTH_ALWAYS */
+    put_key_parms(b, encScheme, sigScheme);
+    put_u32(b, 0);                      /* PCRInfoSize */
+    put_u32(b, 0);                      /* pubKey */
+    put_u32(b, 0);                      /* encData */
+}
+
+/* return the size of the TPM_KEY at the start of 'p' */
+static uint32_t key_size(const unsigned char *p)
+{
+    uint32_t o = 4 + 2 + 4 + 1;
+
+    o += 4 + 2 + 2 + 4 + get_u32(p + o + 8);    /* algorithmParms */
+    o += 4 + get_u32(p + o);                    /* PCRInfo */
+    o += 4 + get_u32(p + o);                    /* pubKey */
+    o += 4 + get_u32(p + o);                    /* encData */
+    return o;
+}
+
+static const unsigned char owner_auth[DIGEST_SIZE] = "owner secret 0123456";
+static const unsigned char srk_auth[DIGEST_SIZE];
+static const unsigned char key_auth[DIGEST_SIZE] = "key secret 012345678";
+static const unsigned char data_auth[DIGEST_SIZE] = "data secret 01234567";
+
+static unsigned char ek_modulus[MAX_MODULUS_BYTES];
+static uint32_t ek_modulus_size;
+
+static void create_ek(void)
+{
+    struct buffer body = { .size = 0 }, resp;
+    unsigned char nonce[DIGEST_SIZE];
+    uint32_t rc, o;
+
+    get_random(nonce, sizeof(nonce));
+    put_bytes(&body, nonce, sizeof(nonce));
+    put_key_parms(&body, ES_RSAESOAEP, SS_NONE);
+    simple(ORD_CreateEndorsementKeyPair, &body, "TPM_CreateEndorsementKeyPair");
+
+    body.size = 0;
+    put_bytes(&body, nonce, sizeof(nonce));
+    rc = transmit(TAG_RQU_COMMAND, ORD_ReadPubek, &body, &resp);
+    if (rc != TPM_SUCCESS)
+        die("TPM_ReadPubek", rc);
+    /* TPM_PUBKEY: TPM_KEY_PARMS, TPM_STORE_PUBKEY */
+    o = 4 + 2 + 2 + 4 + get_u32(resp.data + 8);
+    ek_modulus_size = get_u32(resp.data + o);
+    if (ek_modulus_size > sizeof(ek_modulus))
+        die("TPM_ReadPubek modulus", ek_modulus_size);
+    memcpy(ek_modulus, resp.data + o + 4, ek_modulus_size);
+}
+
+static void take_ownership(void)
+{
+    struct buffer params = { .size = 0 }, resp;
+    unsigned char enc[MAX_MODULUS_BYTES];
+    struct session s;
+    uint32_t rc;
+
+    put_u16(&params, 0x0005);           /* TPM_PID_OWNER */
+    rsa_encrypt_oaep(enc, ek_modulus, ek_modulus_size, owner_auth, DIGEST_SIZE);
+    put_u32(&params, ek_modulus_size);
+    put_bytes(&params, enc, ek_modulus_size);
+    rsa_encrypt_oaep(enc, ek_modulus, ek_modulus_size, srk_auth, DIGEST_SIZE);
+    put_u32(&params, ek_modulus_size);
+    put_bytes(&params, enc, ek_modulus_size);
+    put_key(&params, KEY_STORAGE, ES_RSAESOAEP, SS_NONE);
+
+    oiap(&s, owner_auth);
+    rc = auth1(ORD_TakeOwnership, NULL, &params, &s, &resp);
+    if (rc != TPM_SUCCESS)
+        die("TPM_TakeOwnership", rc);
+}
+
+static void owner_clear(void)
+{
+    struct buffer params = { .size = 0 }, resp;
+    struct session s;
+    uint32_t rc;
+
+    oiap(&s, owner_auth);
+    rc = auth1(ORD_OwnerClear, NULL, &params, &s, &resp);
+    if (rc != TPM_SUCCESS)
+        die("TPM_OwnerClear", rc);
+}
+
+static void extend(void)
+{
+    struct buffer body = { .size = 0 };
+    unsigned char digest[DIGEST_SIZE];
+
+    get_random(digest, sizeof(digest));
+    put_u32(&body, BENCH_PCR);
+    put_bytes(&body, digest, sizeof(digest));
+    simple(ORD_Extend, &body, "TPM_Extend");
+}
+
+static struct buffer key_blob;
+
+static void create_wrap_key(void)
+{
+    struct buffer handles = { .size = 0 }, params = { .size = 0 }, resp;
+    unsigned char nonceOdd[DIGEST_SIZE], enc[DIGEST_SIZE];
+    struct session s;
+    uint32_t rc;
+
+    osap(&s, ET_KEYHANDLE, KH_SRK, srk_auth);
+    get_random(nonceOdd, sizeof(nonceOdd));
+    put_u32(&handles, KH_SRK);
+    encauth(enc, &s, s.nonceEven, key_auth);
+    put_bytes(&params, enc, sizeof(enc));
+    encauth(enc, &s, nonceOdd, key_auth);
+    put_bytes(&params, enc, sizeof(enc));
+    put_key(&params, KEY_SIGNING, ES_NONE, SS_RSASSAPKCS1v15_SHA1);
+    rc = transmit_auth(ORD_CreateWrapKey, &handles, &params, &s, 1, nonceOdd, &resp);
+    if (rc != TPM_SUCCESS)
+        die("TPM_CreateWrapKey", rc);
+    key_blob.size = key_size(resp.data);
+    memcpy(key_blob.data, resp.data, key_blob.size);
+}
+
+static struct session srk_session;
+
+static uint32_t load_key(void)
+{
+    struct buffer handles = { .size = 0 }, resp;
+    uint32_t rc;
+
+    put_u32(&handles, KH_SRK);
+    rc = auth1(ORD_LoadKey2, &handles, &key_blob, &srk_session, &resp);
+    if (rc != TPM_SUCCESS)
+        die("TPM_LoadKey2", rc);
+    return get_u32(resp.data);
+}
+
+static void flush_key(uint32_t handle)
+{
+    struct buffer body = { .size = 0 };
+
+    put_u32(&body, handle);
+    put_u32(&body, 0x00000001);         /* TPM_RT_KEY */
+    simple(ORD_FlushSpecific, &body, "TPM_FlushSpecific");
+}
+
+static struct buffer sealed_blob;
+
+static void seal(void)
+{
+    struct buffer handles = { .size = 0 }, params = { .size = 0 }, resp;
+    unsigned char enc[DIGEST_SIZE];
+    static const unsigned char secret[32] = "sealed data 0123456789abcdefghi";
+    struct session s;
+    uint32_t rc;
+
+    osap(&s, ET_KEYHANDLE, KH_SRK, srk_auth);
+    put_u32(&handles, KH_SRK);
+    encauth(enc, &s, s.nonceEven, data_auth);
+    put_bytes(&params, enc, sizeof(enc));
+    put_u32(&params, 0);                /* pcrInfoSize */
+    put_u32(&params, sizeof(secret));
+    put_bytes(&params, secret, sizeof(secret));
+    rc = auth1(ORD_Seal, &handles, &params, &s, &resp);
+    if (rc != TPM_SUCCESS)
+        die("TPM_Seal", rc);
+    /* TPM_STORED_DATA: ver, sealInfo, encData */
+    sealed_blob.size = 4 + 4 + get_u32(resp.data + 4);
+    sealed_blob.size += 4 + get_u32(resp.data + sealed_blob.size);
+    memcpy(sealed_blob.data, resp.data, sealed_blob.size);
+}
+
+static struct session data_session;
+
+static void unseal(void)
+{
+    struct buffer handles = { .size = 0 }, resp;
+    unsigned char nonceOdd[DIGEST_SIZE];
+    struct session sessions[2];
+    uint32_t rc;
+
+    put_u32(&handles, KH_SRK);
+    get_random(nonceOdd, sizeof(nonceOdd));
+    sessions[0] = srk_session;
+    sessions[1] = data_session;
+    rc = transmit_auth(ORD_Unseal, &handles, &sealed_blob, sessions, 2, nonceOdd, &resp);
+    if (rc != TPM_SUCCESS)
+        die("TPM_Unseal", rc);
+    srk_session = sessions[0];
+    data_session = sessions[1];
+}
+
+static uint32_t quote_key;
+static struct session key_session;
+
+static void quote(void)
+{
+    struct buffer handles = { .size = 0 }, params = { .size = 0 }, resp;
+    unsigned char externalData[DIGEST_SIZE];
+    uint32_t rc;
+
+    get_random(externalData, sizeof(externalData));
+    put_u32(&handles, quote_key);
+    put_bytes(&params, externalData, sizeof(externalData));
+    put_u16(&params, 3);                /* TPM_PCR_SELECTION */
+    put_u8(&params, 0x00);
+    put_u8(&params, 1 << (BENCH_PCR - 8));
+    put_u8(&params, 0x00);
+    rc = auth1(ORD_Quote, &handles, &params, &key_session, &resp);
+    if (rc != TPM_SUCCESS)
+        die("TPM_Quote", rc);
+}
+
+static void put_pcr_info_short(struct buffer *b)
+{
+    unsigned char digest[DIGEST_SIZE] = { 0, };
+
+    put_u16(b, 3);                      /* TPM_PCR_SELECTION */
+    put_u8(b, 0);
+    put_u8(b, 0);
+    put_u8(b, 0);
+    put_u8(b, 0x1f);                    /* localityAtRelease */
+    put_bytes(b, digest, sizeof(digest));
+}
+
+static void nv_define_space(void)
+{
+    struct buffer params = { .size = 0 }, resp;
+    unsigned char enc[DIGEST_SIZE];
+    struct session s;
+    uint32_t rc;
+
+    osap(&s, ET_OWNER, KH_OWNER, owner_auth);
+    put_u16(&params, 0x0018);           /* TPM_TAG_NV_DATA_PUBLIC */
+    put_u32(&params, BENCH_NV_INDEX);
+    put_pcr_info_short(&params);        /* pcrInfoRead */
+    put_pcr_info_short(&params);        /* pcrInfoWrite */
+    put_u16(&params, 0x0017);           /* TPM_TAG_NV_ATTRIBUTES */
+    put_u32(&params, 0x00000002);       /* TPM_NV_PER_OWNERWRITE */
+    put_u8(&params, FALSE);             /* bReadSTClear */
+    put_u8(&params, FALSE);             /* bWriteSTClear */
+    put_u8(&params, FALSE);             /* bWriteDefine */
+    put_u32(&params, BENCH_NV_SIZE);
+    encauth(enc, &s, s.nonceEven, data_auth);
+    put_bytes(&params, enc, sizeof(enc));
+    rc = auth1(ORD_NV_DefineSpace, NULL, &params, &s, &resp);
+    if (rc != TPM_SUCCESS)
+        die("TPM_NV_DefineSpace", rc);
+}
+
+static struct session owner_session;
+
+static void nv_write_value(void)
+{
+    struct buffer params = { .size = 0 }, resp;
+    unsigned char data[BENCH_NV_SIZE];
+    uint32_t rc;
+
+    get_random(data, sizeof(data));
+    put_u32(&params, BENCH_NV_INDEX);
+    put_u32(&params, 0);                /* offset */
+    put_u32(&params, sizeof(data));
+    put_bytes(&params, data, sizeof(data));
+    rc = auth1(ORD_NV_WriteValue, NULL, &params, &owner_session, &resp);
+    if (rc != TPM_SUCCESS)
+        die("TPM_NV_WriteValue", rc);
+}
+
+static uint32_t counter_id;
+static struct session counter_session;
+
+static void create_counter(void)
+{
+    struct buffer params = { .size = 0 }, resp;
+    unsigned char enc[DIGEST_SIZE];
+    struct session s;
+    uint32_t rc;
+
+    osap(&s, ET_OWNER, KH_OWNER, owner_auth);
+    encauth(enc, &s, s.nonceEven, data_auth);
+    put_bytes(&params, enc, sizeof(enc));
+    put_bytes(&params, "bnch", 4);      /* label */
+    rc = auth1(ORD_CreateCounter, NULL, &params, &s, &resp);
+    if (rc != TPM_SUCCESS)
+        die("TPM_CreateCounter", rc);
+    counter_id = get_u32(resp.data);
+}
+
+static void increment_counter(void)
+{
+    struct buffer params = { .size = 0 }, resp;
+    uint32_t rc;
+
+    put_u32(&params, counter_id);
+    rc = auth1(ORD_IncrementCounter, NULL, &params, &counter_session, &resp);
+    if (rc != TPM_SUCCESS)
+        die("TPM_IncrementCounter", rc);
+}
+
+/*
+ * Reporting
+ */
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *latencies, unsigned int n)
+{
+    double total = 0;
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+        total += latencies[i];
+    qsort(latencies, n, sizeof(double), compare_double);
+    printf("%-20s %8u %12.1f %12.1f %12.1f\n",
+           name, n, n * 1e6 / total,
+           latencies[(n - 1) * 50 / 100], latencies[(n - 1) * 99 / 100]);
+}
+
+static void usage(const char *prg)
+{
+    printf("Usage: %s [-n iterations] [-k keygen iterations]\n"
+           "\n"
+           "Benchmark TPM 1.2 commands sent through TPMLIB_Process().\n"
+           "Commands that generate an RSA key run 'keygen iterations' times.\n",
+           prg);
+}
+
+int main(int argc, char *argv[])
+{
+    struct libtpms_callbacks callbacks = {
+        .sizeOfStruct = sizeof(struct libtpms_callbacks),
+        .tpm_nvram_init = nvram_init,
+        .tpm_nvram_loaddata = nvram_loaddata,
+        .tpm_nvram_storedata = nvram_storedata,
+        .tpm_nvram_deletename = nvram_deletename,
+        .tpm_io_init = io_init,
+        .tpm_io_getlocality = io_getlocality,
+        .tpm_io_getphysicalpresence = io_getphysicalpresence,
+        .tpm_nvram_appenddata = nvram_appenddata,
+    };
+    unsigned int iterations = 100, keygen_iterations = 5, i;
+    double *latencies;
+    uint32_t handle;
+    TPM_RESULT rc;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:k:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'k':
+            keygen_iterations = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (iterations == 0 || keygen_iterations == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    latencies = calloc(iterations > keygen_iterations ? iterations : keygen_iterations,
+                       sizeof(double));
+    if (latencies == NULL)
+        die("calloc", TPM_SIZE);
+
+    srand(time(NULL));
+
+    rc = TPMLIB_RegisterCallbacks(&callbacks);
+    if (rc != TPM_SUCCESS)
+        die("TPMLIB_RegisterCallbacks", rc);
+    rc = TPMLIB_MainInit();
+    if (rc != TPM_SUCCESS)
+        die("TPMLIB_MainInit", rc);
+    startup();
+    physical_presence(0x0020);          /* TPM_PHYSICAL_PRESENCE_CMD_ENABLE */
+    enable_activate();
+    create_ek();
+
+    printf("libtpms %u.%u.%u, %s crypto library\n\n",
+           TPM_LIBRARY_VER_MAJOR, TPM_LIBRARY_VER_MINOR, TPM_LIBRARY_VER_MICRO,
+           BENCH_CRYPTO_LIBRARY);
+    printf("%-20s %8s %12s %12s %12s\n",
+           "command", "ops", "ops/s", "p50 (us)", "p99 (us)");
+
+    for (i = 0; i < iterations; i++) {
+        TPMLIB_Terminate();
+        rc = TPMLIB_MainInit();
+        if (rc != TPM_SUCCESS)
+            die("TPMLIB_MainInit", rc);
+        startup();
+        latencies[i] = last_latency;
+    }
+    report("Startup", latencies, iterations);
+
+    for (i = 0; i < keygen_iterations; i++) {
+        if (i > 0) {
+            owner_clear();
+            enable_activate();
+        }
+        take_ownership();
+        latencies[i] = last_latency;
+    }
+    report("TakeOwnership", latencies, keygen_iterations);
+
+    for (i = 0; i < keygen_iterations; i++) {
+        create_wrap_key();
+        latencies[i] = last_latency;
+    }
+    report("CreateWrapKey", latencies, keygen_iterations);
+
+    oiap(&srk_session, srk_auth);
+    for (i = 0; i < iterations; i++) {
+        handle = load_key();
+        latencies[i] = last_latency;
+        flush_key(handle);
+    }
+    report("LoadKey2", latencies, iterations);
+
+    for (i = 0; i < iterations; i++) {
+        seal();
+        latencies[i] = last_latency;
+    }
+    report("Seal", latencies, iterations);
+
+    oiap(&data_session, data_auth);
+    for (i = 0; i < iterations; i++) {
+        unseal();
+        latencies[i] = last_latency;
+    }
+    report("Unseal", latencies, iterations);
+
+    for (i = 0; i < iterations; i++) {
+        extend();
+        latencies[i] = last_latency;
+    }
+    report("Extend", latencies, iterations);
+
+    quote_key = load_key();
+    oiap(&key_session, key_auth);
+    for (i = 0; i < iterations; i++) {
+        quote();
+        latencies[i] = last_latency;
+    }
+    report("Quote", latencies, iterations);
+
+    nv_define_space();
+    oiap(&owner_session, owner_auth);
+    for (i = 0; i < iterations; i++) {
+        nv_write_value();
+        latencies[i] = last_latency;
+    }
+    report("NV_WriteValue", latencies, iterations);
+
+    create_counter();
+    oiap(&counter_session, data_auth);
+    for (i = 0; i < iterations; i++) {
+        increment_counter();
+        latencies[i] = last_latency;
+    }
+    report("IncrementCounter", latencies, iterations);
+
+    TPMLIB_Terminate();
+    for (i = 0; i < NVRAM_ENTRIES; i++)
+        free(nvram[i].data);
+    free(latencies);
+    free(respbuffer);
+
+    return EXIT_SUCCESS;
+}